@@ -0,0 +1,415 @@
+#include "AsyncFileReader.h"
+#include <algorithm>
+#include <cstring>
+#ifndef _WIN32
+#include <locale>
+#include <codecvt>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace
+{
+    constexpr size_t MAX_READ_SIZE = 1u << 30;  // larger reads are split; ReadFile takes a DWORD
+    constexpr size_t REAP_BATCH = 64;
+
+#ifndef _WIN32
+    // reads what is left of [buffer, buffer + len) at offset; false on error, stops early at the end of the file
+    bool preadRest(int fd, unsigned char* buffer, size_t len, unsigned long long offset, size_t& done)
+    {
+        while (done < len)
+        {
+            ssize_t n = pread(fd, buffer + done, std::min(len - done, MAX_READ_SIZE), static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return false;
+            if (n == 0)
+                break;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+#endif
+}
+
+#ifdef __linux__
+// The rings shared with the kernel, set up without liburing
+struct AsyncFileReader::Ring
+{
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, sqRingSize);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool setup(unsigned entries)
+    {
+        io_uring_params params{};
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+            return false;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+            return false;
+        cqRing = singleMapping ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+            return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return false;
+        auto sq = static_cast<unsigned char*>(sqRing);
+        auto cq = static_cast<unsigned char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // submits the queued entries and, with wait, waits for a completion; number of entries submitted
+    int enter(unsigned toSubmit, bool wait)
+    {
+        for (;;)
+        {
+            int submitted = static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (submitted >= 0 || (errno != EINTR && errno != EAGAIN && errno != EBUSY))
+                return submitted;
+        }
+    }
+};
+#endif
+
+AsyncFileReader::AsyncFileReader(unsigned queueDepth, size_t memoryBudget)
+    : queueDepth(queueDepth ? queueDepth : 1), memoryBudget(memoryBudget), requests(this->queueDepth)
+{
+    for (size_t i = requests.size(); i-- > 0;)
+        freeRequests.push_back(i);
+#ifdef _WIN32
+    port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+#elif defined(__linux__)
+    ring = std::make_unique<Ring>();
+    if (!ring->setup(this->queueDepth))
+        ring.reset();
+#endif
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    drain();
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        // files the caller never closed
+        if (std::find(freeFiles.begin(), freeFiles.end(), static_cast<int>(i)) == freeFiles.end())
+            releaseFile(static_cast<int>(i));
+    }
+#ifdef _WIN32
+    if (port)
+        CloseHandle(port);
+#endif
+}
+
+const char* AsyncFileReader::backend() const
+{
+#ifdef _WIN32
+    return port ? "IOCP" : "pread";
+#else
+    return ring ? "io_uring" : "pread";
+#endif
+}
+
+int AsyncFileReader::openFile(const std::wstring& path, unsigned long long& size)
+{
+    File file;
+#ifdef _WIN32
+    if (!port)
+        return -1;
+    file.handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+    if (file.handle == INVALID_HANDLE_VALUE)
+        return -1;
+    LARGE_INTEGER li{};
+    if (!GetFileSizeEx(file.handle, &li) || !CreateIoCompletionPort(file.handle, port, 0, 0))
+    {
+        CloseHandle(file.handle);
+        return -1;
+    }
+    size = static_cast<unsigned long long>(li.QuadPart);
+#else
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    file.fd = ::open(converter.to_bytes(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0)
+        return -1;
+    struct stat st {};
+    if (fstat(file.fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(file.fd);
+        return -1;
+    }
+    size = static_cast<unsigned long long>(st.st_size);
+#endif
+    int index;
+    if (!freeFiles.empty())
+    {
+        index = freeFiles.back();
+        freeFiles.pop_back();
+        files[index] = file;
+    }
+    else
+    {
+        index = static_cast<int>(files.size());
+        files.push_back(file);
+    }
+    return index;
+}
+
+void AsyncFileReader::closeFile(int file)
+{
+    files[file].closing = true;
+    if (files[file].pendingReads == 0)
+        releaseFile(file);
+}
+
+void AsyncFileReader::releaseFile(int file)
+{
+#ifdef _WIN32
+    CloseHandle(files[file].handle);
+#else
+    ::close(files[file].fd);
+#endif
+    files[file] = File();
+    freeFiles.push_back(file);
+}
+
+void AsyncFileReader::read(int file, unsigned long long offset, unsigned char* buffer, size_t len, Completion completion)
+{
+    // a single read larger than the budget goes alone
+    while (numberInFlight > 0 && (freeRequests.empty() || bytesInFlight + len > memoryBudget))
+        poll(true);
+    size_t r = freeRequests.back();
+    freeRequests.pop_back();
+    Request& request = requests[r];
+    request.file = file;
+    request.offset = offset;
+    request.buffer = buffer;
+    request.len = len;
+    request.done = 0;
+    request.completion = std::move(completion);
+    files[file].pendingReads++;
+    numberInFlight++;
+    bytesInFlight += len;
+    if (len == 0)
+        ready.emplace_back(r, true);
+    else
+        start(r);
+}
+
+void AsyncFileReader::start(size_t r)
+{
+    Request& request = requests[r];
+    size_t len = std::min(request.len - request.done, MAX_READ_SIZE);
+    unsigned long long offset = request.offset + request.done;
+#ifdef _WIN32
+    request.overlapped = OVERLAPPED();
+    request.overlapped.Offset = static_cast<DWORD>(offset);
+    request.overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    if (!ReadFile(files[request.file].handle, request.buffer + request.done, static_cast<DWORD>(len), nullptr, &request.overlapped))
+    {
+        DWORD error = GetLastError();
+        if (error != ERROR_IO_PENDING)
+            ready.emplace_back(r, error == ERROR_HANDLE_EOF);  // no packet is queued for a read that failed right away
+    }
+    // one that succeeded right away still queues its packet
+#else
+    int fd = files[request.file].fd;
+#ifdef __linux__
+    if (ring)
+    {
+        unsigned tail = *ring->sqTail;
+        if (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries)
+        {
+            // can't happen while queueDepth <= sqEntries, but the kernel may round differently
+            int submitted = ring->enter(unsubmitted, false);
+            if (submitted > 0)
+                unsubmitted -= static_cast<unsigned>(submitted);
+        }
+        unsigned index = tail & ring->sqMask;
+        io_uring_sqe& sqe = ring->sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.off = offset;
+        sqe.addr = reinterpret_cast<unsigned long long>(request.buffer + request.done);
+        sqe.len = static_cast<unsigned>(len);
+        sqe.user_data = r;
+        ring->sqArray[index] = index;
+        __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;  // submitted by the next poll, together with the others
+        return;
+    }
+#endif
+    bool ok = preadRest(fd, request.buffer, request.len, request.offset, request.done);
+    ready.emplace_back(r, ok);
+#endif
+}
+
+void AsyncFileReader::finish(size_t r, bool ok)
+{
+    Request& request = requests[r];
+    // the slot is free before the completion runs, so the completion can read again
+    Completion completion = std::move(request.completion);
+    request.completion = nullptr;
+    size_t bytesRead = request.done;
+    int file = request.file;
+    numberInFlight--;
+    bytesInFlight -= request.len;
+    freeRequests.push_back(r);
+    if (--files[file].pendingReads == 0 && files[file].closing)
+        releaseFile(file);
+    completion(ok, bytesRead);
+}
+
+size_t AsyncFileReader::poll(bool wait)
+{
+    size_t count = 0;
+    while (!ready.empty())
+    {
+        auto done = ready.front();
+        ready.pop_front();
+        finish(done.first, done.second);
+        count++;
+    }
+    if (count)
+        wait = false;
+    return count + reap(wait && numberInFlight > 0);
+}
+
+void AsyncFileReader::drain()
+{
+    while (numberInFlight > 0)
+        poll(true);
+}
+
+size_t AsyncFileReader::reap(bool wait)
+{
+    size_t count = 0;
+#ifdef _WIN32
+    if (!port)
+        return 0;
+    OVERLAPPED_ENTRY entries[REAP_BATCH];
+    ULONG removed = 0;
+    if (!GetQueuedCompletionStatusEx(port, entries, REAP_BATCH, &removed, wait ? INFINITE : 0, FALSE))
+        return 0;
+    for (ULONG i = 0; i < removed; i++)
+    {
+        auto request = reinterpret_cast<Request*>(entries[i].lpOverlapped);
+        size_t r = request - requests.data();
+        DWORD bytes = 0;
+        bool ok = GetOverlappedResult(files[request->file].handle, &request->overlapped, &bytes, FALSE) != FALSE;
+        bool endOfFile = !ok && GetLastError() == ERROR_HANDLE_EOF;
+        request->done += bytes;
+        if (ok && bytes > 0 && request->done < request->len)
+        {
+            start(r);
+            continue;
+        }
+        finish(r, ok || endOfFile);
+        count++;
+    }
+#elif defined(__linux__)
+    if (!ring)
+        return 0;
+    if (unsubmitted > 0 || wait)
+    {
+        int submitted = ring->enter(unsubmitted, wait);
+        if (submitted > 0)
+            unsubmitted -= static_cast<unsigned>(submitted);
+    }
+    for (;;)
+    {
+        // take a batch off the ring before running completions, which may poll again
+        std::pair<size_t, int> completed[REAP_BATCH];
+        size_t numberCompleted = 0;
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail && numberCompleted < REAP_BATCH; head++)
+        {
+            const io_uring_cqe& cqe = ring->cqes[head & ring->cqMask];
+            completed[numberCompleted++] = { static_cast<size_t>(cqe.user_data), cqe.res };
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+        if (numberCompleted == 0)
+            break;
+        for (size_t i = 0; i < numberCompleted; i++)
+        {
+            size_t r = completed[i].first;
+            int result = completed[i].second;
+            Request& request = requests[r];
+            if (result == -EINVAL || result == -EOPNOTSUPP)
+            {
+                // IORING_OP_READ needs Linux 5.6
+                bool ok = preadRest(files[request.file].fd, request.buffer, request.len, request.offset, request.done);
+                finish(r, ok);
+            }
+            else if (result < 0)
+            {
+                finish(r, false);
+            }
+            else if (result > 0 && request.done + result < request.len)
+            {
+                request.done += result;
+                start(r);
+                continue;
+            }
+            else
+            {
+                request.done += result;
+                finish(r, true);
+            }
+            count++;
+        }
+    }
+#endif
+    return count;
+}
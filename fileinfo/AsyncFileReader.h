@@ -0,0 +1,94 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reads pieces of any number of files with many reads in flight, submitted from a single thread.
+// The backend is io_uring on Linux and overlapped ReadFile on an I/O completion port on Windows.
+// Where neither is available (io_uring disabled by a sandbox, an old kernel, other systems) the
+// reads are done with pread as they are submitted, so callers need no second code path.
+//
+// At most queueDepth reads and memoryBudget bytes are in flight; read() waits for earlier reads to
+// complete when either limit is reached. The reader is not thread safe: read, poll and drain are
+// called by one thread, which also runs the completions.
+class AsyncFileReader
+{
+public:
+    // bytesRead is less than the length asked for only at the end of the file; ok is false if the
+    // read failed. A completion may call read() and closeFile().
+    using Completion = std::function<void(bool ok, size_t bytesRead)>;
+
+    explicit AsyncFileReader(unsigned queueDepth = DEFAULT_QUEUE_DEPTH, size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+    ~AsyncFileReader();
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    // returns -1 if the file can't be opened
+    int openFile(const std::wstring& path, unsigned long long& size);
+    // the file is closed as soon as its last read has completed
+    void closeFile(int file);
+    // Reads len bytes at offset into buffer, which must stay valid until the completion has run.
+    void read(int file, unsigned long long offset, unsigned char* buffer, size_t len, Completion completion);
+    // Submits the reads queued so far and runs the completions of those that are done. With wait,
+    // blocks until at least one completes, unless none is in flight. Returns the completions run.
+    size_t poll(bool wait);
+    // waits for every read and runs its completion
+    void drain();
+
+    size_t inFlight() const { return numberInFlight; }
+    const char* backend() const;  // "io_uring", "IOCP" or "pread"
+
+    static constexpr unsigned DEFAULT_QUEUE_DEPTH = 64;
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+private:
+    struct Request
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};  // first, so a completion packet leads back to its request
+#endif
+        int file = -1;
+        unsigned long long offset = 0;
+        unsigned char* buffer = nullptr;
+        size_t len = 0;
+        size_t done = 0;  // bytes read so far; a short read is continued where it stopped
+        Completion completion;
+    };
+    struct File
+    {
+#ifdef _WIN32
+        HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+        int fd = -1;
+#endif
+        unsigned pendingReads = 0;
+        bool closing = false;
+    };
+
+    void start(size_t request);  // hands the rest of a request to the backend
+    void finish(size_t request, bool ok);  // frees the slot, then runs the completion
+    void releaseFile(int file);
+    size_t reap(bool wait);
+
+    unsigned queueDepth;
+    size_t memoryBudget;
+    std::vector<Request> requests;  // fixed size, so the backend may hold pointers into it
+    std::vector<size_t> freeRequests;
+    size_t numberInFlight = 0;
+    size_t bytesInFlight = 0;
+    std::vector<File> files;
+    std::vector<int> freeFiles;
+    std::deque<std::pair<size_t, bool>> ready;  // pread backend: done, completion not run yet
+#ifdef _WIN32
+    HANDLE port = nullptr;
+#else
+    struct Ring;
+    std::unique_ptr<Ring> ring;  // nullptr: pread backend
+    unsigned unsubmitted = 0;
+#endif
+};
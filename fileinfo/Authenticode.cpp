@@ -0,0 +1,340 @@
+#include "Authenticode.h"
+#include <WinTrust.h>  // for WIN_CERTIFICATE only, nothing is linked from wintrust.dll
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+AuthenticodeHash::AuthenticodeHash(const PeImage& image, unsigned hashMask)
+    : hash(hashMask & (hashFlag(HashType::HashSha1) | hashFlag(HashType::HashSha256)))
+{
+    // CheckSum is at the same offset in both optional headers
+    const unsigned char* optionalHeader = image.is32bit()
+        ? reinterpret_cast<const unsigned char*>(image.optionalHeader32())
+        : reinterpret_cast<const unsigned char*>(image.optionalHeader64());
+    unsigned long long checkSum = (optionalHeader - image.data()) + offsetof(IMAGE_OPTIONAL_HEADER32, CheckSum);
+    excluded.push_back({ checkSum, checkSum + sizeof(DWORD) });
+    auto security = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_SECURITY);
+    if (security)
+    {
+        unsigned long long entry = reinterpret_cast<const unsigned char*>(security) - image.data();
+        excluded.push_back({ entry, entry + sizeof(IMAGE_DATA_DIRECTORY) });
+        // unlike every other directory, the certificate table is addressed by file offset
+        if (security->VirtualAddress != 0 && security->Size != 0)
+        {
+            unsigned long long begin = std::max<unsigned long long>(security->VirtualAddress, entry + sizeof(IMAGE_DATA_DIRECTORY));
+            unsigned long long end = std::min<unsigned long long>(static_cast<unsigned long long>(security->VirtualAddress) + security->Size, image.size());
+            if (begin < end)
+                excluded.push_back({ begin, end });
+        }
+    }
+}
+
+void AuthenticodeHash::consume(unsigned long long offset, const unsigned char* data, size_t len)
+{
+    unsigned long long end = offset + len;
+    for (const auto& range : excluded)
+    {
+        if (range.end <= offset || range.begin >= end)
+            continue;
+        if (range.begin > offset)
+        {
+            size_t part = static_cast<size_t>(range.begin - offset);
+            hash.update(data, part);
+            data += part;
+            offset += part;
+        }
+        size_t skip = static_cast<size_t>(std::min(range.end, end) - offset);
+        data += skip;
+        offset += skip;
+    }
+    if (offset < end)
+        hash.update(data, static_cast<size_t>(end - offset));
+}
+
+namespace
+{
+    // One DER element. Only definite lengths are accepted; Authenticode signatures are DER.
+    struct DerElement
+    {
+        unsigned char tag = 0;
+        const unsigned char* begin = nullptr;  // first byte of the tag
+        const unsigned char* content = nullptr;
+        size_t length = 0;  // of the content
+        const unsigned char* end() const { return content + length; }
+        size_t totalLength() const { return end() - begin; }
+    };
+
+    // reads the element at p and moves p past it
+    bool readDer(const unsigned char*& p, const unsigned char* end, DerElement& element)
+    {
+        if (end - p < 2)
+            return false;
+        element.begin = p;
+        element.tag = p[0];
+        size_t length = p[1];
+        const unsigned char* content = p + 2;
+        if (length & 0x80)
+        {
+            size_t numberOfBytes = length & 0x7f;
+            if (numberOfBytes == 0 || numberOfBytes > 4 || static_cast<size_t>(end - content) < numberOfBytes)
+                return false;
+            length = 0;
+            for (size_t i = 0; i < numberOfBytes; i++)
+                length = (length << 8) | *content++;
+        }
+        if (static_cast<size_t>(end - content) < length)
+            return false;
+        element.content = content;
+        element.length = length;
+        p = content + length;
+        return true;
+    }
+
+    // reads the element at p, which must have the given tag
+    bool expectDer(const unsigned char*& p, const unsigned char* end, unsigned char tag, DerElement& element)
+    {
+        return readDer(p, end, element) && element.tag == tag;
+    }
+
+    constexpr unsigned char TAG_INTEGER = 0x02;
+    constexpr unsigned char TAG_OCTET_STRING = 0x04;
+    constexpr unsigned char TAG_OID = 0x06;
+    constexpr unsigned char TAG_SEQUENCE = 0x30;
+    constexpr unsigned char TAG_SET = 0x31;
+    constexpr unsigned char TAG_CONTEXT_0 = 0xa0;
+
+    bool oidEquals(const DerElement& oid, const unsigned char* value, size_t len)
+    {
+        return oid.tag == TAG_OID && oid.length == len && memcmp(oid.content, value, len) == 0;
+    }
+
+    const unsigned char OID_SIGNED_DATA[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x07, 0x02 };  // 1.2.840.113549.1.7.2
+    const unsigned char OID_SPC_INDIRECT_DATA[] = { 0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x02, 0x01, 0x04 };  // 1.3.6.1.4.1.311.2.1.4
+    const unsigned char OID_COMMON_NAME[] = { 0x55, 0x04, 0x03 };  // 2.5.4.3
+
+    struct DigestAlgorithm
+    {
+        unsigned char oid[9];
+        size_t oidLength;
+        const wchar_t* name;
+        bool hasHashType;
+        HashType hashType;
+    };
+    const DigestAlgorithm DIGEST_ALGORITHMS[] =
+    {
+        { { 0x2b, 0x0e, 0x03, 0x02, 0x1a }, 5, L"SHA1", true, HashType::HashSha1 },
+        { { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 }, 9, L"SHA256", true, HashType::HashSha256 },
+        { { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02 }, 9, L"SHA384", false, HashType::HashSha256 },
+        { { 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03 }, 9, L"SHA512", false, HashType::HashSha256 },
+        { { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x02, 0x05 }, 8, L"MD5", false, HashType::HashMd5 },
+    };
+
+    // Text of a DirectoryString: UTF8String, PrintableString, IA5String, T61String or BMPString
+    std::wstring directoryString(const DerElement& value)
+    {
+        std::wstring text;
+        if (value.tag == 0x1e)
+        {
+            for (size_t i = 0; i + 1 < value.length; i += 2)
+                text += static_cast<wchar_t>((value.content[i] << 8) | value.content[i + 1]);
+            return text;
+        }
+        if (value.tag == 0x0c)
+        {
+            std::string utf8(reinterpret_cast<const char*>(value.content), value.length);
+            int n = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), nullptr, 0);
+            if (n > 0)
+            {
+                text.resize(n);
+                MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), &text[0], n);
+            }
+            return text;
+        }
+        // the other string types are 8-bit; names in them are ASCII in practice
+        for (size_t i = 0; i < value.length; i++)
+            text += static_cast<wchar_t>(value.content[i]);
+        return text;
+    }
+
+    // CN of a Name: SEQUENCE OF SET OF SEQUENCE { OID, value }; the last one wins, as in most viewers
+    std::wstring commonName(const DerElement& name)
+    {
+        std::wstring cn;
+        const unsigned char* p = name.content;
+        DerElement rdn;
+        while (expectDer(p, name.end(), TAG_SET, rdn))
+        {
+            const unsigned char* q = rdn.content;
+            DerElement attribute;
+            while (expectDer(q, rdn.end(), TAG_SEQUENCE, attribute))
+            {
+                const unsigned char* r = attribute.content;
+                DerElement oid, value;
+                if (readDer(r, attribute.end(), oid) && readDer(r, attribute.end(), value) &&
+                    oidEquals(oid, OID_COMMON_NAME, sizeof(OID_COMMON_NAME)))
+                    cn = directoryString(value);
+            }
+        }
+        return cn;
+    }
+
+    // From SpcIndirectDataContent ::= SEQUENCE { data SpcAttributeTypeAndOptionalValue, messageDigest DigestInfo }
+    bool readIndirectData(const DerElement& indirectData, AuthenticodeSignature& signature)
+    {
+        const unsigned char* p = indirectData.content;
+        DerElement data, digestInfo, algorithm, oid, digest;
+        if (!expectDer(p, indirectData.end(), TAG_SEQUENCE, data) || !expectDer(p, indirectData.end(), TAG_SEQUENCE, digestInfo))
+            return false;
+        p = digestInfo.content;
+        if (!expectDer(p, digestInfo.end(), TAG_SEQUENCE, algorithm) || !expectDer(p, digestInfo.end(), TAG_OCTET_STRING, digest))
+            return false;
+        const unsigned char* q = algorithm.content;
+        if (!expectDer(q, algorithm.end(), TAG_OID, oid))
+            return false;
+        signature.digestAlgorithm = L"unknown";
+        for (const auto& known : DIGEST_ALGORITHMS)
+        {
+            if (oidEquals(oid, known.oid, known.oidLength))
+            {
+                signature.digestAlgorithm = known.name;
+                signature.hasHashType = known.hasHashType;
+                signature.hashType = known.hashType;
+            }
+        }
+        signature.signedDigest = bytesToHex(digest.content, digest.length);
+        return true;
+    }
+
+    // Finds the certificate with the given issuer and serial number in the SignedData certificates
+    // and returns the common names of its subject and issuer.
+    void findSigner(const DerElement& certificates, const DerElement& issuer, const DerElement& serial, AuthenticodeSignature& signature)
+    {
+        const unsigned char* p = certificates.content;
+        DerElement certificate;
+        while (readDer(p, certificates.end(), certificate))
+        {
+            if (certificate.tag != TAG_SEQUENCE)
+                continue;  // attribute certificates and other choices
+            // TBSCertificate ::= SEQUENCE { [0] version OPTIONAL, serialNumber, signature, issuer, validity, subject, ... }
+            const unsigned char* q = certificate.content;
+            DerElement tbs, field, certificateSerial, algorithm, certificateIssuer, validity, subject;
+            if (!expectDer(q, certificate.end(), TAG_SEQUENCE, tbs))
+                continue;
+            q = tbs.content;
+            if (!readDer(q, tbs.end(), field))
+                continue;
+            if (field.tag == TAG_CONTEXT_0)
+            {
+                if (!readDer(q, tbs.end(), field))
+                    continue;
+            }
+            certificateSerial = field;
+            if (certificateSerial.tag != TAG_INTEGER || !expectDer(q, tbs.end(), TAG_SEQUENCE, algorithm) ||
+                !expectDer(q, tbs.end(), TAG_SEQUENCE, certificateIssuer) || !expectDer(q, tbs.end(), TAG_SEQUENCE, validity) ||
+                !expectDer(q, tbs.end(), TAG_SEQUENCE, subject))
+                continue;
+            if (certificateSerial.totalLength() == serial.totalLength() && memcmp(certificateSerial.begin, serial.begin, serial.totalLength()) == 0 &&
+                certificateIssuer.totalLength() == issuer.totalLength() && memcmp(certificateIssuer.begin, issuer.begin, issuer.totalLength()) == 0)
+            {
+                signature.signer = commonName(subject);
+                signature.issuer = commonName(certificateIssuer);
+                return;
+            }
+        }
+    }
+
+    // ContentInfo { signedData, [0] SignedData { version, digestAlgorithms, contentInfo, [0] certificates, [1] crls, signerInfos } }
+    bool parseSignedData(const unsigned char* data, size_t len, AuthenticodeSignature& signature)
+    {
+        const unsigned char* p = data;
+        const unsigned char* end = data + len;
+        DerElement contentInfo, oid, explicitContent, signedData;
+        if (!expectDer(p, end, TAG_SEQUENCE, contentInfo))
+            return false;
+        p = contentInfo.content;
+        if (!expectDer(p, contentInfo.end(), TAG_OID, oid) || !oidEquals(oid, OID_SIGNED_DATA, sizeof(OID_SIGNED_DATA)) ||
+            !expectDer(p, contentInfo.end(), TAG_CONTEXT_0, explicitContent))
+            return false;
+        p = explicitContent.content;
+        if (!expectDer(p, explicitContent.end(), TAG_SEQUENCE, signedData))
+            return false;
+
+        p = signedData.content;
+        end = signedData.end();
+        DerElement version, digestAlgorithms, encapsulated, contentType, content;
+        if (!expectDer(p, end, TAG_INTEGER, version) || !expectDer(p, end, TAG_SET, digestAlgorithms) ||
+            !expectDer(p, end, TAG_SEQUENCE, encapsulated))
+            return false;
+        const unsigned char* q = encapsulated.content;
+        if (!expectDer(q, encapsulated.end(), TAG_OID, contentType) || !oidEquals(contentType, OID_SPC_INDIRECT_DATA, sizeof(OID_SPC_INDIRECT_DATA)) ||
+            !expectDer(q, encapsulated.end(), TAG_CONTEXT_0, content))
+            return false;
+        // PKCS#7 as written by signtool puts the SEQUENCE right here, CMS wraps it in an OCTET STRING
+        q = content.content;
+        DerElement indirectData;
+        if (!readDer(q, content.end(), indirectData))
+            return false;
+        if (indirectData.tag == TAG_OCTET_STRING)
+        {
+            q = indirectData.content;
+            if (!readDer(q, indirectData.end(), indirectData))
+                return false;
+        }
+        if (indirectData.tag != TAG_SEQUENCE || !readIndirectData(indirectData, signature))
+            return false;
+
+        // the optional [0] certificates and [1] crls, then signerInfos
+        DerElement certificates, element, signerInfos;
+        while (readDer(p, end, element))
+        {
+            if (element.tag == TAG_CONTEXT_0)
+                certificates = element;
+            else if (element.tag == TAG_SET)
+                signerInfos = element;
+        }
+        // SignerInfo ::= SEQUENCE { version, issuerAndSerialNumber SEQUENCE { issuer, serialNumber }, ... }
+        DerElement signerInfo, signerVersion, issuerAndSerial, issuer, serial;
+        p = signerInfos.content;
+        if (signerInfos.content && certificates.content &&
+            expectDer(p, signerInfos.end(), TAG_SEQUENCE, signerInfo))
+        {
+            q = signerInfo.content;
+            if (expectDer(q, signerInfo.end(), TAG_INTEGER, signerVersion) && expectDer(q, signerInfo.end(), TAG_SEQUENCE, issuerAndSerial))
+            {
+                q = issuerAndSerial.content;
+                if (expectDer(q, issuerAndSerial.end(), TAG_SEQUENCE, issuer) && expectDer(q, issuerAndSerial.end(), TAG_INTEGER, serial))
+                    findSigner(certificates, issuer, serial, signature);
+            }
+        }
+        return true;
+    }
+}
+
+AuthenticodeSignature parseAuthenticodeSignature(const PeImage& image)
+{
+    AuthenticodeSignature signature;
+    auto security = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_SECURITY);
+    if (!security || security->VirtualAddress == 0 || security->Size == 0)
+        return signature;
+    signature.present = true;
+    // WIN_CERTIFICATE entries follow each other on 8-byte boundaries
+    DWORD offset = security->VirtualAddress;
+    DWORD end = security->VirtualAddress + security->Size;
+    if (end < offset || end > image.size())
+        end = static_cast<DWORD>(image.size());
+    constexpr DWORD HEADER_SIZE = offsetof(WIN_CERTIFICATE, bCertificate);
+    while (offset < end && end - offset >= HEADER_SIZE)
+    {
+        auto certificate = image.at<WIN_CERTIFICATE>(offset);
+        if (!certificate || certificate->dwLength < HEADER_SIZE || certificate->dwLength > end - offset)
+            break;
+        if (certificate->wCertificateType == WIN_CERT_TYPE_PKCS_SIGNED_DATA &&
+            parseSignedData(certificate->bCertificate, certificate->dwLength - HEADER_SIZE, signature))
+        {
+            signature.parsed = true;
+            break;
+        }
+        offset += (certificate->dwLength + 7) & ~7u;
+    }
+    return signature;
+}
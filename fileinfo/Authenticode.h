@@ -0,0 +1,46 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include "HashPipeline.h"
+#include "PeImage.h"
+
+// Authenticode image hash ("PE hash"): the digest of the file without the CheckSum field, the
+// certificate table directory entry and the certificate table itself, so it is the same before
+// and after signing. It is a ChunkSink, so it shares the read of the file with the other digests.
+// Ranges are skipped by file offset, in file order; this equals the section-by-section definition
+// of the specification for every image whose sections are laid out in order, as linkers do.
+class AuthenticodeHash : public ChunkSink
+{
+public:
+    // hashMask selects SHA1 and/or SHA256; MD5 is ignored
+    AuthenticodeHash(const PeImage& image, unsigned hashMask);
+    void consume(unsigned long long offset, const unsigned char* data, size_t len) override;
+    // "" if the digest was not selected
+    std::wstring hexDigest(HashType hashType) { return hash.hexDigest(hashType); }
+private:
+    struct Range
+    {
+        unsigned long long begin;
+        unsigned long long end;
+    };
+    std::vector<Range> excluded;  // sorted, non-overlapping
+    MultiHash hash;
+};
+
+// What the first PKCS#7 signature in the certificate table claims. Nothing is verified here: there
+// is no chain building and no check of the signature value, only the fields needed to tell who
+// signed and which digest of the image was signed.
+struct AuthenticodeSignature
+{
+    bool present = false;  // the image has a certificate table
+    bool parsed = false;  // it holds a PKCS#7 SignedData with SPC_INDIRECT_DATA content that could be read
+    std::wstring digestAlgorithm;  // e.g. "SHA256"
+    bool hasHashType = false;  // digestAlgorithm is one of HashType
+    HashType hashType = HashType::HashSha256;
+    std::wstring signedDigest;  // lowercase hex, to compare with AuthenticodeHash::hexDigest
+    std::wstring signer;  // common name of the signing certificate's subject
+    std::wstring issuer;  // common name of its issuer
+};
+
+AuthenticodeSignature parseAuthenticodeSignature(const PeImage& image);
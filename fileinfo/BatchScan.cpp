@@ -0,0 +1,96 @@
+#include "BatchScan.h"
+#include <filesystem>
+#include <fstream>
+#include <cwctype>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    void walkDirectory(const fs::path& directory, const InputFileCallback& callback)
+    {
+        std::error_code ec;
+        // unreadable directories are skipped instead of aborting the whole scan
+        fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+        for (fs::recursive_directory_iterator end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code typeError;
+            if (it->is_regular_file(typeError))
+            {
+                callback(it->path().wstring(), false);
+            }
+        }
+    }
+}
+
+void enumerateInputFiles(const std::vector<std::wstring>& inputs, const InputFileCallback& callback)
+{
+    for (const auto& input : inputs)
+    {
+        if (input.empty())
+            continue;
+        fs::path path(input);
+        std::wstring filename = path.filename().wstring();
+        std::error_code ec;
+        if (filename.find_first_of(L"*?") != std::wstring::npos)
+        {
+            fs::path parent = path.has_parent_path() ? path.parent_path() : fs::path(L".");
+            for (fs::directory_iterator it(parent, ec), end; !ec && it != end; it.increment(ec))
+            {
+                std::error_code typeError;
+                if (it->is_regular_file(typeError) && matchWildcard(filename.c_str(), it->path().filename().wstring().c_str()))
+                {
+                    callback(it->path().wstring(), false);
+                }
+            }
+        }
+        else if (fs::is_directory(path, ec))
+        {
+            walkDirectory(path, callback);
+        }
+        else
+        {
+            // missing files are still reported so that the caller can emit an error record for them
+            callback(input, true);
+        }
+    }
+}
+
+bool matchWildcard(const wchar_t* pattern, const wchar_t* name)
+{
+    // iterative matcher with backtracking to the last '*'
+    const wchar_t* starPattern = nullptr;
+    const wchar_t* starName = nullptr;
+    while (*name)
+    {
+        if (*pattern == L'*')
+        {
+            starPattern = ++pattern;
+            starName = name;
+        }
+        else if (*pattern == L'?' || std::towlower(*pattern) == std::towlower(*name))
+        {
+            pattern++;
+            name++;
+        }
+        else if (starPattern)
+        {
+            pattern = starPattern;
+            name = ++starName;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == L'*')
+        pattern++;
+    return *pattern == 0;
+}
+
+bool looksLikePeFile(const std::wstring& path)
+{
+    std::ifstream reader(fs::path(path), std::ios::binary);
+    char signature[2]{};
+    return reader.read(signature, 2) && signature[0] == 'M' && signature[1] == 'Z';
+}
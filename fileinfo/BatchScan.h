@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+// Expands the inputs of batch mode into file paths.
+// An input can be a file, a directory (walked recursively), or a wildcard pattern such as
+// C:\Windows\System32\*.dll. Wildcards (* and ?) are only allowed in the last path component.
+// explicitlyNamed is true for files named directly on the command line; files found by walking a
+// directory or matching a pattern are reported with false, so callers can skip non-PE files quietly.
+using InputFileCallback = std::function<void(const std::wstring& path, bool explicitlyNamed)>;
+void enumerateInputFiles(const std::vector<std::wstring>& inputs, const InputFileCallback& callback);
+
+// case-insensitive match of * and ? wildcards
+bool matchWildcard(const wchar_t* pattern, const wchar_t* name);
+
+// true if the file starts with the "MZ" DOS signature
+bool looksLikePeFile(const std::wstring& path);
@@ -0,0 +1,158 @@
+#include "ByteStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BYTE_STATISTICS_SSE2 1
+#endif
+
+namespace
+{
+    // 64-bit counters += 4 tables of 32-bit counters
+    void reduceTables(const uint32_t (&tables)[4][256], unsigned long long histogram[256])
+    {
+#ifdef BYTE_STATISTICS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < 256; i += 4)
+        {
+            __m128i sum = _mm_add_epi32(
+                _mm_add_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(&tables[0][i])), _mm_load_si128(reinterpret_cast<const __m128i*>(&tables[1][i]))),
+                _mm_add_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(&tables[2][i])), _mm_load_si128(reinterpret_cast<const __m128i*>(&tables[3][i]))));
+            auto low = reinterpret_cast<__m128i*>(histogram + i);
+            auto high = reinterpret_cast<__m128i*>(histogram + i + 2);
+            _mm_storeu_si128(low, _mm_add_epi64(_mm_loadu_si128(low), _mm_unpacklo_epi32(sum, zero)));
+            _mm_storeu_si128(high, _mm_add_epi64(_mm_loadu_si128(high), _mm_unpackhi_epi32(sum, zero)));
+        }
+#else
+        for (int i = 0; i < 256; i++)
+            histogram[i] += static_cast<unsigned long long>(tables[0][i]) + tables[1][i] + tables[2][i] + tables[3][i];
+#endif
+    }
+
+    void addHistogram(std::array<unsigned long long, 256>& sum, const std::array<unsigned long long, 256>& histogram)
+    {
+#ifdef BYTE_STATISTICS_SSE2
+        for (int i = 0; i < 256; i += 2)
+        {
+            auto p = reinterpret_cast<__m128i*>(&sum[i]);
+            _mm_storeu_si128(p, _mm_add_epi64(_mm_loadu_si128(p), _mm_loadu_si128(reinterpret_cast<const __m128i*>(&histogram[i]))));
+        }
+#else
+        for (int i = 0; i < 256; i++)
+            sum[i] += histogram[i];
+#endif
+    }
+}
+
+double ByteStatistics::entropy() const
+{
+    if (total == 0)
+        return 0;
+    // H = -sum(p * log2(p)) = log2(total) - sum(c * log2(c)) / total
+    double sum = 0;
+    for (auto count : histogram)
+    {
+        if (count)
+            sum += static_cast<double>(count) * std::log2(static_cast<double>(count));
+    }
+    double entropy = std::log2(static_cast<double>(total)) - sum / static_cast<double>(total);
+    return entropy < 0 ? 0 : entropy;
+}
+
+void countBytes(const unsigned char* data, size_t len, unsigned long long histogram[256])
+{
+    // Incrementing one table stalls on runs of equal bytes (zero padding, mostly), as every
+    // increment waits for the previous store to the same counter. Four tables, used in turn, let
+    // four increments be in flight; they are summed at the end.
+    alignas(16) uint32_t tables[4][256];
+    // every 32-bit counter stays below 2^28 within a block
+    constexpr size_t BLOCK_SIZE = size_t(1) << 30;
+    while (len > 0)
+    {
+        size_t n = len < BLOCK_SIZE ? len : BLOCK_SIZE;
+        memset(tables, 0, sizeof(tables));
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            uint64_t a, b;
+            memcpy(&a, data + i, sizeof(a));
+            memcpy(&b, data + i + 8, sizeof(b));
+            tables[0][a & 0xff]++;
+            tables[1][(a >> 8) & 0xff]++;
+            tables[2][(a >> 16) & 0xff]++;
+            tables[3][(a >> 24) & 0xff]++;
+            tables[0][(a >> 32) & 0xff]++;
+            tables[1][(a >> 40) & 0xff]++;
+            tables[2][(a >> 48) & 0xff]++;
+            tables[3][a >> 56]++;
+            tables[0][b & 0xff]++;
+            tables[1][(b >> 8) & 0xff]++;
+            tables[2][(b >> 16) & 0xff]++;
+            tables[3][(b >> 24) & 0xff]++;
+            tables[0][(b >> 32) & 0xff]++;
+            tables[1][(b >> 40) & 0xff]++;
+            tables[2][(b >> 48) & 0xff]++;
+            tables[3][b >> 56]++;
+        }
+        for (; i < n; i++)
+            tables[i & 3][data[i]]++;
+        reduceTables(tables, histogram);
+        data += n;
+        len -= n;
+    }
+}
+
+ByteStatisticsSink::ByteStatisticsSink(const SectionTable& sections)
+    : sectionStatistics(sections.size())
+{
+    sectionRanges.reserve(sections.size());
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        unsigned long long begin = sections.rawOffset(i);
+        unsigned long long end = begin + sections.rawSize(i);
+        sectionRanges.push_back({ begin, end });
+        boundaries.push_back(begin);
+        boundaries.push_back(end);
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+}
+
+void ByteStatisticsSink::consume(unsigned long long offset, const unsigned char* data, size_t len)
+{
+    unsigned long long end = offset + len;
+    fileStatistics.total += len;
+    ByteStatistics piece;
+    while (offset < end)
+    {
+        auto next = std::upper_bound(boundaries.begin(), boundaries.end(), offset);
+        unsigned long long pieceEnd = next == boundaries.end() ? end : std::min(*next, end);
+        size_t pieceLen = static_cast<size_t>(pieceEnd - offset);
+        // no section begins or ends inside the piece, so it is either inside a section or not
+        bool inSection = false;
+        for (const auto& range : sectionRanges)
+            inSection = inSection || (range.begin <= offset && pieceEnd <= range.end);
+        if (!inSection)
+        {
+            countBytes(data, pieceLen, fileStatistics.histogram.data());
+        }
+        else
+        {
+            piece.histogram.fill(0);
+            countBytes(data, pieceLen, piece.histogram.data());
+            addHistogram(fileStatistics.histogram, piece.histogram);
+            for (size_t i = 0; i < sectionRanges.size(); i++)
+            {
+                if (sectionRanges[i].begin <= offset && pieceEnd <= sectionRanges[i].end)
+                {
+                    addHistogram(sectionStatistics[i].histogram, piece.histogram);
+                    sectionStatistics[i].total += pieceLen;
+                }
+            }
+        }
+        data += pieceLen;
+        offset = pieceEnd;
+    }
+}
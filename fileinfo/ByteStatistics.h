@@ -0,0 +1,41 @@
+#pragma once
+#include <Windows.h>
+#include <array>
+#include <vector>
+#include "HashPipeline.h"
+#include "SectionTable.h"
+
+// Byte histogram of a range of the file, and the Shannon entropy derived from it
+struct ByteStatistics
+{
+    std::array<unsigned long long, 256> histogram{};
+    unsigned long long total = 0;
+    // in bits per byte, 0..8; 0 for an empty range
+    double entropy() const;
+};
+
+// Adds the number of occurrences of every byte value in data to histogram.
+void countBytes(const unsigned char* data, size_t len, unsigned long long histogram[256]);
+
+// Histograms of the whole file and of the raw data of every section, as a ChunkSink.
+// A chunk is cut at section boundaries and every piece is counted once, then added to the file
+// and to each section containing it, so overlapping sections don't cost an extra count.
+class ByteStatisticsSink : public ChunkSink
+{
+public:
+    explicit ByteStatisticsSink(const SectionTable& sections);
+    void consume(unsigned long long offset, const unsigned char* data, size_t len) override;
+    const ByteStatistics& file() const { return fileStatistics; }
+    // in the order of the section table, i.e. by virtual address
+    const std::vector<ByteStatistics>& sections() const { return sectionStatistics; }
+private:
+    struct Range
+    {
+        unsigned long long begin;
+        unsigned long long end;
+    };
+    std::vector<Range> sectionRanges;
+    std::vector<unsigned long long> boundaries;  // sorted begins and ends of all sections
+    ByteStatistics fileStatistics;
+    std::vector<ByteStatistics> sectionStatistics;
+};
@@ -0,0 +1,246 @@
+#include "CabExtractor.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+const wchar_t* const CabExtractor::TEMP_FILE_SUFFIX = L".fileinfoexpand";
+
+namespace
+{
+    constexpr size_t HEADER_SIZE = 36;  // CFHEADER without its optional fields
+    constexpr size_t FOLDER_SIZE = 8;  // CFFOLDER without its reserved bytes
+    constexpr size_t FILE_SIZE = 16;  // CFFILE without its name
+    constexpr size_t DATA_SIZE = 8;  // CFDATA without its reserved bytes and data
+    constexpr size_t MAX_NAME_LENGTH = 256;
+    constexpr uint16_t FLAG_PREVIOUS_CABINET = 0x0001;
+    constexpr uint16_t FLAG_NEXT_CABINET = 0x0002;
+    constexpr uint16_t FLAG_RESERVE_PRESENT = 0x0004;
+    constexpr uint16_t COMPRESSION_MASK = 0x000F;
+    constexpr uint16_t COMPRESSION_NONE = 0;
+    constexpr uint16_t COMPRESSION_MSZIP = 1;
+    constexpr uint16_t COMPRESSION_LZX = 3;
+    constexpr size_t MAX_BLOCK_SIZE = 32768;
+
+    uint16_t read16(const uint8_t* data)
+    {
+        return static_cast<uint16_t>(data[0] | data[1] << 8);
+    }
+
+    uint32_t read32(const uint8_t* data)
+    {
+        return data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+    }
+}
+
+CabExtractor::CabExtractor(const std::wstring& outputPath)
+    : outputPath(outputPath), tempPath(outputPath + TEMP_FILE_SUFFIX)
+{
+}
+
+CabExtractor::~CabExtractor()
+{
+    if (state != State::Done || output.is_open())
+    {
+        if (output.is_open())
+            output.close();
+        std::error_code ec;
+        fs::remove(fs::path(tempPath), ec);
+    }
+}
+
+bool CabExtractor::write(const void* data, size_t size)
+{
+    if (state == State::Failed)
+        return false;
+    if (state == State::Done)
+        return true;  // past the last CFDATA
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+    if (state == State::Headers && !parseHeaders())
+        return state != State::Failed;
+    while (state == State::Data && parseBlock())
+    {
+    }
+    if (state == State::Failed)
+        return false;
+    // the rest of the block being received moves to the front
+    buffer.erase(buffer.begin(), buffer.begin() + std::min(bufferStart, buffer.size()));
+    bufferOffset += bufferStart;
+    bufferStart = 0;
+    return true;
+}
+
+bool CabExtractor::parseHeaders()
+{
+    const uint8_t* data = buffer.data();
+    size_t size = buffer.size();
+    if (size < HEADER_SIZE)
+        return false;
+    if (memcmp(data, "MSCF", 4) != 0)
+        return fail(L"not a cabinet");
+    uint32_t filesOffset = read32(data + 16);
+    uint16_t numberOfFolders = read16(data + 26);
+    uint16_t numberOfFiles = read16(data + 28);
+    uint16_t flags = read16(data + 30);
+    if (flags & (FLAG_PREVIOUS_CABINET | FLAG_NEXT_CABINET))
+        return fail(L"the cabinet is part of a set");
+    if (numberOfFolders != 1 || numberOfFiles != 1)
+        return fail(L"the cabinet holds " + std::to_wstring(numberOfFiles) + L" files; only single-file cabinets are supported");
+
+    size_t folderOffset = HEADER_SIZE;
+    size_t folderReserveSize = 0;
+    if (flags & FLAG_RESERVE_PRESENT)
+    {
+        if (size < HEADER_SIZE + 4)
+            return false;
+        folderOffset += 4 + read16(data + HEADER_SIZE);
+        folderReserveSize = data[HEADER_SIZE + 2];
+        dataReserveSize = data[HEADER_SIZE + 3];
+    }
+    if (size < folderOffset + FOLDER_SIZE + folderReserveSize)
+        return false;
+    dataOffset = read32(data + folderOffset);
+    numberOfBlocks = read16(data + folderOffset + 4);
+    uint16_t typeCompress = read16(data + folderOffset + 6);
+    if (dataOffset > MAX_HEADER_SIZE || filesOffset + FILE_SIZE > dataOffset)
+        return fail(L"bad cabinet header");
+    // the file name ends before the first CFDATA
+    if (size < dataOffset)
+        return false;
+    const uint8_t* file = data + filesOffset;
+    const uint8_t* nameEnd = std::find(file + FILE_SIZE, data + dataOffset, '\0');
+    if (nameEnd == data + dataOffset || nameEnd - (file + FILE_SIZE) > static_cast<ptrdiff_t>(MAX_NAME_LENGTH))
+        return fail(L"bad file name in the cabinet");
+    fileSize = read32(file);
+    if (read32(file + 4) != 0 || read16(file + 8) != 0)
+        return fail(L"the file doesn't start the folder");
+    nameInCabinet.assign(file + FILE_SIZE, nameEnd);  // ASCII, as PDB names are
+
+    switch (typeCompress & COMPRESSION_MASK)
+    {
+    case COMPRESSION_NONE:
+        compression = Compression::None;
+        break;
+    case COMPRESSION_MSZIP:
+        compression = Compression::Mszip;
+        mszip = std::make_unique<MszipDecoder>();
+        break;
+    case COMPRESSION_LZX:
+    {
+        unsigned windowBits = (typeCompress >> 8) & 0x1F;
+        if (windowBits < LzxDecoder::MIN_WINDOW_BITS || windowBits > LzxDecoder::MAX_WINDOW_BITS)
+            return fail(L"bad LZX window size");
+        compression = Compression::Lzx;
+        lzx = std::make_unique<LzxDecoder>(windowBits);
+        break;
+    }
+    default:
+        return fail(L"unsupported compression " + std::to_wstring(typeCompress & COMPRESSION_MASK));
+    }
+
+    output.open(fs::path(tempPath), std::ios::binary | std::ios::trunc);
+    if (!output)
+        return fail(L"can't create " + tempPath);
+    blockOutput.resize(MAX_BLOCK_SIZE);
+    bufferStart = static_cast<size_t>(dataOffset);
+    state = numberOfBlocks == 0 ? State::Done : State::Data;
+    return true;
+}
+
+bool CabExtractor::parseBlock()
+{
+    size_t available = buffer.size() - bufferStart;
+    size_t headerSize = DATA_SIZE + dataReserveSize;
+    if (available < headerSize)
+        return false;
+    const uint8_t* block = &buffer[bufferStart];
+    size_t compressedSize = read16(block + 4);
+    size_t uncompressedSize = read16(block + 6);
+    if (available < headerSize + compressedSize)
+        return false;
+    if (uncompressedSize == 0 || uncompressedSize > MAX_BLOCK_SIZE)
+        return fail(L"bad block size in the cabinet");
+    // LZX frames carry on in one window, which only the last may leave part full
+    if (compression == Compression::Lzx && uncompressedSize != LzxDecoder::FRAME_SIZE && blocksDone + 1 != numberOfBlocks)
+        return fail(L"short block before the last in the cabinet");
+
+    const uint8_t* in = block + headerSize;
+    bool isDecoded = false;
+    switch (compression)
+    {
+    case Compression::None:
+        isDecoded = compressedSize == uncompressedSize;
+        if (isDecoded)
+            memcpy(blockOutput.data(), in, uncompressedSize);
+        break;
+    case Compression::Mszip:
+        isDecoded = mszip->decodeBlock(in, compressedSize, blockOutput.data(), uncompressedSize);
+        break;
+    case Compression::Lzx:
+        isDecoded = lzx->decodeFrame(in, compressedSize, blockOutput.data(), uncompressedSize);
+        break;
+    }
+    if (!isDecoded)
+        return fail(L"bad compressed data at offset " + std::to_wstring(bufferOffset + bufferStart));
+
+    size_t toWrite = static_cast<size_t>(std::min<unsigned long long>(uncompressedSize, fileSize - bytesWritten));
+    if (!output.write(reinterpret_cast<const char*>(blockOutput.data()), toWrite))
+        return fail(L"can't write " + tempPath);
+    bytesWritten += toWrite;
+    bufferStart += headerSize + compressedSize;
+    if (++blocksDone == numberOfBlocks)
+        state = State::Done;
+    return true;
+}
+
+bool CabExtractor::finish()
+{
+    if (state == State::Failed)
+        return false;
+    if (state != State::Done)
+        return fail(L"the cabinet is incomplete");
+    if (bytesWritten != fileSize)
+        return fail(L"the cabinet has " + std::to_wstring(bytesWritten) + L" of the " + std::to_wstring(fileSize) + L" bytes of its file");
+    output.close();
+    if (!output)
+        return fail(L"can't write " + tempPath);
+    std::error_code ec;
+    fs::rename(fs::path(tempPath), fs::path(outputPath), ec);
+    if (ec)
+        return fail(L"can't rename " + tempPath + L" to " + outputPath);
+    return true;
+}
+
+bool CabExtractor::fail(const std::wstring& message)
+{
+    errorMessage = message;
+    state = State::Failed;
+    if (output.is_open())
+        output.close();
+    std::error_code ec;
+    fs::remove(fs::path(tempPath), ec);
+    return false;
+}
+
+bool CabExtractor::extract(const std::wstring& cabinetPath, const std::wstring& outputPath, std::wstring& error)
+{
+    CabExtractor extractor(outputPath);
+    std::ifstream input(fs::path(cabinetPath), std::ios::binary);
+    if (!input)
+    {
+        error = L"can't open " + cabinetPath;
+        return false;
+    }
+    std::vector<char> piece(64 * 1024);
+    while (input)
+    {
+        input.read(piece.data(), piece.size());
+        if (input.gcount() > 0 && !extractor.write(piece.data(), static_cast<size_t>(input.gcount())))
+            break;
+    }
+    bool isExtracted = extractor.finish();
+    error = extractor.error();
+    return isExtracted;
+}
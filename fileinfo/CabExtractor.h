@@ -0,0 +1,69 @@
+#pragma once
+#include "LzxDecoder.h"
+#include "MszipDecoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Extracts a cabinet from its bytes as they arrive, e.g. a compressed PDB (name.pd_) while it
+// downloads: each CFDATA block is decoded as soon as it is complete, so the file is ready when the
+// last byte lands and the cabinet is never read back. Only what a .pd_ is is supported: one folder
+// holding one file, stored, MSZIP or LZX compressed, in a single cabinet. Checksums aren't verified;
+// both decoders reject data that doesn't decode to the sizes the cabinet gives.
+//
+// The file is written next to outputPath and renamed to it once complete. Not thread safe.
+class CabExtractor
+{
+public:
+    explicit CabExtractor(const std::wstring& outputPath);
+    ~CabExtractor();  // an unfinished file is deleted
+    CabExtractor(const CabExtractor&) = delete;
+    CabExtractor& operator=(const CabExtractor&) = delete;
+
+    // The next bytes of the cabinet. Returns false once it is known to be bad or the file can't be
+    // written, with error() telling why; later bytes are ignored then.
+    bool write(const void* data, size_t size);
+    // Returns true if the whole file was extracted; it is at outputPath then.
+    bool finish();
+    const std::wstring& error() const { return errorMessage; }
+    // as named in the cabinet, once its header is in
+    const std::wstring& fileName() const { return nameInCabinet; }
+
+    // extracts a cabinet that is already in a file
+    static bool extract(const std::wstring& cabinetPath, const std::wstring& outputPath, std::wstring& error);
+
+    static const wchar_t* const TEMP_FILE_SUFFIX;
+    static constexpr size_t MAX_HEADER_SIZE = 64 * 1024;  // everything before the first CFDATA
+private:
+    enum class State { Headers, Data, Done, Failed };
+    enum class Compression { None, Mszip, Lzx };
+
+    // false if more bytes are needed or the cabinet is bad, which fail() has recorded
+    bool parseHeaders();
+    bool parseBlock();
+    bool fail(const std::wstring& message);
+
+    std::wstring outputPath;
+    std::wstring tempPath;
+    std::ofstream output;
+    std::wstring nameInCabinet;
+    std::wstring errorMessage;
+    State state = State::Headers;
+    std::vector<uint8_t> buffer;  // bytes received but not parsed yet
+    size_t bufferStart = 0;  // of the unparsed bytes in buffer
+    unsigned long long bufferOffset = 0;  // of buffer[0] in the cabinet
+
+    Compression compression = Compression::None;
+    size_t dataReserveSize = 0;  // per CFDATA
+    unsigned long long dataOffset = 0;  // of the first CFDATA
+    unsigned numberOfBlocks = 0;
+    unsigned blocksDone = 0;
+    unsigned long long fileSize = 0;
+    unsigned long long bytesWritten = 0;
+    std::unique_ptr<MszipDecoder> mszip;
+    std::unique_ptr<LzxDecoder> lzx;
+    std::vector<uint8_t> blockOutput;
+};
@@ -0,0 +1,290 @@
+#include "ColumnarWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // little endian, whatever the host
+    void put(std::string& out, unsigned long long value, size_t width)
+    {
+        for (size_t i = 0; i < width; i++)
+            out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+
+    size_t fixedWidth(const ColumnSpec& spec)
+    {
+        switch (spec.type)
+        {
+        case ColumnType::UInt8: return 1;
+        case ColumnType::UInt16: return 2;
+        case ColumnType::UInt32: return 4;
+        case ColumnType::UInt64: return 8;
+        case ColumnType::Float64: return 8;
+        case ColumnType::Binary: return spec.width;
+        default: return 0;
+        }
+    }
+}
+
+void ColumnarRow::setNumber(size_t column, unsigned long long value)
+{
+    cells[column].valid = true;
+    cells[column].number = value;
+}
+
+void ColumnarRow::setReal(size_t column, double value)
+{
+    cells[column].valid = true;
+    cells[column].real = value;
+}
+
+void ColumnarRow::setBytes(size_t column, std::string_view bytes)
+{
+    cells[column].valid = true;
+    cells[column].bytes.assign(bytes.data(), bytes.size());
+}
+
+void ColumnarRow::beginList(size_t column)
+{
+    cells[column].valid = true;
+    cells[column].elements.clear();
+}
+
+void ColumnarRow::addElement(size_t column, std::string_view element)
+{
+    cells[column].elements.emplace_back(element);
+}
+
+void ColumnarRow::encode(std::string& out) const
+{
+    // host byte order: only read back by the same program
+    auto putValue = [&](const auto& value) { out.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    auto putString = [&](const std::string& text)
+    {
+        putValue(static_cast<uint32_t>(text.size()));
+        out += text;
+    };
+    putValue(static_cast<uint32_t>(cells.size()));
+    for (const auto& cell : cells)
+    {
+        out += static_cast<char>(cell.valid);
+        if (!cell.valid)
+            continue;
+        putValue(cell.number);
+        putValue(cell.real);
+        putString(cell.bytes);
+        putValue(static_cast<uint32_t>(cell.elements.size()));
+        for (const auto& element : cell.elements)
+            putString(element);
+    }
+}
+
+bool ColumnarRow::decode(std::string_view in)
+{
+    size_t position = 0;
+    auto getValue = [&](auto& value)
+    {
+        if (in.size() - position < sizeof(value))
+            return false;
+        memcpy(&value, in.data() + position, sizeof(value));
+        position += sizeof(value);
+        return true;
+    };
+    auto getString = [&](std::string& text)
+    {
+        uint32_t len = 0;
+        if (!getValue(len) || in.size() - position < len)
+            return false;
+        text.assign(in.data() + position, len);
+        position += len;
+        return true;
+    };
+    uint32_t numberOfCells = 0;
+    if (!getValue(numberOfCells) || numberOfCells > in.size())
+        return false;
+    cells.assign(numberOfCells, Cell());
+    for (auto& cell : cells)
+    {
+        if (position == in.size())
+            return false;
+        cell.valid = in[position++] != 0;
+        if (!cell.valid)
+            continue;
+        uint32_t numberOfElements = 0;
+        if (!getValue(cell.number) || !getValue(cell.real) || !getString(cell.bytes) || !getValue(numberOfElements) || numberOfElements > in.size())
+            return false;
+        cell.elements.resize(numberOfElements);
+        for (auto& element : cell.elements)
+        {
+            if (!getString(element))
+                return false;
+        }
+    }
+    return position == in.size();
+}
+
+ColumnarWriter::ColumnarWriter(BufferedOutput& output, std::vector<ColumnSpec> schema, size_t rowsPerGroup)
+    : output(output), rowsPerGroup(rowsPerGroup ? rowsPerGroup : DEFAULT_ROWS_PER_GROUP)
+{
+    for (const auto& spec : schema)
+        columns.emplace_back(spec);
+    write(std::string_view(MAGIC, sizeof(MAGIC)));
+}
+
+void ColumnarWriter::append(const ColumnarRow& row)
+{
+    if (finished)
+        return;
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        Column& column = columns[i];
+        if (column.validity.size() * 8 <= rows)
+            column.validity.push_back(0);
+        const ColumnarRow::Cell* cell = i < row.cells.size() ? &row.cells[i] : nullptr;
+        if (!cell || !cell->valid)
+        {
+            column.nullCount++;
+            continue;
+        }
+        column.validity[rows / 8] |= 1 << (rows % 8);
+        switch (column.spec.type)
+        {
+        case ColumnType::Float64:
+        {
+            uint64_t bits;
+            memcpy(&bits, &cell->real, sizeof(bits));
+            put(column.fixed, bits, sizeof(bits));
+            break;
+        }
+        case ColumnType::Binary:
+            // a value of the wrong size is padded or cut, so the column stays fixed width
+            column.fixed.append(cell->bytes.data(), std::min<size_t>(cell->bytes.size(), column.spec.width));
+            column.fixed.append(column.spec.width - std::min<size_t>(cell->bytes.size(), column.spec.width), '\0');
+            break;
+        case ColumnType::String:
+            addString(column, cell->bytes);
+            break;
+        case ColumnType::StringList:
+            for (const auto& element : cell->elements)
+                addString(column, element);
+            column.listOffsets.push_back(static_cast<uint32_t>(column.indices.size()));
+            break;
+        default:
+            put(column.fixed, cell->number, fixedWidth(column.spec));
+            break;
+        }
+    }
+    if (++rows == rowsPerGroup)
+        writeRowGroup();
+}
+
+void ColumnarWriter::addString(Column& column, std::string_view value)
+{
+    auto inserted = column.dictionary.emplace(std::string(value), static_cast<uint32_t>(column.dictionaryEntries.size()));
+    if (inserted.second)
+    {
+        column.dictionaryEntries.push_back(&inserted.first->first);
+        column.dictionaryBytes += value.size();
+    }
+    column.indices.push_back(inserted.first->second);
+    column.plainBytes += value.size();
+}
+
+void ColumnarWriter::writeStrings(const Column& column, std::string& chunk) const
+{
+    size_t n = column.indices.size();
+    size_t d = column.dictionaryEntries.size();
+    size_t indexWidth = d <= 0x100 ? 1 : d <= 0x10000 ? 2 : 4;
+    size_t plainSize = 4 * (n + 1) + column.plainBytes;
+    size_t dictionarySize = 4 + 4 * (d + 1) + column.dictionaryBytes + indexWidth * n;
+    if (plainSize <= dictionarySize)
+    {
+        put(chunk, 0, 1);
+        uint32_t end = 0;
+        put(chunk, end, 4);
+        for (auto index : column.indices)
+        {
+            end += static_cast<uint32_t>(column.dictionaryEntries[index]->size());
+            put(chunk, end, 4);
+        }
+        for (auto index : column.indices)
+            chunk += *column.dictionaryEntries[index];
+    }
+    else
+    {
+        put(chunk, 1, 1);
+        put(chunk, d, 4);
+        uint32_t end = 0;
+        put(chunk, end, 4);
+        for (auto entry : column.dictionaryEntries)
+        {
+            end += static_cast<uint32_t>(entry->size());
+            put(chunk, end, 4);
+        }
+        for (auto entry : column.dictionaryEntries)
+            chunk += *entry;
+        for (auto index : column.indices)
+            put(chunk, index, indexWidth);
+    }
+}
+
+void ColumnarWriter::writeRowGroup()
+{
+    if (rows == 0)
+        return;
+    put(footer, rows, 4);
+    std::string chunk;
+    for (auto& column : columns)
+    {
+        chunk.clear();
+        put(chunk, column.nullCount, 4);
+        if (column.nullCount)
+            chunk.append(reinterpret_cast<const char*>(column.validity.data()), (rows + 7) / 8);
+        if (column.spec.type == ColumnType::StringList)
+        {
+            for (auto listOffset : column.listOffsets)
+                put(chunk, listOffset, 4);
+        }
+        if (column.spec.type == ColumnType::String || column.spec.type == ColumnType::StringList)
+            writeStrings(column, chunk);
+        else
+            chunk += column.fixed;
+
+        put(footer, offset, 8);
+        put(footer, chunk.size(), 8);
+        write(chunk);
+        column = Column(column.spec);
+    }
+    numberOfRowGroups++;
+    rows = 0;
+}
+
+void ColumnarWriter::finish()
+{
+    if (finished)
+        return;
+    writeRowGroup();
+    finished = true;
+    std::string tail;
+    put(tail, columns.size(), 4);
+    for (const auto& column : columns)
+    {
+        size_t nameLength = strlen(column.spec.name);
+        put(tail, static_cast<unsigned>(column.spec.type), 1);
+        put(tail, column.spec.width, 1);
+        put(tail, nameLength, 2);
+        tail.append(column.spec.name, nameLength);
+    }
+    put(tail, numberOfRowGroups, 4);
+    tail += footer;
+    put(tail, tail.size(), 4);
+    tail.append(MAGIC, sizeof(MAGIC));
+    write(tail);
+    output.flush();
+}
+
+void ColumnarWriter::write(std::string_view data)
+{
+    output.write(data);
+    offset += data.size();
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "JsonWriter.h"
+
+// Compact binary column store for scans of many files, one row per file.
+//
+// Values are collected column by column and written out in row groups, so a reader can load one
+// column of a row group without touching the others. All integers are little endian.
+//
+//   file        = MAGIC rowGroup* footer
+//   rowGroup    = one columnChunk per column, in schema order
+//   columnChunk = nullCount:u32 [validity: (rows + 7) / 8 bytes, bit i set if row i is not null; only if nullCount != 0] values
+//   footer      = numberOfColumns:u32 (type:u8 width:u8 nameLength:u16 name)*
+//                 numberOfRowGroups:u32 (rows:u32 (offset:u64 length:u64)[numberOfColumns])*
+//                 footerLength:u32 MAGIC    (footerLength counts the bytes from numberOfColumns up to it)
+//
+// values has one entry per row that is not null:
+//   UInt8 .. UInt64, Float64, Binary: width bytes each; Binary is fixed width, e.g. a digest
+//   String:     strings
+//   StringList: offsets:u32[n + 1] into the elements, then strings of all elements
+//   strings   = encoding:u8, then
+//               0 (plain):      offsets:u32[n + 1] bytes
+//               1 (dictionary): d:u32 offsets:u32[d + 1] bytes indices[n], an index is u8 if d <= 256, u16 if d <= 65536, else u32
+// Every row group takes the smaller of the two string encodings, so unique values such as paths
+// stay plain while repeated ones (DLL and function names) are stored once per row group.
+enum class ColumnType : unsigned char
+{
+    UInt8, UInt16, UInt32, UInt64, Float64, Binary, String, StringList
+};
+
+struct ColumnSpec
+{
+    const char* name;
+    ColumnType type;
+    unsigned char width;  // bytes of a Binary value, ignored for other types
+};
+
+// The values of one row. It is filled on a worker thread, then handed to ColumnarWriter::append.
+// Cells that are not set are null.
+class ColumnarRow
+{
+public:
+    ColumnarRow() = default;
+    explicit ColumnarRow(size_t numberOfColumns) : cells(numberOfColumns) {}
+
+    void setNumber(size_t column, unsigned long long value);
+    void setReal(size_t column, double value);
+    // String, or Binary of exactly width bytes
+    void setBytes(size_t column, std::string_view bytes);
+    // StringList: makes the cell an empty list, then adds to it
+    void beginList(size_t column);
+    void addElement(size_t column, std::string_view element);
+
+    // the row as bytes and back, e.g. to keep it in a cache; decode returns false if in is damaged
+    void encode(std::string& out) const;
+    bool decode(std::string_view in);
+
+private:
+    friend class ColumnarWriter;
+    struct Cell
+    {
+        bool valid = false;
+        unsigned long long number = 0;
+        double real = 0;
+        std::string bytes;
+        std::vector<std::string> elements;
+    };
+    std::vector<Cell> cells;
+};
+
+class ColumnarWriter
+{
+public:
+    ColumnarWriter(BufferedOutput& output, std::vector<ColumnSpec> schema, size_t rowsPerGroup = DEFAULT_ROWS_PER_GROUP);
+    ~ColumnarWriter() { finish(); }
+    ColumnarWriter(const ColumnarWriter&) = delete;
+    ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+    // Not thread safe; rows are stored in the order they are appended.
+    void append(const ColumnarRow& row);
+    // writes the last row group and the footer; nothing can be appended after that
+    void finish();
+
+    static constexpr size_t DEFAULT_ROWS_PER_GROUP = 64 * 1024;
+    static constexpr char MAGIC[8] = { 'P', 'E', 'C', 'O', 'L', 'S', '1', '\n' };
+private:
+    // the values of one column in the current row group
+    struct Column
+    {
+        explicit Column(const ColumnSpec& spec) : spec(spec) {}
+
+        ColumnSpec spec;
+        std::vector<unsigned char> validity;
+        uint32_t nullCount = 0;
+        std::string fixed;  // packed fixed width values
+        // String and StringList: every value is an index into the dictionary
+        std::unordered_map<std::string, uint32_t> dictionary;
+        std::vector<const std::string*> dictionaryEntries;  // by index; map nodes don't move
+        size_t dictionaryBytes = 0;
+        std::vector<uint32_t> indices;
+        size_t plainBytes = 0;
+        std::vector<uint32_t> listOffsets{ 0 };
+    };
+
+    void addString(Column& column, std::string_view value);
+    void writeStrings(const Column& column, std::string& chunk) const;
+    void writeRowGroup();
+    void write(std::string_view data);
+
+    BufferedOutput& output;
+    std::vector<Column> columns;
+    size_t rowsPerGroup;
+    uint32_t rows = 0;  // in the current row group
+    unsigned long long offset = 0;  // bytes written so far
+    std::string footer;  // the row group index
+    uint32_t numberOfRowGroups = 0;
+    bool finished = false;
+};
@@ -0,0 +1,168 @@
+#include "ExportTable.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // ordinals are 16-bit, so a valid export address table can't be larger
+    constexpr DWORD MAX_EXPORTED_FUNCTIONS = 65536;
+    // forwarder chains longer than this are treated as loops
+    constexpr int MAX_FORWARDER_DEPTH = 16;
+}
+
+ExportTable::ExportTable(const PeImage& image)
+{
+    auto directory = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_EXPORT);
+    if (!directory || directory->VirtualAddress == 0)
+        return;
+    DWORD directoryOffset = image.rvaToOffset(directory->VirtualAddress, sizeof(IMAGE_EXPORT_DIRECTORY));
+    auto exportDirectory = directoryOffset ? image.at<IMAGE_EXPORT_DIRECTORY>(directoryOffset) : nullptr;
+    if (!exportDirectory)
+    {
+        isTruncated = true;
+        return;
+    }
+    ordinalBase = exportDirectory->Base;
+    DWORD numberOfFunctions = std::min(exportDirectory->NumberOfFunctions, MAX_EXPORTED_FUNCTIONS);
+    DWORD numberOfNames = std::min(exportDirectory->NumberOfNames, MAX_EXPORTED_FUNCTIONS);
+    isTruncated = numberOfFunctions != exportDirectory->NumberOfFunctions || numberOfNames != exportDirectory->NumberOfNames;
+
+    DWORD functionsOffset = image.rvaToOffset(exportDirectory->AddressOfFunctions, numberOfFunctions * sizeof(DWORD));
+    auto addresses = functionsOffset ? image.at<DWORD>(functionsOffset, numberOfFunctions) : nullptr;
+    if (!addresses)
+    {
+        isTruncated = isTruncated || numberOfFunctions != 0;
+        numberOfFunctions = 0;
+    }
+    DWORD namesOffset = image.rvaToOffset(exportDirectory->AddressOfNames, numberOfNames * sizeof(DWORD));
+    DWORD ordinalsOffset = image.rvaToOffset(exportDirectory->AddressOfNameOrdinals, numberOfNames * sizeof(WORD));
+    auto nameRvas = namesOffset ? image.at<DWORD>(namesOffset, numberOfNames) : nullptr;
+    auto nameOrdinals = ordinalsOffset ? image.at<WORD>(ordinalsOffset, numberOfNames) : nullptr;
+    if (!nameRvas || !nameOrdinals)
+    {
+        isTruncated = isTruncated || numberOfNames != 0;
+        numberOfNames = 0;
+    }
+
+    // First collect views into the image, then move every string into the arena in one allocation.
+    std::string_view dll = image.stringAtRva(exportDirectory->Name);
+    size_t arenaSize = dll.size();
+    functionByOrdinal.assign(numberOfFunctions, NO_FUNCTION);
+    exportedFunctions.reserve(numberOfFunctions);
+    for (DWORD i = 0; i < numberOfFunctions; i++)
+    {
+        DWORD rva = addresses[i];
+        if (rva == 0)
+            continue;  // unused ordinal
+        ExportedFunction function{ ordinalBase + i, rva, {}, {} };
+        // an address inside the export directory is the name of the function it forwards to
+        if (rva >= directory->VirtualAddress && rva - directory->VirtualAddress < directory->Size)
+        {
+            function.forwarder = image.stringAtRva(rva);
+            function.rva = 0;
+            arenaSize += function.forwarder.size();
+        }
+        functionByOrdinal[i] = static_cast<unsigned>(exportedFunctions.size());
+        exportedFunctions.push_back(function);
+    }
+    nameIndex.reserve(numberOfNames);
+    for (DWORD i = 0; i < numberOfNames; i++)
+    {
+        WORD index = nameOrdinals[i];
+        std::string_view name = image.stringAtRva(nameRvas[i]);
+        if (index >= numberOfFunctions || functionByOrdinal[index] == NO_FUNCTION || name.empty())
+            continue;
+        nameIndex.emplace_back(name, functionByOrdinal[index]);
+        arenaSize += name.size();
+    }
+
+    arena.resize(arenaSize);
+    char* next = arena.data();
+    auto keep = [&next](std::string_view& str)
+    {
+        if (str.empty())
+            return;
+        memcpy(next, str.data(), str.size());
+        str = std::string_view(next, str.size());
+        next += str.size();
+    };
+    moduleName = dll;
+    keep(moduleName);
+    for (auto& function : exportedFunctions)
+        keep(function.forwarder);
+    for (auto& entry : nameIndex)
+    {
+        keep(entry.first);
+        auto& function = exportedFunctions[entry.second];
+        if (function.name.empty())
+            function.name = entry.first;
+    }
+
+    // The loader binary searches the name table, so linkers emit it sorted; check before sorting.
+    auto byName = [](const std::pair<std::string_view, unsigned>& a, const std::pair<std::string_view, unsigned>& b) { return a.first < b.first; };
+    if (!std::is_sorted(nameIndex.begin(), nameIndex.end(), byName))
+        std::sort(nameIndex.begin(), nameIndex.end(), byName);
+}
+
+const ExportedFunction* ExportTable::find(std::string_view name) const
+{
+    auto it = std::lower_bound(nameIndex.begin(), nameIndex.end(), name,
+        [](const std::pair<std::string_view, unsigned>& entry, std::string_view value) { return entry.first < value; });
+    if (it == nameIndex.end() || it->first != name)
+        return nullptr;
+    return &exportedFunctions[it->second];
+}
+
+const ExportedFunction* ExportTable::findOrdinal(DWORD ordinal) const
+{
+    if (ordinal < ordinalBase || ordinal - ordinalBase >= functionByOrdinal.size())
+        return nullptr;
+    unsigned index = functionByOrdinal[ordinal - ordinalBase];
+    return index == NO_FUNCTION ? nullptr : &exportedFunctions[index];
+}
+
+bool ExportTable::splitForwarder(std::string_view forwarder, std::string_view& module, std::string_view& function)
+{
+    size_t dot = forwarder.rfind('.');
+    if (dot == std::string_view::npos || dot == 0 || dot + 1 == forwarder.size())
+        return false;
+    module = forwarder.substr(0, dot);
+    function = forwarder.substr(dot + 1);
+    return true;
+}
+
+const ExportedFunction* ExportTable::resolve(std::string_view name, const ModuleLookup& lookup) const
+{
+    const ExportedFunction* function = find(name);
+    for (int depth = 0; function && depth < MAX_FORWARDER_DEPTH; depth++)
+    {
+        if (function->forwarder.empty())
+            return function;
+        std::string_view module, target;
+        if (!splitForwarder(function->forwarder, module, target))
+            return nullptr;
+        const ExportTable* table = lookup(module);
+        if (!table)
+            return nullptr;
+        if (target[0] == '#')
+        {
+            // forwarded by ordinal: "NTDLL.#12"; ordinals are 16-bit, so more digits can't name one
+            std::string_view digits = target.substr(1);
+            if (digits.empty() || digits.size() > 5)
+                return nullptr;
+            DWORD ordinal = 0;
+            for (char c : digits)
+            {
+                if (c < '0' || c > '9')
+                    return nullptr;
+                ordinal = ordinal * 10 + (c - '0');
+            }
+            function = table->findOrdinal(ordinal);
+        }
+        else
+        {
+            function = table->find(target);
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <Windows.h>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "PeImage.h"
+
+struct ExportedFunction
+{
+    DWORD ordinal;
+    DWORD rva;  // 0 for forwarders
+    std::string_view name;  // first name of the function, empty if it is exported by ordinal only
+    std::string_view forwarder;  // e.g. "NTDLL.RtlAllocateHeap" or "NTDLL.#12", empty if not forwarded
+};
+
+// Export directory of a PE image, indexed for lookups by name and by ordinal.
+// The table copies the names it needs into one buffer of its own, so it stays usable after the
+// image is closed: build it once per DLL and query it as often as needed. Lookups by name are a
+// binary search over the sorted names, lookups by ordinal index an array.
+class ExportTable
+{
+public:
+    ExportTable() = default;
+    explicit ExportTable(const PeImage& image);
+    // moving keeps the buffer, and with it every string_view handed out; copying would not
+    ExportTable(ExportTable&&) = default;
+    ExportTable& operator=(ExportTable&&) = default;
+    ExportTable(const ExportTable&) = delete;
+    ExportTable& operator=(const ExportTable&) = delete;
+
+    std::string_view dllName() const { return moduleName; }
+    // one entry per used slot of the export address table, in ordinal order
+    const std::vector<ExportedFunction>& functions() const { return exportedFunctions; }
+    size_t numberOfNames() const { return nameIndex.size(); }
+    // true if part of the directory ran out of the file; what was read before that is kept
+    bool truncated() const { return isTruncated; }
+
+    // nullptr if not exported. Names are case sensitive, as for GetProcAddress.
+    const ExportedFunction* find(std::string_view name) const;
+    const ExportedFunction* findOrdinal(DWORD ordinal) const;
+
+    // Returns the export table of a module named in a forwarder (e.g. "NTDLL"), or nullptr
+    using ModuleLookup = std::function<const ExportTable*(std::string_view moduleName)>;
+    // Follows forwarders through other modules until a function with code is found.
+    // nullptr if name is not exported, a module in the chain is unknown, or the chain loops.
+    const ExportedFunction* resolve(std::string_view name, const ModuleLookup& lookup) const;
+    // "NTDLL.RtlAllocateHeap" -> "NTDLL", "RtlAllocateHeap"
+    static bool splitForwarder(std::string_view forwarder, std::string_view& module, std::string_view& function);
+
+private:
+    std::vector<char> arena;
+    std::string_view moduleName;
+    DWORD ordinalBase = 0;
+    std::vector<ExportedFunction> exportedFunctions;
+    std::vector<unsigned> functionByOrdinal;  // ordinal - ordinalBase -> index into exportedFunctions, NO_FUNCTION if unused
+    std::vector<std::pair<std::string_view, unsigned>> nameIndex;  // sorted by name
+    bool isTruncated = false;
+
+    static constexpr unsigned NO_FUNCTION = ~0u;
+};
@@ -0,0 +1,146 @@
+#include "Fingerprints.h"
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+
+std::wstring imphash(const ImportTable& imports)
+{
+    std::string list;
+    bool empty = true;
+    for (const auto& module : imports.modules())
+    {
+        // delay-loaded modules are not part of imphash
+        if (module.delayLoaded)
+            continue;
+        std::string moduleName(module.name);
+        std::transform(moduleName.begin(), moduleName.end(), moduleName.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        size_t dot = moduleName.rfind('.');
+        if (dot != std::string::npos)
+        {
+            std::string extension = moduleName.substr(dot + 1);
+            if (extension == "dll" || extension == "ocx" || extension == "sys")
+                moduleName.resize(dot);
+        }
+        for (unsigned i = module.firstFunction; i < module.firstFunction + module.numberOfFunctions; i++)
+        {
+            const ImportedFunction& function = imports.functions()[i];
+            std::string functionName = function.byOrdinal ? "ord" + std::to_string(function.hintOrOrdinal) : std::string(function.name);
+            if (functionName.empty())
+                continue;  // the name was not inside the file
+            std::transform(functionName.begin(), functionName.end(), functionName.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+            if (!empty)
+                list += ',';
+            list += moduleName + '.' + functionName;
+            empty = false;
+        }
+    }
+    if (empty)
+        return L"";
+    return GetHashText(list.data(), static_cast<unsigned long>(list.size()), HashType::HashMd5);
+}
+
+namespace
+{
+    constexpr DWORD RICH_MARKER = 0x68636952;  // "Rich"
+    constexpr DWORD DANS_MARKER = 0x536e6144;  // "DanS"
+
+    DWORD rotateLeft(DWORD value, unsigned count)
+    {
+        count &= 31;
+        return count ? (value << count) | (value >> (32 - count)) : value;
+    }
+}
+
+RichHeader parseRichHeader(const PeImage& image)
+{
+    RichHeader rich;
+    auto dosHeader = image.at<IMAGE_DOS_HEADER>(0);
+    if (!dosHeader || dosHeader->e_lfanew <= 0)
+        return rich;
+    // the header is DWORD aligned and ends right before the PE header, padding aside
+    size_t end = std::min<size_t>(static_cast<size_t>(dosHeader->e_lfanew), image.size()) & ~static_cast<size_t>(3);
+    auto dwords = image.at<DWORD>(0, end / sizeof(DWORD));
+    if (!dwords)
+        return rich;
+    size_t numberOfDwords = end / sizeof(DWORD);
+    size_t richIndex = numberOfDwords;
+    for (size_t i = sizeof(IMAGE_DOS_HEADER) / sizeof(DWORD); i + 1 < numberOfDwords; i++)
+    {
+        if (dwords[i] == RICH_MARKER)
+        {
+            richIndex = i;
+            break;
+        }
+    }
+    if (richIndex == numberOfDwords)
+        return rich;
+    DWORD key = dwords[richIndex + 1];
+    size_t dansIndex = richIndex;
+    while (dansIndex > sizeof(IMAGE_DOS_HEADER) / sizeof(DWORD) && (dwords[dansIndex] ^ key) != DANS_MARKER)
+        dansIndex--;
+    // "DanS", then three zero DWORDs, then (comp.id, count) pairs
+    if ((dwords[dansIndex] ^ key) != DANS_MARKER || richIndex - dansIndex < 4 || (richIndex - dansIndex - 4) % 2 != 0)
+        return rich;
+    rich.present = true;
+    rich.key = key;
+
+    std::vector<DWORD> decoded(richIndex - dansIndex);
+    for (size_t i = dansIndex; i < richIndex; i++)
+        decoded[i - dansIndex] = dwords[i] ^ key;
+    rich.hash = GetHashText(decoded.data(), static_cast<unsigned long>(decoded.size() * sizeof(DWORD)), HashType::HashMd5);
+
+    // the linker's key: the offset of "DanS", plus every byte before it rotated by its offset
+    // (skipping e_lfanew), plus every comp.id rotated by its count
+    DWORD checksum = static_cast<DWORD>(dansIndex * sizeof(DWORD));
+    auto bytes = image.data();
+    for (size_t i = 0; i < dansIndex * sizeof(DWORD); i++)
+    {
+        if (i >= offsetof(IMAGE_DOS_HEADER, e_lfanew) && i < offsetof(IMAGE_DOS_HEADER, e_lfanew) + sizeof(LONG))
+            continue;
+        checksum += rotateLeft(bytes[i], static_cast<unsigned>(i));
+    }
+    for (size_t i = 4; i + 1 < decoded.size(); i += 2)
+    {
+        DWORD compId = decoded[i];
+        DWORD count = decoded[i + 1];
+        rich.entries.push_back({ static_cast<WORD>(compId >> 16), static_cast<WORD>(compId & 0xffff), count });
+        checksum += rotateLeft(compId, count);
+    }
+    rich.checksumValid = checksum == key;
+    return rich;
+}
+
+SectionHashes::SectionHashes(const SectionTable& table, unsigned hashMask)
+{
+    unsigned mask = hashMask & (hashFlag(HashType::HashMd5) | hashFlag(HashType::HashSha256));
+    sectionDigests.reserve(table.size());
+    sections.reserve(table.size());
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        sectionDigests.push_back({ table.name(i), table.rawOffset(i), table.rawSize(i), L"", L"" });
+        sections.push_back({ table.rawOffset(i), static_cast<unsigned long long>(table.rawOffset(i)) + table.rawSize(i), MultiHash(mask) });
+    }
+}
+
+void SectionHashes::consume(unsigned long long offset, const unsigned char* data, size_t len)
+{
+    // sections are few, and their raw data may overlap, so every one is checked
+    unsigned long long end = offset + len;
+    for (auto& section : sections)
+    {
+        unsigned long long begin = std::max(section.begin, offset);
+        unsigned long long last = std::min(section.end, end);
+        if (begin < last)
+            section.hash.update(data + (begin - offset), static_cast<size_t>(last - begin));
+    }
+}
+
+std::vector<SectionDigest> SectionHashes::digests()
+{
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        sectionDigests[i].md5 = sections[i].hash.hexDigest(HashType::HashMd5);
+        sectionDigests[i].sha256 = sections[i].hash.hexDigest(HashType::HashSha256);
+    }
+    return sectionDigests;
+}
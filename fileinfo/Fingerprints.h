@@ -0,0 +1,64 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include "HashPipeline.h"
+#include "ImportTable.h"
+#include "PeImage.h"
+
+// Fingerprints used to cluster similar images, next to the whole-file digests.
+
+// MD5 of "module.function" pairs of the regular imports, lowercase and comma separated, with the
+// module's .dll/.ocx/.sys extension dropped, as computed by pefile. Functions imported by ordinal
+// are "ordN"; pefile resolves ws2_32, wsock32 and oleaut32 ordinals to names instead, so imphashes
+// of images importing those by ordinal differ from pefile's. "" if there are no imports.
+std::wstring imphash(const ImportTable& imports);
+
+struct RichEntry
+{
+    WORD productId;
+    WORD build;
+    DWORD count;  // number of objects built by this tool
+};
+
+// The "Rich" header the Microsoft linker leaves between the DOS stub and the PE header
+struct RichHeader
+{
+    bool present = false;
+    bool checksumValid = false;  // the XOR key matches the one the linker computes
+    DWORD key = 0;
+    std::vector<RichEntry> entries;
+    std::wstring hash;  // MD5 of the decoded header, from "DanS" up to "Rich"
+};
+
+RichHeader parseRichHeader(const PeImage& image);
+
+struct SectionDigest
+{
+    std::string name;
+    DWORD rawOffset;
+    DWORD rawSize;
+    std::wstring md5;
+    std::wstring sha256;
+};
+
+// MD5 and SHA256 of the raw data of every section, as a ChunkSink: each chunk of the file is
+// handed to the sections it overlaps, so the digests come out of the same read as the file's.
+class SectionHashes : public ChunkSink
+{
+public:
+    // hashMask selects MD5 and/or SHA256; SHA1 is ignored
+    SectionHashes(const SectionTable& sections, unsigned hashMask);
+    void consume(unsigned long long offset, const unsigned char* data, size_t len) override;
+    // in the order of the section table, i.e. by virtual address
+    std::vector<SectionDigest> digests();
+private:
+    struct Section
+    {
+        unsigned long long begin;
+        unsigned long long end;
+        MultiHash hash;
+    };
+    std::vector<SectionDigest> sectionDigests;
+    std::vector<Section> sections;
+};
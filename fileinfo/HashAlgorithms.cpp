@@ -0,0 +1,381 @@
+#include "HashAlgorithms.h"
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HASH_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+// kernels in HashAlgorithmsX86.cpp
+void sha1CompressShaNi(uint32_t state[5], const uint8_t* blocks, size_t numberOfBlocks);
+void sha256CompressShaNi(uint32_t state[8], const uint8_t* blocks, size_t numberOfBlocks);
+void sha256CompressAvx2x8(uint32_t states[8][8], const uint8_t* const blocks[8], size_t numberOfBlocks);
+#endif
+
+extern const uint32_t g_sha256RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+namespace
+{
+    inline uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+    inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+    inline uint32_t loadLE32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+    inline uint32_t loadBE32(const uint8_t* p) { return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+    inline void storeLE32(uint8_t* p, uint32_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); p[2] = uint8_t(v >> 16); p[3] = uint8_t(v >> 24); }
+    inline void storeBE32(uint8_t* p, uint32_t v) { p[0] = uint8_t(v >> 24); p[1] = uint8_t(v >> 16); p[2] = uint8_t(v >> 8); p[3] = uint8_t(v); }
+
+    const uint32_t SHA256_INIT[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    void md5CompressScalar(uint32_t state[4], const uint8_t* blocks, size_t numberOfBlocks)
+    {
+        static const uint32_t K[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+        };
+        static const int R[64] = {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+        };
+        for (size_t blk = 0; blk < numberOfBlocks; blk++, blocks += 64)
+        {
+            uint32_t m[16];
+            for (int i = 0; i < 16; i++)
+                m[i] = loadLE32(blocks + i * 4);
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            for (int i = 0; i < 64; i++)
+            {
+                uint32_t f;
+                int g;
+                if (i < 16) { f = (b & c) | (~b & d); g = i; }
+                else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) & 15; }
+                else if (i < 48) { f = b ^ c ^ d; g = (3 * i + 5) & 15; }
+                else { f = c ^ (b | ~d); g = (7 * i) & 15; }
+                uint32_t temp = d;
+                d = c;
+                c = b;
+                b = b + rotl(a + f + K[i] + m[g], R[i]);
+                a = temp;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        }
+    }
+
+    void sha1CompressScalar(uint32_t state[5], const uint8_t* blocks, size_t numberOfBlocks)
+    {
+        for (size_t blk = 0; blk < numberOfBlocks; blk++, blocks += 64)
+        {
+            uint32_t w[80];
+            for (int i = 0; i < 16; i++)
+                w[i] = loadBE32(blocks + i * 4);
+            for (int i = 16; i < 80; i++)
+                w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+            for (int i = 0; i < 80; i++)
+            {
+                uint32_t f, k;
+                if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+                else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+                else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+                else { f = b ^ c ^ d; k = 0xca62c1d6; }
+                uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = rotl(b, 30);
+                b = a;
+                a = temp;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+        }
+    }
+
+    void sha256CompressScalar(uint32_t state[8], const uint8_t* blocks, size_t numberOfBlocks)
+    {
+        for (size_t blk = 0; blk < numberOfBlocks; blk++, blocks += 64)
+        {
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++)
+                w[i] = loadBE32(blocks + i * 4);
+            for (int i = 16; i < 64; i++)
+            {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++)
+            {
+                uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                uint32_t ch = (e & f) ^ (~e & g);
+                uint32_t temp1 = h + S1 + ch + g_sha256RoundConstants[i] + w[i];
+                uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+                uint32_t temp2 = S0 + maj;
+                h = g;
+                g = f;
+                f = e;
+                e = d + temp1;
+                d = c;
+                c = b;
+                b = a;
+                a = temp1 + temp2;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+    }
+
+    struct CpuFeatures
+    {
+        bool shaNi = false;
+        bool avx2 = false;
+    };
+    CpuFeatures detectCpuFeatures()
+    {
+        CpuFeatures features;
+#ifdef HASH_X86
+        unsigned int regs1[4]{}, regs7[4]{};
+#ifdef _MSC_VER
+        int r[4]{};
+        __cpuid(r, 0);
+        int maxLeaf = r[0];
+        __cpuidex(r, 1, 0);
+        memcpy(regs1, r, sizeof(r));
+        if (maxLeaf >= 7)
+        {
+            __cpuidex(r, 7, 0);
+            memcpy(regs7, r, sizeof(r));
+        }
+#else
+        unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+        __get_cpuid(1, &regs1[0], &regs1[1], &regs1[2], &regs1[3]);
+        if (maxLeaf >= 7)
+            __get_cpuid_count(7, 0, &regs7[0], &regs7[1], &regs7[2], &regs7[3]);
+#endif
+        bool ssse3 = (regs1[2] >> 9) & 1;
+        bool sse41 = (regs1[2] >> 19) & 1;
+        bool osxsave = (regs1[2] >> 27) & 1;
+        features.shaNi = ssse3 && sse41 && ((regs7[1] >> 29) & 1);
+        if (osxsave && ((regs7[1] >> 5) & 1))
+        {
+            // the OS must save the YMM registers on context switches
+#ifdef _MSC_VER
+            unsigned long long xcr0 = _xgetbv(0);
+#else
+            unsigned int eax = 0, edx = 0;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+            features.avx2 = (xcr0 & 6) == 6;
+        }
+#endif
+        return features;
+    }
+    const CpuFeatures& detectedCpuFeatures()
+    {
+        static const CpuFeatures features = detectCpuFeatures();
+        return features;
+    }
+    // the features the kernels are picked from: the detected ones, unless a test restricted them
+    CpuFeatures& cpuFeatures()
+    {
+        static CpuFeatures features = detectedCpuFeatures();
+        return features;
+    }
+
+    using Sha1CompressFunc = void (*)(uint32_t state[5], const uint8_t* blocks, size_t numberOfBlocks);
+    using Sha256CompressFunc = void (*)(uint32_t state[8], const uint8_t* blocks, size_t numberOfBlocks);
+    Sha1CompressFunc sha1Compress()
+    {
+#ifdef HASH_X86
+        if (cpuFeatures().shaNi)
+            return sha1CompressShaNi;
+#endif
+        return sha1CompressScalar;
+    }
+    Sha256CompressFunc sha256Compress()
+    {
+#ifdef HASH_X86
+        if (cpuFeatures().shaNi)
+            return sha256CompressShaNi;
+#endif
+        return sha256CompressScalar;
+    }
+}
+
+void BlockHash::update(const void* data, size_t len)
+{
+    if (len == 0)
+        return;  // data may be null then
+    auto p = static_cast<const uint8_t*>(data);
+    totalLength += len;
+    if (bufferLength > 0)
+    {
+        size_t toCopy = BLOCK_SIZE - bufferLength < len ? BLOCK_SIZE - bufferLength : len;
+        memcpy(buffer + bufferLength, p, toCopy);
+        bufferLength += toCopy;
+        p += toCopy;
+        len -= toCopy;
+        if (bufferLength < BLOCK_SIZE)
+            return;
+        compress(buffer, 1);
+        bufferLength = 0;
+    }
+    size_t numberOfBlocks = len / BLOCK_SIZE;
+    if (numberOfBlocks > 0)
+    {
+        // whole blocks are hashed straight from the caller's buffer
+        compress(p, numberOfBlocks);
+        p += numberOfBlocks * BLOCK_SIZE;
+        len -= numberOfBlocks * BLOCK_SIZE;
+    }
+    memcpy(buffer, p, len);
+    bufferLength = len;
+}
+void BlockHash::finishPadding(bool bigEndianLength)
+{
+    uint64_t bitLength = totalLength * 8;
+    buffer[bufferLength++] = 0x80;
+    if (bufferLength > BLOCK_SIZE - 8)
+    {
+        memset(buffer + bufferLength, 0, BLOCK_SIZE - bufferLength);
+        compress(buffer, 1);
+        bufferLength = 0;
+    }
+    memset(buffer + bufferLength, 0, BLOCK_SIZE - 8 - bufferLength);
+    for (int i = 0; i < 8; i++)
+    {
+        buffer[BLOCK_SIZE - 8 + i] = static_cast<uint8_t>(bigEndianLength ? bitLength >> (56 - 8 * i) : bitLength >> (8 * i));
+    }
+    compress(buffer, 1);
+    bufferLength = 0;
+}
+
+Md5::Md5() : state{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 }
+{
+}
+void Md5::compress(const uint8_t* blocks, size_t numberOfBlocks)
+{
+    md5CompressScalar(state, blocks, numberOfBlocks);
+}
+void Md5::final(uint8_t digest[DIGEST_SIZE])
+{
+    finishPadding(false);
+    for (int i = 0; i < 4; i++)
+        storeLE32(digest + i * 4, state[i]);
+}
+
+Sha1::Sha1() : state{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 }
+{
+}
+void Sha1::compress(const uint8_t* blocks, size_t numberOfBlocks)
+{
+    sha1Compress()(state, blocks, numberOfBlocks);
+}
+void Sha1::final(uint8_t digest[DIGEST_SIZE])
+{
+    finishPadding(true);
+    for (int i = 0; i < 5; i++)
+        storeBE32(digest + i * 4, state[i]);
+}
+
+Sha256::Sha256()
+{
+    memcpy(state, SHA256_INIT, sizeof(state));
+}
+void Sha256::compress(const uint8_t* blocks, size_t numberOfBlocks)
+{
+    sha256Compress()(state, blocks, numberOfBlocks);
+}
+void Sha256::final(uint8_t digest[DIGEST_SIZE])
+{
+    finishPadding(true);
+    for (int i = 0; i < 8; i++)
+        storeBE32(digest + i * 4, state[i]);
+}
+
+void sha256MultiBuffer(const uint8_t* const* messages, size_t numberOfMessages, size_t len, uint8_t (*digests)[Sha256::DIGEST_SIZE])
+{
+    size_t done = 0;
+#ifdef HASH_X86
+    // SHA-NI on one stream beats 8 AVX2 lanes, so the multi-buffer kernel is only used without it
+    if (cpuFeatures().avx2 && !cpuFeatures().shaNi)
+    {
+        size_t wholeBlocks = len / 64;
+        size_t tailLength = len % 64;
+        // all lanes have the same length, so they share the same padding layout
+        size_t paddedTailBlocks = tailLength + 9 > 64 ? 2 : 1;
+        std::vector<uint8_t> tails(8 * 128);
+        for (; done + 8 <= numberOfMessages; done += 8)
+        {
+            uint32_t states[8][8];
+            const uint8_t* lanes[8];
+            const uint8_t* tailLanes[8];
+            for (int lane = 0; lane < 8; lane++)
+            {
+                memcpy(states[lane], SHA256_INIT, sizeof(SHA256_INIT));
+                lanes[lane] = messages[done + lane];
+                uint8_t* tail = tails.data() + lane * 128;
+                memset(tail, 0, 128);
+                if (tailLength > 0)
+                    memcpy(tail, lanes[lane] + wholeBlocks * 64, tailLength);
+                tail[tailLength] = 0x80;
+                uint64_t bitLength = static_cast<uint64_t>(len) * 8;
+                for (int i = 0; i < 8; i++)
+                    tail[paddedTailBlocks * 64 - 1 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+                tailLanes[lane] = tail;
+            }
+            sha256CompressAvx2x8(states, lanes, wholeBlocks);
+            sha256CompressAvx2x8(states, tailLanes, paddedTailBlocks);
+            for (int lane = 0; lane < 8; lane++)
+            {
+                for (int i = 0; i < 8; i++)
+                    storeBE32(digests[done + lane] + i * 4, states[lane][i]);
+            }
+        }
+    }
+#endif
+    for (; done < numberOfMessages; done++)
+    {
+        Sha256 sha;
+        sha.update(messages[done], len);
+        sha.final(digests[done]);
+    }
+}
+
+const char* hashBackendName()
+{
+    if (cpuFeatures().shaNi)
+        return "SHA-NI";
+    if (cpuFeatures().avx2)
+        return "AVX2";
+    return "scalar";
+}
+
+bool restrictHashKernels(bool isShaNiAllowed, bool isAvx2Allowed)
+{
+    const CpuFeatures& detected = detectedCpuFeatures();
+    cpuFeatures().shaNi = detected.shaNi && isShaNiAllowed;
+    cpuFeatures().avx2 = detected.avx2 && isAvx2Allowed;
+    return (detected.shaNi || !isShaNiAllowed) && (detected.avx2 || !isAvx2Allowed);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// In-tree MD5 / SHA-1 / SHA-256 implementations, independent of CryptoAPI so they also build on Linux.
+// The block functions are picked once at runtime from the CPU features:
+//   SHA-1, SHA-256: SHA-NI when available, otherwise portable scalar code
+//   MD5: portable scalar code (it has no useful SIMD form for a single stream)
+// Independent equal-length messages can be hashed together with sha256MultiBuffer, which uses
+// an 8-lane AVX2 kernel on CPUs that have AVX2 but no SHA-NI.
+
+// Merkle-Damgard framing shared by all three algorithms: 64-byte blocks and a 64-bit bit length.
+class BlockHash
+{
+public:
+    virtual ~BlockHash() = default;
+    void update(const void* data, size_t len);
+protected:
+    static constexpr size_t BLOCK_SIZE = 64;
+    virtual void compress(const uint8_t* blocks, size_t numberOfBlocks) = 0;
+    void finishPadding(bool bigEndianLength);
+
+    uint64_t totalLength = 0;
+    uint8_t buffer[BLOCK_SIZE]{};
+    size_t bufferLength = 0;
+};
+
+class Md5 : public BlockHash
+{
+public:
+    static constexpr size_t DIGEST_SIZE = 16;
+    Md5();
+    void final(uint8_t digest[DIGEST_SIZE]);
+private:
+    void compress(const uint8_t* blocks, size_t numberOfBlocks) override;
+    uint32_t state[4];
+};
+
+class Sha1 : public BlockHash
+{
+public:
+    static constexpr size_t DIGEST_SIZE = 20;
+    Sha1();
+    void final(uint8_t digest[DIGEST_SIZE]);
+private:
+    void compress(const uint8_t* blocks, size_t numberOfBlocks) override;
+    uint32_t state[5];
+};
+
+class Sha256 : public BlockHash
+{
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    Sha256();
+    void final(uint8_t digest[DIGEST_SIZE]);
+private:
+    void compress(const uint8_t* blocks, size_t numberOfBlocks) override;
+    uint32_t state[8];
+};
+
+// Hashes numberOfMessages messages of the same length. Used for tree hash leaves.
+void sha256MultiBuffer(const uint8_t* const* messages, size_t numberOfMessages, size_t len, uint8_t (*digests)[Sha256::DIGEST_SIZE]);
+
+// "SHA-NI", "AVX2" or "scalar": the SHA-256 kernel selected for this CPU
+const char* hashBackendName();
+
+// For tests and benchmarks: picks the kernels as if the CPU only had the features allowed here, so
+// every kernel can be checked on one machine. Returns false if the CPU lacks an allowed feature.
+// Not thread safe: call it while nothing is being hashed.
+bool restrictHashKernels(bool isShaNiAllowed, bool isAvx2Allowed);
@@ -0,0 +1,182 @@
+// SHA-NI and AVX2 kernels for HashAlgorithms.cpp. They are only called after CPUID has confirmed
+// the instruction set, so this file is compiled without raising the baseline target of the program.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define HASH_TARGET(isa)
+#else
+#define HASH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+extern const uint32_t g_sha256RoundConstants[64];
+
+namespace
+{
+    // the blocks of a message can be at any address
+    inline int load32(const uint8_t* p)
+    {
+        int value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+}
+
+// Reference: Intel SHA Extensions sample code, https://github.com/noloader/SHA-Intrinsics
+HASH_TARGET("sha,sse4.1,ssse3")
+void sha1CompressShaNi(uint32_t state[5], const uint8_t* blocks, size_t numberOfBlocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    __m128i E0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; numberOfBlocks > 0; numberOfBlocks--, blocks += 64)
+    {
+        const __m128i ABCD_SAVE = ABCD;
+        const __m128i E0_SAVE = E0;
+        __m128i M[4];
+        for (int i = 0; i < 4; i++)
+            M[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), MASK);
+        __m128i E = E0;  // E input of the current group
+        __m128i prevABCD = ABCD;
+
+        // group g runs rounds 4g..4g+3 and extends the message schedule for the following groups
+#define SHA1_GROUP(g) do { \
+        E = ((g) == 0) ? _mm_add_epi32(E, M[0]) : _mm_sha1nexte_epu32(prevABCD, M[(g) & 3]); \
+        prevABCD = ABCD; \
+        if ((g) >= 3 && (g) <= 18) M[((g) + 1) & 3] = _mm_sha1msg2_epu32(M[((g) + 1) & 3], M[(g) & 3]); \
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E, (g) / 5); \
+        if ((g) >= 1 && (g) <= 16) M[((g) + 3) & 3] = _mm_sha1msg1_epu32(M[((g) + 3) & 3], M[(g) & 3]); \
+        if ((g) >= 2 && (g) <= 17) M[((g) + 2) & 3] = _mm_xor_si128(M[((g) + 2) & 3], M[(g) & 3]); \
+    } while (0)
+
+        SHA1_GROUP(0); SHA1_GROUP(1); SHA1_GROUP(2); SHA1_GROUP(3); SHA1_GROUP(4);
+        SHA1_GROUP(5); SHA1_GROUP(6); SHA1_GROUP(7); SHA1_GROUP(8); SHA1_GROUP(9);
+        SHA1_GROUP(10); SHA1_GROUP(11); SHA1_GROUP(12); SHA1_GROUP(13); SHA1_GROUP(14);
+        SHA1_GROUP(15); SHA1_GROUP(16); SHA1_GROUP(17); SHA1_GROUP(18); SHA1_GROUP(19);
+#undef SHA1_GROUP
+
+        E0 = _mm_sha1nexte_epu32(prevABCD, E0_SAVE);
+        ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    }
+    ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), ABCD);
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(E0, 3));
+}
+
+HASH_TARGET("sha,sse4.1,ssse3")
+void sha256CompressShaNi(uint32_t state[8], const uint8_t* blocks, size_t numberOfBlocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i TMP = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);  // CDAB
+    __m128i STATE1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);  // EFGH
+    __m128i STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);  // ABEF
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);  // CDGH
+
+    for (; numberOfBlocks > 0; numberOfBlocks--, blocks += 64)
+    {
+        const __m128i ABEF_SAVE = STATE0;
+        const __m128i CDGH_SAVE = STATE1;
+        __m128i M[4];
+        for (int i = 0; i < 4; i++)
+            M[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), MASK);
+
+        // group g runs rounds 4g..4g+3; groups 0..11 also compute the message words of group g+4
+#define SHA256_GROUP(g) do { \
+        __m128i MSG = _mm_add_epi32(M[(g) & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&g_sha256RoundConstants[4 * (g)]))); \
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG); \
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, _mm_shuffle_epi32(MSG, 0x0E)); \
+        if ((g) < 12) { \
+            __m128i T = _mm_sha256msg1_epu32(M[(g) & 3], M[((g) + 1) & 3]); \
+            T = _mm_add_epi32(T, _mm_alignr_epi8(M[((g) + 3) & 3], M[((g) + 2) & 3], 4)); \
+            M[(g) & 3] = _mm_sha256msg2_epu32(T, M[((g) + 3) & 3]); \
+        } \
+    } while (0)
+
+        SHA256_GROUP(0); SHA256_GROUP(1); SHA256_GROUP(2); SHA256_GROUP(3);
+        SHA256_GROUP(4); SHA256_GROUP(5); SHA256_GROUP(6); SHA256_GROUP(7);
+        SHA256_GROUP(8); SHA256_GROUP(9); SHA256_GROUP(10); SHA256_GROUP(11);
+        SHA256_GROUP(12); SHA256_GROUP(13); SHA256_GROUP(14); SHA256_GROUP(15);
+#undef SHA256_GROUP
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    }
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);  // FEBA
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);  // DCHG
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);  // DCBA
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);  // ABEF
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), STATE0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), STATE1);
+}
+
+// 8 independent SHA-256 streams, one per 32-bit lane
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+HASH_TARGET("avx2")
+void sha256CompressAvx2x8(uint32_t states[8][8], const uint8_t* const blocks[8], size_t numberOfBlocks)
+{
+    __m256i s[8];
+    for (int j = 0; j < 8; j++)
+    {
+        s[j] = _mm256_set_epi32(static_cast<int>(states[7][j]), static_cast<int>(states[6][j]), static_cast<int>(states[5][j]), static_cast<int>(states[4][j]),
+            static_cast<int>(states[3][j]), static_cast<int>(states[2][j]), static_cast<int>(states[1][j]), static_cast<int>(states[0][j]));
+    }
+    const __m256i BSWAP = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (size_t blk = 0; blk < numberOfBlocks; blk++)
+    {
+        __m256i w[16];
+        for (int t = 0; t < 16; t++)
+        {
+            const size_t offset = blk * 64 + t * 4;
+            __m256i v = _mm256_set_epi32(
+                load32(blocks[7] + offset), load32(blocks[6] + offset), load32(blocks[5] + offset), load32(blocks[4] + offset),
+                load32(blocks[3] + offset), load32(blocks[2] + offset), load32(blocks[1] + offset), load32(blocks[0] + offset));
+            w[t] = _mm256_shuffle_epi8(v, BSWAP);
+        }
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; t++)
+        {
+            if (t >= 16)
+            {
+                __m256i w15 = w[(t - 15) & 15];
+                __m256i w2 = w[(t - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w15, 7), ROTR8(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w2, 17), ROTR8(w2, 19)), _mm256_srli_epi32(w2, 10));
+                w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+            }
+            __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(e, 6), ROTR8(e, 11)), ROTR8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32(static_cast<int>(g_sha256RoundConstants[t]))), w[t & 15]));
+            __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(a, 2), ROTR8(a, 13)), ROTR8(a, 22));
+            __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+            __m256i temp2 = _mm256_add_epi32(S0, maj);
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, temp1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(temp1, temp2);
+        }
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+    }
+    for (int j = 0; j < 8; j++)
+    {
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), s[j]);
+        for (int lane = 0; lane < 8; lane++)
+            states[lane][j] = lanes[lane];
+    }
+}
+#undef ROTR8
+#endif
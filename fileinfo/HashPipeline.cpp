@@ -0,0 +1,205 @@
+#include "HashPipeline.h"
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include "AsyncFileReader.h"
+
+namespace
+{
+    struct RingSlot
+    {
+        std::vector<unsigned char> data;
+        size_t len = 0;
+        unsigned long long offset = 0;
+        unsigned long long chunkIndex = ~0ull;  // which chunk of the file the slot holds
+        size_t pendingSinks = 0;  // sinks that have not consumed the chunk yet
+        bool reading = false;  // a read into the slot is in flight; only the I/O thread looks at it
+    };
+}
+
+HashPipeline::HashPipeline(size_t bufferSize, size_t numberOfBuffers)
+    : bufferSize(bufferSize), numberOfBuffers(numberOfBuffers < 2 ? 2 : numberOfBuffers)
+{
+}
+
+void HashPipeline::addSink(ChunkSink* sink)
+{
+    sinks.push_back(sink);
+}
+
+bool HashPipeline::run(const std::wstring& path)
+{
+    // every buffer of the ring can have a read in flight
+    AsyncFileReader reader(static_cast<unsigned>(numberOfBuffers), bufferSize * numberOfBuffers);
+    unsigned long long fileSize = 0;
+    int file = reader.openFile(path, fileSize);
+    if (file < 0)
+        return false;
+    // the chunks are cut from the size at open; a file that shrinks meanwhile is a read error
+    const unsigned long long numberOfChunks = (fileSize + bufferSize - 1) / bufferSize;
+
+    std::vector<RingSlot> slots(numberOfBuffers);
+    for (auto& slot : slots)
+        slot.data.resize(bufferSize);
+    std::mutex m;
+    std::condition_variable chunkFilled;
+    std::condition_variable chunkDrained;
+
+    std::vector<std::thread> workers;
+    for (auto sink : sinks)
+    {
+        workers.emplace_back([&, sink]()
+            {
+                for (unsigned long long k = 0; k < numberOfChunks; k++)
+                {
+                    RingSlot& slot = slots[k % slots.size()];
+                    {
+                        std::unique_lock<std::mutex> lock(m);
+                        chunkFilled.wait(lock, [&]() { return slot.chunkIndex == k; });
+                    }
+                    sink->consume(slot.offset, slot.data.data(), slot.len);
+                    std::lock_guard<std::mutex> lock(m);
+                    if (--slot.pendingSinks == 0)
+                        chunkDrained.notify_one();
+                }
+            });
+    }
+
+    // This thread is the I/O thread. Reads may complete in any order; a slot is handed to the
+    // sinks when its own read is done, and the sinks take the slots in file order.
+    bool readError = false;
+    for (unsigned long long k = 0; k < numberOfChunks; k++)
+    {
+        RingSlot& slot = slots[k % slots.size()];
+        while (slot.reading)
+            reader.poll(true);
+        // submits the reads queued meanwhile before this thread blocks
+        reader.poll(false);
+        {
+            std::unique_lock<std::mutex> lock(m);
+            chunkDrained.wait(lock, [&]() { return slot.pendingSinks == 0; });
+        }
+        // no worker touches the slot until chunkIndex says it holds chunk k
+        unsigned long long offset = k * bufferSize;
+        size_t len = static_cast<size_t>(std::min<unsigned long long>(bufferSize, fileSize - offset));
+        slot.reading = true;
+        reader.read(file, offset, slot.data.data(), len, [&, k, offset, len](bool ok, size_t bytesRead)
+            {
+                RingSlot& slot = slots[k % slots.size()];
+                slot.reading = false;
+                if (!ok || bytesRead != len)
+                    readError = true;
+                std::lock_guard<std::mutex> lock(m);
+                slot.len = bytesRead;
+                slot.offset = offset;
+                slot.pendingSinks = sinks.size();
+                slot.chunkIndex = k;
+                chunkFilled.notify_all();
+            });
+    }
+    reader.drain();
+    reader.closeFile(file);
+    for (auto& worker : workers)
+        worker.join();
+    return !readError;
+}
+
+namespace
+{
+    void hashNode(const unsigned char left[Sha256::DIGEST_SIZE], const unsigned char right[Sha256::DIGEST_SIZE], unsigned char out[Sha256::DIGEST_SIZE])
+    {
+        const unsigned char prefix = 0x01;
+        Sha256 sha;
+        sha.update(&prefix, 1);
+        sha.update(left, Sha256::DIGEST_SIZE);
+        sha.update(right, Sha256::DIGEST_SIZE);
+        sha.final(out);
+    }
+    // hash of leaves [first, first + count), BLAKE3 tree shape
+    void hashSubtree(const unsigned char (*leaves)[Sha256::DIGEST_SIZE], size_t first, size_t count, unsigned char out[Sha256::DIGEST_SIZE])
+    {
+        if (count == 1)
+        {
+            memcpy(out, leaves[first], Sha256::DIGEST_SIZE);
+            return;
+        }
+        size_t leftCount = 1;
+        while (leftCount * 2 < count)
+            leftCount *= 2;
+        unsigned char left[Sha256::DIGEST_SIZE], right[Sha256::DIGEST_SIZE];
+        hashSubtree(leaves, first, leftCount, left);
+        hashSubtree(leaves, first + leftCount, count - leftCount, right);
+        hashNode(left, right, out);
+    }
+}
+
+size_t treeHashLeafCount(size_t len)
+{
+    // an empty file still has one (empty) leaf
+    return len == 0 ? 1 : (len + TREE_HASH_LEAF_SIZE - 1) / TREE_HASH_LEAF_SIZE;
+}
+
+void treeHashLeaves(const unsigned char* data, size_t len, size_t firstLeaf, size_t lastLeaf, unsigned char* leafDigests)
+{
+    auto digests = reinterpret_cast<unsigned char (*)[Sha256::DIGEST_SIZE]>(leafDigests);
+    size_t numberOfFullLeaves = len / TREE_HASH_LEAF_SIZE;
+    size_t fullEnd = lastLeaf < numberOfFullLeaves ? lastLeaf : numberOfFullLeaves;
+    constexpr size_t BATCH = 8;
+    const unsigned char* messages[BATCH];
+    for (size_t i = firstLeaf; i < fullEnd; i += BATCH)
+    {
+        size_t n = fullEnd - i < BATCH ? fullEnd - i : BATCH;
+        for (size_t j = 0; j < n; j++)
+            messages[j] = data + (i + j) * TREE_HASH_LEAF_SIZE;
+        sha256MultiBuffer(messages, n, TREE_HASH_LEAF_SIZE, &digests[i]);
+    }
+    if (lastLeaf > numberOfFullLeaves)
+    {
+        // trailing partial leaf, or the single empty leaf of an empty file
+        Sha256 sha;
+        sha.update(data + numberOfFullLeaves * TREE_HASH_LEAF_SIZE, len - numberOfFullLeaves * TREE_HASH_LEAF_SIZE);
+        sha.final(digests[numberOfFullLeaves]);
+    }
+}
+
+std::wstring treeHashRoot(const unsigned char* leafDigests, size_t len)
+{
+    unsigned char top[Sha256::DIGEST_SIZE];
+    hashSubtree(reinterpret_cast<const unsigned char (*)[Sha256::DIGEST_SIZE]>(leafDigests), 0, treeHashLeafCount(len), top);
+    unsigned char trailer[1 + Sha256::DIGEST_SIZE + 8];
+    trailer[0] = 0x02;
+    memcpy(trailer + 1, top, Sha256::DIGEST_SIZE);
+    for (int i = 0; i < 8; i++)
+        trailer[1 + Sha256::DIGEST_SIZE + i] = static_cast<unsigned char>(static_cast<unsigned long long>(len) >> (8 * i));
+    Sha256 sha;
+    sha.update(trailer, sizeof(trailer));
+    unsigned char root[Sha256::DIGEST_SIZE];
+    sha.final(root);
+    return bytesToHex(root, Sha256::DIGEST_SIZE);
+}
+
+std::wstring treeHashSha256(const unsigned char* data, size_t len, unsigned numberOfThreads)
+{
+    size_t numberOfLeaves = treeHashLeafCount(len);
+    std::vector<unsigned char> leafDigests(numberOfLeaves * Sha256::DIGEST_SIZE);
+
+    if (numberOfThreads == 0)
+        numberOfThreads = std::thread::hardware_concurrency();
+    if (numberOfThreads == 0)
+        numberOfThreads = 1;
+    if (numberOfThreads > numberOfLeaves)
+        numberOfThreads = static_cast<unsigned>(numberOfLeaves);
+
+    // leaves are split into contiguous ranges, one per thread
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < numberOfThreads; t++)
+    {
+        threads.emplace_back(treeHashLeaves, data, len, numberOfLeaves * t / numberOfThreads, numberOfLeaves * (t + 1) / numberOfThreads, leafDigests.data());
+    }
+    treeHashLeaves(data, len, 0, numberOfLeaves / numberOfThreads, leafDigests.data());
+    for (auto& thread : threads)
+        thread.join();
+    return treeHashRoot(leafDigests.data(), len);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "crypto.h"
+
+// Receives the bytes of a file in order, one chunk at a time.
+// In a HashPipeline every sink is driven by its own worker thread.
+class ChunkSink
+{
+public:
+    virtual ~ChunkSink() = default;
+    virtual void consume(unsigned long long offset, const unsigned char* data, size_t len) = 0;
+};
+
+// One digest of the file, as a pipeline stage
+class DigestSink : public ChunkSink
+{
+public:
+    explicit DigestSink(HashType hashType) : hashType(hashType), hash(hashFlag(hashType)) {}
+    void consume(unsigned long long /*offset*/, const unsigned char* data, size_t len) override { hash.update(data, len); }
+    std::wstring hexDigest() { return hash.hexDigest(hashType); }
+    HashType type() const { return hashType; }
+private:
+    HashType hashType;
+    MultiHash hash;
+};
+
+// Overlaps reading and hashing of large files.
+// The calling thread keeps a read in flight for every free buffer of a bounded ring (through
+// AsyncFileReader, so they are submitted together), while every sink consumes the buffers on a
+// separate worker thread. A buffer is refilled only after all sinks are done with it, so memory
+// use is bufferSize * numberOfBuffers regardless of the file size.
+class HashPipeline
+{
+public:
+    HashPipeline(size_t bufferSize = 1024 * 1024, size_t numberOfBuffers = 8);
+    void addSink(ChunkSink* sink);
+    // false if the file can't be read; the sinks' results are meaningless in that case
+    bool run(const std::wstring& path);
+private:
+    size_t bufferSize;
+    size_t numberOfBuffers;
+    std::vector<ChunkSink*> sinks;
+};
+
+// Files at least this large are hashed through HashPipeline instead of a single pass over the mapping
+constexpr unsigned long long PIPELINE_THRESHOLD = 64ull * 1024 * 1024;
+
+// Tree hash used as a deduplication key. Unlike MD5/SHA it scales across all cores.
+//   leaf  = SHA256(leaf bytes), leaves are TREE_HASH_LEAF_SIZE bytes (the last one may be shorter)
+//   node  = SHA256(0x01 || left || right); the left subtree holds the largest power of two
+//           number of leaves that is smaller than the total, as in BLAKE3
+//   root  = SHA256(0x02 || top node || file length as 64-bit little-endian)
+// Leaves are hashed with sha256MultiBuffer on numberOfThreads threads (0: all cores).
+constexpr size_t TREE_HASH_LEAF_SIZE = 1024 * 1024;
+std::wstring treeHashSha256(const unsigned char* data, size_t len, unsigned numberOfThreads = 0);
+
+// Building blocks of treeHashSha256 for callers that schedule the leaf work on their own threads.
+size_t treeHashLeafCount(size_t len);
+// writes the 32-byte digests of leaves [firstLeaf, lastLeaf) to leafDigests + 32 * firstLeaf
+void treeHashLeaves(const unsigned char* data, size_t len, size_t firstLeaf, size_t lastLeaf, unsigned char* leafDigests);
+std::wstring treeHashRoot(const unsigned char* leafDigests, size_t len);
@@ -0,0 +1,123 @@
+#include "ImportTable.h"
+#include <algorithm>
+
+ImportTable::ImportTable(const PeImage& image)
+{
+    // the IAT directory covers the thunks of all regular imports, which gives a good size estimate
+    auto iatDirectory = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_IAT);
+    if (iatDirectory)
+    {
+        size_t thunkSize = image.is32bit() ? sizeof(IMAGE_THUNK_DATA32) : sizeof(IMAGE_THUNK_DATA64);
+        importedFunctions.reserve(std::min<size_t>(iatDirectory->Size / thunkSize, MAX_FUNCTIONS_PER_MODULE));
+    }
+    parseImportDirectory(image);
+    parseDelayImportDirectory(image);
+}
+
+void ImportTable::parseImportDirectory(const PeImage& image)
+{
+    auto directory = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT);
+    if (!directory || directory->VirtualAddress == 0)
+        return;
+    importedModules.reserve(std::min<size_t>(directory->Size / sizeof(IMAGE_IMPORT_DESCRIPTOR), MAX_IMPORTED_MODULES));
+    for (unsigned i = 0; ; i++)
+    {
+        // the directory size is often wrong, the array ends with an empty descriptor
+        DWORD offset = image.rvaToOffset(directory->VirtualAddress + i * static_cast<DWORD>(sizeof(IMAGE_IMPORT_DESCRIPTOR)), sizeof(IMAGE_IMPORT_DESCRIPTOR));
+        auto descriptor = offset ? image.at<IMAGE_IMPORT_DESCRIPTOR>(offset) : nullptr;
+        if (!descriptor)
+        {
+            isTruncated = true;
+            return;
+        }
+        if (descriptor->Name == 0 && descriptor->FirstThunk == 0)
+            return;
+        if (i == MAX_IMPORTED_MODULES)
+        {
+            isTruncated = true;
+            return;
+        }
+        // Without an import lookup table, the names are read from the IAT. That fails for images
+        // bound the old way, whose IAT on disk holds addresses; those are rare enough to ignore.
+        DWORD thunkRva = descriptor->OriginalFirstThunk ? descriptor->OriginalFirstThunk : descriptor->FirstThunk;
+        addModule(image, image.stringAtRva(descriptor->Name), thunkRva, false);
+    }
+}
+
+void ImportTable::parseDelayImportDirectory(const PeImage& image)
+{
+    auto directory = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT);
+    if (!directory || directory->VirtualAddress == 0)
+        return;
+    for (unsigned i = 0; ; i++)
+    {
+        DWORD offset = image.rvaToOffset(directory->VirtualAddress + i * static_cast<DWORD>(sizeof(IMAGE_DELAYLOAD_DESCRIPTOR)), sizeof(IMAGE_DELAYLOAD_DESCRIPTOR));
+        auto descriptor = offset ? image.at<IMAGE_DELAYLOAD_DESCRIPTOR>(offset) : nullptr;
+        if (!descriptor)
+        {
+            isTruncated = true;
+            return;
+        }
+        if (descriptor->DllNameRVA == 0)
+            return;
+        if (i == MAX_IMPORTED_MODULES)
+        {
+            isTruncated = true;
+            return;
+        }
+        DWORD nameRva = descriptor->DllNameRVA;
+        DWORD thunkRva = descriptor->ImportNameTableRVA;
+        if (!descriptor->Attributes.RvaBased)
+        {
+            // descriptors from before VC 7 hold VAs
+            nameRva = static_cast<DWORD>(nameRva - image.imageBase());
+            thunkRva = static_cast<DWORD>(thunkRva - image.imageBase());
+        }
+        addModule(image, image.stringAtRva(nameRva), thunkRva, true);
+    }
+}
+
+void ImportTable::addModule(const PeImage& image, std::string_view name, DWORD thunkRva, bool delayLoaded)
+{
+    unsigned moduleIndex = static_cast<unsigned>(importedModules.size());
+    ImportedModule module{ name, static_cast<unsigned>(importedFunctions.size()), 0, delayLoaded };
+    const bool is32bit = image.is32bit();
+    const DWORD thunkSize = is32bit ? sizeof(IMAGE_THUNK_DATA32) : sizeof(IMAGE_THUNK_DATA64);
+    for (unsigned n = 0; ; n++)
+    {
+        DWORD offset = image.rvaToOffset(thunkRva + n * thunkSize, thunkSize);
+        if (thunkRva == 0 || offset == 0)
+        {
+            isTruncated = true;
+            break;
+        }
+        ULONGLONG thunk = is32bit ? *image.at<DWORD>(offset) : *image.at<ULONGLONG>(offset);
+        if (thunk == 0)
+            break;
+        if (n == MAX_FUNCTIONS_PER_MODULE)
+        {
+            isTruncated = true;
+            break;
+        }
+        ImportedFunction function{ {}, moduleIndex, 0, false };
+        if (is32bit ? IMAGE_SNAP_BY_ORDINAL32(thunk) : IMAGE_SNAP_BY_ORDINAL64(thunk))
+        {
+            function.byOrdinal = true;
+            function.hintOrOrdinal = static_cast<WORD>(is32bit ? IMAGE_ORDINAL32(thunk) : IMAGE_ORDINAL64(thunk));
+        }
+        else
+        {
+            // IMAGE_IMPORT_BY_NAME: WORD hint followed by the name
+            DWORD hintOffset = image.rvaToOffset(static_cast<DWORD>(thunk), sizeof(WORD));
+            auto hint = hintOffset ? image.at<WORD>(hintOffset) : nullptr;
+            if (hint)
+            {
+                function.hintOrOrdinal = *hint;
+                function.name = image.stringAt(hintOffset + sizeof(WORD));
+            }
+        }
+        importedFunctions.push_back(function);
+        module.numberOfFunctions++;
+    }
+    importedModules.push_back(module);
+}
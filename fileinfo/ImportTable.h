@@ -0,0 +1,51 @@
+#pragma once
+#include <Windows.h>
+#include <string_view>
+#include <vector>
+#include "PeImage.h"
+
+struct ImportedModule
+{
+    std::string_view name;
+    unsigned firstFunction;  // index into ImportTable::functions()
+    unsigned numberOfFunctions;
+    bool delayLoaded;
+};
+
+struct ImportedFunction
+{
+    std::string_view name;  // empty if imported by ordinal
+    unsigned module;  // index into ImportTable::modules()
+    WORD hintOrOrdinal;  // hint of a by-name import, ordinal of a by-ordinal import
+    bool byOrdinal;
+};
+
+// Regular and delay-load imports of a PE image.
+// All functions of all modules go into one flat array, in descriptor order, and every name is a
+// view of the string inside the image, so parsing allocates two arrays per image and copies no
+// strings. The views stay valid as long as the PeImage they were parsed from.
+class ImportTable
+{
+public:
+    // malformed images can declare endless descriptor or thunk arrays
+    static constexpr unsigned MAX_IMPORTED_MODULES = 4096;  // of each directory
+    static constexpr unsigned MAX_FUNCTIONS_PER_MODULE = 65536;
+
+    explicit ImportTable(const PeImage& image);
+
+    const std::vector<ImportedModule>& modules() const { return importedModules; }
+    const std::vector<ImportedFunction>& functions() const { return importedFunctions; }
+    // true if a descriptor or thunk array ran out of the file or past one of the limits; what was
+    // read before that is kept
+    bool truncated() const { return isTruncated; }
+
+private:
+    void parseImportDirectory(const PeImage& image);
+    void parseDelayImportDirectory(const PeImage& image);
+    // thunkRva: import lookup table, an array of IMAGE_THUNK_DATA32/64 ending with 0
+    void addModule(const PeImage& image, std::string_view name, DWORD thunkRva, bool delayLoaded);
+
+    std::vector<ImportedModule> importedModules;
+    std::vector<ImportedFunction> importedFunctions;
+    bool isTruncated = false;
+};
@@ -0,0 +1,433 @@
+#include "IncrementalScan.h"
+#include <algorithm>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#ifdef _WIN32
+#include <winioctl.h>
+#include <unordered_set>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char SNAPSHOT_MAGIC[8] = { 'P', 'E', 'F', 'I', 'S', 'N', 'A', 'P' };
+    constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+    std::wstring absolutePath(const std::wstring& path)
+    {
+        std::error_code ec;
+        fs::path full = fs::absolute(fs::path(path), ec);
+        return (ec ? fs::path(path) : full).lexically_normal().wstring();
+    }
+
+    // absolute and, on Windows, lowercase, so that the same file always looks the same
+    std::wstring normalizedPath(const std::wstring& path)
+    {
+        std::wstring text = absolutePath(path);
+#ifdef _WIN32
+        std::transform(text.begin(), text.end(), text.begin(), [](wchar_t c) { return static_cast<wchar_t>(towlower(c)); });
+#endif
+        return text;
+    }
+
+    uint64_t pathKey(const std::wstring& path)
+    {
+        // FNV-1a over the UTF-16 (UTF-32 elsewhere) code units
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (wchar_t c : normalizedPath(path))
+        {
+            hash ^= static_cast<uint64_t>(c);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    void put(std::ostream& out, T value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool get(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    // code units are stored as 32-bit values, so the file doesn't depend on sizeof(wchar_t)
+    void putString(std::ostream& out, const std::wstring& text)
+    {
+        put(out, static_cast<uint32_t>(text.size()));
+        for (wchar_t c : text)
+            put(out, static_cast<uint32_t>(c));
+    }
+
+    bool getString(std::istream& in, std::wstring& text)
+    {
+        uint32_t len = 0;
+        if (!get(in, len) || len > 32768)
+            return false;
+        text.resize(len);
+        for (auto& c : text)
+        {
+            uint32_t unit = 0;
+            if (!get(in, unit))
+                return false;
+            c = static_cast<wchar_t>(unit);
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+    // the part of path below directory, normalized; empty if it isn't below it
+    std::wstring pathBelow(const std::wstring& path, const std::wstring& directory)
+    {
+        std::wstring prefix = normalizedPath(directory);
+        if (!prefix.empty() && prefix.back() != L'\\')
+            prefix += L'\\';
+        std::wstring normalized = normalizedPath(path);
+        if (normalized.length() <= prefix.length() || normalized.compare(0, prefix.length(), prefix) != 0)
+            return L"";
+        return normalized.substr(prefix.length());
+    }
+
+    // full path of an open file as the system names it, links resolved; empty on error
+    std::wstring finalPath(HANDLE hFile)
+    {
+        std::vector<wchar_t> buffer(MAX_PATH);
+        DWORD len = GetFinalPathNameByHandleW(hFile, buffer.data(), static_cast<DWORD>(buffer.size()), FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+        if (len >= buffer.size())
+        {
+            buffer.resize(len + 1);
+            len = GetFinalPathNameByHandleW(hFile, buffer.data(), static_cast<DWORD>(buffer.size()), FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+        }
+        if (len == 0 || len >= buffer.size())
+            return L"";
+        // \\?\C:\dir\file or \\?\UNC\server\share\dir\file
+        std::wstring path(buffer.data(), len);
+        if (path.compare(0, 8, L"\\\\?\\UNC\\") == 0)
+            return L"\\\\" + path.substr(8);
+        if (path.compare(0, 4, L"\\\\?\\") == 0)
+            return path.substr(4);
+        return path;
+    }
+#endif
+}
+
+void IncrementalScan::load(const std::wstring& snapshotPath)
+{
+    files.clear();
+    retryPaths.clear();
+    snapshotRetryPaths.clear();
+    snapshotInputs.clear();
+    journals.clear();
+    std::ifstream in(fs::path(snapshotPath), std::ios::binary);
+    char magic[sizeof(SNAPSHOT_MAGIC)]{};
+    uint32_t version = 0;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), SNAPSHOT_MAGIC) || !get(in, version) || version != SNAPSHOT_VERSION)
+        return;
+
+    bool ok = true;
+    uint32_t numberOfInputs = 0;
+    ok = get(in, numberOfInputs);
+    for (uint32_t i = 0; ok && i < numberOfInputs; i++)
+    {
+        std::wstring input;
+        ok = getString(in, input);
+        snapshotInputs.push_back(input);
+    }
+    uint32_t numberOfVolumes = 0;
+    ok = ok && get(in, numberOfVolumes);
+    for (uint32_t i = 0; ok && i < numberOfVolumes; i++)
+    {
+        std::wstring volume;
+        JournalPosition position{};
+        ok = getString(in, volume) && get(in, position.journalId) && get(in, position.nextUsn);
+        journals[volume] = position;
+    }
+    uint64_t numberOfFiles = 0;
+    ok = ok && get(in, numberOfFiles);
+    for (uint64_t i = 0; ok && i < numberOfFiles; i++)
+    {
+        uint64_t key = 0;
+        Stamp stamp{};
+        ok = get(in, key) && get(in, stamp.size) && get(in, stamp.modified);
+        files[key] = stamp;
+    }
+    uint32_t numberOfRetries = 0;
+    ok = ok && get(in, numberOfRetries);
+    for (uint32_t i = 0; ok && i < numberOfRetries; i++)
+    {
+        std::wstring path;
+        ok = getString(in, path);
+        snapshotRetryPaths.insert(path);
+    }
+    if (!ok)
+    {
+        // a damaged snapshot is as good as none: everything is scanned again
+        files.clear();
+        snapshotRetryPaths.clear();
+        snapshotInputs.clear();
+        journals.clear();
+    }
+}
+
+bool IncrementalScan::save(const std::wstring& snapshotPath) const
+{
+    fs::path path(snapshotPath);
+    fs::path temporaryPath(snapshotPath + L".tmp");
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        put(out, SNAPSHOT_VERSION);
+        put(out, static_cast<uint32_t>(scanInputs.size()));
+        for (const auto& input : scanInputs)
+            putString(out, input);
+        put(out, static_cast<uint32_t>(newJournals.size()));
+        for (const auto& journal : newJournals)
+        {
+            putString(out, journal.first);
+            put(out, journal.second.journalId);
+            put(out, journal.second.nextUsn);
+        }
+        std::lock_guard<std::mutex> lock(filesMutex);
+        // sorted, so that the same state always gives the same file
+        std::vector<std::pair<uint64_t, Stamp>> sortedFiles(files.begin(), files.end());
+        std::sort(sortedFiles.begin(), sortedFiles.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        put(out, static_cast<uint64_t>(sortedFiles.size()));
+        for (const auto& file : sortedFiles)
+        {
+            put(out, file.first);
+            put(out, file.second.size);
+            put(out, file.second.modified);
+        }
+        put(out, static_cast<uint32_t>(retryPaths.size()));
+        for (const auto& retryPath : retryPaths)
+            putString(out, retryPath);
+        out.flush();
+        if (!out)
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(temporaryPath, path, ec);
+    return !ec;
+}
+
+bool IncrementalScan::update(const std::wstring& path)
+{
+    std::error_code ec;
+    fs::directory_entry entry(fs::path(path), ec);
+    Stamp stamp{};
+    if (!ec)
+        stamp.size = entry.file_size(ec);
+    if (!ec)
+        stamp.modified = static_cast<uint64_t>(entry.last_write_time(ec).time_since_epoch().count());
+    uint64_t key = pathKey(path);
+    std::lock_guard<std::mutex> lock(filesMutex);
+    if (ec)
+    {
+        // can't tell, so it is reported, and again next time
+        files.erase(key);
+        retryPaths.insert(absolutePath(path));
+        return true;
+    }
+    auto it = files.find(key);
+    bool changed = it == files.end() || it->second.size != stamp.size || it->second.modified != stamp.modified;
+    files[key] = stamp;
+    return changed;
+}
+
+void IncrementalScan::forget(const std::wstring& path)
+{
+    uint64_t key = pathKey(path);
+    std::wstring fullPath = absolutePath(path);
+    std::lock_guard<std::mutex> lock(filesMutex);
+    files.erase(key);
+    retryPaths.insert(fullPath);
+}
+
+void IncrementalScan::enumerateChangedFiles(const std::vector<std::wstring>& inputs, const InputFileCallback& callback)
+{
+    scanInputs.clear();
+    for (const auto& input : inputs)
+    {
+        if (!input.empty())
+            scanInputs.push_back(normalizedPath(input));
+    }
+    std::sort(scanInputs.begin(), scanInputs.end());
+    scanInputs.erase(std::unique(scanInputs.begin(), scanInputs.end()), scanInputs.end());
+    // Saved journal positions tell what changed in the directories of the scan that saved them.
+    // A directory that was not part of it has to be walked, so other inputs mean no journal at all.
+    useJournals = scanInputs == snapshotInputs;
+
+    std::vector<std::wstring> walkedInputs;
+    for (const auto& input : inputs)
+    {
+        if (input.empty())
+            continue;
+        fs::path path(input);
+        std::wstring filename = path.filename().wstring();
+        bool isPattern = filename.find_first_of(L"*?") != std::wstring::npos;
+        std::error_code ec;
+        if (!isPattern && !fs::is_directory(path, ec))
+        {
+            if (update(input))
+                callback(input, true);
+            continue;
+        }
+#ifdef _WIN32
+        std::wstring directory = !isPattern ? input : path.has_parent_path() ? path.parent_path().wstring() : L".";
+        std::vector<std::wstring> relativePaths;
+        if (journalChanges(directory, relativePaths))
+        {
+            // what the journal has, named as the walk would name it, and what failed last time
+            std::vector<std::pair<std::wstring, std::wstring>> candidates;  // path, path relative to directory
+            for (const auto& relativePath : relativePaths)
+                candidates.emplace_back((fs::path(directory) / relativePath).wstring(), relativePath);
+            for (const auto& retryPath : snapshotRetryPaths)
+            {
+                std::wstring relativePath = pathBelow(retryPath, directory);
+                if (!relativePath.empty())
+                    candidates.emplace_back(retryPath, relativePath);
+            }
+            for (const auto& candidate : candidates)
+            {
+                // a pattern only matches files right in its directory
+                const std::wstring& relativePath = candidate.second;
+                if (isPattern && (relativePath.find(L'\\') != std::wstring::npos || !matchWildcard(filename.c_str(), relativePath.c_str())))
+                    continue;
+                std::error_code typeError;
+                if (fs::is_regular_file(fs::path(candidate.first), typeError) && update(candidate.first))
+                    callback(candidate.first, false);
+            }
+            continue;
+        }
+#endif
+        walkedInputs.push_back(input);
+    }
+    enumerateInputFiles(walkedInputs, [&](const std::wstring& path, bool explicitlyNamed)
+        {
+            if (update(path))
+                callback(path, explicitlyNamed);
+        });
+}
+
+#ifdef _WIN32
+bool IncrementalScan::journalChanges(const std::wstring& directory, std::vector<std::wstring>& relativePaths)
+{
+    // the directory as the journal's file IDs resolve to it: full path, links resolved
+    HANDLE hDirectory = CreateFileW(directory.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (hDirectory == INVALID_HANDLE_VALUE)
+        return false;
+    std::wstring finalDirectory = finalPath(hDirectory);
+    CloseHandle(hDirectory);
+    wchar_t mountPoint[MAX_PATH]{};
+    wchar_t volumeName[MAX_PATH]{};
+    if (finalDirectory.empty() || !GetVolumePathNameW(finalDirectory.c_str(), mountPoint, MAX_PATH) ||
+        !GetVolumeNameForVolumeMountPointW(mountPoint, volumeName, MAX_PATH))
+        return false;
+
+    auto it = volumeChanges.find(volumeName);
+    if (it == volumeChanges.end())
+        it = volumeChanges.emplace(volumeName, readJournal(volumeName)).first;
+    if (!it->second.usable)
+        return false;
+    if (finalDirectory.back() != L'\\')
+        finalDirectory += L'\\';
+    // relative, so that a directory reached through a link, junction or subst drive names its
+    // files the same way as when it is walked
+    size_t directoryLength = finalDirectory.length();
+    for (const auto& path : it->second.paths)
+    {
+        if (path.length() > directoryLength && _wcsnicmp(path.c_str(), finalDirectory.c_str(), directoryLength) == 0)
+            relativePaths.push_back(path.substr(directoryLength));
+    }
+    return true;
+}
+
+IncrementalScan::VolumeChanges IncrementalScan::readJournal(const std::wstring& volumeName)
+{
+    VolumeChanges changes;
+    // \\?\Volume{GUID}\ names the root directory; without the backslash it is the volume.
+    // Opening it needs administrator rights; without them every directory is walked.
+    std::wstring device = volumeName;
+    if (!device.empty() && device.back() == L'\\')
+        device.pop_back();
+    HANDLE hVolume = CreateFileW(device.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (hVolume == INVALID_HANDLE_VALUE)
+        return changes;
+    USN_JOURNAL_DATA_V0 journal{};
+    DWORD bytes = 0;
+    if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL, nullptr, 0, &journal, sizeof(journal), &bytes, nullptr))
+    {
+        CloseHandle(hVolume);
+        return changes;
+    }
+    // taken before anything is read, so changes made while scanning are found next time
+    newJournals[volumeName] = { journal.UsnJournalID, journal.NextUsn };
+    auto saved = journals.find(volumeName);
+    // a recreated journal, or one that has wrapped past the saved position, has lost changes
+    if (!useJournals || saved == journals.end() || saved->second.journalId != journal.UsnJournalID ||
+        saved->second.nextUsn < journal.FirstUsn || saved->second.nextUsn > journal.NextUsn)
+    {
+        CloseHandle(hVolume);
+        return changes;
+    }
+
+    std::unordered_set<DWORDLONG> fileIds;
+    READ_USN_JOURNAL_DATA_V0 read{};
+    read.StartUsn = saved->second.nextUsn;
+    read.ReasonMask = USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_FILE_CREATE |
+        USN_REASON_RENAME_NEW_NAME | USN_REASON_HARD_LINK_CHANGE | USN_REASON_BASIC_INFO_CHANGE;
+    read.UsnJournalID = journal.UsnJournalID;
+    std::vector<DWORDLONG> buffer(64 * 1024 / sizeof(DWORDLONG));
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(buffer.data());
+    bool ok = true;
+    while (read.StartUsn < journal.NextUsn)
+    {
+        if (!DeviceIoControl(hVolume, FSCTL_READ_USN_JOURNAL, &read, sizeof(read), buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORDLONG)), &bytes, nullptr) ||
+            bytes < sizeof(USN))
+        {
+            ok = false;
+            break;
+        }
+        // the USN to continue from, then records
+        USN next = *reinterpret_cast<const USN*>(data);
+        for (DWORD offset = sizeof(USN); bytes - offset >= sizeof(USN_RECORD_V2);)
+        {
+            auto record = reinterpret_cast<const USN_RECORD_V2*>(data + offset);
+            if (record->RecordLength < sizeof(USN_RECORD_V2) || record->RecordLength > bytes - offset)
+                break;
+            if (record->MajorVersion == 2 && record->Usn < journal.NextUsn && !(record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                fileIds.insert(record->FileReferenceNumber);
+            offset += record->RecordLength;
+        }
+        if (next <= read.StartUsn)
+            break;
+        read.StartUsn = next;
+    }
+    if (ok)
+    {
+        for (auto fileId : fileIds)
+        {
+            FILE_ID_DESCRIPTOR id{};
+            id.dwSize = sizeof(id);
+            id.Type = FileIdType;
+            id.FileId.QuadPart = static_cast<LONGLONG>(fileId);
+            HANDLE hFile = OpenFileById(hVolume, &id, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, 0);
+            if (hFile == INVALID_HANDLE_VALUE)
+                continue;  // deleted since
+            std::wstring path = finalPath(hFile);
+            CloseHandle(hFile);
+            if (!path.empty())
+                changes.paths.push_back(path);
+        }
+        changes.usable = true;
+    }
+    CloseHandle(hVolume);
+    return changes;
+}
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "BatchScan.h"
+
+// Incremental batch scans: only the files of the inputs that were added or modified since the
+// previous scan with the same snapshot file are reported.
+//
+// The snapshot holds the size and last write time of every file seen so far (by a hash of its
+// full path), the inputs it was made for and, on Windows, the position of the NTFS change journal
+// (USN journal) of every volume holding a scanned directory. If the inputs are the same and a
+// volume's journal still goes back to the saved position, the candidates on that volume are read
+// from the journal and nothing is walked. Otherwise (first scan, other inputs, no journal or no
+// right to read it, other systems) the inputs are walked and the metadata of every file is
+// compared with the snapshot, which doesn't open any file either.
+//
+// Files that were forgotten or whose metadata couldn't be read are listed in the snapshot too, and
+// are reported again by the next scan even if the journal has nothing on them. Files read from the
+// journal are named below the input as given, as a walk would name them, whatever links it went
+// through.
+class IncrementalScan
+{
+public:
+    // A missing or unreadable snapshot is not an error; every file is new then.
+    void load(const std::wstring& snapshotPath);
+    // Like enumerateInputFiles, but only for files that changed. A missing explicitly named file
+    // is reported too, so the caller can tell about it.
+    void enumerateChangedFiles(const std::vector<std::wstring>& inputs, const InputFileCallback& callback);
+    // The next scan reports this file again, e.g. because it couldn't be analyzed. Thread safe.
+    void forget(const std::wstring& path);
+    // Writes a temporary file and renames it over snapshotPath, so a scan that dies half way
+    // leaves the previous snapshot in place.
+    bool save(const std::wstring& snapshotPath) const;
+
+private:
+    struct Stamp
+    {
+        uint64_t size;
+        uint64_t modified;
+    };
+    struct JournalPosition
+    {
+        uint64_t journalId;
+        int64_t nextUsn;
+    };
+    // records the current stamp of path; true if it differs from the one in the snapshot
+    bool update(const std::wstring& path);
+#ifdef _WIN32
+    // Paths relative to directory of the files below it that the journal says were touched since
+    // the saved position. false if the journal can't be used for it; the directory is walked then.
+    bool journalChanges(const std::wstring& directory, std::vector<std::wstring>& relativePaths);
+    struct VolumeChanges
+    {
+        bool usable = false;
+        std::vector<std::wstring> paths;  // of every touched file of the volume
+    };
+    VolumeChanges readJournal(const std::wstring& volumeName);
+    std::unordered_map<std::wstring, VolumeChanges> volumeChanges;  // of this scan, by volume name
+#endif
+
+    bool useJournals = false;  // the snapshot was made for the inputs of this scan
+
+    mutable std::mutex filesMutex;
+    std::unordered_map<uint64_t, Stamp> files;  // by hash of the full path
+    std::set<std::wstring> retryPaths;  // full paths to report again next time
+    std::set<std::wstring> snapshotRetryPaths;  // and those the snapshot had
+    std::vector<std::wstring> snapshotInputs;  // inputs of the scan that made the snapshot
+    std::vector<std::wstring> scanInputs;  // and of this scan
+    std::unordered_map<std::wstring, JournalPosition> journals;  // of the snapshot, by volume name
+    std::unordered_map<std::wstring, JournalPosition> newJournals;  // taken before this scan started reading
+};
@@ -0,0 +1,226 @@
+#include "JsonWriter.h"
+#include <cmath>
+#include <cstdio>
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // code point at text[i], advancing i past it; a lone surrogate can't be encoded in UTF-8
+    unsigned nextCodePoint(const std::wstring& text, size_t& i)
+    {
+        unsigned c = static_cast<unsigned>(text[i++]) & 0xffff;
+        if (c >= 0xd800 && c < 0xdc00 && i < text.length())
+        {
+            unsigned low = static_cast<unsigned>(text[i]) & 0xffff;
+            if (low >= 0xdc00 && low < 0xe000)
+            {
+                i++;
+                return 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            }
+        }
+        return c >= 0xd800 && c < 0xe000 ? 0xfffd : c;
+    }
+
+    void appendCodePoint(std::string& out, unsigned codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800)
+        {
+            out += static_cast<char>(0xc0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out += static_cast<char>(0xe0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+        else
+        {
+            out += static_cast<char>(0xf0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+    }
+}
+
+void appendUtf8(std::string& out, const std::wstring& text)
+{
+    for (size_t i = 0; i < text.length();)
+        appendCodePoint(out, nextCodePoint(text, i));
+}
+
+void JsonWriter::separate()
+{
+    if (afterKey)
+    {
+        afterKey = false;
+        return;
+    }
+    if (!first.back())
+        out += ',';
+    first.back() = false;
+}
+
+void JsonWriter::beginObject()
+{
+    separate();
+    out += '{';
+    first.push_back(true);
+}
+
+void JsonWriter::endObject()
+{
+    first.pop_back();
+    out += '}';
+}
+
+void JsonWriter::beginArray()
+{
+    separate();
+    out += '[';
+    first.push_back(true);
+}
+
+void JsonWriter::endArray()
+{
+    first.pop_back();
+    out += ']';
+}
+
+void JsonWriter::key(std::string_view name)
+{
+    // only for literals of this program, which need no escaping; names read from a file go through key(wstring)
+    separate();
+    out += '"';
+    out += name;
+    out += "\":";
+    afterKey = true;
+}
+
+void JsonWriter::key(const std::wstring& name)
+{
+    value(name);
+    out += ':';
+    afterKey = true;
+}
+
+void JsonWriter::escaped(unsigned codePoint)
+{
+    switch (codePoint)
+    {
+    case '"': out += "\\\""; return;
+    case '\\': out += "\\\\"; return;
+    case '\n': out += "\\n"; return;
+    case '\r': out += "\\r"; return;
+    case '\t': out += "\\t"; return;
+    }
+    if (codePoint < 0x20)
+    {
+        char escape[8];
+        snprintf(escape, sizeof(escape), "\\u%04x", codePoint);
+        out += escape;
+    }
+    else
+    {
+        appendCodePoint(out, codePoint);
+    }
+}
+
+void JsonWriter::value(const std::wstring& text)
+{
+    separate();
+    out += '"';
+    for (size_t i = 0; i < text.length();)
+        escaped(nextCodePoint(text, i));
+    out += '"';
+}
+
+void JsonWriter::value(std::string_view text)
+{
+    separate();
+    out += '"';
+    for (char c : text)
+        escaped(static_cast<unsigned char>(c));
+    out += '"';
+}
+
+void JsonWriter::value(unsigned long long number)
+{
+    separate();
+    char digits[24];
+    int len = snprintf(digits, sizeof(digits), "%llu", number);
+    out.append(digits, len);
+}
+
+void JsonWriter::value(double number)
+{
+    separate();
+    if (!std::isfinite(number))
+    {
+        out += "null";
+        return;
+    }
+    char digits[32];
+    int len = snprintf(digits, sizeof(digits), "%.4g", number);
+    out.append(digits, len);
+}
+
+void JsonWriter::value(bool flag)
+{
+    separate();
+    out += flag ? "true" : "false";
+}
+
+void JsonWriter::null()
+{
+    separate();
+    out += "null";
+}
+
+void BufferedOutput::write(std::string_view data)
+{
+    buffer.append(data.data(), data.size());
+    if (buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+bool BufferedOutput::flush()
+{
+    const char* p = buffer.data();
+    size_t left = buffer.size();
+    bool ok = true;
+    while (left > 0)
+    {
+#ifdef _WIN32
+        DWORD written = 0;
+        DWORD chunk = left < 0x40000000 ? static_cast<DWORD>(left) : 0x40000000;
+        if (!WriteFile(output, p, chunk, &written, nullptr) || written == 0)
+        {
+            ok = false;
+            break;
+        }
+#else
+        ssize_t written = ::write(output, p, left);
+        if (written < 0 && errno == EINTR)
+            continue;  // interrupted by a signal before anything was written
+        if (written <= 0)
+        {
+            ok = false;
+            break;
+        }
+#endif
+        p += written;
+        left -= written;
+    }
+    // on error the rest is dropped; there is nobody left to read it
+    buffer.clear();
+    return ok;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Appends text as UTF-8; a lone surrogate becomes U+FFFD
+void appendUtf8(std::string& out, const std::wstring& text);
+
+// Streaming JSON serializer that appends UTF-8 to a caller owned string.
+// Nothing is built up as an intermediate tree or wstring: every call writes its token right away,
+// and commas are tracked with one flag per open object or array. Calls must be well nested; that
+// is the caller's job, not checked here. One NDJSON record is one top-level object plus '\n'.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string& out) : out(out) {}
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    // name of the next member of the current object; a literal of this program, written unescaped
+    void key(std::string_view name);
+    // a name from the input, e.g. a version resource key: escaped like a string value
+    void key(const std::wstring& name);
+
+    // UTF-16 text, e.g. paths and resource strings
+    void value(const std::wstring& text);
+    // a wide literal would otherwise convert to bool
+    void value(const wchar_t* text) { value(std::wstring(text)); }
+    // 8-bit text from an image (DLL and function names). ASCII is written as is; other bytes
+    // are taken as Latin-1, so the output is valid UTF-8 whatever the image contains.
+    void value(std::string_view text);
+    void value(const char* text) { value(std::string_view(text)); }
+    void value(unsigned long long number);
+    void value(unsigned long number) { value(static_cast<unsigned long long>(number)); }
+    void value(unsigned number) { value(static_cast<unsigned long long>(number)); }
+    void value(unsigned short number) { value(static_cast<unsigned long long>(number)); }
+    void value(double number);
+    void value(bool flag);
+    void null();
+
+    // key(name) followed by value(v)
+    template <typename T>
+    void member(std::string_view name, const T& v)
+    {
+        key(name);
+        value(v);
+    }
+
+private:
+    void separate();
+    void escaped(unsigned codePoint);
+
+    std::string& out;
+    std::vector<bool> first{ true };  // per nesting level: nothing written at this level yet
+    bool afterKey = false;
+};
+
+// Append-only output to a file descriptor (a HANDLE on Windows) through a large buffer, so that
+// many small records cost one write system call per BUFFER_SIZE bytes. Not thread safe.
+class BufferedOutput
+{
+public:
+#ifdef _WIN32
+    explicit BufferedOutput(HANDLE output) : output(output) {}
+#else
+    explicit BufferedOutput(int output) : output(output) {}
+#endif
+    ~BufferedOutput() { flush(); }
+    BufferedOutput(const BufferedOutput&) = delete;
+    BufferedOutput& operator=(const BufferedOutput&) = delete;
+
+    void write(std::string_view data);
+    // false if a write failed, e.g. the pipe was closed
+    bool flush();
+
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+private:
+#ifdef _WIN32
+    HANDLE output;
+#else
+    int output;
+#endif
+    std::string buffer;
+};
@@ -0,0 +1,426 @@
+#include "LzxDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr unsigned POSITION_SLOTS[] = { 30, 32, 34, 36, 38, 42, 50 };  // by window size, from 2^15 to 2^21
+    constexpr unsigned NUMBER_OF_PRIMARY_LENGTHS = 7;
+    constexpr unsigned MIN_MATCH = 2;
+    constexpr unsigned PRETREE_SYMBOLS = 20;
+
+    unsigned extraBits(unsigned slot)
+    {
+        return slot < 4 ? 0 : std::min((slot - 2) / 2, 17u);
+    }
+
+    uint32_t positionBase(unsigned slot)
+    {
+        uint32_t base = 0;
+        for (unsigned i = 0; i < slot; i++)
+            base += 1u << extraBits(i);
+        return base;
+    }
+}
+
+// 16-bit little-endian words, each read from its most significant bit
+class LzxDecoder::BitReader
+{
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    // words past the end read as zeros; overrun() tells afterwards whether any was used
+    uint32_t peek(unsigned count)
+    {
+        while (bitCount < count)
+        {
+            uint64_t word = byteAt(position) | byteAt(position + 1) << 8;
+            position += 2;
+            bitBuffer |= word << (48 - bitCount);
+            bitCount += 16;
+        }
+        return count == 0 ? 0 : static_cast<uint32_t>(bitBuffer >> (64 - count));
+    }
+    void skip(unsigned count)
+    {
+        bitBuffer <<= count;
+        bitCount -= count;
+    }
+    uint32_t bits(unsigned count)
+    {
+        uint32_t value = peek(count);
+        skip(count);
+        return value;
+    }
+    // Before the bytes of an uncompressed block: 1 to 16 bits up to the end of the current word.
+    // Words follow on from wherever the previous bytes ended, so this isn't relative to the frame.
+    void startBytes()
+    {
+        unsigned padding = bitCount % 16 == 0 ? 16 : bitCount % 16;
+        peek(padding);
+        skip(padding);
+        position -= bitCount / 16 * 2;  // words read ahead
+        bitBuffer = 0;
+        bitCount = 0;
+    }
+    // after startBytes, until bits are read again
+    bool readBytes(uint8_t* out, size_t count)
+    {
+        if (count > bytesLeft())
+            return false;
+        memcpy(out, data + position, count);
+        position += count;
+        return true;
+    }
+    size_t bytesLeft() const { return size - std::min(position, size); }
+    // at the end of a frame: the rest of the current word
+    void align()
+    {
+        skip(bitCount % 16);
+    }
+    bool overrun() const { return consumedBits() > size * 8; }
+private:
+    uint64_t byteAt(size_t index) const { return index < size ? data[index] : 0; }
+    size_t consumedBits() const { return position * 8 - bitCount; }
+
+    const uint8_t* data;
+    size_t size;
+    size_t position = 0;
+    uint64_t bitBuffer = 0;  // from its most significant bit
+    unsigned bitCount = 0;
+};
+
+LzxDecoder::LzxDecoder(unsigned windowBits)
+{
+    windowBits = std::min(std::max(windowBits, MIN_WINDOW_BITS), MAX_WINDOW_BITS);
+    window.resize(size_t(1) << windowBits);
+    numberOfMainSymbols = NUMBER_OF_CHARS + POSITION_SLOTS[windowBits - MIN_WINDOW_BITS] * 8;
+}
+
+bool LzxDecoder::decodeFrame(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize)
+{
+    // only the last frame is short, so each one fits in the window where the previous one ended
+    if (outSize == 0 || outSize > FRAME_SIZE || isEnded || windowPosition + outSize > window.size())
+        return false;
+    BitReader reader(in, inSize);
+    if (isPaddingPending)
+    {
+        uint8_t padding = 0;
+        if (!reader.readBytes(&padding, 1))
+            return false;
+        isPaddingPending = false;
+    }
+    if (!isHeaderRead)
+    {
+        isHeaderRead = true;
+        if (reader.bits(1))
+        {
+            uint32_t high = reader.bits(16);
+            translationSize = static_cast<int32_t>(high << 16 | reader.bits(16));
+        }
+    }
+
+    size_t frameStart = windowPosition;
+    size_t frameEnd = frameStart + outSize;
+    while (windowPosition < frameEnd)
+    {
+        if (blockRemaining == 0 && !readBlockHeader(reader))
+            return false;
+        size_t run = std::min(blockRemaining, frameEnd - windowPosition);
+        if (blockType == BLOCK_UNCOMPRESSED)
+        {
+            if (!reader.readBytes(&window[windowPosition], run))
+                return false;
+            windowPosition += run;
+            blockRemaining -= run;
+            if (blockRemaining == 0 && blockLength % 2 != 0)
+            {
+                // the padding byte may be in the next frame's data
+                uint8_t padding = 0;
+                if (!reader.readBytes(&padding, 1))
+                    isPaddingPending = true;
+            }
+            continue;
+        }
+        size_t runStart = windowPosition;
+        if (!decodeCompressed(reader, frameStart, runStart + run))
+            return false;
+        // the last match may go on past the run, though not past the block or the frame
+        size_t decoded = windowPosition - runStart;
+        if (decoded > blockRemaining || windowPosition > frameEnd)
+            return false;
+        blockRemaining -= decoded;
+    }
+    if (reader.overrun())
+        return false;
+    if (blockType != BLOCK_UNCOMPRESSED)
+        reader.align();
+
+    memcpy(out, &window[frameStart], outSize);
+    if (isTranslationStarted && translationSize != 0 && frameIndex < 32768 && outSize > 10)
+        translateCalls(out, outSize);
+    translationPosition += outSize;
+    frameIndex++;
+    isEnded = outSize < FRAME_SIZE;
+    totalDecoded += outSize;
+    if (windowPosition == window.size())
+        windowPosition = 0;
+    return true;
+}
+
+bool LzxDecoder::readBlockHeader(BitReader& reader)
+{
+    if (reader.overrun())
+        return false;
+    uint32_t type = reader.bits(3);
+    if (type < BLOCK_VERBATIM || type > BLOCK_UNCOMPRESSED)
+        return false;
+    blockType = static_cast<BlockType>(type);
+    uint32_t high = reader.bits(16);
+    blockLength = high << 8 | reader.bits(8);
+    blockRemaining = blockLength;
+    switch (blockType)
+    {
+    case BLOCK_ALIGNED:
+        for (auto& length : alignedLengths)
+            length = static_cast<uint8_t>(reader.bits(3));
+        if (!buildTree(alignedTree, alignedLengths, 8))
+            return false;
+        [[fallthrough]];  // and the trees of a verbatim block
+    case BLOCK_VERBATIM:
+        if (!readLengths(reader, mainLengths, 0, NUMBER_OF_CHARS, sizeof(mainLengths))
+            || !readLengths(reader, mainLengths, NUMBER_OF_CHARS, numberOfMainSymbols, sizeof(mainLengths))
+            || !buildTree(mainTree, mainLengths, numberOfMainSymbols) || mainTree.isEmpty)
+            return false;
+        if (mainLengths[0xE8] != 0)
+            isTranslationStarted = true;
+        return readLengths(reader, lengthLengths, 0, NUMBER_OF_LENGTH_SYMBOLS, sizeof(lengthLengths))
+            && buildTree(lengthTree, lengthLengths, NUMBER_OF_LENGTH_SYMBOLS);
+    case BLOCK_UNCOMPRESSED:
+    {
+        isTranslationStarted = true;
+        reader.startBytes();
+        uint8_t offsets[12];
+        if (!reader.readBytes(offsets, sizeof(offsets)))
+            return false;
+        for (unsigned i = 0; i < 3; i++)
+            repeatedOffsets[i] = offsets[i * 4] | offsets[i * 4 + 1] << 8 | offsets[i * 4 + 2] << 16 | static_cast<uint32_t>(offsets[i * 4 + 3]) << 24;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool LzxDecoder::readLengths(BitReader& reader, uint8_t* lengths, unsigned first, unsigned last, unsigned tableSize)
+{
+    uint8_t pretreeLengths[PRETREE_SYMBOLS];
+    for (auto& length : pretreeLengths)
+        length = static_cast<uint8_t>(reader.bits(4));
+    Tree pretree;
+    if (!buildTree(pretree, pretreeLengths, PRETREE_SYMBOLS))
+        return false;
+    for (unsigned i = first; i < last;)
+    {
+        int symbol = decodeSymbol(reader, pretree);
+        if (symbol < 0 || reader.overrun())
+            return false;
+        unsigned repeat = 1;
+        uint8_t value = 0;
+        if (symbol == 17)
+        {
+            repeat = reader.bits(4) + 4;
+        }
+        else if (symbol == 18)
+        {
+            repeat = reader.bits(5) + 20;
+        }
+        else if (symbol == 19)
+        {
+            repeat = reader.bits(1) + 4;
+            symbol = decodeSymbol(reader, pretree);
+            if (symbol < 0 || symbol > 16)
+                return false;
+            value = static_cast<uint8_t>((lengths[i] + 17 - symbol) % 17);
+        }
+        else
+        {
+            value = static_cast<uint8_t>((lengths[i] + 17 - symbol) % 17);
+        }
+        if (i + repeat > tableSize)
+            return false;
+        for (; repeat > 0; repeat--)
+            lengths[i++] = value;
+    }
+    return true;
+}
+
+bool LzxDecoder::buildTree(Tree& tree, const uint8_t* lengths, unsigned numberOfSymbols)
+{
+    tree = Tree();
+    for (unsigned i = 0; i < numberOfSymbols; i++)
+        tree.count[lengths[i]]++;
+    tree.count[0] = 0;
+    int left = 1;
+    for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        left = (left << 1) - tree.count[length];
+        if (left < 0)
+            return false;
+        if (tree.count[length] != 0)
+            tree.isEmpty = false;
+    }
+    uint16_t offsets[MAX_CODE_LENGTH + 2]{};
+    for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+        offsets[length + 1] = offsets[length] + tree.count[length];
+    for (unsigned i = 0; i < numberOfSymbols; i++)
+    {
+        if (lengths[i] != 0)
+            tree.symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+    }
+    unsigned code = 0;
+    unsigned index = 0;
+    for (unsigned length = 1; length <= FAST_BITS; length++)
+    {
+        for (unsigned i = 0; i < tree.count[length]; i++, code++, index++)
+        {
+            unsigned entry = code << (FAST_BITS - length);
+            for (unsigned k = 0; k < (1u << (FAST_BITS - length)); k++)
+                tree.fast[entry + k] = static_cast<uint16_t>(tree.symbols[index] << 5 | length);
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+int LzxDecoder::decodeSymbol(BitReader& reader, const Tree& tree)
+{
+    uint16_t entry = tree.fast[reader.peek(FAST_BITS)];
+    if (entry != 0)
+    {
+        reader.skip(entry & 31);
+        return entry >> 5;
+    }
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        code |= static_cast<int>(reader.bits(1));
+        int numberOfCodes = tree.count[length];
+        if (code - numberOfCodes < first)
+            return tree.symbols[index + (code - first)];
+        index += numberOfCodes;
+        first = (first + numberOfCodes) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool LzxDecoder::decodeCompressed(BitReader& reader, size_t frameStart, size_t end)
+{
+    static const struct Slots
+    {
+        uint32_t base[MAX_POSITION_SLOTS];
+        uint8_t extra[MAX_POSITION_SLOTS];
+        Slots()
+        {
+            for (unsigned slot = 0; slot < MAX_POSITION_SLOTS; slot++)
+            {
+                base[slot] = positionBase(slot);
+                extra[slot] = static_cast<uint8_t>(extraBits(slot));
+            }
+        }
+    } slots;
+
+    size_t windowMask = window.size() - 1;
+    while (windowPosition < end)
+    {
+        int symbol = decodeSymbol(reader, mainTree);
+        if (symbol < 0)
+            return false;
+        if (symbol < static_cast<int>(NUMBER_OF_CHARS))
+        {
+            window[windowPosition++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        symbol -= NUMBER_OF_CHARS;
+        size_t matchLength = symbol & NUMBER_OF_PRIMARY_LENGTHS;
+        if (matchLength == NUMBER_OF_PRIMARY_LENGTHS)
+        {
+            int footer = decodeSymbol(reader, lengthTree);
+            if (footer < 0)
+                return false;
+            matchLength += footer;
+        }
+        matchLength += MIN_MATCH;
+
+        unsigned slot = static_cast<unsigned>(symbol) >> 3;
+        uint32_t offset = 0;
+        if (slot < 3)
+        {
+            // a repeated offset, which moves to the front
+            offset = repeatedOffsets[slot];
+            repeatedOffsets[slot] = repeatedOffsets[0];
+        }
+        else
+        {
+            unsigned extra = slots.extra[slot];
+            offset = slots.base[slot] - 2;
+            if (blockType == BLOCK_ALIGNED && extra >= 3)
+            {
+                // the low 3 bits come from the aligned offset tree
+                offset += reader.bits(extra - 3) << 3;
+                int aligned = decodeSymbol(reader, alignedTree);
+                if (aligned < 0)
+                    return false;
+                offset += aligned;
+            }
+            else
+            {
+                offset += reader.bits(extra);
+            }
+            repeatedOffsets[2] = repeatedOffsets[1];
+            repeatedOffsets[1] = repeatedOffsets[0];
+        }
+        repeatedOffsets[0] = offset;
+
+        // a match can't reach before the start of the stream, nor run past the window
+        if (offset == 0 || offset > totalDecoded + (windowPosition - frameStart) || offset >= window.size() || windowPosition + matchLength > window.size())
+            return false;
+        size_t from = (windowPosition - offset) & windowMask;
+        for (size_t i = 0; i < matchLength; i++)
+            window[windowPosition + i] = window[(from + i) & windowMask];
+        windowPosition += matchLength;
+    }
+    return true;
+}
+
+void LzxDecoder::translateCalls(uint8_t* data, size_t size)
+{
+    // E8 (call) operands were made absolute by the compressor, except in the last 10 bytes of a frame
+    int64_t position = static_cast<int64_t>(translationPosition);
+    int64_t fileSize = translationSize;
+    for (size_t i = 0; i < size - 10;)
+    {
+        if (data[i] != 0xE8)
+        {
+            i++;
+            position++;
+            continue;
+        }
+        uint8_t* operand = data + i + 1;
+        int32_t absolute = static_cast<int32_t>(operand[0] | operand[1] << 8 | operand[2] << 16 | static_cast<uint32_t>(operand[3]) << 24);
+        if (absolute >= -position && absolute < fileSize)
+        {
+            int64_t relative = absolute >= 0 ? absolute - position : absolute + fileSize;
+            uint32_t value = static_cast<uint32_t>(relative);
+            operand[0] = static_cast<uint8_t>(value);
+            operand[1] = static_cast<uint8_t>(value >> 8);
+            operand[2] = static_cast<uint8_t>(value >> 16);
+            operand[3] = static_cast<uint8_t>(value >> 24);
+        }
+        i += 5;
+        position += 5;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decodes the LZX data of a cabinet folder, the compression of most compressed PDBs (.pd_).
+// The folder is one LZX stream cut into 32 KB frames: each CFDATA block holds the compressed bytes
+// of one frame, which end on a 16-bit boundary, while the window, the Huffman code lengths, the
+// repeated offsets and the current block carry over from one frame to the next. Frames are decoded
+// in order by the same decoder, including the E8 call translation of x86 code.
+class LzxDecoder
+{
+public:
+    explicit LzxDecoder(unsigned windowBits);  // MIN_WINDOW_BITS to MAX_WINDOW_BITS
+
+    // Decodes the next frame into out, which receives exactly outSize bytes: FRAME_SIZE for all
+    // but the last. Returns false if the frame is malformed or follows a short one; the decoder can't
+    // be used after that.
+    bool decodeFrame(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize);
+
+    static constexpr unsigned MIN_WINDOW_BITS = 15;
+    static constexpr unsigned MAX_WINDOW_BITS = 21;
+    static constexpr size_t FRAME_SIZE = 32768;
+    static constexpr unsigned MAX_CODE_LENGTH = 16;
+    static constexpr unsigned FAST_BITS = 10;  // codes up to this length are decoded with one lookup
+private:
+    static constexpr unsigned NUMBER_OF_CHARS = 256;
+    static constexpr unsigned MAX_POSITION_SLOTS = 50;
+    static constexpr unsigned MAX_MAIN_SYMBOLS = NUMBER_OF_CHARS + MAX_POSITION_SLOTS * 8;
+    static constexpr unsigned NUMBER_OF_LENGTH_SYMBOLS = 249;
+    static constexpr unsigned LENGTHS_SAFETY = 64;  // a run of lengths may go past the end of its table
+
+    enum BlockType { BLOCK_NONE = 0, BLOCK_VERBATIM = 1, BLOCK_ALIGNED = 2, BLOCK_UNCOMPRESSED = 3 };
+
+    // canonical Huffman code, read most significant bit first
+    struct Tree
+    {
+        uint16_t count[MAX_CODE_LENGTH + 1]{};
+        uint16_t symbols[MAX_MAIN_SYMBOLS]{};
+        uint16_t fast[1 << FAST_BITS]{};  // symbol << 5 | length, 0 for a longer code
+        bool isEmpty = true;
+    };
+    class BitReader;
+
+    bool readBlockHeader(BitReader& reader);
+    // the code lengths of symbols first to last, as differences from the previous block's
+    bool readLengths(BitReader& reader, uint8_t* lengths, unsigned first, unsigned last, unsigned tableSize);
+    static bool buildTree(Tree& tree, const uint8_t* lengths, unsigned numberOfSymbols);
+    static int decodeSymbol(BitReader& reader, const Tree& tree);
+    // decodes until the window reaches end, which the last match may pass; false if it is malformed
+    bool decodeCompressed(BitReader& reader, size_t frameStart, size_t end);
+    void translateCalls(uint8_t* data, size_t size);
+
+    std::vector<uint8_t> window;
+    size_t windowPosition = 0;
+    unsigned long long totalDecoded = 0;  // before the current frame, to tell matches reaching before the stream
+    unsigned numberOfMainSymbols = 0;
+    uint32_t repeatedOffsets[3] = { 1, 1, 1 };
+
+    bool isHeaderRead = false;
+    int32_t translationSize = 0;  // E8 translation: the file size given in the stream header, 0 for none
+    bool isTranslationStarted = false;
+    unsigned long long translationPosition = 0;
+    unsigned frameIndex = 0;
+    bool isEnded = false;  // a frame shorter than FRAME_SIZE was decoded, which must be the last
+
+    BlockType blockType = BLOCK_NONE;
+    size_t blockLength = 0;
+    size_t blockRemaining = 0;
+    bool isPaddingPending = false;  // an uncompressed block of odd length ended the frame before its padding byte
+    uint8_t mainLengths[MAX_MAIN_SYMBOLS + LENGTHS_SAFETY]{};
+    uint8_t lengthLengths[NUMBER_OF_LENGTH_SYMBOLS + LENGTHS_SAFETY]{};
+    uint8_t alignedLengths[8]{};
+    Tree mainTree;
+    Tree lengthTree;
+    Tree alignedTree;
+};
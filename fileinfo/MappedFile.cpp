@@ -0,0 +1,222 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <utility>
+#ifndef _WIN32
+#include <locale>
+#include <codecvt>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+#ifdef _WIN32
+        std::swap(hFile, other.hFile);
+        std::swap(hMapping, other.hMapping);
+#else
+        std::swap(fd, other.fd);
+#endif
+        std::swap(view, other.view);
+        std::swap(viewSize, other.viewSize);
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::wstring& path)
+{
+    close();
+    hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER li{};
+    if (!GetFileSizeEx(hFile, &li) || li.QuadPart == 0 || static_cast<unsigned long long>(li.QuadPart) > SIZE_MAX)
+    {
+        // CreateFileMapping can't map an empty file
+        close();
+        return false;
+    }
+    hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!hMapping)
+    {
+        close();
+        return false;
+    }
+    view = static_cast<const unsigned char*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!view)
+    {
+        close();
+        return false;
+    }
+    viewSize = static_cast<size_t>(li.QuadPart);
+    return true;
+}
+void MappedFile::close()
+{
+    if (view)
+        UnmapViewOfFile(view);
+    if (hMapping)
+        CloseHandle(hMapping);
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    view = nullptr;
+    viewSize = 0;
+    hMapping = nullptr;
+    hFile = INVALID_HANDLE_VALUE;
+}
+
+PositionedFile::~PositionedFile()
+{
+    close();
+}
+bool PositionedFile::open(const std::wstring& path)
+{
+    close();
+    hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER li{};
+    if (!GetFileSizeEx(hFile, &li))
+    {
+        close();
+        return false;
+    }
+    fileSize = static_cast<unsigned long long>(li.QuadPart);
+    return true;
+}
+void PositionedFile::close()
+{
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+    fileSize = 0;
+}
+bool PositionedFile::read(unsigned long long offset, void* data, size_t len) const
+{
+    if (hFile == INVALID_HANDLE_VALUE || offset > fileSize || len > fileSize - offset)
+        return false;
+    auto p = static_cast<unsigned char*>(data);
+    while (len > 0)
+    {
+        // on a synchronous handle, ReadFile with an OVERLAPPED reads at its offset and waits
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(len, 1u << 30));
+        DWORD bytesRead = 0;
+        if (!ReadFile(hFile, p, chunk, &bytesRead, &overlapped) || bytesRead == 0)
+            return false;
+        p += bytesRead;
+        offset += bytesRead;
+        len -= bytesRead;
+    }
+    return true;
+}
+#else
+bool MappedFile::open(const std::wstring& path)
+{
+    close();
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    std::string utf8Path = converter.to_bytes(path);
+    fd = ::open(utf8Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || !S_ISREG(st.st_mode))
+    {
+        close();
+        return false;
+    }
+    void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    madvise(p, static_cast<size_t>(st.st_size), MADV_RANDOM);
+    view = static_cast<const unsigned char*>(p);
+    viewSize = static_cast<size_t>(st.st_size);
+    return true;
+}
+void MappedFile::close()
+{
+    if (view)
+        munmap(const_cast<unsigned char*>(view), viewSize);
+    if (fd >= 0)
+        ::close(fd);
+    view = nullptr;
+    viewSize = 0;
+    fd = -1;
+}
+
+PositionedFile::~PositionedFile()
+{
+    close();
+}
+bool PositionedFile::open(const std::wstring& path)
+{
+    close();
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    std::string utf8Path = converter.to_bytes(path);
+    fd = ::open(utf8Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close();
+        return false;
+    }
+    fileSize = static_cast<unsigned long long>(st.st_size);
+    return true;
+}
+void PositionedFile::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    fileSize = 0;
+}
+bool PositionedFile::read(unsigned long long offset, void* data, size_t len) const
+{
+    if (fd < 0 || offset > fileSize || len > fileSize - offset)
+        return false;
+    auto p = static_cast<unsigned char*>(data);
+    while (len > 0)
+    {
+        ssize_t bytesRead = pread(fd, p, len, static_cast<off_t>(offset));
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+        p += bytesRead;
+        offset += static_cast<unsigned long long>(bytesRead);
+        len -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+#endif
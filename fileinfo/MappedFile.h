@@ -0,0 +1,78 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <string>
+
+// Read-only memory-mapped view of a whole file.
+// Pages are faulted in by the OS only when they are touched, so parsing the headers of a
+// multi-GB image doesn't read (or allocate memory for) the rest of the file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::wstring& path);
+    void close();
+
+    const unsigned char* data() const { return view; }
+    size_t size() const { return viewSize; }
+    bool isOpen() const { return view != nullptr; }
+
+    // true if [offset, offset + len) lies inside the file
+    bool contains(size_t offset, size_t len) const
+    {
+        return offset <= viewSize && len <= viewSize - offset;
+    }
+    // returns nullptr if a T at offset would run past the end of the file
+    template <typename T>
+    const T* at(size_t offset, size_t count = 1) const
+    {
+        if (!view || count > viewSize / sizeof(T) || !contains(offset, sizeof(T) * count))
+            return nullptr;
+        return reinterpret_cast<const T*>(view + offset);
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    const unsigned char* view = nullptr;
+    size_t viewSize = 0;
+};
+
+// A file read piecewise with positioned reads (pread, or ReadFile at an offset), without a mapping.
+// For when only a few small pieces of a possibly huge file are needed: each piece costs one read
+// and nothing else of the file is touched. Reads don't move a file position, so any number of
+// threads can read the same file at the same time.
+class PositionedFile
+{
+public:
+    PositionedFile() = default;
+    ~PositionedFile();
+    PositionedFile(const PositionedFile&) = delete;
+    PositionedFile& operator=(const PositionedFile&) = delete;
+
+    bool open(const std::wstring& path);
+    void close();
+
+    unsigned long long size() const { return fileSize; }
+    // reads exactly len bytes at offset; false on error or if they run past the end of the file
+    bool read(unsigned long long offset, void* data, size_t len) const;
+
+private:
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    unsigned long long fileSize = 0;
+};
@@ -0,0 +1,283 @@
+#include "MszipDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr unsigned MAX_CODE_LENGTH = 15;
+    constexpr unsigned FAST_BITS = 10;  // codes up to this length are decoded with one lookup
+    constexpr unsigned MAX_LITERAL_CODES = 288;
+    constexpr unsigned MAX_DISTANCE_CODES = 30;
+
+    constexpr uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    constexpr uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+        6145, 8193, 12289, 16385, 24577 };
+    constexpr uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    // order in which the lengths of the code length code are stored
+    constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    // the bits of a deflate stream, least significant first
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+        // bytes past the end read as zeros; overrun() tells afterwards whether any was used
+        uint32_t peek(unsigned count)
+        {
+            while (bitCount < count)
+            {
+                uint64_t byte = position < size ? data[position] : 0;
+                position++;
+                bitBuffer |= byte << bitCount;
+                bitCount += 8;
+            }
+            return static_cast<uint32_t>(bitBuffer & ((1ull << count) - 1));
+        }
+        void skip(unsigned count)
+        {
+            bitBuffer >>= count;
+            bitCount -= count;
+        }
+        uint32_t bits(unsigned count)
+        {
+            uint32_t value = peek(count);
+            skip(count);
+            return value;
+        }
+        void alignToByte() { skip(bitCount % 8); }
+        // after alignToByte: whole bytes, from the bit buffer first
+        bool copyBytes(uint8_t* out, size_t count)
+        {
+            for (; count > 0 && bitCount > 0; count--)
+                *out++ = static_cast<uint8_t>(bits(8));
+            if (count > size - std::min(position, size))
+                return false;
+            memcpy(out, data + position, count);
+            position += count;
+            return true;
+        }
+        bool overrun() const { return position * 8 - bitCount > size * 8; }
+    private:
+        const uint8_t* data;
+        size_t size;
+        size_t position = 0;
+        uint64_t bitBuffer = 0;
+        unsigned bitCount = 0;
+    };
+
+    // canonical Huffman code, as deflate assigns it from the code lengths
+    struct Huffman
+    {
+        uint16_t count[MAX_CODE_LENGTH + 1]{};  // number of codes of each length
+        uint16_t symbols[MAX_LITERAL_CODES]{};  // by code
+        uint16_t fast[1 << FAST_BITS]{};  // by the next FAST_BITS bits: symbol << 4 | length, 0 for a longer code
+
+        // false if the lengths describe more codes than there are; an incomplete code is allowed
+        bool build(const uint8_t* lengths, unsigned numberOfSymbols)
+        {
+            for (unsigned i = 0; i < numberOfSymbols; i++)
+                count[lengths[i]]++;
+            count[0] = 0;
+            int left = 1;
+            for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+            {
+                left = (left << 1) - count[length];
+                if (left < 0)
+                    return false;
+            }
+            uint16_t offsets[MAX_CODE_LENGTH + 2]{};
+            for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+                offsets[length + 1] = offsets[length] + count[length];
+            for (unsigned i = 0; i < numberOfSymbols; i++)
+            {
+                if (lengths[i] != 0)
+                    symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+            }
+            // the codes are read from their first bit, which is the least significant one of the stream
+            unsigned code = 0;
+            unsigned index = 0;
+            for (unsigned length = 1; length <= FAST_BITS; length++)
+            {
+                for (unsigned i = 0; i < count[length]; i++, code++, index++)
+                {
+                    unsigned reversed = 0;
+                    for (unsigned bit = 0; bit < length; bit++)
+                        reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                    for (unsigned entry = reversed; entry < (1u << FAST_BITS); entry += 1u << length)
+                        fast[entry] = static_cast<uint16_t>(symbols[index] << 4 | length);
+                }
+                code <<= 1;
+            }
+            return true;
+        }
+
+        // -1 if the bits are no code
+        int decode(BitReader& reader) const
+        {
+            uint16_t entry = fast[reader.peek(FAST_BITS)];
+            if (entry != 0)
+            {
+                reader.skip(entry & 15);
+                return entry >> 4;
+            }
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+            {
+                code |= static_cast<int>(reader.bits(1));
+                int numberOfCodes = count[length];
+                if (code - numberOfCodes < first)
+                    return symbols[index + (code - first)];
+                index += numberOfCodes;
+                first = (first + numberOfCodes) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+    };
+
+    // the literal/length and distance codes of a block
+    bool readDynamicCodes(BitReader& reader, Huffman& literals, Huffman& distances)
+    {
+        unsigned numberOfLiterals = reader.bits(5) + 257;
+        unsigned numberOfDistances = reader.bits(5) + 1;
+        unsigned numberOfCodeLengths = reader.bits(4) + 4;
+        if (numberOfLiterals > 286 || numberOfDistances > MAX_DISTANCE_CODES)
+            return false;
+        uint8_t lengths[MAX_LITERAL_CODES + MAX_DISTANCE_CODES]{};
+        for (unsigned i = 0; i < numberOfCodeLengths; i++)
+            lengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(reader.bits(3));
+        Huffman codeLengths;
+        if (!codeLengths.build(lengths, 19))
+            return false;
+
+        memset(lengths, 0, sizeof(lengths));
+        unsigned total = numberOfLiterals + numberOfDistances;
+        for (unsigned i = 0; i < total;)
+        {
+            int symbol = codeLengths.decode(reader);
+            if (symbol < 0)
+                return false;
+            if (symbol < 16)
+            {
+                lengths[i++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            uint8_t value = 0;
+            unsigned repeat = 0;
+            if (symbol == 16)
+            {
+                if (i == 0)
+                    return false;
+                value = lengths[i - 1];
+                repeat = 3 + reader.bits(2);
+            }
+            else if (symbol == 17)
+            {
+                repeat = 3 + reader.bits(3);
+            }
+            else
+            {
+                repeat = 11 + reader.bits(7);
+            }
+            if (i + repeat > total)
+                return false;
+            for (; repeat > 0; repeat--)
+                lengths[i++] = value;
+        }
+        if (lengths[256] == 0)
+            return false;  // no end of block
+        return literals.build(lengths, numberOfLiterals) && distances.build(lengths + numberOfLiterals, numberOfDistances);
+    }
+
+    void buildFixedCodes(Huffman& literals, Huffman& distances)
+    {
+        uint8_t lengths[MAX_LITERAL_CODES];
+        std::fill(lengths, lengths + 144, static_cast<uint8_t>(8));
+        std::fill(lengths + 144, lengths + 256, static_cast<uint8_t>(9));
+        std::fill(lengths + 256, lengths + 280, static_cast<uint8_t>(7));
+        std::fill(lengths + 280, lengths + 288, static_cast<uint8_t>(8));
+        literals.build(lengths, MAX_LITERAL_CODES);
+        std::fill(lengths, lengths + MAX_DISTANCE_CODES, static_cast<uint8_t>(5));
+        distances.build(lengths, MAX_DISTANCE_CODES);
+    }
+}
+
+MszipDecoder::MszipDecoder()
+    : window(HISTORY_SIZE + MAX_BLOCK_SIZE)
+{
+}
+
+bool MszipDecoder::decodeBlock(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize)
+{
+    if (inSize < 2 || in[0] != 'C' || in[1] != 'K' || outSize > MAX_BLOCK_SIZE)
+        return false;
+    BitReader reader(in + 2, inSize - 2);
+    // the block is decoded after the history, where its matches can reach it
+    size_t position = historySize;
+    size_t end = historySize + outSize;
+    bool isLastBlock = false;
+    while (!isLastBlock)
+    {
+        isLastBlock = reader.bits(1) != 0;
+        unsigned type = reader.bits(2);
+        if (type == 0)
+        {
+            reader.alignToByte();
+            uint32_t length = reader.bits(16);
+            if ((reader.bits(16) ^ 0xFFFF) != length || length > end - position || !reader.copyBytes(&window[position], length))
+                return false;
+            position += length;
+            continue;
+        }
+        Huffman literals;
+        Huffman distances;
+        if (type == 1)
+            buildFixedCodes(literals, distances);
+        else if (type != 2 || !readDynamicCodes(reader, literals, distances))
+            return false;
+        for (;;)
+        {
+            int symbol = literals.decode(reader);
+            if (symbol < 0 || reader.overrun())
+                return false;
+            if (symbol < 256)
+            {
+                if (position == end)
+                    return false;
+                window[position++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            if (symbol == 256)
+                break;
+            symbol -= 257;
+            if (symbol >= 29)
+                return false;
+            size_t length = LENGTH_BASE[symbol] + reader.bits(LENGTH_EXTRA[symbol]);
+            int distanceSymbol = distances.decode(reader);
+            if (distanceSymbol < 0 || distanceSymbol >= 30)
+                return false;
+            size_t distance = DISTANCE_BASE[distanceSymbol] + reader.bits(DISTANCE_EXTRA[distanceSymbol]);
+            if (distance > position || length > end - position)
+                return false;
+            // byte by byte: the match may overlap the bytes it produces
+            const uint8_t* from = &window[position - distance];
+            uint8_t* to = &window[position];
+            for (size_t i = 0; i < length; i++)
+                to[i] = from[i];
+            position += length;
+        }
+    }
+    if (position != end || reader.overrun())
+        return false;
+
+    memcpy(out, &window[historySize], outSize);
+    // keep the last 32 KB at the start of the window
+    size_t keep = std::min(end, HISTORY_SIZE);
+    memmove(window.data(), &window[end - keep], keep);
+    historySize = keep;
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decodes the MSZIP data of a cabinet folder. Each CFDATA block is "CK" followed by a deflate
+// stream (RFC 1951) giving at most 32 KB, whose matches may reach back into the 32 KB before it,
+// so the blocks of a folder are decoded in order by the same decoder.
+class MszipDecoder
+{
+public:
+    MszipDecoder();
+
+    // Decodes one block into out, which receives exactly outSize bytes. Returns false if the block
+    // is malformed or doesn't decode to outSize bytes; the decoder can't be used after that.
+    bool decodeBlock(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize);
+
+    static constexpr size_t MAX_BLOCK_SIZE = 32768;
+    static constexpr size_t HISTORY_SIZE = 32768;
+private:
+    std::vector<uint8_t> window;  // the history, then the block being decoded
+    size_t historySize = 0;
+};
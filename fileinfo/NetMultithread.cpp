@@ -1,24 +1,457 @@
 #include "NetMultithread.h"
+#include <algorithm>
+#include <cerrno>
+#include <cwctype>
+#include <fstream>
+#include <vector>
+#pragma comment(lib, "WinINet.lib")
+
+const wchar_t* const NetMultithread::TEMP_FILE_SUFFIX = L".fileinfoparts";
+
+namespace
+{
+    constexpr DWORD READ_BUFFER_SIZE = 64 * 1024;
+
+    std::wstring rangeHeader(unsigned long long first, unsigned long long last)
+    {
+        return L"Range: bytes=" + std::to_wstring(first) + L"-" + std::to_wstring(last) + L"\r\n";
+    }
+    // "bytes first-last/total"; false for anything else, including an unknown total ("*")
+    bool parseContentRange(HINTERNET hRequest, unsigned long long& first, unsigned long long& last, unsigned long long& total)
+    {
+        wchar_t value[128]{};
+        DWORD dwBufLength = sizeof(value) - sizeof(wchar_t);
+        DWORD dwIndex = 0;
+        if (!HttpQueryInfoW(hRequest, HTTP_QUERY_CONTENT_RANGE, value, &dwBufLength, &dwIndex))
+            return false;
+        return swscanf_s(value, L"bytes %llu-%llu/%llu", &first, &last, &total) == 3 && first <= last && last < total;
+    }
+    // read as text: HTTP_QUERY_FLAG_NUMBER gives a DWORD, which a body of 4 GB or more overflows
+    bool parseContentLength(HINTERNET hRequest, unsigned long long& length)
+    {
+        wchar_t value[32]{};
+        DWORD dwBufLength = sizeof(value) - sizeof(wchar_t);
+        DWORD dwIndex = 0;
+        if (!HttpQueryInfoW(hRequest, HTTP_QUERY_CONTENT_LENGTH, value, &dwBufLength, &dwIndex) || !iswdigit(value[0]))
+            return false;
+        wchar_t* end = nullptr;
+        errno = 0;
+        length = _wcstoui64(value, &end, 10);
+        return *end == L'\0' && errno != ERANGE;
+    }
+    DWORD toCallbackLength(unsigned long long length)
+    {
+        // the callbacks take DWORDs, and the two largest values have a meaning of their own
+        return length < NetAsync::NO_CONTENT_LENGTH ? static_cast<DWORD>(length) : NetAsync::NO_CONTENT_LENGTH;
+    }
+}
 
 NetMultithread::NetMultithread()
+    : session(NetSession::get(NetSession::Settings()))
+{
+    init();
+}
+
+NetMultithread::NetMultithread(const wchar_t* userAgent, NetAsyncProxyType proxyType, const wchar_t* proxyServer, const wchar_t* proxyBypass,
+    unsigned numberOfParallelDownload)
+    : numberOfParallelDownload(std::max(numberOfParallelDownload, 1u))
 {
-    init(DEFAULT_USER_AGENT);
+    NetSession::Settings settings;
+    settings.userAgent = userAgent;
+    settings.proxyType = proxyType;
+    if (proxyType == NetAsyncProxyType::UserSpecified)
+    {
+        settings.proxyServer = proxyServer ? proxyServer : L"";
+        settings.proxyBypass = proxyBypass ? proxyBypass : L"";
+    }
+    session = NetSession::get(settings);
+    init();
 }
 
-NetMultithread::NetMultithread(std::wstring userAgent)
+NetMultithread::NetMultithread(std::shared_ptr<NetSession> session, unsigned numberOfParallelDownload)
+    : numberOfParallelDownload(std::max(numberOfParallelDownload, 1u)), session(std::move(session))
 {
-    init(userAgent);
+    init();
 }
 
 NetMultithread::~NetMultithread()
 {
-    for (auto i : this->vecDownloader)
+    if (downloadThread.joinable() && downloadThread.get_id() == std::this_thread::get_id())
+    {
+        // deleted by the completion callback: the thread returns right after it
+        cancelled = true;
+        downloadThread.detach();
+    }
+    cancel();
+    if (downloadThread.joinable())
+        downloadThread.join();
+}
+
+void NetMultithread::cancel()
+{
+    cancelled = true;
+    // closing the connection handle fails the requests that are waiting on the network
+    closeConnection();
+    {
+        std::lock_guard<std::mutex> lock(consumeMutex);
+    }
+    consumedCondition.notify_all();
+}
+
+void NetMultithread::fail()
+{
+    failed = true;
+    {
+        std::lock_guard<std::mutex> lock(consumeMutex);
+    }
+    consumedCondition.notify_all();
+}
+
+void NetMultithread::closeConnection()
+{
+    HINTERNET hConnection = hConnect.exchange(nullptr);
+    if (hConnection)
+        InternetCloseHandle(hConnection);
+}
+
+std::vector<NetRequestTiming> NetMultithread::timings()
+{
+    std::lock_guard<std::mutex> lock(timingsMutex);
+    std::vector<NetRequestTiming> copies;
+    for (const auto& timing : requestTimings)
+        copies.push_back(*timing);
+    return copies;
+}
+
+void NetMultithread::init()
+{
+    // WinINet keeps only a few connections per server, which would queue the chunks behind each other
+    DWORD maxConnections = 0;
+    DWORD dwBufLength = sizeof(maxConnections);
+    if (InternetQueryOptionW(nullptr, INTERNET_OPTION_MAX_CONNS_PER_SERVER, &maxConnections, &dwBufLength) && maxConnections < numberOfParallelDownload)
+    {
+        maxConnections = numberOfParallelDownload;
+        InternetSetOptionW(nullptr, INTERNET_OPTION_MAX_CONNS_PER_SERVER, &maxConnections, sizeof(maxConnections));
+        InternetSetOptionW(nullptr, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER, &maxConnections, sizeof(maxConnections));
+    }
+}
+
+bool NetMultithread::startDownload(const wchar_t* url, const wchar_t* savePath, const NetCallbacks& callbacks)
+{
+    if (!session || savedPath.length() != 0)
+    {
+        // WinINet failed, or this instance is in use
+        return false;
+    }
+    this->url = url;
+    savedPath = savePath;
+    tempFilePath = savedPath + TEMP_FILE_SUFFIX;
+    this->callbacks = callbacks;
+    // the thread waits for the assignment: the completion callback may delete the object right away
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    downloadThread = std::thread([this] { run(); });
+    return true;
+}
+
+NetMultithread::Response NetMultithread::openUrl(const std::wstring& headers)
+{
+    Response response;
+    HINTERNET hConnection = hConnect;
+    if (!hConnection || cancelled)
+        return response;
+    std::unique_ptr<NetRequestTiming> timing = std::make_unique<NetRequestTiming>();
+    response.handle = session->sendRequest(hConnection, path, isSecure, headers, *timing);
+    if (response.handle)
+    {
+        DWORD dwBufLength = sizeof(DWORD);
+        DWORD dwIndex = 0;
+        if (!HttpQueryInfoW(response.handle, HTTP_QUERY_FLAG_NUMBER | HTTP_QUERY_STATUS_CODE, &response.statusCode, &dwBufLength, &dwIndex))
+            response.statusCode = NetAsync::NO_STATUS_CODE;
+        // kept until the next download: the handle's status callbacks point to it
+        response.timing = timing.get();
+        std::lock_guard<std::mutex> lock(timingsMutex);
+        requestTimings.push_back(std::move(timing));
+    }
+    return response;
+}
+
+void NetMultithread::closeResponse(Response& response, unsigned long long size)
+{
+    if (!response.handle)
+        return;
+    NetSession::finishTiming(*response.timing, size);
+    InternetCloseHandle(response.handle);
+    response.handle = nullptr;
+}
+
+bool NetMultithread::download(const wchar_t* url, const wchar_t* savePath, DWORD& statusCode, unsigned long long& size,
+    const NetCallbacks& callbacks, const std::function<bool()>& claim, const DataCallback& consume)
+{
+    statusCode = NetAsync::NO_STATUS_CODE;
+    size = 0;
+    if (!session || cancelled || downloadThread.joinable())
+        return false;
+    this->url = url;
+    savedPath = savePath;
+    tempFilePath = savedPath + TEMP_FILE_SUFFIX;
+    this->callbacks = callbacks;
+    this->callbacks.pCompletion = nullptr;
+    this->claim = claim;
+    this->consume = consume;
+    consumedOffset = 0;
+    pendingData.clear();
+    firstStatusCode = NetAsync::NO_STATUS_CODE;
+    totalSize = UNKNOWN_SIZE;
+    numberOfChunks = 0;
+    nextChunk = 0;
+    bytesDownloaded = 0;
+    failed = false;
+    {
+        std::lock_guard<std::mutex> lock(timingsMutex);
+        requestTimings.clear();
+    }
+    bool isSuccessful = transfer(statusCode);
+    size = bytesDownloaded;
+    return isSuccessful;
+}
+
+void NetMultithread::run()
+{
+    {
+        std::lock_guard<std::mutex> lock(callbackMutex);
+    }
+    DWORD statusCode = NetAsync::NO_STATUS_CODE;
+    bool isSuccessful = transfer(statusCode);
+    if (!cancelled)
+        finish(isSuccessful, statusCode);  // the destructor isn't waiting for this thread
+}
+
+bool NetMultithread::transfer(DWORD& statusCode)
+{
+    hConnect = session->connect(url, path, isSecure);
+    if (cancelled)
+        closeConnection();  // cancel() may have come before the handle
+    bool isSuccessful = transferOnConnection(statusCode);
+    closeConnection();
+    return isSuccessful;
+}
+
+bool NetMultithread::transferOnConnection(DWORD& statusCode)
+{
+    Response first = openUrl(rangeHeader(0, chunkSize - 1));
+    unsigned long long rangeFirst = 0, rangeLast = 0, rangeTotal = 0;
+    bool isRanged = first.handle && first.statusCode == 206 && parseContentRange(first.handle, rangeFirst, rangeLast, rangeTotal)
+        && rangeFirst == 0 && rangeLast == std::min<unsigned long long>(chunkSize, rangeTotal) - 1;
+    if (first.handle && !isRanged && (first.statusCode == 206 || first.statusCode == 416))
+    {
+        // a range we can't plan with, or an empty file: ask for all of it
+        closeResponse(first, 0);
+        first = openUrl(L"");
+    }
+    if (!first.handle || first.statusCode == NetAsync::NO_STATUS_CODE || first.statusCode >= 400)
+    {
+        statusCode = first.handle ? first.statusCode : NetAsync::NO_STATUS_CODE;
+        closeResponse(first, 0);
+        return false;
+    }
+    if (claim && !claim())
+    {
+        // another download has the file
+        closeResponse(first, 0);
+        return false;
+    }
+    firstStatusCode = first.statusCode;
+
+    if (isRanged)
+    {
+        totalSize = rangeTotal;
+    }
+    else
+    {
+        unsigned long long contentLength = 0;
+        if (parseContentLength(first.handle, contentLength))
+            totalSize = contentLength;
+    }
+    if (callbacks.pContentLength)
+    {
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        callbacks.pContentLength(totalSize == UNKNOWN_SIZE ? NetAsync::NO_CONTENT_LENGTH : toCallbackLength(totalSize));
+    }
+
+    bool isSuccessful = false;
+    {
+        std::ofstream fileWriter(tempFilePath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+        if (fileWriter && isRanged && totalSize > 0)
+        {
+            // full size up front, so every chunk is written into place
+            fileWriter.seekp(static_cast<std::streamoff>(totalSize - 1));
+            fileWriter.put('\0');
+        }
+        isSuccessful = static_cast<bool>(fileWriter);
+    }
+    if (!isSuccessful)
+    {
+        closeResponse(first, 0);
+    }
+    else if (isRanged)
+    {
+        numberOfChunks = (totalSize + chunkSize - 1) / chunkSize;
+        nextChunk = 1;
+        // this thread fetches the first chunk, whose response is already here, then helps with the rest
+        std::vector<std::thread> workers;
+        unsigned numberOfWorkers = static_cast<unsigned>(std::min<unsigned long long>(numberOfParallelDownload, numberOfChunks)) - 1;
+        for (unsigned i = 0; i < numberOfWorkers; i++)
+            workers.emplace_back([this] { takeChunks(); });
+        if (!fetchChunk(0, first))
+            fail();
+        takeChunks();
+        for (auto& worker : workers)
+            worker.join();
+        isSuccessful = !failed;
+    }
+    else
+    {
+        unsigned long long received = 0;
+        isSuccessful = readBody(first.handle, 0, totalSize, received);
+        closeResponse(first, received);
+    }
+
+    if (isSuccessful && !cancelled)
+        isSuccessful = MoveFileExW(tempFilePath.c_str(), savedPath.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+    if (!isSuccessful || cancelled)
+        DeleteFileW(tempFilePath.c_str());  // it has holes, so there's nothing to resume from
+    statusCode = isSuccessful ? firstStatusCode : NetAsync::STATUS_NETASYNC_INTERRUPTED_RESPONSE;
+    return isSuccessful && !cancelled;
+}
+
+void NetMultithread::takeChunks()
+{
+    while (!failed && !cancelled)
+    {
+        unsigned long long index = nextChunk++;
+        if (index >= numberOfChunks)
+            return;
+        if (consume)
+        {
+            // what arrives ahead of the consumer is held in memory: keep it to a few chunks
+            std::unique_lock<std::mutex> lock(consumeMutex);
+            consumedCondition.wait(lock, [&] { return failed || cancelled || index * chunkSize < consumedOffset + numberOfParallelDownload * chunkSize; });
+        }
+        if (!fetchChunk(index, Response()))
+            fail();
+    }
+}
+
+bool NetMultithread::fetchChunk(unsigned long long index, Response response)
+{
+    unsigned long long first = index * chunkSize;
+    unsigned long long last = std::min(first + chunkSize, totalSize) - 1;
+    for (unsigned attempt = 0; attempt < MAX_ATTEMPTS && !failed && !cancelled; attempt++)
+    {
+        if (consume)
+        {
+            std::lock_guard<std::mutex> lock(consumeMutex);
+            pendingData.erase(first);  // held bytes of an earlier attempt
+        }
+        if (!response.handle)
+        {
+            response = openUrl(rangeHeader(first, last));
+            unsigned long long rangeFirst = 0, rangeLast = 0, rangeTotal = 0;
+            if (response.handle && (response.statusCode != 206 || !parseContentRange(response.handle, rangeFirst, rangeLast, rangeTotal)
+                || rangeFirst != first || rangeLast != last || rangeTotal != totalSize))
+            {
+                // not the bytes asked for; the file may have changed on the server
+                closeResponse(response, 0);
+            }
+            if (!response.handle)
+                continue;
+        }
+        unsigned long long received = 0;
+        bool isComplete = readBody(response.handle, first, last - first + 1, received);
+        closeResponse(response, received);
+        if (isComplete)
+            return true;
+        addProgress(-static_cast<long long>(received));  // the chunk starts over
+    }
+    closeResponse(response, 0);
+    return false;
+}
+
+bool NetMultithread::readBody(HINTERNET hRequest, unsigned long long offset, unsigned long long expected, unsigned long long& received)
+{
+    // each thread has its own stream; the chunks don't overlap
+    std::fstream fileWriter(tempFilePath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!fileWriter)
+        return false;
+    fileWriter.seekp(static_cast<std::streamoff>(offset));
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    while (!cancelled)
+    {
+        DWORD dwNumberOfBytesRead = 0;
+        if (!InternetReadFile(hRequest, buffer.data(), READ_BUFFER_SIZE, &dwNumberOfBytesRead))
+            return false;
+        if (dwNumberOfBytesRead == 0)
+            return expected == UNKNOWN_SIZE || received == expected;
+        if (expected != UNKNOWN_SIZE && dwNumberOfBytesRead > expected - received)
+            return false;
+        if (!fileWriter.write(buffer.data(), dwNumberOfBytesRead))
+            return false;
+        if (consume && !deliver(offset, offset + received, buffer.data(), dwNumberOfBytesRead))
+        {
+            fail();  // not worth another attempt
+            return false;
+        }
+        received += dwNumberOfBytesRead;
+        addProgress(dwNumberOfBytesRead);
+    }
+    return false;
+}
+
+bool NetMultithread::deliver(unsigned long long offset, unsigned long long position, const char* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(consumeMutex);
+    if (position > consumedOffset)
+    {
+        // an earlier chunk isn't in yet
+        auto& pending = pendingData[offset];
+        pending.insert(pending.end(), data, data + size);
+        return true;
+    }
+    if (position + size <= consumedOffset)
+        return true;  // consumed by an earlier attempt
+    size_t skipped = static_cast<size_t>(consumedOffset - position);
+    if (!consume(data + skipped, size - skipped))
+        return false;
+    consumedOffset = position + size;
+    // the chunks that were waiting for these bytes
+    for (auto next = pendingData.find(consumedOffset); next != pendingData.end(); next = pendingData.find(consumedOffset))
+    {
+        std::vector<char> pending = std::move(next->second);
+        pendingData.erase(next);
+        if (!consume(pending.data(), pending.size()))
+            return false;
+        consumedOffset += pending.size();
+    }
+    consumedCondition.notify_all();
+    return true;
+}
+
+void NetMultithread::addProgress(long long numberOfBytes)
+{
+    bytesDownloaded += static_cast<unsigned long long>(numberOfBytes);
+    if (callbacks.pProgress)
     {
-        delete[] i;
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        callbacks.pProgress(toCallbackLength(bytesDownloaded), totalSize == UNKNOWN_SIZE ? NetAsync::NO_CONTENT_LENGTH : toCallbackLength(totalSize));
     }
 }
 
-void NetMultithread::init(std::wstring userAgent)
+void NetMultithread::finish(bool successful, DWORD statusCode)
 {
-    this->userAgent = userAgent;
+    CompletionCallback pCompletion = callbacks.pCompletion;
+    DWORD numberOfBytesRead = toCallbackLength(bytesDownloaded);
+    DWORD contentLength = totalSize == UNKNOWN_SIZE ? NetAsync::NO_CONTENT_LENGTH : toCallbackLength(totalSize);
+    std::wstring localSavedFilePath = savedPath;
+    if (pCompletion)
+        pCompletion(successful, statusCode, numberOfBytesRead, contentLength, localSavedFilePath);
 }
@@ -1,21 +1,122 @@
 #pragma once
 #include "NetAsync.h"
+#include "NetSession.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
+
+// Downloads one file over several HTTP connections at once.
+// The file is cut into chunkSize ranges, which numberOfParallelDownload threads take in order,
+// each with its own Range request, and write into the temporary file at their offsets. The first
+// request asks for the first chunk, and its Content-Range tells whether the server serves ranges and
+// how large the file is. A server that doesn't (200 OK, or no total size) gets a single request
+// for the whole file. A chunk that fails is requested again, up to MAX_ATTEMPTS times.
+// The requests go through a NetSession, so the connections are kept alive for the next chunk and
+// for other downloads with the same settings; timings() tells where the time of each went.
+//
+// The callbacks are NetAsync's. They run on the download threads one at a time; progress is the
+// sum over all chunks. As with NetAsync, the completion callback may delete the object.
 class NetMultithread
 {
 public:
+    // the bytes of the file, in order; returning false fails the download
+    using DataCallback = std::function<bool(const char* data, size_t size)>;
+
     NetMultithread();
-    NetMultithread(std::wstring userAgent);
+    NetMultithread(const wchar_t* userAgent, NetAsyncProxyType proxyType, const wchar_t* proxyServer = nullptr, const wchar_t* proxyBypass = nullptr,
+        unsigned numberOfParallelDownload = DEFAULT_PARALLEL_DOWNLOADS);
+    // on a session from NetSession::get, which may be nullptr if it failed
+    explicit NetMultithread(std::shared_ptr<NetSession> session, unsigned numberOfParallelDownload = DEFAULT_PARALLEL_DOWNLOADS);
+    // cancels a running download; its completion callback is not called then
     ~NetMultithread();
+    NetMultithread(const NetMultithread&) = delete;
+    NetMultithread& operator=(const NetMultithread&) = delete;
 
-    bool startDownload();
+    // Returns false if this instance is in use or WinINet can't be initialized.
+    bool startDownload(const wchar_t* url, const wchar_t* savePath, const NetCallbacks& callbacks);
+    // The same download on the calling thread; the instance can be used again afterwards. statusCode
+    // is as passed to the completion callback, which isn't called; size is the number of bytes saved.
+    // claim, if any, is called once the server has answered with the file, before anything is written;
+    // returning false gives the download up, e.g. when the same file is asked from several servers.
+    // consume, if any, is also given the file as it arrives, e.g. to decompress it on the way: chunks
+    // that come in ahead of their turn are held in memory, and no chunk is requested more than
+    // numberOfParallelDownload chunks ahead of the bytes consumed. A chunk that is requested again
+    // doesn't repeat the bytes already consumed.
+    bool download(const wchar_t* url, const wchar_t* savePath, DWORD& statusCode, unsigned long long& size,
+        const NetCallbacks& callbacks = {}, const std::function<bool()>& claim = {}, const DataCallback& consume = {});
+    // Makes a download running on another thread fail as soon as possible, and any later one at once.
+    void cancel();
+    // the requests of the last download that got a response, in the order they were sent
+    std::vector<NetRequestTiming> timings();
+
+    static constexpr unsigned DEFAULT_PARALLEL_DOWNLOADS = 5;
+    static constexpr unsigned MAX_ATTEMPTS = 3;
+    // Not NetAsync's suffix: a NetAsync temporary file is a prefix of the file, which a later
+    // download resumes from, while this one has holes until every chunk is in. It is deleted on failure.
+    static const wchar_t* const TEMP_FILE_SUFFIX;
 private:
-    const wchar_t* const DEFAULT_USER_AGENT = L"C++ Download Library";
-    unsigned int numberOfParallelDownload = 5;
+    static constexpr unsigned long long UNKNOWN_SIZE = ~0ull;
+    unsigned int numberOfParallelDownload = DEFAULT_PARALLEL_DOWNLOADS;
     const unsigned long chunkSize = 5 * 1024 * 1024;  // 5 MB
 
-    std::vector<NetAsync*> vecDownloader;
-    std::wstring userAgent;
+    struct Response
+    {
+        HINTERNET handle = nullptr;
+        DWORD statusCode = NetAsync::NO_STATUS_CODE;
+        NetRequestTiming* timing = nullptr;
+    };
+
+    void init();
+    // sends a GET for the URL with these extra headers
+    Response openUrl(const std::wstring& headers);
+    // size: the bytes of the body that were read
+    void closeResponse(Response& response, unsigned long long size);
+    void closeConnection();
+    void run();  // startDownload's thread
+    bool transfer(DWORD& statusCode);  // the whole download
+    bool transferOnConnection(DWORD& statusCode);
+    // takes chunks until none is left or one has failed
+    void takeChunks();
+    // response: for the chunk, already received, or without a handle
+    bool fetchChunk(unsigned long long index, Response response);
+    // writes the body at offset; expected may be UNKNOWN_SIZE
+    bool readBody(HINTERNET hRequest, unsigned long long offset, unsigned long long expected, unsigned long long& received);
+    // passes the bytes at position, read for the chunk at offset, to consume once their turn comes
+    bool deliver(unsigned long long offset, unsigned long long position, const char* data, size_t size);
+    void fail();  // stops the other chunks, including those waiting for their turn
+    void addProgress(long long numberOfBytes);
+    // calls the completion callback, which may delete this; nothing may touch the object after it
+    void finish(bool successful, DWORD statusCode);
 
-    void init(std::wstring userAgent);
+    std::shared_ptr<NetSession> session;
+    std::atomic<HINTERNET> hConnect{ nullptr };  // of the download running; cancel() closes it
+    std::wstring url;
+    std::wstring path;  // on the server
+    bool isSecure = false;
+    std::wstring savedPath;
+    std::wstring tempFilePath;
+    NetCallbacks callbacks{};
+    std::function<bool()> claim;
+    DataCallback consume;
+    DWORD firstStatusCode = NetAsync::NO_STATUS_CODE;
+    unsigned long long totalSize = UNKNOWN_SIZE;
+    unsigned long long numberOfChunks = 0;
+    std::atomic<unsigned long long> nextChunk{ 0 };
+    std::atomic<unsigned long long> bytesDownloaded{ 0 };
+    std::atomic<bool> failed{ false };
+    std::atomic<bool> cancelled{ false };
+    std::mutex callbackMutex;  // the callbacks are called one at a time
+    std::mutex consumeMutex;
+    std::condition_variable consumedCondition;  // consumedOffset went forward, or the download failed
+    unsigned long long consumedOffset = 0;
+    std::map<unsigned long long, std::vector<char>> pendingData;  // chunk offset -> bytes received ahead of their turn
+    std::thread downloadThread;
+    std::mutex timingsMutex;
+    std::vector<std::unique_ptr<NetRequestTiming>> requestTimings;  // the status callback writes into them
 };
@@ -0,0 +1,192 @@
+#include "NetSession.h"
+#pragma comment(lib, "WinINet.lib")
+
+std::mutex NetSession::sessionsMutex;
+std::map<NetSession::Settings, std::weak_ptr<NetSession>> NetSession::sessions;
+
+namespace
+{
+    double milliseconds(NetRequestTiming::Clock::time_point from, NetRequestTiming::Clock::time_point to)
+    {
+        if (from == NetRequestTiming::Clock::time_point() || to < from)
+            return 0;
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    std::wstring toMilliseconds(double value)
+    {
+        return std::to_wstring(static_cast<long long>(value + 0.5)) + L" ms";
+    }
+}
+
+std::wstring NetRequestTiming::describe() const
+{
+    std::wstring text;
+    if (isReused)
+    {
+        text = L"kept-alive connection";
+    }
+    else
+    {
+        text = L"dns " + toMilliseconds(dns) + L", connect " + toMilliseconds(connect);
+        if (tls > 0)
+            text += L", TLS " + toMilliseconds(tls);
+    }
+    text += L", first byte " + toMilliseconds(firstByte) + L", transfer " + toMilliseconds(transfer);
+    if (isHttp2)
+        text += L", HTTP/2";
+    return text;
+}
+
+std::wstring NetRequestTiming::describe(const std::vector<NetRequestTiming>& timings)
+{
+    if (timings.empty())
+        return L"";
+    std::wstring text = timings.front().describe();
+    if (timings.size() > 1)
+    {
+        size_t numberOfReused = 0;
+        for (size_t i = 1; i < timings.size(); i++)
+        {
+            if (timings[i].isReused)
+                numberOfReused++;
+        }
+        size_t numberOfMore = timings.size() - 1;
+        text += L"; " + std::to_wstring(numberOfMore) + (numberOfMore == 1 ? L" more request, " : L" more requests, ")
+            + std::to_wstring(numberOfReused) + L" of them on kept-alive connections";
+    }
+    return text;
+}
+
+std::shared_ptr<NetSession> NetSession::get(const Settings& settings)
+{
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    std::shared_ptr<NetSession> session = sessions[settings].lock();
+    if (session)
+        return session;
+
+    // synchronous: each request blocks the thread that sends it
+    HINTERNET hSession = nullptr;
+    switch (settings.proxyType)
+    {
+    case NetAsyncProxyType::Direct:
+        hSession = InternetOpenW(settings.userAgent.c_str(), INTERNET_OPEN_TYPE_DIRECT, nullptr, nullptr, 0);
+        break;
+    case NetAsyncProxyType::UserSpecified:
+        hSession = InternetOpenW(settings.userAgent.c_str(), INTERNET_OPEN_TYPE_PROXY, settings.proxyServer.c_str(), settings.proxyBypass.c_str(), 0);
+        break;
+    case NetAsyncProxyType::System:
+    default:
+        hSession = InternetOpenW(settings.userAgent.c_str(), INTERNET_OPEN_TYPE_PRECONFIG, nullptr, nullptr, 0);
+        break;
+    }
+    if (!hSession)
+    {
+        sessions.erase(settings);
+        return nullptr;
+    }
+    // the callback only times the requests that are given a context
+    InternetSetStatusCallbackW(hSession, statusCallback);
+#ifdef INTERNET_OPTION_ENABLE_HTTP_PROTOCOL
+    if (settings.isHttp2Enabled)
+    {
+        DWORD protocols = HTTP_PROTOCOL_FLAG_HTTP2;
+        InternetSetOptionW(hSession, INTERNET_OPTION_ENABLE_HTTP_PROTOCOL, &protocols, sizeof(protocols));
+    }
+#endif
+    session.reset(new NetSession(hSession));
+    sessions[settings] = session;
+    return session;
+}
+
+NetSession::~NetSession()
+{
+    InternetSetStatusCallbackW(hSession, nullptr);
+    InternetCloseHandle(hSession);
+}
+
+HINTERNET NetSession::connect(const std::wstring& url, std::wstring& path, bool& isSecure)
+{
+    URL_COMPONENTSW components{};
+    components.dwStructSize = sizeof(components);
+    components.dwHostNameLength = static_cast<DWORD>(-1);
+    components.dwUrlPathLength = static_cast<DWORD>(-1);
+    components.dwExtraInfoLength = static_cast<DWORD>(-1);
+    if (!InternetCrackUrlW(url.c_str(), 0, 0, &components) || (components.nScheme != INTERNET_SCHEME_HTTP && components.nScheme != INTERNET_SCHEME_HTTPS)
+        || components.dwHostNameLength == 0)
+        return nullptr;
+    std::wstring hostName(components.lpszHostName, components.dwHostNameLength);
+    path.assign(components.lpszUrlPath ? components.lpszUrlPath : L"", components.dwUrlPathLength);
+    if (components.lpszExtraInfo)
+        path.append(components.lpszExtraInfo, components.dwExtraInfoLength);
+    if (path.empty())
+        path = L"/";
+    isSecure = components.nScheme == INTERNET_SCHEME_HTTPS;
+    // no network yet: WinINet connects when a request is sent, or hands it a connection it kept alive
+    return InternetConnectW(hSession, hostName.c_str(), components.nPort, nullptr, nullptr, INTERNET_SERVICE_HTTP, 0, 0);
+}
+
+HINTERNET NetSession::sendRequest(HINTERNET hConnect, const std::wstring& path, bool isSecure, const std::wstring& headers, NetRequestTiming& timing)
+{
+    DWORD flags = INTERNET_FLAG_NO_UI | INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_KEEP_CONNECTION;
+    if (isSecure)
+        flags |= INTERNET_FLAG_SECURE;
+    HINTERNET hRequest = HttpOpenRequestW(hConnect, L"GET", path.c_str(), nullptr, nullptr, nullptr, flags, reinterpret_cast<DWORD_PTR>(&timing));
+    if (!hRequest)
+        return nullptr;
+    NetRequestTiming::Clock::time_point start = NetRequestTiming::Clock::now();
+    if (!HttpSendRequestW(hRequest, headers.empty() ? nullptr : headers.c_str(), headers.empty() ? 0 : static_cast<DWORD>(-1), nullptr, 0))
+    {
+        InternetCloseHandle(hRequest);
+        return nullptr;
+    }
+    timing.received = NetRequestTiming::Clock::now();
+    if (timing.sending == NetRequestTiming::Clock::time_point())
+        timing.sending = start;
+    timing.isReused = timing.connecting == NetRequestTiming::Clock::time_point();
+    timing.dns = milliseconds(timing.resolving, timing.resolved);
+    timing.connect = milliseconds(timing.connecting, timing.connected);
+    timing.tls = isSecure ? milliseconds(timing.connected, timing.sending) : 0;
+    timing.firstByte = milliseconds(timing.sending, timing.received);
+#ifdef INTERNET_OPTION_HTTP_PROTOCOL_USED
+    DWORD protocol = 0;
+    DWORD dwBufLength = sizeof(protocol);
+    if (InternetQueryOptionW(hRequest, INTERNET_OPTION_HTTP_PROTOCOL_USED, &protocol, &dwBufLength))
+        timing.isHttp2 = (protocol & HTTP_PROTOCOL_FLAG_HTTP2) != 0;
+#endif
+    return hRequest;
+}
+
+void NetSession::finishTiming(NetRequestTiming& timing, unsigned long long size)
+{
+    timing.size = size;
+    timing.transfer = milliseconds(timing.received, NetRequestTiming::Clock::now());
+}
+
+void __stdcall NetSession::statusCallback(HINTERNET hInternet, DWORD_PTR dwContext, DWORD dwInternetStatus, LPVOID lpvStatusInformation, DWORD dwStatusInformationLength)
+{
+    // synchronous: called on the thread sending the request, so the timing needs no lock
+    NetRequestTiming* timing = reinterpret_cast<NetRequestTiming*>(dwContext);
+    if (!timing)
+        return;
+    switch (dwInternetStatus)
+    {
+    case INTERNET_STATUS_RESOLVING_NAME:
+        timing->resolving = NetRequestTiming::Clock::now();
+        break;
+    case INTERNET_STATUS_NAME_RESOLVED:
+        timing->resolved = NetRequestTiming::Clock::now();
+        break;
+    case INTERNET_STATUS_CONNECTING_TO_SERVER:
+        timing->connecting = NetRequestTiming::Clock::now();
+        break;
+    case INTERNET_STATUS_CONNECTED_TO_SERVER:
+        timing->connected = NetRequestTiming::Clock::now();
+        break;
+    case INTERNET_STATUS_SENDING_REQUEST:
+        timing->sending = NetRequestTiming::Clock::now();
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "NetAsync.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Where the time of one HTTP request went, in milliseconds.
+struct NetRequestTiming
+{
+    using Clock = std::chrono::steady_clock;
+
+    bool isReused = true;  // sent on a connection kept alive from an earlier request: no DNS, connect or TLS
+    bool isHttp2 = false;
+    double dns = 0;
+    double connect = 0;
+    double tls = 0;  // from the connection to the request being sent, which is the handshake for https
+    double firstByte = 0;  // from the request being sent to its response headers
+    double transfer = 0;  // the body, until the request was closed
+    unsigned long long size = 0;  // of the body
+
+    // e.g. "dns 3 ms, connect 21 ms, TLS 40 ms, first byte 95 ms, transfer 1210 ms"
+    std::wstring describe() const;
+    // the first request, and how many more there were and how many of them reused a connection
+    static std::wstring describe(const std::vector<NetRequestTiming>& timings);
+
+    // set by the status callback as the request goes, then turned into the durations above
+    Clock::time_point resolving, resolved, connecting, connected, sending, received;
+};
+
+// A synchronous WinINet session shared by every download with the same user agent and proxy settings.
+// WinINet keeps the connections of a session alive after a request (HTTP/1.1 keep-alive) and gives
+// them to the next request for the same server, so the downloads of a session only pay the TCP and
+// TLS handshakes once per server and connection instead of once per file. With isHttp2Enabled, HTTP/2
+// is offered where WinINet supports it (Windows 10 1809 and later): requests to a server that accepts
+// it are then multiplexed over one connection.
+//
+// A session lasts as long as someone holds it. Thread safe.
+class NetSession
+{
+public:
+    struct Settings
+    {
+        std::wstring userAgent = L"C++ Download Library";
+        NetAsyncProxyType proxyType = NetAsyncProxyType::System;
+        std::wstring proxyServer;  // UserSpecified only
+        std::wstring proxyBypass;
+        bool isHttp2Enabled = false;
+
+        bool operator<(const Settings& other) const
+        {
+            return std::tie(userAgent, proxyType, proxyServer, proxyBypass, isHttp2Enabled)
+                < std::tie(other.userAgent, other.proxyType, other.proxyServer, other.proxyBypass, other.isHttp2Enabled);
+        }
+    };
+
+    // The session with these settings, opened if nobody holds it; nullptr if WinINet can't be initialized.
+    static std::shared_ptr<NetSession> get(const Settings& settings);
+    ~NetSession();
+    NetSession(const NetSession&) = delete;
+    NetSession& operator=(const NetSession&) = delete;
+
+    // A handle for the requests of one download to the server of url, which gives its path. Closing it
+    // fails the requests opened on it, even while they wait on the network; the connections stay in
+    // the session. nullptr if url isn't http or https.
+    HINTERNET connect(const std::wstring& url, std::wstring& path, bool& isSecure);
+    // Sends a GET with these extra headers on a connect() handle and waits for the response headers.
+    // timing is filled in as it goes; it must outlive the request handle returned.
+    HINTERNET sendRequest(HINTERNET hConnect, const std::wstring& path, bool isSecure, const std::wstring& headers, NetRequestTiming& timing);
+    // Call when the request is done with, before closing it.
+    static void finishTiming(NetRequestTiming& timing, unsigned long long size);
+private:
+    explicit NetSession(HINTERNET hSession) : hSession(hSession) {}
+    static void __stdcall statusCallback(HINTERNET hInternet, DWORD_PTR dwContext, DWORD dwInternetStatus, LPVOID lpvStatusInformation, DWORD dwStatusInformationLength);
+
+    HINTERNET hSession = nullptr;
+    static std::mutex sessionsMutex;
+    static std::map<Settings, std::weak_ptr<NetSession>> sessions;
+};
@@ -0,0 +1,324 @@
+#include "PeImage.h"
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    struct undocCodeViewFormat
+    {
+        // http://www.godevtool.com/Other/pdb.htm
+        DWORD Signature;  // "RSDS"
+        GUID guid;  // 16-byte GUID12
+        DWORD age;  // incremented each time the executable and its associated pdb file is remade by the linker
+        char pdbName[1];  // zero terminated UTF8 path and file name
+    };
+
+    std::wstring guidToWstring(const GUID& guid)
+    {
+        wchar_t wsGUID[100]{};
+        if (StringFromGUID2(guid, wsGUID, sizeof(wsGUID) / sizeof(wsGUID[0])) > 0)
+        {
+            return std::wstring(wsGUID);
+        }
+        return L"";
+    }
+
+    // Linkers write the PDB path as UTF-8, older toolchains in the ANSI code page of the build machine.
+    // Invalid UTF-8 is read as ANSI, which never fails.
+    std::wstring pdbNameToWstring(const std::string& pdbName)
+    {
+        if (pdbName.empty())
+            return std::wstring();
+        UINT codePage = CP_UTF8;
+        int len = MultiByteToWideChar(codePage, MB_ERR_INVALID_CHARS, pdbName.data(), static_cast<int>(pdbName.size()), nullptr, 0);
+        if (len <= 0)
+        {
+            codePage = CP_ACP;
+            len = MultiByteToWideChar(codePage, 0, pdbName.data(), static_cast<int>(pdbName.size()), nullptr, 0);
+        }
+        std::wstring text(len > 0 ? len : 0, L'\0');
+        if (len > 0)
+            MultiByteToWideChar(codePage, 0, pdbName.data(), static_cast<int>(pdbName.size()), &text[0], len);
+        return text;
+    }
+
+    // headers that don't fit in this are not worth reading
+    constexpr unsigned long long MAX_HEADERS_SIZE = 16 * 1024 * 1024;
+    // a debug directory or CodeView record larger than this is not read from the file
+    constexpr size_t MAX_DEBUG_READ_SIZE = 64 * 1024;
+
+    // bytes from the start of the file to the end of the section table, as far as the headers in
+    // buffer tell; 0 if they don't even tell where the NT headers are
+    unsigned long long headersEnd(const std::vector<unsigned char>& buffer)
+    {
+        if (buffer.size() < sizeof(IMAGE_DOS_HEADER))
+            return 0;
+        auto dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(buffer.data());
+        if (dosHeader->e_lfanew < 0)
+            return 0;
+        unsigned long long fileHeaderOffset = static_cast<unsigned long long>(dosHeader->e_lfanew) + sizeof(DWORD);
+        if (fileHeaderOffset + sizeof(IMAGE_FILE_HEADER) > buffer.size())
+            return fileHeaderOffset + sizeof(IMAGE_FILE_HEADER) + sizeof(IMAGE_OPTIONAL_HEADER64);
+        auto fileHeader = reinterpret_cast<const IMAGE_FILE_HEADER*>(buffer.data() + fileHeaderOffset);
+        return fileHeaderOffset + sizeof(IMAGE_FILE_HEADER) + fileHeader->SizeOfOptionalHeader +
+            static_cast<unsigned long long>(fileHeader->NumberOfSections) * sizeof(IMAGE_SECTION_HEADER);
+    }
+}
+
+bool PeImage::open(const std::wstring& path)
+{
+    *this = PeImage();
+    imagePath = path;
+    if (!mapping.open(path))
+    {
+        errorMessage = L"Error: " + path + L" can't be opened.";
+        return false;
+    }
+    base = mapping.data();
+    length = mapping.size();
+    fileLength = length;
+    return parse();
+}
+
+bool PeImage::openHeaders(const std::wstring& path, std::vector<unsigned char> head)
+{
+    *this = PeImage();
+    imagePath = path;
+    onlyHeaders = true;
+    PositionedFile file;
+    if (!file.open(path))
+    {
+        errorMessage = L"Error: " + path + L" can't be opened.";
+        return false;
+    }
+    fileLength = file.size();
+    bool readOk = true;
+    if (!head.empty() && head.size() <= fileLength)
+    {
+        buffer = std::move(head);
+    }
+    else
+    {
+        buffer.resize(static_cast<size_t>(std::min<unsigned long long>(fileLength, HEADER_READ_SIZE)));
+        readOk = file.read(0, buffer.data(), buffer.size());
+    }
+    // A long DOS stub or many sections push the section table past the first read. If the NT headers
+    // themselves are past it, the second read finds out how many sections there are, and a third
+    // one gets them.
+    for (int i = 0; readOk && i < 2; i++)
+    {
+        unsigned long long end = std::min(std::min(headersEnd(buffer), fileLength), MAX_HEADERS_SIZE);
+        if (end <= buffer.size())
+            break;
+        size_t start = buffer.size();
+        buffer.resize(static_cast<size_t>(end));
+        readOk = file.read(start, buffer.data() + start, buffer.size() - start);
+    }
+    if (!readOk)
+    {
+        errorMessage = L"Error: " + path + L" can't be read.";
+        return false;
+    }
+    base = buffer.data();
+    length = buffer.size();
+    return parse(&file);
+}
+
+bool PeImage::load(std::vector<unsigned char> content, const std::wstring& name)
+{
+    *this = PeImage();
+    imagePath = name;
+    buffer = std::move(content);
+    base = buffer.data();
+    length = buffer.size();
+    fileLength = length;
+    return parse();
+}
+
+bool PeImage::fail(const std::wstring& reason)
+{
+    errorMessage = L"Error: File " + imagePath + L" is not a valid PE file: " + reason;
+    return false;
+}
+
+bool PeImage::parse(const PositionedFile* file)
+{
+    // no minimum size beyond the headers themselves: hand-made PEs of a few hundred bytes load fine
+    if (length < sizeof(IMAGE_DOS_HEADER))
+    {
+        errorMessage = L"Error: " + imagePath + L" is not a valid PE file. File is too small.";
+        return false;
+    }
+    auto dosHeader = at<IMAGE_DOS_HEADER>(0);
+    if (!dosHeader || dosHeader->e_magic != 'ZM')
+    {
+        return fail(L"does not start with \"PE\"");
+    }
+    LONG offsetToNtHeader = dosHeader->e_lfanew;
+    if (offsetToNtHeader < 0 || !at<unsigned char>(offsetToNtHeader, offsetof(IMAGE_NT_HEADERS32, OptionalHeader)))
+    {
+        return fail(L"DOS header's e_lfanew value is too large");
+    }
+    // only the signature and the file header are known to be inside the file so far
+    auto nt32Header = reinterpret_cast<const IMAGE_NT_HEADERS32*>(base + offsetToNtHeader);
+    if (nt32Header->Signature != 'EP')
+    {
+        return fail(L"Wrong PE Signature");
+    }
+    pFileHeader = &nt32Header->FileHeader;
+    const IMAGE_SECTION_HEADER* firstSection = nullptr;
+    if (pFileHeader->SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER32))
+    {
+        if (!at<IMAGE_NT_HEADERS32>(offsetToNtHeader))
+        {
+            return fail(L"optional header is truncated");
+        }
+        if (nt32Header->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+        {
+            return fail(L"OptionalHeader32.Magic is incorrect.");
+        }
+        pOptionalHeader32 = &nt32Header->OptionalHeader;
+        firstSection = reinterpret_cast<const IMAGE_SECTION_HEADER*>(nt32Header + 1);
+    }
+    else if (pFileHeader->SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER64))
+    {
+        auto nt64Header = at<IMAGE_NT_HEADERS64>(offsetToNtHeader);
+        if (!nt64Header)
+        {
+            return fail(L"optional header is truncated");
+        }
+        if (nt64Header->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+        {
+            return fail(L"OptionalHeader64.Magic is incorrect.");
+        }
+        pOptionalHeader64 = &nt64Header->OptionalHeader;
+        firstSection = reinterpret_cast<const IMAGE_SECTION_HEADER*>(nt64Header + 1);
+    }
+    else
+    {
+        return fail(L"size of optional header is incorrect");
+    }
+    parseSections(firstSection, pFileHeader->NumberOfSections);
+    parseDebugDirectory(file);
+    return true;
+}
+
+WORD PeImage::subsystem() const
+{
+    return pOptionalHeader32 ? pOptionalHeader32->Subsystem : pOptionalHeader64->Subsystem;
+}
+
+WORD PeImage::dllCharacteristics() const
+{
+    return pOptionalHeader32 ? pOptionalHeader32->DllCharacteristics : pOptionalHeader64->DllCharacteristics;
+}
+
+DWORD PeImage::sizeOfImage() const
+{
+    return pOptionalHeader32 ? pOptionalHeader32->SizeOfImage : pOptionalHeader64->SizeOfImage;
+}
+
+ULONGLONG PeImage::imageBase() const
+{
+    return pOptionalHeader32 ? pOptionalHeader32->ImageBase : pOptionalHeader64->ImageBase;
+}
+
+std::string_view PeImage::stringAt(size_t offset, size_t maxLength) const
+{
+    if (offset >= length)
+        return {};
+    const char* str = reinterpret_cast<const char*>(base + offset);
+    size_t available = std::min(length - offset, maxLength);
+    size_t len = strnlen(str, available);
+    if (len == available)
+        return {};
+    return std::string_view(str, len);
+}
+
+std::string_view PeImage::stringAtRva(DWORD rva, size_t maxLength) const
+{
+    DWORD offset = rvaToOffset(rva);
+    return offset ? stringAt(offset, maxLength) : std::string_view();
+}
+
+const IMAGE_DATA_DIRECTORY* PeImage::dataDirectory(DWORD index) const
+{
+    DWORD numberOfEntries = pOptionalHeader32 ? pOptionalHeader32->NumberOfRvaAndSizes : pOptionalHeader64->NumberOfRvaAndSizes;
+    if (index >= numberOfEntries || index >= IMAGE_NUMBEROF_DIRECTORY_ENTRIES)
+        return nullptr;
+    return pOptionalHeader32 ? &pOptionalHeader32->DataDirectory[index] : &pOptionalHeader64->DataDirectory[index];
+}
+
+bool PeImage::isDotNet() const
+{
+    auto clrHeader = dataDirectory(IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR);
+    return clrHeader && clrHeader->Size != 0;
+}
+
+void PeImage::parseSections(const IMAGE_SECTION_HEADER* firstSection, WORD numberOfSections)
+{
+    if (!numberOfSections)
+        return;
+    size_t sectionTableOffset = reinterpret_cast<const unsigned char*>(firstSection) - base;
+    if (!at<IMAGE_SECTION_HEADER>(sectionTableOffset, numberOfSections))
+        return;  // section table is truncated
+
+    if (pOptionalHeader32)
+        sectionTable.build(firstSection, numberOfSections, pOptionalHeader32->FileAlignment, pOptionalHeader32->SectionAlignment, pOptionalHeader32->SizeOfHeaders, fileLength);
+    else
+        sectionTable.build(firstSection, numberOfSections, pOptionalHeader64->FileAlignment, pOptionalHeader64->SectionAlignment, pOptionalHeader64->SizeOfHeaders, fileLength);
+}
+
+void PeImage::parseDebugDirectory(const PositionedFile* file)
+{
+    // https://github.com/dotnet/symstore/blob/master/docs/specs/SSQP_Key_Conventions.md
+    auto directory = dataDirectory(IMAGE_DIRECTORY_ENTRY_DEBUG);
+    if (!directory || directory->Size % sizeof(IMAGE_DEBUG_DIRECTORY) != 0)
+        return;
+    // bytes past those in memory are read from file, if any
+    auto fetch = [&](size_t offset, size_t len, std::vector<unsigned char>& scratch) -> const unsigned char*
+    {
+        if (auto bytes = at<unsigned char>(offset, len))
+            return bytes;
+        if (!file || len > MAX_DEBUG_READ_SIZE)
+            return nullptr;
+        scratch.resize(len);
+        return file->read(offset, scratch.data(), len) ? scratch.data() : nullptr;
+    };
+    std::vector<unsigned char> directoryBytes;
+    std::vector<unsigned char> recordBytes;
+    DWORD debugDirectoryOffset = rvaToOffset(directory->VirtualAddress, directory->Size);
+    size_t numOfDebugDirectory = directory->Size / sizeof(IMAGE_DEBUG_DIRECTORY);
+    auto pFirstDebugDirectory = reinterpret_cast<const IMAGE_DEBUG_DIRECTORY*>(fetch(debugDirectoryOffset, directory->Size, directoryBytes));
+    if (debugDirectoryOffset == 0 || !pFirstDebugDirectory)
+        return;
+    for (size_t i = 0; i < numOfDebugDirectory; i++)
+    {
+        auto curDebugDir = pFirstDebugDirectory + i;
+        if (curDebugDir->Type != IMAGE_DEBUG_TYPE_CODEVIEW)
+            continue;
+        DWORD dataLen = curDebugDir->SizeOfData;
+        DWORD dataRaw = curDebugDir->PointerToRawData;
+        if (rvaToOffset(curDebugDir->AddressOfRawData) != dataRaw || dataLen <= offsetof(undocCodeViewFormat, pdbName) ||
+            static_cast<unsigned long long>(dataRaw) + dataLen > fileLength)
+            continue;
+        // from a file, a record longer than the limit is read up to it, which leaves plenty for the name
+        size_t readLen = at<unsigned char>(dataRaw, dataLen) ? dataLen : std::min<size_t>(dataLen, MAX_DEBUG_READ_SIZE);
+        auto rsdsStruct = reinterpret_cast<const undocCodeViewFormat*>(fetch(dataRaw, readLen, recordBytes));
+        if (rsdsStruct)
+        {
+            // info is consistent
+            // pdbName is not guaranteed to be terminated inside the file
+            size_t maxNameLen = readLen - offsetof(undocCodeViewFormat, pdbName);
+            std::string pdbName(rsdsStruct->pdbName, strnlen(rsdsStruct->pdbName, maxNameLen));
+            debug.pdbGuid = guidToWstring(rsdsStruct->guid);
+            debug.pdbFile = pdbNameToWstring(pdbName);
+            debug.pdbAge = std::to_wstring(rsdsStruct->age);
+            debug.guid = rsdsStruct->guid;
+            debug.age = rsdsStruct->age;
+            wchar_t exekey[17]{};
+            swprintf_s(exekey, L"%08X%X", curDebugDir->TimeDateStamp, sizeOfImage());  // timestamp (but not size of image) must pad to 8 chars with zeros prefixed
+            debug.exeKey = exekey;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+#include "SectionTable.h"
+
+// CodeView (RSDS) record of the debug directory, i.e. what a symbol server needs to find the PDB
+struct PeDebugInfo
+{
+    std::wstring pdbGuid;
+    std::wstring pdbAge;
+    std::wstring pdbFile;
+    GUID guid{};  // pdbGuid and pdbAge as stored in the record
+    DWORD age = 0;
+    std::wstring exeKey;  // <TimeDateStamp><SizeOfImage> e.g. in `foo.exe/542d574232000/foo.exe`, 542d574232000 is exeKey
+};
+
+// The parsed headers of one PE file.
+// Everything parsed lives in the object, so any number of images can be analyzed at the same time
+// on different threads. The object owns the bytes it parses: either a read-only mapping of the file
+// (open), the headers read from the file (openHeaders) or a caller supplied buffer (load).
+class PeImage
+{
+public:
+    PeImage() = default;
+    PeImage(const PeImage&) = delete;
+    PeImage& operator=(const PeImage&) = delete;
+    PeImage(PeImage&&) = default;
+    PeImage& operator=(PeImage&&) = default;
+
+    // Both return false if the file is not a valid PE file; error() then says why.
+    bool open(const std::wstring& path);
+    bool load(std::vector<unsigned char> buffer, const std::wstring& name);
+    // Reads the DOS and NT headers and the section table with one read (two if they don't fit in the
+    // first HEADER_READ_SIZE bytes), then the debug directory and the CodeView record with one read
+    // each. The rest of the file is never touched, so the cost doesn't depend on the size of the file.
+    // data() and size() then cover the headers only, and whatever lies past them (imports, exports,
+    // resources, digests) is not available.
+    // head: the first bytes of the file if the caller has read them already, e.g. with
+    // AsyncFileReader; they are not read again.
+    bool openHeaders(const std::wstring& path, std::vector<unsigned char> head = {});
+    static constexpr size_t HEADER_READ_SIZE = 4096;
+    const std::wstring& error() const { return errorMessage; }
+
+    const std::wstring& path() const { return imagePath; }
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+    unsigned long long fileSize() const { return fileLength; }
+    bool headersOnly() const { return onlyHeaders; }
+    // returns nullptr if a T at offset would run past the end of the file
+    template <typename T>
+    const T* at(size_t offset, size_t count = 1) const
+    {
+        if (!base || count > length / sizeof(T) || offset > length || sizeof(T) * count > length - offset)
+            return nullptr;
+        return reinterpret_cast<const T*>(base + offset);
+    }
+
+    // zero terminated string at offset; empty if it is not terminated inside the file within maxLength bytes
+    std::string_view stringAt(size_t offset, size_t maxLength = 4096) const;
+    std::string_view stringAtRva(DWORD rva, size_t maxLength = 4096) const;
+
+    bool is32bit() const { return pOptionalHeader32 != nullptr; }
+    const IMAGE_FILE_HEADER& fileHeader() const { return *pFileHeader; }
+    const IMAGE_OPTIONAL_HEADER32* optionalHeader32() const { return pOptionalHeader32; }
+    const IMAGE_OPTIONAL_HEADER64* optionalHeader64() const { return pOptionalHeader64; }
+    WORD machine() const { return pFileHeader->Machine; }
+    WORD characteristics() const { return pFileHeader->Characteristics; }
+    WORD subsystem() const;
+    WORD dllCharacteristics() const;
+    DWORD sizeOfImage() const;
+    ULONGLONG imageBase() const;
+    // nullptr if the optional header has no such entry
+    const IMAGE_DATA_DIRECTORY* dataDirectory(DWORD index) const;
+    bool isDotNet() const;
+
+    const SectionTable& sections() const { return sectionTable; }
+    // file offset of rva, 0 if rva is not backed by file data
+    DWORD rvaToOffset(DWORD rva) const { return sectionTable.rvaToOffset(rva); }
+    DWORD rvaToOffset(DWORD rva, DWORD len) const { return sectionTable.rvaToOffset(rva, len); }
+
+    bool hasDebugInfo() const { return !debug.pdbGuid.empty(); }
+    const PeDebugInfo& debugInfo() const { return debug; }
+
+private:
+    // file: where to read what lies past the bytes in memory, nullptr if they are the whole file
+    bool parse(const PositionedFile* file = nullptr);
+    bool fail(const std::wstring& reason);
+    void parseSections(const IMAGE_SECTION_HEADER* firstSection, WORD numberOfSections);
+    void parseDebugDirectory(const PositionedFile* file);
+
+    std::wstring imagePath;
+    MappedFile mapping;
+    std::vector<unsigned char> buffer;
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+    unsigned long long fileLength = 0;
+    bool onlyHeaders = false;
+    std::wstring errorMessage;
+
+    const IMAGE_FILE_HEADER* pFileHeader = nullptr;
+    const IMAGE_OPTIONAL_HEADER32* pOptionalHeader32 = nullptr;
+    const IMAGE_OPTIONAL_HEADER64* pOptionalHeader64 = nullptr;
+    SectionTable sectionTable;
+    PeDebugInfo debug;
+};
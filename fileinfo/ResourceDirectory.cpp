@@ -0,0 +1,282 @@
+#include "ResourceDirectory.h"
+#include <algorithm>
+
+namespace
+{
+    // UTF-16LE string of at most maxChars characters, ending at the first 0
+    std::wstring readUtf16(const unsigned char* p, size_t maxChars)
+    {
+        std::wstring str;
+        for (size_t i = 0; i < maxChars; i++)
+        {
+            wchar_t c = static_cast<wchar_t>(p[2 * i] | (p[2 * i + 1] << 8));
+            if (c == 0)
+                break;
+            str += c;
+        }
+        return str;
+    }
+
+    size_t alignTo4(size_t offset)
+    {
+        return (offset + 3) & ~static_cast<size_t>(3);
+    }
+
+    // Header of one block of a VS_VERSIONINFO: VS_VERSIONINFO itself, StringFileInfo, StringTable,
+    // String, VarFileInfo and Var all share it. Offsets are relative to the start of the resource.
+    struct VersionBlock
+    {
+        size_t end;
+        WORD valueLength;
+        WORD type;  // 1: the value is text
+        std::wstring key;
+        size_t valueOffset;
+        size_t childrenOffset;
+    };
+
+    bool readVersionBlock(std::string_view data, size_t offset, size_t limit, VersionBlock& block)
+    {
+        auto p = reinterpret_cast<const unsigned char*>(data.data());
+        if (offset + 6 > limit)
+            return false;
+        WORD length = static_cast<WORD>(p[offset] | (p[offset + 1] << 8));
+        if (length < 6 || offset + length > limit)
+            return false;
+        block.end = offset + length;
+        block.valueLength = static_cast<WORD>(p[offset + 2] | (p[offset + 3] << 8));
+        block.type = static_cast<WORD>(p[offset + 4] | (p[offset + 5] << 8));
+        block.key = readUtf16(p + offset + 6, (block.end - offset - 6) / 2);
+        block.valueOffset = alignTo4(offset + 6 + (block.key.length() + 1) * 2);
+        size_t valueBytes = block.type == 1 ? block.valueLength * 2 : block.valueLength;
+        block.childrenOffset = alignTo4(block.valueOffset + valueBytes);
+        if (block.valueOffset > block.end)
+            block.valueOffset = block.end;
+        if (block.childrenOffset > block.end)
+            block.childrenOffset = block.end;
+        return true;
+    }
+
+    std::wstring versionToString(DWORD ms, DWORD ls)
+    {
+        return std::to_wstring(HIWORD(ms)) + L"." + std::to_wstring(LOWORD(ms)) + L"." + std::to_wstring(HIWORD(ls)) + L"." + std::to_wstring(LOWORD(ls));
+    }
+}
+
+std::wstring VersionInfo::value(const std::wstring& key) const
+{
+    for (const auto& entry : strings)
+    {
+        if (entry.first == key)
+            return entry.second;
+    }
+    return L"";
+}
+
+ResourceDirectory::ResourceDirectory(const PeImage& image) : image(image)
+{
+    auto directory = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE);
+    if (!directory || directory->VirtualAddress == 0)
+        return;
+    rootRva = directory->VirtualAddress;
+    ResourceId path[2]{};
+    std::unordered_set<DWORD> visited;
+    walk(0, 0, path, visited);
+}
+
+void ResourceDirectory::walk(DWORD directoryOffset, int level, ResourceId path[2], std::unordered_set<DWORD>& visited)
+{
+    // a directory reached twice is either a cycle or a shared subtree built to multiply the work
+    if (!visited.insert(directoryOffset).second)
+    {
+        isTruncated = true;
+        return;
+    }
+    DWORD offset = image.rvaToOffset(rootRva + directoryOffset, sizeof(IMAGE_RESOURCE_DIRECTORY));
+    auto dir = offset ? image.at<IMAGE_RESOURCE_DIRECTORY>(offset) : nullptr;
+    if (!dir)
+    {
+        isTruncated = true;
+        return;
+    }
+    DWORD numberOfEntries = static_cast<DWORD>(dir->NumberOfNamedEntries) + dir->NumberOfIdEntries;
+    auto entries = image.at<IMAGE_RESOURCE_DIRECTORY_ENTRY>(offset + sizeof(IMAGE_RESOURCE_DIRECTORY), numberOfEntries);
+    if (!entries)
+    {
+        isTruncated = true;
+        return;
+    }
+    for (DWORD i = 0; i < numberOfEntries; i++)
+    {
+        if (resourceLeaves.size() >= MAX_LEAVES)
+        {
+            isTruncated = true;
+            return;
+        }
+        const auto& entry = entries[i];
+        ResourceId id{ 0, 0 };
+        if (entry.Name & IMAGE_RESOURCE_NAME_IS_STRING)
+        {
+            DWORD nameOffset = image.rvaToOffset(rootRva + (entry.Name & ~IMAGE_RESOURCE_NAME_IS_STRING), sizeof(WORD));
+            if (!nameOffset)
+            {
+                isTruncated = true;
+                continue;
+            }
+            id.nameOffset = nameOffset;
+        }
+        else
+        {
+            id.id = static_cast<WORD>(entry.Name);
+        }
+
+        bool isDirectory = (entry.OffsetToData & IMAGE_RESOURCE_DATA_IS_DIRECTORY) != 0;
+        DWORD target = entry.OffsetToData & ~IMAGE_RESOURCE_DATA_IS_DIRECTORY;
+        if (level < 2)
+        {
+            // type and name levels hold directories
+            if (!isDirectory)
+            {
+                isTruncated = true;
+                continue;
+            }
+            path[level] = id;
+            walk(target, level + 1, path, visited);
+        }
+        else
+        {
+            // language level holds the data entries; anything deeper is not loaded by Windows either
+            DWORD dataOffset = isDirectory ? 0 : image.rvaToOffset(rootRva + target, sizeof(IMAGE_RESOURCE_DATA_ENTRY));
+            auto dataEntry = dataOffset ? image.at<IMAGE_RESOURCE_DATA_ENTRY>(dataOffset) : nullptr;
+            if (!dataEntry)
+            {
+                isTruncated = true;
+                continue;
+            }
+            resourceLeaves.push_back({ path[0], path[1], id.id, dataEntry->OffsetToData, dataEntry->Size, dataEntry->CodePage });
+        }
+    }
+}
+
+size_t ResourceDirectory::numberOfTypes() const
+{
+    // leaves are in directory order, so the leaves of one type are adjacent
+    size_t count = 0;
+    for (size_t i = 0; i < resourceLeaves.size(); i++)
+    {
+        const auto& type = resourceLeaves[i].type;
+        if (i == 0 || type.id != resourceLeaves[i - 1].type.id || type.nameOffset != resourceLeaves[i - 1].type.nameOffset)
+            count++;
+    }
+    return count;
+}
+
+std::wstring ResourceDirectory::toString(const ResourceId& id) const
+{
+    if (!id.isName())
+        return L"#" + std::to_wstring(id.id);
+    // IMAGE_RESOURCE_DIR_STRING_U: WORD length, then that many UTF-16 characters, not terminated
+    WORD length = *image.at<WORD>(id.nameOffset);
+    auto chars = image.at<unsigned char>(id.nameOffset + sizeof(WORD), length * 2u);
+    if (!chars)
+        return L"";
+    std::wstring name;
+    name.reserve(length);
+    for (WORD i = 0; i < length; i++)
+        name += static_cast<wchar_t>(chars[2 * i] | (chars[2 * i + 1] << 8));
+    return name;
+}
+
+std::string_view ResourceDirectory::data(const ResourceLeaf& leaf) const
+{
+    DWORD offset = leaf.size ? image.rvaToOffset(leaf.dataRva, leaf.size) : 0;
+    if (!offset)
+        return {};
+    return std::string_view(reinterpret_cast<const char*>(image.data() + offset), leaf.size);
+}
+
+const ResourceLeaf* ResourceDirectory::findFirst(WORD type) const
+{
+    for (const auto& leaf : resourceLeaves)
+    {
+        if (!leaf.type.isName() && leaf.type.id == type)
+            return &leaf;
+    }
+    return nullptr;
+}
+
+bool ResourceDirectory::versionInfo(VersionInfo& info) const
+{
+    info = VersionInfo();
+    const ResourceLeaf* leaf = findFirst(TYPE_VERSION);
+    if (!leaf)
+        return false;
+    std::string_view content = data(*leaf);
+    VersionBlock root;
+    if (!readVersionBlock(content, 0, content.size(), root) || root.key != L"VS_VERSION_INFO")
+        return false;
+    if (root.valueLength >= sizeof(VS_FIXEDFILEINFO) && root.valueOffset + sizeof(VS_FIXEDFILEINFO) <= root.end)
+    {
+        auto fixed = reinterpret_cast<const VS_FIXEDFILEINFO*>(content.data() + root.valueOffset);
+        if (fixed->dwSignature == 0xFEEF04BD)
+        {
+            info.fileVersion = versionToString(fixed->dwFileVersionMS, fixed->dwFileVersionLS);
+            info.productVersion = versionToString(fixed->dwProductVersionMS, fixed->dwProductVersionLS);
+        }
+    }
+    // StringFileInfo -> StringTable (one per language/code page) -> String
+    VersionBlock child;
+    for (size_t offset = root.childrenOffset; readVersionBlock(content, offset, root.end, child); offset = alignTo4(child.end))
+    {
+        if (child.key != L"StringFileInfo")
+            continue;
+        VersionBlock table;
+        if (!readVersionBlock(content, child.childrenOffset, child.end, table))
+            break;
+        VersionBlock str;
+        for (size_t strOffset = table.childrenOffset; readVersionBlock(content, strOffset, table.end, str); strOffset = alignTo4(str.end))
+        {
+            auto value = reinterpret_cast<const unsigned char*>(content.data() + str.valueOffset);
+            info.strings.emplace_back(str.key, readUtf16(value, (str.end - str.valueOffset) / 2));
+        }
+        break;
+    }
+    return true;
+}
+
+std::string_view ResourceDirectory::manifest() const
+{
+    const ResourceLeaf* leaf = findFirst(TYPE_MANIFEST);
+    return leaf ? data(*leaf) : std::string_view();
+}
+
+std::vector<std::vector<IconGroupEntry>> ResourceDirectory::iconGroups() const
+{
+    std::vector<std::vector<IconGroupEntry>> groups;
+    for (const auto& leaf : resourceLeaves)
+    {
+        if (leaf.type.isName() || leaf.type.id != TYPE_GROUP_ICON)
+            continue;
+        // GRPICONDIR: WORD reserved, WORD type, WORD count, then 14-byte GRPICONDIRENTRYs
+        std::string_view content = data(leaf);
+        auto p = reinterpret_cast<const unsigned char*>(content.data());
+        if (content.size() < 6)
+            continue;
+        size_t count = p[4] | (p[5] << 8);
+        count = std::min(count, (content.size() - 6) / 14);
+        std::vector<IconGroupEntry> group;
+        group.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char* entry = p + 6 + 14 * i;
+            IconGroupEntry icon{};
+            icon.width = entry[0] ? entry[0] : 256;
+            icon.height = entry[1] ? entry[1] : 256;
+            icon.bitCount = static_cast<WORD>(entry[6] | (entry[7] << 8));
+            icon.bytesInResource = static_cast<DWORD>(entry[8] | (entry[9] << 8) | (entry[10] << 16) | (static_cast<DWORD>(entry[11]) << 24));
+            icon.iconId = static_cast<WORD>(entry[12] | (entry[13] << 8));
+            group.push_back(icon);
+        }
+        groups.push_back(std::move(group));
+    }
+    return groups;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "PeImage.h"
+
+// Type, name or language of a resource: an integer ID or a UTF-16 string inside the image
+struct ResourceId
+{
+    WORD id;  // valid if nameOffset is 0
+    DWORD nameOffset;  // file offset of the IMAGE_RESOURCE_DIR_STRING_U, 0 for integer IDs
+    bool isName() const { return nameOffset != 0; }
+};
+
+struct ResourceLeaf
+{
+    ResourceId type;
+    ResourceId name;
+    WORD language;
+    DWORD dataRva;
+    DWORD size;
+    DWORD codePage;
+};
+
+struct VersionInfo
+{
+    std::wstring fileVersion;  // from VS_FIXEDFILEINFO, e.g. "10.0.19041.1"
+    std::wstring productVersion;
+    std::vector<std::pair<std::wstring, std::wstring>> strings;  // first StringTable, e.g. CompanyName, ProductName
+    // empty if key is not in strings
+    std::wstring value(const std::wstring& key) const;
+};
+
+struct IconGroupEntry
+{
+    unsigned width;  // in pixels; 0 in the file means 256
+    unsigned height;
+    WORD bitCount;
+    DWORD bytesInResource;
+    WORD iconId;  // name of the RT_ICON resource holding the image
+};
+
+// Resource tree of a PE image.
+// The constructor only walks the directory tables and records where every leaf is; no payload is
+// read or copied. VS_VERSIONINFO, manifests and icon groups are decoded when they are asked for.
+// The walk is bounded: every directory is visited at most once, the tree is at most three levels
+// deep as the loader expects, and at most MAX_LEAVES leaves are recorded, so cyclic or shared
+// subdirectories in a hostile sample cost no more than the directory bytes in the file.
+class ResourceDirectory
+{
+public:
+    static constexpr WORD TYPE_ICON = 3;
+    static constexpr WORD TYPE_GROUP_ICON = 14;
+    static constexpr WORD TYPE_VERSION = 16;
+    static constexpr WORD TYPE_MANIFEST = 24;
+    static constexpr size_t MAX_LEAVES = 256 * 1024;
+
+    // image must outlive the object
+    explicit ResourceDirectory(const PeImage& image);
+
+    const std::vector<ResourceLeaf>& leaves() const { return resourceLeaves; }
+    // true if the tree was cut short: out of the file, a cycle, too deep, or too many leaves
+    bool truncated() const { return isTruncated; }
+    size_t numberOfTypes() const;
+    // "#16" for integer IDs, the string itself for names
+    std::wstring toString(const ResourceId& id) const;
+    // the payload, empty if it is not inside the file
+    std::string_view data(const ResourceLeaf& leaf) const;
+    // first leaf of the given type, nullptr if there is none
+    const ResourceLeaf* findFirst(WORD type) const;
+
+    bool versionInfo(VersionInfo& info) const;
+    // the XML text of the first RT_MANIFEST resource, empty if there is none
+    std::string_view manifest() const;
+    // one vector per RT_GROUP_ICON resource
+    std::vector<std::vector<IconGroupEntry>> iconGroups() const;
+
+private:
+    void walk(DWORD directoryOffset, int level, ResourceId path[2], std::unordered_set<DWORD>& visited);
+
+    const PeImage& image;
+    DWORD rootRva = 0;
+    std::vector<ResourceLeaf> resourceLeaves;
+    bool isTruncated = false;
+};
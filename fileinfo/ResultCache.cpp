@@ -0,0 +1,372 @@
+#include "ResultCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "HashAlgorithms.h"
+#ifndef _WIN32
+#include <locale>
+#include <codecvt>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    constexpr char FILE_MAGIC[8] = { 'P', 'E', 'F', 'I', 'C', 'A', 'C', 'H' };
+    constexpr uint32_t FILE_VERSION = 1;
+    constexpr size_t FILE_HEADER_SIZE = 16;
+    constexpr uint32_t RECORD_MAGIC = 0x31444352;  // "RCD1"
+    constexpr size_t RECORD_HEADER_SIZE = 24;
+    constexpr size_t FIXED_PAYLOAD_SIZE = 8 + 4 * 8 + QUICK_DIGEST_SIZE;
+
+    uint64_t fnv1a(const void* data, size_t len)
+    {
+        auto p = static_cast<const unsigned char*>(data);
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < len; i++)
+        {
+            hash ^= p[i];
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    T load(const unsigned char* p)
+    {
+        T value;
+        memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void append(std::string& out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    size_t paddedSize(size_t len)
+    {
+        return (len + 7) & ~static_cast<size_t>(7);
+    }
+}
+
+bool quickDigest(const std::wstring& path, unsigned long long size, unsigned char digest[QUICK_DIGEST_SIZE])
+{
+    constexpr size_t PART_SIZE = 64 * 1024;
+    std::ifstream reader(std::filesystem::path(path), std::ios::binary);
+    if (!reader)
+        return false;
+    std::vector<char> buffer(PART_SIZE);
+    Sha256 sha256;
+    size_t head = static_cast<size_t>(size < PART_SIZE ? size : PART_SIZE);
+    if (!reader.read(buffer.data(), head))
+        return false;
+    sha256.update(buffer.data(), head);
+    if (size > PART_SIZE)
+    {
+        size_t tail = static_cast<size_t>(size - PART_SIZE < PART_SIZE ? size - PART_SIZE : PART_SIZE);
+        reader.seekg(static_cast<std::streamoff>(size - tail));
+        if (!reader.read(buffer.data(), tail))
+            return false;
+        sha256.update(buffer.data(), tail);
+    }
+    sha256.final(digest);
+    return true;
+}
+
+#ifdef _WIN32
+bool readFileStamp(const std::wstring& path, FileStamp& stamp)
+{
+    // opened for its attributes only, which doesn't need read access or touch the data
+    HANDLE hFile = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    BY_HANDLE_FILE_INFORMATION info{};
+    bool ok = GetFileInformationByHandle(hFile, &info) != FALSE;
+    CloseHandle(hFile);
+    if (!ok)
+        return false;
+    stamp.size = (static_cast<unsigned long long>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    stamp.modified = (static_cast<unsigned long long>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    stamp.fileId = (static_cast<unsigned long long>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    stamp.volume = info.dwVolumeSerialNumber;
+    return true;
+}
+
+bool ResultCache::open(const std::wstring& path)
+{
+    close();
+    // FILE_APPEND_DATA without FILE_WRITE_DATA: every write goes to the end of the file.
+    // Read access is only there because LockFileEx wants it.
+    hFile = CreateFileW(path.c_str(), FILE_READ_DATA | FILE_APPEND_DATA | FILE_READ_ATTRIBUTES | SYNCHRONIZE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    std::string header(FILE_MAGIC, sizeof(FILE_MAGIC));
+    append(header, FILE_VERSION);
+    append(header, uint32_t(0));
+    // only the first scanner to take the lock writes the header
+    if (!appendLocked(header, true))
+    {
+        close();
+        return false;
+    }
+    mapping.open(path);
+    if (!mapping.isOpen() || mapping.size() < FILE_HEADER_SIZE || memcmp(mapping.data(), header.data(), FILE_HEADER_SIZE) != 0)
+    {
+        close();
+        return false;
+    }
+    indexRecords();
+    return true;
+}
+
+void ResultCache::close()
+{
+    mapping.close();
+    index.clear();
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+}
+
+bool ResultCache::appendLocked(const std::string& data, bool onlyIfEmpty)
+{
+    // The lock is on a byte far past the end of the file, so it never blocks reading the records.
+    OVERLAPPED lockRange{};
+    lockRange.Offset = 0xfffffff0;
+    lockRange.OffsetHigh = 0x7fffffff;
+    if (!LockFileEx(hFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &lockRange))
+        return false;
+    bool ok = true;
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(hFile, &size))
+        ok = false;
+    std::string toWrite;
+    if (ok && onlyIfEmpty)
+    {
+        if (size.QuadPart == 0)
+            toWrite = data;
+    }
+    else if (ok)
+    {
+        // a scanner that crashed in the middle of a write can leave the end unaligned
+        toWrite.assign(static_cast<size_t>(paddedSize(static_cast<size_t>(size.QuadPart)) - size.QuadPart), '\0');
+        toWrite += data;
+    }
+    const char* p = toWrite.data();
+    size_t left = toWrite.size();
+    while (ok && left > 0)
+    {
+        DWORD written = 0;
+        DWORD chunk = left < 0x40000000 ? static_cast<DWORD>(left) : 0x40000000;
+        if (!WriteFile(hFile, p, chunk, &written, nullptr) || written == 0)
+            ok = false;
+        p += written;
+        left -= written;
+    }
+    UnlockFileEx(hFile, 0, 1, 0, &lockRange);
+    return ok;
+}
+#else
+bool readFileStamp(const std::wstring& path, FileStamp& stamp)
+{
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    struct stat st {};
+    if (stat(converter.to_bytes(path).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    stamp.size = static_cast<unsigned long long>(st.st_size);
+    stamp.modified = static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+    stamp.fileId = st.st_ino;
+    stamp.volume = st.st_dev;
+    return true;
+}
+
+bool ResultCache::open(const std::wstring& path)
+{
+    close();
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    // O_APPEND: every write goes to the end of the file
+    fd = ::open(converter.to_bytes(path).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    std::string header(FILE_MAGIC, sizeof(FILE_MAGIC));
+    append(header, FILE_VERSION);
+    append(header, uint32_t(0));
+    // only the first scanner to take the lock writes the header
+    if (!appendLocked(header, true))
+    {
+        close();
+        return false;
+    }
+    mapping.open(path);
+    if (!mapping.isOpen() || mapping.size() < FILE_HEADER_SIZE || memcmp(mapping.data(), header.data(), FILE_HEADER_SIZE) != 0)
+    {
+        close();
+        return false;
+    }
+    indexRecords();
+    return true;
+}
+
+void ResultCache::close()
+{
+    mapping.close();
+    index.clear();
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+bool ResultCache::appendLocked(const std::string& data, bool onlyIfEmpty)
+{
+    if (flock(fd, LOCK_EX) != 0)
+        return false;
+    bool ok = true;
+    struct stat st {};
+    if (fstat(fd, &st) != 0)
+        ok = false;
+    std::string toWrite;
+    if (ok && onlyIfEmpty)
+    {
+        if (st.st_size == 0)
+            toWrite = data;
+    }
+    else if (ok)
+    {
+        // a scanner that crashed in the middle of a write can leave the end unaligned
+        toWrite.assign(paddedSize(static_cast<size_t>(st.st_size)) - static_cast<size_t>(st.st_size), '\0');
+        toWrite += data;
+    }
+    const char* p = toWrite.data();
+    size_t left = toWrite.size();
+    while (ok && left > 0)
+    {
+        ssize_t written = ::write(fd, p, left);
+        if (written <= 0)
+        {
+            ok = false;
+            break;
+        }
+        p += written;
+        left -= written;
+    }
+    flock(fd, LOCK_UN);
+    return ok;
+}
+#endif
+
+ResultCache::~ResultCache()
+{
+    flush();
+    close();
+}
+
+void ResultCache::indexRecords()
+{
+    const unsigned char* base = mapping.data();
+    size_t end = mapping.size();
+    size_t offset = FILE_HEADER_SIZE;
+    bool resynchronizing = false;
+    while (end - offset >= RECORD_HEADER_SIZE)
+    {
+        const unsigned char* record = base + offset;
+        uint32_t length = load<uint32_t>(record + 4);
+        bool valid = load<uint32_t>(record) == RECORD_MAGIC && length >= FIXED_PAYLOAD_SIZE && length <= end - offset - RECORD_HEADER_SIZE;
+        size_t next = offset + paddedSize(RECORD_HEADER_SIZE + length);
+        // A record cut short by a crash is followed by the records of the next scanner to append,
+        // and its length would skip them. So the length is only taken on trust if a record or the
+        // end of the file follows; otherwise, and after damage, where anything that looks like a
+        // header could be inside a payload, the checksum decides. Opening stays cheap that way.
+        bool isFollowed = next == end || (next + 4 <= end && load<uint32_t>(base + next) == RECORD_MAGIC);
+        if (valid && (resynchronizing || !isFollowed))
+            valid = fnv1a(record + RECORD_HEADER_SIZE, length) == load<uint64_t>(record + 16);
+        if (!valid)
+        {
+            resynchronizing = true;
+            offset += 8;
+            continue;
+        }
+        resynchronizing = false;
+        index[load<uint64_t>(record + 8)] = offset;
+        offset = next;
+        if (offset > end)
+            break;
+    }
+}
+
+bool ResultCache::lookup(std::string_view key, const FileStamp& stamp, const unsigned char* digest, std::string& value) const
+{
+    auto it = index.find(fnv1a(key.data(), key.size()));
+    if (it == index.end())
+        return false;
+    const unsigned char* record = mapping.data() + it->second;
+    uint32_t length = load<uint32_t>(record + 4);
+    const unsigned char* payload = record + RECORD_HEADER_SIZE;
+    uint32_t keyLength = load<uint32_t>(payload);
+    if (keyLength > length - FIXED_PAYLOAD_SIZE || keyLength != key.size() ||
+        memcmp(payload + FIXED_PAYLOAD_SIZE, key.data(), keyLength) != 0)
+        return false;
+    if (load<uint64_t>(payload + 8) != stamp.size || load<uint64_t>(payload + 16) != stamp.modified ||
+        load<uint64_t>(payload + 24) != stamp.fileId || load<uint64_t>(payload + 32) != stamp.volume)
+        return false;
+    if (digest && (!load<uint32_t>(payload + 4) || memcmp(payload + 40, digest, QUICK_DIGEST_SIZE) != 0))
+        return false;
+    if (fnv1a(payload, length) != load<uint64_t>(record + 16))
+        return false;
+    value.assign(reinterpret_cast<const char*>(payload) + FIXED_PAYLOAD_SIZE + keyLength, length - FIXED_PAYLOAD_SIZE - keyLength);
+    return true;
+}
+
+void ResultCache::store(std::string_view key, const FileStamp& stamp, const unsigned char* digest, std::string_view value)
+{
+    std::string payload;
+    payload.reserve(FIXED_PAYLOAD_SIZE + key.size() + value.size());
+    append(payload, static_cast<uint32_t>(key.size()));
+    append(payload, uint32_t(digest ? 1 : 0));
+    append(payload, static_cast<uint64_t>(stamp.size));
+    append(payload, static_cast<uint64_t>(stamp.modified));
+    append(payload, static_cast<uint64_t>(stamp.fileId));
+    append(payload, static_cast<uint64_t>(stamp.volume));
+    if (digest)
+        payload.append(reinterpret_cast<const char*>(digest), QUICK_DIGEST_SIZE);
+    else
+        payload.append(QUICK_DIGEST_SIZE, '\0');
+    payload += key;
+    payload += value;
+    if (payload.size() > UINT32_MAX)
+        return;
+
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    append(pending, RECORD_MAGIC);
+    append(pending, static_cast<uint32_t>(payload.size()));
+    append(pending, fnv1a(key.data(), key.size()));
+    append(pending, fnv1a(payload.data(), payload.size()));
+    pending += payload;
+    pending.append(paddedSize(pending.size()) - pending.size(), '\0');
+    if (pending.size() >= FLUSH_SIZE)
+    {
+        appendLocked(pending, false);
+        pending.clear();
+    }
+}
+
+bool ResultCache::flush()
+{
+    std::lock_guard<std::mutex> lock(pendingMutex);
+#ifdef _WIN32
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+#else
+    if (fd < 0)
+        return false;
+#endif
+    bool ok = pending.empty() || appendLocked(pending, false);
+    pending.clear();
+    return ok;
+}
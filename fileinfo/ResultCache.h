@@ -0,0 +1,80 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "MappedFile.h"
+
+// Identity and modification stamp of a file. A file whose stamp is unchanged is taken as unchanged.
+struct FileStamp
+{
+    unsigned long long size = 0;
+    unsigned long long modified = 0;  // last write time: FILETIME on Windows, nanoseconds since 1970 elsewhere
+    unsigned long long fileId = 0;  // NTFS file index, or inode
+    unsigned long long volume = 0;  // volume serial number, or device
+};
+
+// Reads the stamp of a file from its metadata; the contents are not touched.
+bool readFileStamp(const std::wstring& path, FileStamp& stamp);
+
+// SHA256 of the first and the last 64 KB of a file of the given size, to check a cache hit against
+// the contents at a fraction of the cost of hashing the whole file.
+constexpr size_t QUICK_DIGEST_SIZE = 32;
+bool quickDigest(const std::wstring& path, unsigned long long size, unsigned char digest[QUICK_DIGEST_SIZE]);
+
+// Analysis results of files, in a single append-only file shared by any number of scanners.
+//
+// The file is mapped when it is opened and indexed by key; lookups read from the mapping, so a hit
+// costs a hash table probe and a checksum of the entry. Entries stored while scanning are buffered
+// and appended in batches under an exclusive file lock, each batch with one write. Nothing is ever
+// overwritten: a newer entry for the same key hides the older ones.
+//
+//   file   = "PEFICACH" version:u32 reserved:u32 record*
+//   record = "RCD1" length:u32 keyHash:u64 checksum:u64 payload[length] zero padding to 8 bytes
+//   payload = keyLength:u32 hasDigest:u32 size:u64 modified:u64 fileId:u64 volume:u64 digest[32] key value
+//
+// checksum is FNV-1a of the payload. A record cut short by a crash, or damaged, fails its checksum
+// and is skipped, and the scan of the file resynchronizes on the next valid record, so a crashed
+// scanner costs at most the entries it hadn't written yet.
+class ResultCache
+{
+public:
+    ResultCache() = default;
+    ~ResultCache();
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Creates the file if needed. False if it can't be opened or is not a cache file.
+    bool open(const std::wstring& path);
+    // key says what was computed for which file, e.g. options and path.
+    // Returns false unless the latest entry for key has the same stamp and, if digest is not
+    // nullptr, the same quick digest. Thread safe.
+    bool lookup(std::string_view key, const FileStamp& stamp, const unsigned char* digest, std::string& value) const;
+    // digest may be nullptr. Thread safe; the entry is visible to scanners that open the file later.
+    void store(std::string_view key, const FileStamp& stamp, const unsigned char* digest, std::string_view value);
+    // writes buffered entries; false if that failed
+    bool flush();
+    // number of keys found when the file was opened
+    size_t size() const { return index.size(); }
+
+    static constexpr size_t FLUSH_SIZE = 1024 * 1024;
+private:
+    void close();
+    // writes data at the end of the file under the file lock; onlyIfEmpty: unless the file has data
+    bool appendLocked(const std::string& data, bool onlyIfEmpty);
+    void indexRecords();
+
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    MappedFile mapping;
+    std::unordered_map<uint64_t, size_t> index;  // key hash -> offset of its latest record in the mapping
+    std::mutex pendingMutex;
+    std::string pending;  // records not written yet
+};
@@ -0,0 +1,131 @@
+#include "SectionTable.h"
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+    // The loader ignores the low 9 bits of PointerToRawData, unless the image uses an alignment
+    // below 512 ("low alignment" images, where file and section alignment are equal).
+    constexpr DWORD HARDCODED_FILE_ALIGNMENT = 0x200;
+
+    unsigned long long alignUp(unsigned long long value, DWORD alignment)
+    {
+        if (alignment == 0)
+            return value;
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+SectionTable::SectionTable(const SectionTable& other)
+{
+    *this = other;
+}
+
+SectionTable& SectionTable::operator=(const SectionTable& other)
+{
+    virtualAddresses = other.virtualAddresses;
+    virtualEnds = other.virtualEnds;
+    rawOffsets = other.rawOffsets;
+    rawSizes = other.rawSizes;
+    sectionCharacteristics = other.sectionCharacteristics;
+    names = other.names;
+    headersSize = other.headersSize;
+    lastHit = 0;
+    return *this;
+}
+
+void SectionTable::clear()
+{
+    *this = SectionTable();
+}
+
+void SectionTable::build(const IMAGE_SECTION_HEADER* headers, WORD numberOfSections, DWORD fileAlignment, DWORD sectionAlignment,
+    DWORD sizeOfHeaders, size_t fileSize)
+{
+    clear();
+    headersSize = static_cast<DWORD>(std::min<unsigned long long>(sizeOfHeaders, fileSize));
+
+    std::vector<WORD> order(numberOfSections);
+    std::iota(order.begin(), order.end(), static_cast<WORD>(0));
+    std::stable_sort(order.begin(), order.end(), [&](WORD a, WORD b) { return headers[a].VirtualAddress < headers[b].VirtualAddress; });
+
+    virtualAddresses.reserve(numberOfSections);
+    virtualEnds.reserve(numberOfSections);
+    rawOffsets.reserve(numberOfSections);
+    rawSizes.reserve(numberOfSections);
+    sectionCharacteristics.reserve(numberOfSections);
+    names.reserve(numberOfSections);
+    for (WORD index : order)
+    {
+        const IMAGE_SECTION_HEADER& header = headers[index];
+        DWORD va = header.VirtualAddress;
+        // a VirtualSize of 0 means SizeOfRawData, as some linkers leave it unset
+        unsigned long long virtualSize = header.Misc.VirtualSize ? header.Misc.VirtualSize : header.SizeOfRawData;
+        unsigned long long virtualEnd = std::min<unsigned long long>(va + alignUp(virtualSize, sectionAlignment), MAXDWORD);
+
+        unsigned long long rawOffset = header.PointerToRawData;
+        if (fileAlignment >= HARDCODED_FILE_ALIGNMENT)
+            rawOffset = rawOffset / HARDCODED_FILE_ALIGNMENT * HARDCODED_FILE_ALIGNMENT;
+        // The loader reads SizeOfRawData rounded up to FileAlignment, but never more than the section
+        // occupies in memory; the rest of the section is zero filled. Data past the end of the file
+        // doesn't exist either.
+        unsigned long long rawSize = std::min(alignUp(header.SizeOfRawData, fileAlignment), alignUp(virtualSize, sectionAlignment));
+        if (rawOffset >= fileSize)
+            rawSize = 0;
+        else
+            rawSize = std::min<unsigned long long>(rawSize, fileSize - rawOffset);
+
+        virtualAddresses.push_back(va);
+        virtualEnds.push_back(static_cast<DWORD>(virtualEnd));
+        rawOffsets.push_back(static_cast<DWORD>(rawSize ? rawOffset : 0));
+        rawSizes.push_back(static_cast<DWORD>(rawSize));
+        sectionCharacteristics.push_back(header.Characteristics);
+        const char* name = reinterpret_cast<const char*>(header.Name);
+        names.emplace_back(name, std::find(name, name + IMAGE_SIZEOF_SHORT_NAME, '\0'));
+    }
+}
+
+int SectionTable::find(DWORD rva) const
+{
+    size_t hint = lastHit.load(std::memory_order_relaxed);
+    if (hint < virtualAddresses.size() && rva >= virtualAddresses[hint] && rva < virtualEnds[hint])
+        return static_cast<int>(hint);
+
+    // last section that starts at or before rva; branchless, since RVAs from a parser are hard to predict
+    size_t count = virtualAddresses.size();
+    if (count == 0 || rva < virtualAddresses[0])
+        return -1;
+    const DWORD* first = virtualAddresses.data();
+    while (count > 1)
+    {
+        size_t half = count / 2;
+        first = (first[half] <= rva) ? first + half : first;
+        count -= half;
+    }
+    size_t i = first - virtualAddresses.data();
+    if (rva >= virtualEnds[i])
+        return -1;
+    if (i != hint)
+        lastHit.store(i, std::memory_order_relaxed);
+    return static_cast<int>(i);
+}
+
+DWORD SectionTable::rvaToOffset(DWORD rva) const
+{
+    return rvaToOffset(rva, 1);
+}
+
+DWORD SectionTable::rvaToOffset(DWORD rva, DWORD len) const
+{
+    int i = find(rva);
+    if (i < 0)
+    {
+        if (rva < headersSize && len <= headersSize - rva && (virtualAddresses.empty() || rva < virtualAddresses[0]))
+            return rva;
+        return 0;
+    }
+    DWORD delta = rva - virtualAddresses[i];
+    if (delta >= rawSizes[i] || len > rawSizes[i] - delta)
+        return 0;
+    return rawOffsets[i] + delta;
+}
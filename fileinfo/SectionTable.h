@@ -0,0 +1,51 @@
+#pragma once
+#include <Windows.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Section table of a PE image, indexed for RVA lookups.
+// Sections are sorted by VirtualAddress when the table is built and kept as parallel arrays, so a
+// lookup is a binary search over one contiguous array of VAs. The section of the previous lookup is
+// tried first, which catches most lookups since parsers tend to walk one directory at a time.
+// Index i refers to the i-th section in VA order, not in header order.
+class SectionTable
+{
+public:
+    SectionTable() = default;
+    SectionTable(const SectionTable& other);
+    SectionTable& operator=(const SectionTable& other);
+
+    // sizeOfHeaders: RVAs below it map to the same file offset, as the loader maps the headers 1:1
+    void build(const IMAGE_SECTION_HEADER* headers, WORD numberOfSections, DWORD fileAlignment, DWORD sectionAlignment,
+        DWORD sizeOfHeaders, size_t fileSize);
+    void clear();
+
+    size_t size() const { return virtualAddresses.size(); }
+    bool empty() const { return virtualAddresses.empty(); }
+    DWORD virtualAddress(size_t i) const { return virtualAddresses[i]; }
+    DWORD virtualSize(size_t i) const { return virtualEnds[i] - virtualAddresses[i]; }  // in memory, aligned to SectionAlignment
+    DWORD rawOffset(size_t i) const { return rawOffsets[i]; }  // PointerToRawData as the loader rounds it
+    DWORD rawSize(size_t i) const { return rawSizes[i]; }  // bytes of the section that are backed by the file
+    DWORD characteristics(size_t i) const { return sectionCharacteristics[i]; }
+    const std::string& name(size_t i) const { return names[i]; }
+
+    // index of the section that contains rva, -1 if none
+    int find(DWORD rva) const;
+    // File offset of rva, 0 if rva is not backed by file data: outside every section, or in the
+    // part of a section past SizeOfRawData that the loader fills with zeros.
+    DWORD rvaToOffset(DWORD rva) const;
+    // like rvaToOffset, but also checks that len bytes from rva are backed by the file
+    DWORD rvaToOffset(DWORD rva, DWORD len) const;
+
+private:
+    std::vector<DWORD> virtualAddresses;  // sorted
+    std::vector<DWORD> virtualEnds;
+    std::vector<DWORD> rawOffsets;
+    std::vector<DWORD> rawSizes;
+    std::vector<DWORD> sectionCharacteristics;
+    std::vector<std::string> names;
+    DWORD headersSize = 0;
+    // only a hint, so concurrent lookups on a shared image may overwrite each other freely
+    mutable std::atomic<size_t> lastHit{ 0 };
+};
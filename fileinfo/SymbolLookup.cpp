@@ -0,0 +1,350 @@
+#include "SymbolLookup.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cwchar>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include "JsonWriter.h"
+
+namespace fs = std::filesystem;
+
+const wchar_t* const SymbolLookup::NEGATIVE_CACHE_FILE_NAME = L"missing-pdbs.fileinfo";
+
+namespace
+{
+    constexpr char NEGATIVE_CACHE_MAGIC[8] = { 'P', 'E', 'F', 'I', 'M', 'I', 'S', 'S' };
+    constexpr uint32_t NEGATIVE_CACHE_VERSION = 1;
+
+    // UTF-8, with every byte but the unreserved characters of RFC 3986 as %XX
+    std::wstring percentEncoded(const std::wstring& text)
+    {
+        std::string utf8;
+        appendUtf8(utf8, text);
+        std::wstring encoded;
+        for (unsigned char c : utf8)
+        {
+            if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~')
+            {
+                encoded += static_cast<wchar_t>(c);
+            }
+            else
+            {
+                encoded += L'%';
+                encoded += L"0123456789ABCDEF"[c >> 4];
+                encoded += L"0123456789ABCDEF"[c & 15];
+            }
+        }
+        return encoded;
+    }
+
+    uint64_t secondsSinceEpoch()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    template <typename T>
+    void put(std::ostream& out, T value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool get(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    // code units are stored as 32-bit values, so the file doesn't depend on sizeof(wchar_t)
+    void putString(std::ostream& out, const std::wstring& text)
+    {
+        put(out, static_cast<uint32_t>(text.size()));
+        for (wchar_t c : text)
+            put(out, static_cast<uint32_t>(c));
+    }
+
+    bool getString(std::istream& in, std::wstring& text)
+    {
+        uint32_t length = 0;
+        if (!get(in, length) || length > 32768)
+            return false;
+        text.resize(length);
+        for (auto& c : text)
+        {
+            uint32_t unit = 0;
+            if (!get(in, unit))
+                return false;
+            c = static_cast<wchar_t>(unit);
+        }
+        return true;
+    }
+}
+
+SymbolLookup::SymbolLookup(const Options& options)
+    : options(options)
+{
+    NetSession::Settings settings;
+    settings.userAgent = L"PDB Symbol Downloader";
+    settings.proxyType = options.proxyType;
+    if (options.proxyType == NetAsyncProxyType::UserSpecified)
+    {
+        settings.proxyServer = options.proxyServer;
+        settings.proxyBypass = options.proxyBypass;
+    }
+    settings.isHttp2Enabled = options.isHttp2Enabled;
+    session = NetSession::get(settings);
+    load();
+}
+
+SymbolLookup::~SymbolLookup()
+{
+    save();
+}
+
+SymbolLookup::Result SymbolLookup::fetch(const std::wstring& name, const std::wstring& key, const std::wstring& directory, const NetCallbacks& callbacks)
+{
+    Result result;
+    if (!isValidFileName(name))
+        return result;
+    std::wstring compressedName = name;
+    compressedName.back() = L'_';
+
+    struct Candidate
+    {
+        size_t server = 0;
+        std::wstring url;
+        std::wstring savePath;
+        std::unique_ptr<NetMultithread> downloader;
+        std::unique_ptr<CabExtractor> extractor;  // for a .pd_ to be expanded
+        bool isSaved = false;
+        DWORD statusCode = NetAsync::NO_STATUS_CODE;
+        unsigned long long size = 0;
+    };
+    std::vector<Candidate> candidates;
+    uint64_t now = secondsSinceEpoch();
+    for (size_t server = 0; server < options.servers.size(); server++)
+    {
+        if (isKnownMissing(missKey(options.servers[server], name, key), now))
+            continue;
+        for (const auto& fileName : { name, compressedName })
+        {
+            Candidate candidate;
+            candidate.server = server;
+            candidate.url = serverUrl(options.servers[server], name, key, fileName != name);
+            candidate.savePath = (fs::path(directory) / fileName).wstring();
+            candidate.downloader = std::make_unique<NetMultithread>(session, options.numberOfConnections);
+            if (options.expandCompressed && fileName != name)
+                candidate.extractor = std::make_unique<CabExtractor>((fs::path(directory) / name).wstring());
+            candidates.push_back(std::move(candidate));
+        }
+    }
+    if (candidates.empty())
+    {
+        result.statusCode = 404;
+        result.isKnownMissing = true;
+        return result;
+    }
+
+    // the first to be answered with the file cancels the others, before they write anything. The
+    // other form on the same server isn't cancelled: it is answered about as soon, and a 404 then
+    // leaves its connection alive for the next request, while cancelling it would close it.
+    std::atomic<size_t> winner{ candidates.size() };
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        threads.emplace_back([&, i]()
+            {
+                Candidate& candidate = candidates[i];
+                NetMultithread::DataCallback consume;
+                if (candidate.extractor)
+                {
+                    // a cabinet that doesn't extract still leaves the .pd_
+                    consume = [&candidate](const char* data, size_t size)
+                        {
+                            candidate.extractor->write(data, size);
+                            return true;
+                        };
+                }
+                candidate.isSaved = candidate.downloader->download(candidate.url.c_str(), candidate.savePath.c_str(), candidate.statusCode, candidate.size, callbacks, [&, i]()
+                    {
+                        size_t none = candidates.size();
+                        if (!winner.compare_exchange_strong(none, i))
+                            return false;
+                        for (size_t j = 0; j < candidates.size(); j++)
+                        {
+                            if (candidates[j].server != candidates[i].server)
+                                candidates[j].downloader->cancel();
+                        }
+                        return true;
+                    }, consume);
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    {
+        // a server is missing the PDB only if it said so for both forms
+        std::lock_guard<std::mutex> lock(missesMutex);
+        for (size_t i = 0; i + 1 < candidates.size(); i += 2)
+        {
+            std::wstring serverMissKey = missKey(options.servers[candidates[i].server], name, key);
+            if (candidates[i].statusCode == 404 && candidates[i + 1].statusCode == 404)
+                misses[serverMissKey] = now;
+            else if (misses.erase(serverMissKey) == 0)
+                continue;
+            missesChanged = true;
+        }
+    }
+
+    if (winner < candidates.size())
+    {
+        const Candidate& candidate = candidates[winner];
+        result.found = candidate.isSaved;
+        result.statusCode = candidate.statusCode;
+        result.size = candidate.size;
+        result.savedPath = candidate.savePath;
+        result.url = candidate.url;
+        result.timings = candidate.downloader->timings();
+        if (candidate.isSaved && candidate.extractor)
+        {
+            if (candidate.extractor->finish())
+                result.expandedPath = (fs::path(directory) / name).wstring();
+            else
+                result.expandError = candidate.extractor->error();
+        }
+        return result;
+    }
+    // no server had it: 404, or the first other error in server order
+    result.statusCode = 404;
+    for (const auto& candidate : candidates)
+    {
+        if (candidate.statusCode != 404)
+        {
+            result.statusCode = candidate.statusCode;
+            break;
+        }
+    }
+    return result;
+}
+
+void SymbolLookup::load()
+{
+    if (options.negativeCachePath.empty())
+        return;
+    std::ifstream in(fs::path(options.negativeCachePath), std::ios::binary);
+    char magic[sizeof(NEGATIVE_CACHE_MAGIC)]{};
+    uint32_t version = 0;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), NEGATIVE_CACHE_MAGIC) || !get(in, version) || version != NEGATIVE_CACHE_VERSION)
+        return;
+    uint64_t numberOfMisses = 0;
+    bool ok = get(in, numberOfMisses);
+    std::lock_guard<std::mutex> lock(missesMutex);
+    for (uint64_t i = 0; ok && i < numberOfMisses; i++)
+    {
+        std::wstring key;
+        uint64_t time = 0;
+        ok = getString(in, key) && get(in, time);
+        if (ok)
+            misses[key] = time;
+    }
+    if (!ok)
+        misses.clear();  // a damaged file only costs requests
+}
+
+bool SymbolLookup::save()
+{
+    std::lock_guard<std::mutex> lock(missesMutex);
+    if (options.negativeCachePath.empty() || !missesChanged)
+        return true;
+    uint64_t now = secondsSinceEpoch();
+    std::vector<std::pair<std::wstring, uint64_t>> sortedMisses;
+    for (const auto& miss : misses)
+    {
+        if (now - miss.second < options.negativeTtlSeconds)
+            sortedMisses.push_back(miss);
+    }
+    std::sort(sortedMisses.begin(), sortedMisses.end());
+    fs::path path(options.negativeCachePath);
+    fs::path temporaryPath(options.negativeCachePath + L".tmp");
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        out.write(NEGATIVE_CACHE_MAGIC, sizeof(NEGATIVE_CACHE_MAGIC));
+        put(out, NEGATIVE_CACHE_VERSION);
+        put(out, static_cast<uint64_t>(sortedMisses.size()));
+        for (const auto& miss : sortedMisses)
+        {
+            putString(out, miss.first);
+            put(out, miss.second);
+        }
+        out.flush();
+        if (!out)
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(temporaryPath, path, ec);
+    if (!ec)
+        missesChanged = false;
+    return !ec;
+}
+
+std::wstring SymbolLookup::missKey(const std::wstring& server, const std::wstring& name, const std::wstring& key)
+{
+    std::wstring text = server;
+    while (!text.empty() && text.back() == L'/')
+        text.pop_back();
+    text += L" " + name + L"/" + key;
+    std::transform(text.begin(), text.end(), text.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    return text;
+}
+
+bool SymbolLookup::isKnownMissing(const std::wstring& missKey, uint64_t now)
+{
+    std::lock_guard<std::mutex> lock(missesMutex);
+    auto miss = misses.find(missKey);
+    // an entry from the future (the clock was set back) is ignored
+    return miss != misses.end() && miss->second <= now && now - miss->second < options.negativeTtlSeconds;
+}
+
+std::wstring SymbolLookup::fileNameOf(const std::wstring& path)
+{
+    size_t lastSeparator = path.find_last_of(L"/\\");
+    return lastSeparator == std::wstring::npos ? path : path.substr(lastSeparator + 1);
+}
+
+bool SymbolLookup::isValidFileName(const std::wstring& name)
+{
+    if (name.empty() || name == L"." || name == L"..")
+        return false;
+    return std::none_of(name.begin(), name.end(), [](wchar_t c) { return c < 0x20 || c == 0x7f || std::wcschr(L"\\/:*?\"<>|", c); });
+}
+
+std::wstring SymbolLookup::pdbKey(const std::wstring& guid, const std::wstring& age)
+{
+    std::wstring key;
+    for (const auto k : guid)
+    {
+        if ((k >= L'A' && k <= L'Z') || (k >= L'0' && k <= L'9'))
+        {
+            key += k;
+        }
+        else if (k >= L'a' && k <= L'z')
+        {
+            key += (k - (L'a' - L'A'));
+        }
+    }
+    return key + age;
+}
+
+std::wstring SymbolLookup::serverUrl(const std::wstring& server, const std::wstring& name, const std::wstring& key, bool isCompressed)
+{
+    std::wstring fileName = name;
+    if (isCompressed)
+        fileName.back() = L'_';
+    std::wstring path = percentEncoded(name) + L"/" + percentEncoded(key) + L"/" + percentEncoded(fileName);
+    if (!server.empty() && server.back() == L'/')
+        return server + path;
+    return server + L"/" + path;
+}
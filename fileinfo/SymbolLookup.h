@@ -0,0 +1,90 @@
+#pragma once
+#include "CabExtractor.h"
+#include "NetMultithread.h"
+#include "NetSession.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Finds a PDB on any of several symbol servers and downloads it.
+// Every server is asked for name.pdb and for the compressed name.pd_ at the same time. The first
+// request answered with the file wins and goes on downloading; the others are cancelled, but for the
+// other form on the same server, which is left to be answered and then gives up. Servers
+// are started in the order given, which also decides which error is reported when all fail.
+//
+// A server that answered 404 for both forms is remembered in the negative cache for the TTL, and
+// isn't asked for that PDB again until then; if no server is left, the PDB is reported missing
+// without any request. The cache is kept in a file, so it lasts across runs. Thread safe.
+//
+// With expandCompressed, a name.pd_ is also extracted to name while it downloads.
+//
+// All requests go through one NetSession, held as long as the lookup, so the fetches of a batch
+// reuse the connections of the ones before.
+class SymbolLookup
+{
+public:
+    struct Options
+    {
+        std::vector<std::wstring> servers;
+        unsigned numberOfConnections = 1;  // of the download that wins
+        NetAsyncProxyType proxyType = NetAsyncProxyType::System;
+        std::wstring proxyServer;
+        std::wstring proxyBypass;
+        bool isHttp2Enabled = false;
+        std::wstring negativeCachePath;  // empty: 404s are not remembered
+        uint64_t negativeTtlSeconds = DEFAULT_NEGATIVE_TTL;
+        bool expandCompressed = false;
+    };
+    struct Result
+    {
+        bool found = false;
+        DWORD statusCode = NetAsync::NO_STATUS_CODE;  // 404 if no server has it
+        unsigned long long size = 0;
+        std::wstring savedPath;  // directory\name, or directory\name.pd_ if the compressed form won
+        std::wstring url;
+        bool isKnownMissing = false;  // answered from the negative cache, without a request
+        std::wstring expandedPath;  // directory\name, if the .pd_ that won was extracted
+        std::wstring expandError;  // why it wasn't; the .pd_ is kept either way
+        std::vector<NetRequestTiming> timings;  // of the download that won
+    };
+
+    explicit SymbolLookup(const Options& options);
+    ~SymbolLookup();  // save()
+    SymbolLookup(const SymbolLookup&) = delete;
+    SymbolLookup& operator=(const SymbolLookup&) = delete;
+
+    // Saves the PDB name (GUID and age: key) in directory, which must exist. Only the pProgress and
+    // pContentLength callbacks are used, for the download that wins.
+    Result fetch(const std::wstring& name, const std::wstring& key, const std::wstring& directory, const NetCallbacks& callbacks = {});
+    // Writes the negative cache, without the entries that have expired, through a temporary file.
+    bool save();
+
+    static constexpr uint64_t DEFAULT_NEGATIVE_TTL = 24 * 60 * 60;
+    static const wchar_t* const NEGATIVE_CACHE_FILE_NAME;  // in the root of the local symbol store
+
+    // The parts of a symbol store path.
+    // file name without its directory; a PDB path in a CodeView record may be absolute
+    static std::wstring fileNameOf(const std::wstring& path);
+    // false for names that can't be one component of a store path: empty, "." or "..", or with
+    // separators, ':' (a drive or a stream), control characters or the other characters Windows rejects
+    static bool isValidFileName(const std::wstring& name);
+    // GUID without dashes or braces, in upper case, followed by the age, e.g. A3028D6B45DA006244A6C9E4DDDA11021
+    static std::wstring pdbKey(const std::wstring& guid, const std::wstring& age);
+    // e.g. https://msdl.microsoft.com/download/symbols/rpcrt4.pdb/A3028D6B45DA006244A6C9E4DDDA11021/rpcrt4.pdb,
+    // or .../rpcrt4.pd_ if isCompressed. name and key are percent-encoded as UTF-8.
+    static std::wstring serverUrl(const std::wstring& server, const std::wstring& name, const std::wstring& key, bool isCompressed = false);
+private:
+    void load();
+    // server and PDB, in lower case: both are looked up case-insensitively
+    static std::wstring missKey(const std::wstring& server, const std::wstring& name, const std::wstring& key);
+    bool isKnownMissing(const std::wstring& missKey, uint64_t now);
+
+    Options options;
+    std::shared_ptr<NetSession> session;
+    std::mutex missesMutex;
+    std::unordered_map<std::wstring, uint64_t> misses;  // miss key -> time of the 404, in seconds since 1970
+    bool missesChanged = false;
+};
@@ -0,0 +1,186 @@
+#include "SymbolStore.h"
+#include <algorithm>
+#include <cwctype>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    SymbolLookup::Options lookupOptions(const SymbolStore::Options& options)
+    {
+        SymbolLookup::Options lookupOptions;
+        lookupOptions.servers = options.servers;
+        lookupOptions.numberOfConnections = 1;
+        lookupOptions.proxyType = options.proxyType;
+        lookupOptions.proxyServer = options.proxyServer;
+        lookupOptions.proxyBypass = options.proxyBypass;
+        lookupOptions.isHttp2Enabled = options.isHttp2Enabled;
+        if (options.negativeTtlSeconds != 0)
+            lookupOptions.negativeCachePath = (fs::path(options.root) / SymbolLookup::NEGATIVE_CACHE_FILE_NAME).wstring();
+        lookupOptions.negativeTtlSeconds = options.negativeTtlSeconds;
+        return lookupOptions;
+    }
+}
+
+SymbolStore::SymbolStore(const Options& options, ReportCallback report)
+    : options(options), lookup(lookupOptions(options)), reportCallback(std::move(report))
+{
+    unsigned numberOfThreads = std::max(options.numberOfConnections, 1u);
+    for (unsigned i = 0; i < numberOfThreads; i++)
+        threads.emplace_back([this] { work(); });
+}
+
+SymbolStore::~SymbolStore()
+{
+    finish();
+}
+
+bool SymbolStore::addImage(const std::wstring& path, const PeDebugInfo& debug)
+{
+    if (debug.pdbGuid.empty() || debug.exeKey.empty())
+        return false;
+    Entry pdb;
+    pdb.isPdb = true;
+    pdb.name = SymbolLookup::fileNameOf(debug.pdbFile);
+    pdb.key = SymbolLookup::pdbKey(debug.pdbGuid, debug.pdbAge);
+    Entry binary;
+    binary.name = SymbolLookup::fileNameOf(path);
+    binary.key = debug.exeKey;
+    binary.sourcePath = path;
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (auto& entry : { pdb, binary })
+    {
+        // a name from a CodeView record could otherwise lead out of the store
+        if (!SymbolLookup::isValidFileName(entry.name))
+            continue;
+        std::wstring seenKey = (entry.isPdb ? L"pdb\\" : L"bin\\") + entry.name + L"\\" + entry.key;
+        std::transform(seenKey.begin(), seenKey.end(), seenKey.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+        if (seenKeys.insert(seenKey).second)
+            queue.push_back(entry);
+    }
+    queueChanged.notify_all();
+    return true;
+}
+
+void SymbolStore::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        closing = true;
+    }
+    queueChanged.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+    lookup.save();
+}
+
+void SymbolStore::work()
+{
+    for (;;)
+    {
+        Entry entry;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return closing || !queue.empty(); });
+            if (queue.empty())
+                return;
+            entry = std::move(queue.front());
+            queue.pop_front();
+        }
+        if (entry.isPdb)
+            storePdb(entry);
+        else
+            storeBinary(entry);
+    }
+}
+
+void SymbolStore::storePdb(const Entry& entry)
+{
+    fs::path directory = fs::path(options.root) / entry.name / entry.key;
+    fs::path pdbPath = directory / entry.name;
+    fs::path compressedPath = pdbPath;
+    std::wstring compressedName = entry.name;
+    compressedName.back() = L'_';
+    compressedPath.replace_filename(compressedName);
+    std::error_code ec;
+    if (fs::exists(pdbPath, ec) || fs::exists(compressedPath, ec))
+    {
+        report(entry, Outcome::AlreadyPresent, L"");
+        return;
+    }
+    fs::create_directories(directory, ec);
+    if (ec)
+    {
+        report(entry, Outcome::Failed, L"can't create " + directory.wstring());
+        return;
+    }
+
+    SymbolLookup::Result result = lookup.fetch(entry.name, entry.key, directory.wstring());
+    if (result.found)
+    {
+        for (const auto& timing : result.timings)
+        {
+            requests++;
+            if (timing.isReused)
+                reusedRequests++;
+        }
+        report(entry, Outcome::Stored, std::to_wstring(result.size) + L" bytes from " + result.url + L"; " + NetRequestTiming::describe(result.timings));
+        return;
+    }
+    // only empty directories are removed
+    fs::remove(directory, ec);
+    fs::remove(directory.parent_path(), ec);
+    switch (result.statusCode)
+    {
+    case 404:
+        report(entry, Outcome::NotFound, result.isKnownMissing ? L"known missing" : L"");
+        break;
+    case NetAsync::NO_STATUS_CODE:
+        report(entry, Outcome::Failed, L"connection failed");
+        break;
+    case NetAsync::STATUS_NETASYNC_INTERRUPTED_RESPONSE:
+        report(entry, Outcome::Failed, L"download interrupted");
+        break;
+    default:
+        report(entry, Outcome::Failed, L"error " + std::to_wstring(result.statusCode));
+        break;
+    }
+}
+
+void SymbolStore::storeBinary(const Entry& entry)
+{
+    fs::path binaryPath = fs::path(options.root) / entry.name / entry.key / entry.name;
+    std::error_code ec;
+    if (fs::exists(binaryPath, ec))
+    {
+        report(entry, Outcome::AlreadyPresent, L"");
+        return;
+    }
+    fs::create_directories(binaryPath.parent_path(), ec);
+    // copied next to its final name, so a copy that fails half way is never taken for the binary
+    fs::path tempPath = binaryPath;
+    tempPath += NetMultithread::TEMP_FILE_SUFFIX;
+    if (!ec)
+        fs::copy_file(entry.sourcePath, tempPath, fs::copy_options::overwrite_existing, ec);
+    if (!ec)
+        fs::rename(tempPath, binaryPath, ec);
+    if (ec)
+    {
+        fs::remove(tempPath, ec);
+        report(entry, Outcome::Failed, L"can't copy " + entry.sourcePath);
+        return;
+    }
+    report(entry, Outcome::Stored, std::to_wstring(fs::file_size(binaryPath, ec)) + L" bytes");
+}
+
+void SymbolStore::report(const Entry& entry, Outcome outcome, const std::wstring& detail)
+{
+    counts[static_cast<size_t>(outcome)]++;
+    if (!reportCallback)
+        return;
+    std::lock_guard<std::mutex> lock(reportMutex);
+    reportCallback((fs::path(entry.name) / entry.key / entry.name).wstring(), outcome, detail);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "PeImage.h"
+#include "SymbolLookup.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fills a local symbol store (the symstore layout a debugger searches: name\key\name) with the PDBs
+// many images refer to and with the images themselves.
+// Images are added from any number of threads. Each PDB (name, GUID and age) and each binary (name,
+// timestamp and size of image) is handled once, however many images share it, and is left alone if
+// the store already has it. Missing PDBs are looked up by numberOfConnections threads, each asking
+// all servers for name.pdb and name.pd_ at once (SymbolLookup), and downloaded over one connection.
+// The lookups share one WinINet session, whose connections are kept alive from one PDB to the next.
+class SymbolStore
+{
+public:
+    struct Options
+    {
+        std::wstring root;  // e.g. C:\ProgramData\dbg\sym
+        std::vector<std::wstring> servers;
+        unsigned numberOfConnections = DEFAULT_CONNECTIONS;
+        NetAsyncProxyType proxyType = NetAsyncProxyType::System;
+        std::wstring proxyServer;
+        std::wstring proxyBypass;
+        bool isHttp2Enabled = false;
+        uint64_t negativeTtlSeconds = SymbolLookup::DEFAULT_NEGATIVE_TTL;  // 0: 404s are not remembered
+    };
+    enum class Outcome { Stored, AlreadyPresent, NotFound, Failed };
+    // Called once per PDB or binary, on the store's threads but one at a time. entry is its path
+    // relative to the root; detail is the size stored or why it failed.
+    using ReportCallback = std::function<void(const std::wstring& entry, Outcome outcome, const std::wstring& detail)>;
+
+    SymbolStore(const Options& options, ReportCallback report);
+    ~SymbolStore();  // finish()
+    SymbolStore(const SymbolStore&) = delete;
+    SymbolStore& operator=(const SymbolStore&) = delete;
+
+    // Queues the PDB and the binary of an image. Returns false if it has no CodeView record, which both keys come from.
+    bool addImage(const std::wstring& path, const PeDebugInfo& debug);
+    // waits until everything queued is stored or has failed
+    void finish();
+    size_t count(Outcome outcome) const { return counts[static_cast<size_t>(outcome)]; }
+    // the HTTP requests of the PDBs stored, and how many of them went on a kept-alive connection
+    size_t requestCount() const { return requests; }
+    size_t reusedRequestCount() const { return reusedRequests; }
+
+    static constexpr unsigned DEFAULT_CONNECTIONS = 8;
+
+private:
+    struct Entry
+    {
+        bool isPdb = false;
+        std::wstring name;
+        std::wstring key;
+        std::wstring sourcePath;  // binary: the image to copy
+    };
+
+    void work();
+    void storePdb(const Entry& entry);
+    void storeBinary(const Entry& entry);
+    void report(const Entry& entry, Outcome outcome, const std::wstring& detail);
+
+    Options options;
+    SymbolLookup lookup;
+    ReportCallback reportCallback;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<Entry> queue;
+    std::set<std::wstring> seenKeys;  // lower case: the store is looked up case-insensitively
+    bool closing = false;
+    std::mutex reportMutex;
+    std::atomic<size_t> counts[4]{};
+    std::atomic<size_t> requests{ 0 };
+    std::atomic<size_t> reusedRequests{ 0 };
+    std::vector<std::thread> threads;
+};
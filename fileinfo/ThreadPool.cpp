@@ -0,0 +1,151 @@
+#include "ThreadPool.h"
+#include <chrono>
+
+namespace
+{
+    // index of the worker running on this thread in its pool, -1 on other threads
+    thread_local int t_workerIndex = -1;
+    thread_local const void* t_workerPool = nullptr;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned numberOfThreads)
+{
+    if (numberOfThreads == 0)
+        numberOfThreads = std::thread::hardware_concurrency();
+    if (numberOfThreads == 0)
+        numberOfThreads = 1;
+    for (unsigned i = 0; i < numberOfThreads; i++)
+        queues.push_back(std::make_unique<WorkerQueue>());
+    for (unsigned i = 0; i < numberOfThreads; i++)
+        threads.emplace_back(&WorkStealingPool::workerLoop, this, static_cast<int>(i));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    waitIdle();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    int self = (t_workerPool == this) ? t_workerIndex : -1;
+    unsigned target = self >= 0 ? static_cast<unsigned>(self) : nextQueue++ % queues.size();
+    unfinishedTasks++;
+    // counted before it is queued: a thief may take it and count it down right after the push
+    queuedTasks++;
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->m);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        // taking the lock orders this notification after a sleeping worker's predicate check
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeUp.notify_one();
+    if (waitingThreads > 0)
+        taskFinished.notify_all();
+}
+
+bool WorkStealingPool::runOneTask(int self)
+{
+    Task task;
+    if (self >= 0)
+    {
+        auto& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.m);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    if (!task)
+    {
+        size_t n = queues.size();
+        size_t start = self >= 0 ? static_cast<size_t>(self) + 1 : 0;
+        for (size_t i = 0; i < n && !task; i++)
+        {
+            auto& victim = *queues[(start + i) % n];
+            std::lock_guard<std::mutex> lock(victim.m);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+    }
+    if (!task)
+        return false;
+    queuedTasks--;
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        // tasks report their own errors; one that escapes is dropped, so the pool and waitIdle keep working
+    }
+    if (--unfinishedTasks == 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        allDone.notify_all();
+    }
+    if (waitingThreads > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        taskFinished.notify_all();
+    }
+    return true;
+}
+
+void WorkStealingPool::workerLoop(int index)
+{
+    t_workerIndex = index;
+    t_workerPool = this;
+    while (true)
+    {
+        if (runOneTask(index))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]() { return stopping || queuedTasks > 0; });
+        if (stopping && queuedTasks == 0)
+            return;
+    }
+}
+
+void WorkStealingPool::waitFor(const std::atomic<size_t>& pending)
+{
+    int self = (t_workerPool == this) ? t_workerIndex : -1;
+    while (pending > 0)
+    {
+        if (runOneTask(self))
+            continue;
+        // nothing left to steal: the remaining subtasks are running on other workers
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        waitingThreads++;
+        taskFinished.wait(lock, [&]() { return pending == 0 || queuedTasks > 0; });
+        waitingThreads--;
+    }
+}
+
+void WorkStealingPool::throttle(size_t maxUnfinished)
+{
+    int self = (t_workerPool == this) ? t_workerIndex : -1;
+    while (unfinishedTasks > maxUnfinished)
+    {
+        if (!runOneTask(self))
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void WorkStealingPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    allDone.wait(lock, [this]() { return unfinishedTasks == 0; });
+}
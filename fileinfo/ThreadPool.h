@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every worker owns a deque. Tasks submitted by a worker go to the back of its own deque and are
+// taken back LIFO, so subtasks run while their data is still in cache; idle workers steal from the
+// front of the other deques, which holds the oldest (and usually largest) work.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned numberOfThreads = 0);  // 0: one worker per core
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // A task should catch its own exceptions: one that escapes is dropped unreported.
+    void submit(Task task);
+    // Runs queued tasks on the calling thread until pending drops to zero.
+    // A task that waits for its own subtasks must use this instead of blocking its worker.
+    void waitFor(const std::atomic<size_t>& pending);
+    // Runs queued tasks on the calling thread until at most maxUnfinished tasks are left.
+    // Lets a producer that submits a huge number of tasks apply backpressure to itself.
+    void throttle(size_t maxUnfinished);
+    // Blocks until every submitted task has finished
+    void waitIdle();
+    unsigned size() const { return static_cast<unsigned>(threads.size()); }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+    bool runOneTask(int self);
+    void workerLoop(int index);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queuedTasks{ 0 };
+    std::atomic<size_t> unfinishedTasks{ 0 };
+    std::atomic<unsigned> nextQueue{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable allDone;
+    std::condition_variable taskFinished;  // wakes the threads blocked in waitFor
+    std::atomic<size_t> waitingThreads{ 0 };
+    bool stopping = false;
+};
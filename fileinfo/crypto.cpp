@@ -1,58 +1,81 @@
 #include "crypto.h"
-#include <vector>
-#include <sstream>
 
-// Reference: https://stackoverflow.com/questions/13256446/compute-md5-hash-value-by-c-winapi
-std::wstring GetHashText(const void* data, const unsigned long data_size, HashType hashType)
+MultiHash::MultiHash(unsigned hashMask) : hashMask(hashMask)
 {
-    HCRYPTPROV hProv = NULL;
+}
 
-    if (!CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT)) {
-        return L"";
-    }
+bool MultiHash::isSelected(HashType hashType) const
+{
+    return (hashMask & hashFlag(hashType)) != 0;
+}
 
-    BOOL hash_ok = FALSE;
-    HCRYPTPROV hHash = NULL;
-    switch (hashType) {
-    case HashType::HashSha1: hash_ok = CryptCreateHash(hProv, CALG_SHA1, 0, 0, &hHash); break;
-    case HashType::HashMd5: hash_ok = CryptCreateHash(hProv, CALG_MD5, 0, 0, &hHash); break;
-    case HashType::HashSha256: hash_ok = CryptCreateHash(hProv, CALG_SHA_256, 0, 0, &hHash); break;
+void MultiHash::update(const void* data, size_t len)
+{
+    auto p = static_cast<const unsigned char*>(data);
+    while (len > 0) {
+        size_t chunk = len < CHUNK_SIZE ? len : CHUNK_SIZE;
+        if (isSelected(HashType::HashMd5))
+            md5.update(p, chunk);
+        if (isSelected(HashType::HashSha1))
+            sha1.update(p, chunk);
+        if (isSelected(HashType::HashSha256))
+            sha256.update(p, chunk);
+        p += chunk;
+        len -= chunk;
     }
+}
 
-    if (!hash_ok) {
-        CryptReleaseContext(hProv, 0);
+std::wstring MultiHash::hexDigest(HashType hashType)
+{
+    if (!isSelected(hashType)) {
         return L"";
     }
-
-    if (!CryptHashData(hHash, static_cast<const BYTE*>(data), data_size, 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProv, 0);
-        return L"";
-    }
-
-    DWORD cbHashSize = 0, dwCount = sizeof(DWORD);
-    if (!CryptGetHashParam(hHash, HP_HASHSIZE, (BYTE*)& cbHashSize, &dwCount, 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProv, 0);
-        return L"";
+    std::wstring& digest = digests[static_cast<int>(hashType)];
+    if (digest.empty()) {
+        unsigned char buffer[Sha256::DIGEST_SIZE];
+        switch (hashType) {
+        case HashType::HashSha1: sha1.final(buffer); digest = bytesToHex(buffer, Sha1::DIGEST_SIZE); break;
+        case HashType::HashMd5: md5.final(buffer); digest = bytesToHex(buffer, Md5::DIGEST_SIZE); break;
+        case HashType::HashSha256: sha256.final(buffer); digest = bytesToHex(buffer, Sha256::DIGEST_SIZE); break;
+        }
     }
+    return digest;
+}
 
-    std::vector<BYTE> buffer(cbHashSize);
-    if (!CryptGetHashParam(hHash, HP_HASHVAL, reinterpret_cast<BYTE*>(&buffer[0]), &cbHashSize, 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProv, 0);
-        return L"";
+std::wstring bytesToHex(const unsigned char* bytes, size_t len)
+{
+    static const wchar_t hexDigits[] = L"0123456789abcdef";
+    std::wstring hex(len * 2, L'0');
+    for (size_t i = 0; i < len; i++) {
+        hex[i * 2] = hexDigits[bytes[i] >> 4];
+        hex[i * 2 + 1] = hexDigits[bytes[i] & 0xf];
     }
+    return hex;
+}
 
-    std::wstringstream oss;
-
-    for (std::vector<BYTE>::const_iterator iter = buffer.begin(); iter != buffer.end(); ++iter) {
-        oss.fill('0');
-        oss.width(2);
-        oss << std::hex << static_cast<const int>(*iter);
+bool hexToBytes(const std::wstring& hex, unsigned char* bytes, size_t len)
+{
+    if (hex.length() != len * 2)
+        return false;
+    auto digit = [](wchar_t c) -> int {
+        if (c >= L'0' && c <= L'9') return c - L'0';
+        if (c >= L'a' && c <= L'f') return c - L'a' + 10;
+        if (c >= L'A' && c <= L'F') return c - L'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < len; i++) {
+        int high = digit(hex[i * 2]);
+        int low = digit(hex[i * 2 + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        bytes[i] = static_cast<unsigned char>(high << 4 | low);
     }
+    return true;
+}
 
-    CryptDestroyHash(hHash);
-    CryptReleaseContext(hProv, 0);
-    return oss.str();
+std::wstring GetHashText(const void* data, const unsigned long data_size, HashType hashType)
+{
+    MultiHash hash(hashFlag(hashType));
+    hash.update(data, data_size);
+    return hash.hexDigest(hashType);
 }
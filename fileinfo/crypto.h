@@ -1,12 +1,42 @@
 #pragma once
 
-#include <Windows.h>
-#include <Wincrypt.h>
 #include <string>
+#include "HashAlgorithms.h"
 enum class HashType
 {
     HashSha1, HashMd5, HashSha256
 };
+constexpr int NUMBER_OF_HASH_TYPES = 3;
 
-// Reference: https://stackoverflow.com/questions/13256446/compute-md5-hash-value-by-c-winapi
-std::wstring GetHashText(const void* data, const unsigned long data_size, HashType hashType);
\ No newline at end of file
+// bit mask used to select the digests a MultiHash computes
+constexpr unsigned hashFlag(HashType hashType) { return 1u << static_cast<unsigned>(hashType); }
+constexpr unsigned HASH_ALL = hashFlag(HashType::HashMd5) | hashFlag(HashType::HashSha1) | hashFlag(HashType::HashSha256);
+
+// Computes several digests in a single pass over the data.
+// Input is split into cache-sized chunks, and every chunk is fed to all selected digests
+// before moving on, so memory is walked once no matter how many digests are requested.
+class MultiHash
+{
+public:
+    explicit MultiHash(unsigned hashMask = HASH_ALL);
+
+    bool isSelected(HashType hashType) const;
+    void update(const void* data, size_t len);
+    // finishes the digest; returns "" if the digest was not selected
+    std::wstring hexDigest(HashType hashType);
+
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+private:
+    unsigned hashMask;
+    Md5 md5;
+    Sha1 sha1;
+    Sha256 sha256;
+    std::wstring digests[NUMBER_OF_HASH_TYPES];
+};
+
+std::wstring bytesToHex(const unsigned char* bytes, size_t len);
+// the reverse: false unless hex is exactly 2 * len hex digits
+bool hexToBytes(const std::wstring& hex, unsigned char* bytes, size_t len);
+
+// Keeps the contract of the original CryptoAPI based helper: lowercase hex digest, or "" on error.
+std::wstring GetHashText(const void* data, const unsigned long data_size, HashType hashType);
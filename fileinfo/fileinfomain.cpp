@@ -6,15 +6,41 @@
 #include <vector>
 #include <locale>
 #include <codecvt>
-#include <tuple>
 #include <fstream>
 #include <uxtheme.h>  // for SetWindowTheme
 #include <iostream>  // for testing
 #include <io.h>  // for _open_osfhandle
 #include <fcntl.h>  // for _O_APPEND
 #include <algorithm>  // for std::remove
+#include <thread>  // for std::thread::hardware_concurrency
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <exception>  // for std::exception_ptr
+#include <functional>
+#include <cstring>  // for memcpy
 #include "crypto.h"
 #include "NetAsync.h"
+#include "NetMultithread.h"
+#include "SymbolLookup.h"
+#include "SymbolStore.h"
+#include "PeImage.h"
+#include "ImportTable.h"
+#include "ExportTable.h"
+#include "ResourceDirectory.h"
+#include "Authenticode.h"
+#include "Fingerprints.h"
+#include "ByteStatistics.h"
+#include "JsonWriter.h"
+#include "ColumnarWriter.h"
+#include "ResultCache.h"
+#include "IncrementalScan.h"
+#include "HashPipeline.h"
+#include "AsyncFileReader.h"
+#include "BatchScan.h"
+#include "ThreadPool.h"
+#include "CabExtractor.h"
 
 // add manifest to enable Comctl32 version2. Otherwise User32.dll controls are used.
 #pragma comment(linker,"\"/manifestdependency:type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
@@ -24,7 +50,6 @@
 #pragma comment(lib, "UxTheme.lib")
 using std::wstring;
 using std::vector;
-using std::ifstream;
 
 // global variables
 const wchar_t g_usage[] = LR"(This program displays information of Windows PE files.
@@ -33,10 +58,24 @@ HKCR\dllfile\shell\Check Info\command: (default) [exe path] "%1" [option]
 HKCR\exefile\shell\Check Info\command: (default) [exe path] "%1" [option]
 HKCR\sysfile\shell\Check Info\command: (default) [exe path] "%1" [option]
 
-Usage: QuickFileInfo.exe [file path] [--proxy=domain:port[|proxy bypass list]] [--dark | --light] ["--run1=[path of external exe]|[parameters to external exe]|[button name]|[admin]"]
+Usage: QuickFileInfo.exe [file path] [--proxy=domain:port[|proxy bypass list]] [--symbol-server=url ...] [--negative-ttl=hours] [--connections=N] [--http2] [--hash=md5,sha1,sha256] [--tree-hash] [--histogram] [--headers-only] [--dark | --light] ["--run1=[path of external exe]|[parameters to external exe]|[button name]|[admin]"]
   --proxy: The proxy server to use to download PDB symbols.
            You can specify --proxy=direct to never use a proxy, and
            --proxy=system to use the system proxy.
+  --symbol-server: The symbol server to download PDB symbols from. Default: Microsoft's. Repeat it to use several:
+                   all are asked for name.pdb and name.pd_ at once, and the first to answer with the file is used.
+                   A name.pd_ is extracted to name.pdb while it downloads; the name.pd_ is kept.
+  --negative-ttl: Hours a server that answered 404 for a PDB isn't asked for it again. Default: 24. 0 disables it.
+                  The 404s are kept in missing-pdbs.fileinfo in the symbol store.
+  --connections: Number of connections a PDB is downloaded over, in 5 MB ranges. Default: 5.
+                 Connections are kept alive and reused by the next download from the same server.
+  --http2: Offer HTTP/2 to the symbol servers, so the requests to a server share one connection (Windows 10 1809 and later).
+  --hash: Comma separated list of the digests to compute. Default: md5,sha1,sha256. Use --hash=none to skip hashing.
+          The Authenticode hash of the image is computed in the same pass, with SHA1 and/or SHA256 as selected.
+  --tree-hash: Also compute a SHA256 based tree hash on all CPU cores, for use as a deduplication key.
+  --histogram: Also show the 256-bin byte histogram of the file. Entropy of the file and of every section is always shown.
+  --headers-only: Only read the headers, the section table and the PDB information, with a few small reads.
+                  Architecture, characteristics, subsystem and PDB GUID are shown; imports, exports, resources and digests are not.
   --dark | --light: Enable or disable dark mode. If not set, the system default theme is used.
   --run1: Add an additional button. Clicking it opens the specified external program.
             [path of external exe]: The full path of the external program. Don't quote it if it contains space; instead, quote the entire --run1 parameter.
@@ -44,27 +83,45 @@ Usage: QuickFileInfo.exe [file path] [--proxy=domain:port[|proxy bypass list]] [
             [button name]: The text shown on this button.
             [admin]: Specify the string "admin" (without quotes) to launch the external program as administrator; otherwise it will be launched unelevated.
 
+Batch mode: QuickFileInfo.exe --batch [file | directory | wildcard pattern | -] ... [--hash=...] [--tree-hash] [--histogram] [--headers-only] [--jobs=N] [--io-depth=N] [--ordered] [--format=text|ndjson|columnar] [--cache=path [--cache-verify]] [--incremental=path] [--symbol-store[=path]]
+  Analyzes every file without creating any window, and writes one record per file to stdout.
+  Files are analyzed in parallel; the hashing of large files is split into subtasks.
+  --jobs: Number of worker threads. Default: one per CPU core.
+  --io-depth: Number of reads in flight when --headers-only reads ahead. Default: 64.
+  --ordered: Write the records in input order. By default they are written as soon as they are ready.
+  --format: text (default), ndjson for one JSON object per file and line, in UTF-8, or
+            columnar for a compact binary table with one row per file (see ColumnarWriter.h).
+  --cache: Keep the results in this file, and reuse them for files whose size, last write time and file ID
+           are unchanged. Several scans can share the file at the same time.
+  --cache-verify: Also compare a digest of the first and last 64 KB of the file before reusing a result.
+  --incremental: Only analyze the files that were added or modified since the previous scan with this snapshot file.
+                 On NTFS, as administrator, they are found in the change journal without walking the directories.
+  --symbol-store: Instead of writing records, put the PDB of every image, downloaded from the symbol servers, and
+                  the image itself into this symbol store (default: C:\ProgramData\dbg\sym). Each PDB and binary is handled
+                  once and skipped if already present; --connections PDBs are downloaded at once (default 5).
+  Directories are walked recursively; files in them that don't start with "MZ" are skipped.
+  Wildcards are allowed in the last path component only, e.g. C:\Windows\System32\*.dll.
+  "-", or no input at all, reads the list of inputs from stdin, one per line.
+
 Information shown by this program:
 1. 64-bit vs 32-bit
 2. Image characteristics
-3. MD5, SHA1, SHA256
-4. Debug GUID)";
+3. MD5, SHA1, SHA256, and the Authenticode hash
+4. Debug GUID
+5. Signer and digest algorithm of the Authenticode signature
+6. Imported DLLs, imphash and exported functions
+7. Version information, manifest and icons from the resources
+8. Rich header and per-section MD5/SHA256
+9. Entropy of the file and of every section)";
 
 const wchar_t g_MicrosoftSymbolServerURL[] = L"https://msdl.microsoft.com/download/symbols";
 const wchar_t g_MozillaSymbolServerURL[] = L"https://symbols.mozilla.org/";
 const wchar_t g_ChromiumSymbolServerURL[] = L"https://chromium-browser-symsrv.commondatastorage.googleapis.com";
 const wchar_t g_Unity3dSymbolServerURL[] = L"https://symbolserver.unity3d.com/"; // Ref: https://docs.unity3d.com/Manual/WindowsDebugging.html
-wstring g_symbolServerUsed = g_MicrosoftSymbolServerURL;
+vector<wstring> g_symbolServers{ g_MicrosoftSymbolServerURL };  // --symbol-server: all are asked at once
+uint64_t g_negativeTtlSeconds = SymbolLookup::DEFAULT_NEGATIVE_TTL;  // --negative-ttl: how long a 404 is believed
 const wchar_t g_localSymbolCacheDirectory[] = L"C:\\ProgramData\\dbg\\sym";
 
-struct undocCodeViewFormat
-{
-    // http://www.godevtool.com/Other/pdb.htm
-    DWORD Signature;  // "RSDS"
-    GUID guid;  // 16-byte GUID12
-    DWORD age;  // incremented each time the executable and its associated pdb file is remade by the linker
-    char pdbName[1];  // zero terminated UTF8 path and file name
-};
 struct externalProgramBtnInfo
 {
     wstring programPath;
@@ -75,21 +132,7 @@ struct externalProgramBtnInfo
 
 wstring filePath;
 wstring fileInfoMsg;
-vector<char> g_fileContent;
-bool is32bit = false;
-DWORD numOfSection = 0;
-std::vector<std::tuple<DWORD, DWORD, DWORD> > vecSectionInfo;  // <VA, PointerToRawData, VirtualSize>
-IMAGE_OPTIONAL_HEADER32* pOptionalHeaders32 = nullptr;
-IMAGE_OPTIONAL_HEADER64* pOptionalHeaders64 = nullptr;
-// pointer to first section header
-IMAGE_SECTION_HEADER* sectionHeader = nullptr;
-DWORD debugDirectoryRva = 0;
-DWORD debugDirectoryLen = 0;
-wstring g_debugGUID;
-wstring g_debugAge;
-wstring g_pdbFile;
-wstring g_exeKey;  // <TimeDateStamp><SizeOfImage> e.g. in `foo.exe/542d574232000/foo.exe`, 542d574232000 is g_exeKey
-DWORD g_SizeOfImage;
+PeImage g_image;  // the file shown in the window
 
 HINSTANCE g_hInstance = nullptr;
 HWND g_hMain = NULL;
@@ -104,8 +147,10 @@ HWND g_hEditStatus = NULL;
 constexpr unsigned long MAIN_WIDTH = 650;
 constexpr unsigned long MAIN_HEIGHT = 600;
 
-NetAsync* fileDownloader = nullptr;
-bool g_compressedTried = false;
+NetAsync* fileDownloader = nullptr;  // resumption of an interrupted download
+std::atomic<bool> g_isSymbolLookupRunning{ false };  // the thread of a SymbolLookup::fetch
+unsigned g_downloadConnections = NetMultithread::DEFAULT_PARALLEL_DOWNLOADS;  // --connections: ranges of a PDB downloaded at once
+bool g_isHttp2Enabled = false;  // --http2: offer HTTP/2 to the symbol servers
 NetAsyncProxyType proxyType = NetAsyncProxyType::System;
 wstring g_proxyServer;
 wstring g_proxyBypass = L"<local>";
@@ -113,25 +158,112 @@ bool g_isDarkMode = false;
 bool g_forceDarkMode = false;  // true if dark mode is enabled in command line arguments
 bool g_forceLightMode = false;  // true if light mode is enabled in command line arguments
 vector<externalProgramBtnInfo> g_arrExternalProgramBtnInfo;
+unsigned g_hashMask = HASH_ALL;  // digests to compute, set by --hash
+bool g_treeHash = false;  // also compute the multi-threaded tree hash, set by --tree-hash
+bool g_byteHistogram = false;  // --histogram: show the 256-bin byte histogram of the file
+bool g_headersOnly = false;  // --headers-only: read the headers and the CodeView record, nothing else of the file
+bool g_headless = false;  // --batch: results and errors go to stdout, no window is ever created
+HANDLE g_hHeadlessOutput = nullptr;
+unsigned g_batchJobs = 0;  // --jobs: worker threads in batch mode, 0: one per core
+unsigned g_ioDepth = 0;  // --io-depth: reads in flight of the batch read-ahead, 0: the default
+bool g_orderedOutput = false;  // --ordered: batch records are written in input order
+enum class OutputFormat { Text, Ndjson, Columnar };
+OutputFormat g_outputFormat = OutputFormat::Text;  // --format: how batch records are written
+wstring g_cachePath;  // --cache: file of batch results to reuse for unchanged files
+bool g_cacheVerify = false;  // --cache-verify: check cached results against a quick digest of the file
+wstring g_snapshotPath;  // --incremental: snapshot of the previous scan, only changed files are analyzed
+wstring g_symbolStorePath;  // --symbol-store: batch mode fills this symbol store instead of describing the files
+constexpr int CACHED_RESULT_VERSION = 1;  // to be bumped whenever the content of a batch record changes
+
+// digests of one file, as shown in the output
+struct FileHashes
+{
+    wstring digests[NUMBER_OF_HASH_TYPES];
+    wstring mode;
+    wstring treeHash;
+    wstring treeMode;
+    wstring authenticode[NUMBER_OF_HASH_TYPES];  // PE image hash, SHA1 and SHA256 only
+    AuthenticodeSignature signature;
+    vector<SectionDigest> sections;
+    ByteStatistics fileStatistics;
+    vector<ByteStatistics> sectionStatistics;  // same order as sections
+};
+
+// columns of --format=columnar, one row per file; g_imageColumns lists them in the same order
+enum ImageColumn : size_t
+{
+    COLUMN_PATH, COLUMN_ERROR, COLUMN_FILE_SIZE,
+    COLUMN_MACHINE, COLUMN_CHARACTERISTICS, COLUMN_SUBSYSTEM, COLUMN_DLL_CHARACTERISTICS,
+    COLUMN_SIZE_OF_IMAGE, COLUMN_TIME_DATE_STAMP, COLUMN_NUMBER_OF_SECTIONS, COLUMN_IS_64BIT, COLUMN_DOT_NET,
+    COLUMN_PDB_GUID, COLUMN_PDB_AGE, COLUMN_PDB_FILE,
+    COLUMN_IMPORT_MODULES, COLUMN_IMPORTS, COLUMN_IMPHASH, COLUMN_EXPORT_DLL, COLUMN_NUMBER_OF_EXPORTS,
+    COLUMN_FILE_VERSION, COLUMN_COMPANY_NAME, COLUMN_RICH_HASH,
+    COLUMN_MD5, COLUMN_SHA1, COLUMN_SHA256, COLUMN_AUTHENTICODE_SHA1, COLUMN_AUTHENTICODE_SHA256,
+    COLUMN_SIGNER, COLUMN_SIGNATURE_MATCHES, COLUMN_ENTROPY, COLUMN_SECTION_NAMES,
+    NUMBER_OF_IMAGE_COLUMNS
+};
+const ColumnSpec g_imageColumns[NUMBER_OF_IMAGE_COLUMNS] = {
+    { "path", ColumnType::String },
+    { "error", ColumnType::String },  // null if the file could be analyzed; all other columns are null if not
+    { "fileSize", ColumnType::UInt64 },
+    { "machine", ColumnType::UInt16 },
+    { "characteristics", ColumnType::UInt16 },
+    { "subsystem", ColumnType::UInt16 },
+    { "dllCharacteristics", ColumnType::UInt16 },
+    { "sizeOfImage", ColumnType::UInt32 },
+    { "timeDateStamp", ColumnType::UInt32 },
+    { "numberOfSections", ColumnType::UInt16 },
+    { "is64bit", ColumnType::UInt8 },
+    { "dotNet", ColumnType::UInt8 },
+    { "pdbGuid", ColumnType::Binary, 16 },  // GUID as stored in the image
+    { "pdbAge", ColumnType::UInt32 },
+    { "pdbFile", ColumnType::String },
+    { "importModules", ColumnType::StringList },
+    { "imports", ColumnType::StringList },  // "module!function", or "module!#ordinal"
+    { "imphash", ColumnType::Binary, 16 },
+    { "exportDll", ColumnType::String },
+    { "numberOfExports", ColumnType::UInt32 },
+    { "fileVersion", ColumnType::String },
+    { "companyName", ColumnType::String },
+    { "richHash", ColumnType::Binary, 16 },
+    { "md5", ColumnType::Binary, 16 },
+    { "sha1", ColumnType::Binary, 20 },
+    { "sha256", ColumnType::Binary, 32 },
+    { "authenticodeSha1", ColumnType::Binary, 20 },
+    { "authenticodeSha256", ColumnType::Binary, 32 },
+    { "signer", ColumnType::String },
+    { "signatureMatches", ColumnType::UInt8 },  // the signed digest is the Authenticode hash of the file
+    { "entropy", ColumnType::Float64 },
+    { "sectionNames", ColumnType::StringList },
+};
 
 #define COLOR_TOTAL_BLACK RGB(0,0,0)
 #define COLOR_SOFT_WHITE RGB(200, 200, 200)
 #define COLOR_TOTAL_WHITE RGB(255, 255, 255)
 
 // prototypes
+bool parseOption(std::wstring arg);
 bool doWork();
+int runBatch(const vector<wstring>& args);
+int populateSymbolStore(const vector<wstring>& inputs);
+void writeHeadlessOutput(const std::wstring& str);
+vector<wstring> readStdinLines();
 void showUsage();
-bool extractBasicInfo();
-void extractSectionInfo();
-void extractDebugGUID(IMAGE_DEBUG_DIRECTORY* pFirstDebugDirectory);
 void showInfo(const std::wstring& msg);
-bool readByteWithRange(const std::wstring& filePath, const size_t start, size_t len = -1);
-void parseSubsystem(WORD Subsystem);
-void parseDllCharacteristics(WORD dll);
-DWORD rvaToRaw(DWORD rva);
-wstring guidToWstring(const GUID& guid);
-void getHashMessage(const char* const fileContent, const unsigned long fileLen);
-bool downloadSymbolToDisk(const wstring& symbolServer, const wstring& symbolGUID, const wstring& symbolAge, const wstring& symbolFilename, const wstring& localSymbolPath, bool isCabCompressed);
+wstring describeImage(const PeImage& image);
+wstring describeSubsystem(WORD Subsystem);
+wstring describeDllCharacteristics(WORD dll);
+wstring describeImports(const PeImage& image);
+wstring describeExports(const PeImage& image);
+wstring describeResources(const PeImage& image);
+wstring describeRichHeader(const PeImage& image);
+FileHashes computeHashes(const PeImage& image, unsigned hashMask, bool treeHash);
+FileHashes computeHashesOnPool(WorkStealingPool& pool, const PeImage& image, unsigned hashMask, bool treeHash);
+wstring formatHashes(const FileHashes& hashes, bool byteHistogram);
+void writeImageJson(JsonWriter& json, const PeImage& image, const FileHashes& hashes, bool byteHistogram);
+void fillImageRow(ColumnarRow& row, const PeImage& image, const FileHashes& hashes);
+unsigned parseHashList(const wstring& hashList);
+bool downloadSymbolToDisk(const wstring& symbolGUID, const wstring& symbolAge, const wstring& symbolFilename, const wstring& localSymbolPath);
 void HandleControlCommands(UINT code, HWND hwnd);
 bool appendTextOnEdit(HWND hEdit, const std::wstring& str);
 bool getFileSizeFromPath(const wstring& filePath, DWORD& filesize);
@@ -158,7 +290,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
             g_hBtnDownloadSymbol = CreateWindowExW(WS_EX_CLIENTEDGE, L"BUTTON", L"Download PDB",
                 WS_TABSTOP | WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON | (g_isDarkMode ? BS_OWNERDRAW : 0), 0, 0, 10, 10, hwnd, NULL, g_hInstance, nullptr);
-            if ((g_debugGUID.size() == 0) || (g_pdbFile.size() == 0))
+            if (g_image.debugInfo().pdbGuid.empty() || g_image.debugInfo().pdbFile.empty())
             {
                 EnableWindow(g_hBtnDownloadSymbol, FALSE);
             }
@@ -313,105 +445,24 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
             showUsage();
             return 0;
         }
-        filePath = arg1;
-        if (argc >= 3)
+        if (arg1 == L"--batch")
         {
+            // headless mode: never creates a window
+            g_headless = true;
+            vector<wstring> inputs;
             for (int index = 2; index < argc; index++)
             {
-                std::wstring arg = argv[index];
-                if (arg.find(L"--proxy=") == 0 && arg.length() > (sizeof(L"--proxy=") / 2 - 1))
-                {
-                    arg = arg.substr(sizeof(L"--proxy=") / 2 - 1);
-                    if (arg == L"direct")
-                    {
-                        proxyType = NetAsyncProxyType::Direct;
-                    }
-                    else if (arg == L"system")
-                    {
-                        proxyType = NetAsyncProxyType::System;
-                    }
-                    else
-                    {
-                        proxyType = NetAsyncProxyType::UserSpecified;
-                        auto indexSeparator = arg.find(L'|');
-                        if (indexSeparator == -1)
-                        {
-                            g_proxyServer = arg;
-                            g_proxyBypass = L"<local>";
-                        }
-                        else
-                        {
-                            g_proxyServer = arg.substr(0, indexSeparator);
-                            g_proxyBypass = arg.substr(indexSeparator + 1);
-                        }
-                    }
-                }
-                else if (arg.find(L"--dark") == 0)
-                {
-                    g_forceDarkMode = true;
-                }
-                else if (arg.find(L"--light") == 0)
+                if (!parseOption(argv[index]))
                 {
-                    g_forceLightMode = true;
-                }
-                else if (arg.find(L"--run1=") == 0 && arg.length() > (sizeof(L"--run1=") / 2 - 1))
-                {
-                    // e.g. --run1=C:\PE Tools\depends.exe|\"%1\"|Open Depends|noadmin
-                    wstring programPath;
-                    wstring programParam;
-                    wstring buttonName;
-                    bool runAsAdmin = false;
-                    arg = arg.substr(sizeof(L"--run1=") / 2 - 1);
-                    // arg is: C:\Tools\depends.exe|\"%1\"|Open Depends|noadmin
-                    for (size_t indexSeparator = arg.find(L"|"), count = 0; arg.length() > 0; indexSeparator = arg.find(L"|"), count++)
-                    {
-                        wstring currentParameter; 
-                        if (indexSeparator == -1)
-                        {
-                            currentParameter = arg;
-                            arg = L"";
-                        }
-                        else
-                        {
-                            currentParameter = arg.substr(0, indexSeparator);
-                            arg = arg.substr(indexSeparator + 1);
-                        }
-                        switch (count)
-                        {
-                        case 0:
-                            programPath = currentParameter;
-                            break;
-                        case 1:
-                        {
-                            programParam = currentParameter;
-                            wstring placeholderForFullExePath = L"%1";
-                            auto indexOfPercentOne = programParam.find(placeholderForFullExePath);
-                            if (indexOfPercentOne != -1)
-                            {
-                                programParam.replace(indexOfPercentOne, placeholderForFullExePath.length(), filePath);
-                            }
-                            break;
-                        }                            
-                        case 2:
-                            buttonName = currentParameter;
-                            break;
-                        case 3:
-                            if (currentParameter == L"admin")                            
-                                runAsAdmin = true;                            
-                            else                            
-                                runAsAdmin = false;
-                            break;
-                        default:
-                            break;
-                        }
-                    }
-                    if (programPath.length() > 0 && buttonName.length() > 0)
-                    {
-                        g_arrExternalProgramBtnInfo.push_back({ programPath, programParam, buttonName, runAsAdmin });
-                    }
+                    inputs.push_back(argv[index]);
                 }
             }
-            
+            return runBatch(inputs);
+        }
+        filePath = arg1;
+        for (int index = 2; index < argc; index++)
+        {
+            parseOption(argv[index]);
         }
         if (!doWork())
         {
@@ -455,144 +506,650 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     }
     return static_cast<int>(Msg.wParam);
 }
-bool doWork()
+bool parseOption(std::wstring arg)
 {
-    bool status = false;
-    status = readByteWithRange(filePath, 0, -1);
-    if (!status)
+    // returns false if arg is not an option
+    if (arg.find(L"--proxy=") == 0 && arg.length() > (sizeof(L"--proxy=") / 2 - 1))
     {
-        showInfo(L"Error: " + filePath + L" can't be opened.");
-        return false;
+        arg = arg.substr(sizeof(L"--proxy=") / 2 - 1);
+        if (arg == L"direct")
+        {
+            proxyType = NetAsyncProxyType::Direct;
+        }
+        else if (arg == L"system")
+        {
+            proxyType = NetAsyncProxyType::System;
+        }
+        else
+        {
+            proxyType = NetAsyncProxyType::UserSpecified;
+            auto indexSeparator = arg.find(L'|');
+            if (indexSeparator == -1)
+            {
+                g_proxyServer = arg;
+                g_proxyBypass = L"<local>";
+            }
+            else
+            {
+                g_proxyServer = arg.substr(0, indexSeparator);
+                g_proxyBypass = arg.substr(indexSeparator + 1);
+            }
+        }
+    }
+    else if (arg.find(L"--symbol-server=") == 0 && arg.length() > (sizeof(L"--symbol-server=") / 2 - 1))
+    {
+        // the first replaces the default server, the others are added to it
+        static bool isServerListGiven = false;
+        if (!isServerListGiven)
+            g_symbolServers.clear();
+        isServerListGiven = true;
+        g_symbolServers.push_back(arg.substr(sizeof(L"--symbol-server=") / 2 - 1));
     }
-    if (g_fileContent.size() < 1024)
+    else if (arg.find(L"--negative-ttl=") == 0)
     {
-        showInfo(L"Error: " + filePath + L" is not a valid PE file. File is too small.");
-        return false;
+        g_negativeTtlSeconds = wcstoull(arg.c_str() + sizeof(L"--negative-ttl=") / 2 - 1, nullptr, 10) * 60 * 60;
     }
-    fileInfoMsg += L"File: " + filePath + L"\r\n";
-    if (!extractBasicInfo())
+    else if (arg.find(L"--connections=") == 0)
     {
-        return false;
+        g_downloadConnections = static_cast<unsigned>(wcstoul(arg.c_str() + sizeof(L"--connections=") / 2 - 1, nullptr, 10));
+    }
+    else if (arg == L"--http2")
+    {
+        g_isHttp2Enabled = true;
+    }
+    else if (arg.find(L"--hash=") == 0)
+    {
+        g_hashMask = parseHashList(arg.substr(sizeof(L"--hash=") / 2 - 1));
+    }
+    else if (arg == L"--tree-hash")
+    {
+        g_treeHash = true;
+    }
+    else if (arg == L"--histogram")
+    {
+        g_byteHistogram = true;
+    }
+    else if (arg == L"--headers-only")
+    {
+        g_headersOnly = true;
+    }
+    else if (arg.find(L"--jobs=") == 0)
+    {
+        g_batchJobs = static_cast<unsigned>(wcstoul(arg.c_str() + sizeof(L"--jobs=") / 2 - 1, nullptr, 10));
+    }
+    else if (arg.find(L"--io-depth=") == 0)
+    {
+        g_ioDepth = static_cast<unsigned>(wcstoul(arg.c_str() + sizeof(L"--io-depth=") / 2 - 1, nullptr, 10));
+    }
+    else if (arg == L"--ordered")
+    {
+        g_orderedOutput = true;
+    }
+    else if (arg == L"--format=text")
+    {
+        g_outputFormat = OutputFormat::Text;
+    }
+    else if (arg == L"--format=ndjson")
+    {
+        g_outputFormat = OutputFormat::Ndjson;
+    }
+    else if (arg == L"--format=columnar")
+    {
+        g_outputFormat = OutputFormat::Columnar;
+    }
+    else if (arg.find(L"--cache=") == 0)
+    {
+        g_cachePath = arg.substr(sizeof(L"--cache=") / 2 - 1);
+    }
+    else if (arg == L"--cache-verify")
+    {
+        g_cacheVerify = true;
     }
-    //status = readByteWithRange(filePath, 0, -1);
-    if (!status)
+    else if (arg == L"--symbol-store")
+    {
+        g_symbolStorePath = g_localSymbolCacheDirectory;
+    }
+    else if (arg.find(L"--symbol-store=") == 0 && arg.length() > (sizeof(L"--symbol-store=") / 2 - 1))
+    {
+        g_symbolStorePath = arg.substr(sizeof(L"--symbol-store=") / 2 - 1);
+    }
+    else if (arg.find(L"--incremental=") == 0)
+    {
+        g_snapshotPath = arg.substr(sizeof(L"--incremental=") / 2 - 1);
+    }
+    else if (arg.find(L"--dark") == 0)
+    {
+        g_forceDarkMode = true;
+    }
+    else if (arg.find(L"--light") == 0)
+    {
+        g_forceLightMode = true;
+    }
+    else if (arg.find(L"--run1=") == 0 && arg.length() > (sizeof(L"--run1=") / 2 - 1))
+    {
+        // e.g. --run1=C:\PE Tools\depends.exe|\"%1\"|Open Depends|noadmin
+        wstring programPath;
+        wstring programParam;
+        wstring buttonName;
+        bool runAsAdmin = false;
+        arg = arg.substr(sizeof(L"--run1=") / 2 - 1);
+        // arg is: C:\Tools\depends.exe|\"%1\"|Open Depends|noadmin
+        for (size_t indexSeparator = arg.find(L"|"), count = 0; arg.length() > 0; indexSeparator = arg.find(L"|"), count++)
+        {
+            wstring currentParameter; 
+            if (indexSeparator == -1)
+            {
+                currentParameter = arg;
+                arg = L"";
+            }
+            else
+            {
+                currentParameter = arg.substr(0, indexSeparator);
+                arg = arg.substr(indexSeparator + 1);
+            }
+            switch (count)
+            {
+            case 0:
+                programPath = currentParameter;
+                break;
+            case 1:
+            {
+                programParam = currentParameter;
+                wstring placeholderForFullExePath = L"%1";
+                auto indexOfPercentOne = programParam.find(placeholderForFullExePath);
+                if (indexOfPercentOne != -1)
+                {
+                    programParam.replace(indexOfPercentOne, placeholderForFullExePath.length(), filePath);
+                }
+                break;
+            }                            
+            case 2:
+                buttonName = currentParameter;
+                break;
+            case 3:
+                if (currentParameter == L"admin")                            
+                    runAsAdmin = true;                            
+                else                            
+                    runAsAdmin = false;
+                break;
+            default:
+                break;
+            }
+        }
+        if (programPath.length() > 0 && buttonName.length() > 0)
+        {
+            g_arrExternalProgramBtnInfo.push_back({ programPath, programParam, buttonName, runAsAdmin });
+        }
+    }
+    else
     {
-        showInfo(L"Error: " + filePath + L" can't be opened.");
         return false;
     }
-    extractSectionInfo();
-    DWORD debugDirectoryRaw = rvaToRaw(debugDirectoryRva);
-    void* pDebug = g_fileContent.data() + debugDirectoryRaw;
-    extractDebugGUID(static_cast<IMAGE_DEBUG_DIRECTORY*>(pDebug));
-    fileInfoMsg += L"\r\n";
-    getHashMessage(g_fileContent.data(), static_cast<unsigned long>(g_fileContent.size()));
     return true;
 }
-void showUsage()
-{
-    showInfo(g_usage);
-}
-void showInfo(const std::wstring& msg)
+bool doWork()
 {
-    MessageBoxW(g_hMain ? g_hMain : nullptr, msg.c_str(), L"Quick File Information", MB_OK);
+    if (!(g_headersOnly ? g_image.openHeaders(filePath) : g_image.open(filePath)))
+    {
+        showInfo(g_image.error());
+        return false;
+    }
+    fileInfoMsg = describeImage(g_image);
+    if (!g_headersOnly)
+        fileInfoMsg += formatHashes(computeHashes(g_image, g_hashMask, g_treeHash), g_byteHistogram);
+    return true;
 }
-bool readByteWithRange(const std::wstring& filePath, const size_t start, size_t len)
+int runBatch(const vector<wstring>& args)
 {
-    // if len == -1, read to end
-    // read to global variable g_fileContent
-    ifstream reader(filePath.c_str(), std::ios::binary);
-    if (!reader)
+    g_hHeadlessOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (!g_hHeadlessOutput || g_hHeadlessOutput == INVALID_HANDLE_VALUE)
     {
-        g_fileContent.resize(0);
-        return false;
+        // stdout is not redirected: write to the console of the parent process, if any
+        g_hHeadlessOutput = nullptr;
+        if (AttachConsole(ATTACH_PARENT_PROCESS))
+        {
+            HANDLE hConsole = CreateFileW(L"CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+            if (hConsole != INVALID_HANDLE_VALUE)
+                g_hHeadlessOutput = hConsole;
+        }
     }
-    
-    if (len == -1)
+    vector<wstring> inputs;
+    for (const auto& arg : args)
     {
-        // get total len:
-        reader.seekg(0, std::ios::end);
-        size_t total_len = reader.tellg();
-        if (start >= total_len || total_len == 0)
+        if (arg == L"-")
         {
-            g_fileContent.resize(0);
-            return false;
+            auto lines = readStdinLines();
+            inputs.insert(inputs.end(), lines.begin(), lines.end());
+        }
+        else
+        {
+            inputs.push_back(arg);
         }
-        reader.seekg(start, std::ios::beg);
-        len = total_len - start;
-        g_fileContent.resize(len);
-        reader.read(g_fileContent.data(), len);
     }
-    else
+    if (args.empty())
     {
-        reader.seekg(start, std::ios::beg);
-        if (reader.eof())
+        inputs = readStdinLines();
+    }
+    if (!g_symbolStorePath.empty())
+        return populateSymbolStore(inputs);
+
+    // A record is text, one NDJSON line already encoded as UTF-8, or one row of the columnar table,
+    // built by a worker. NDJSON lines and row groups go through a large buffer straight to the output handle.
+    // A file found by walking a directory that is not a PE file has an empty record, marked skipped.
+    struct Record
+    {
+        bool skipped = false;
+        wstring text;
+        std::string json;
+        ColumnarRow row;
+    };
+    BufferedOutput binaryOutput(g_hHeadlessOutput);
+    std::unique_ptr<ColumnarWriter> columnarOutput;
+    if (g_outputFormat == OutputFormat::Columnar)
+        columnarOutput = std::make_unique<ColumnarWriter>(binaryOutput, vector<ColumnSpec>(std::begin(g_imageColumns), std::end(g_imageColumns)));
+    auto writeRecord = [&](const Record& record)
+    {
+        if (record.skipped)
+            return;
+        switch (g_outputFormat)
         {
-            g_fileContent.resize(0);
-            return false;
+        case OutputFormat::Text:
+            writeHeadlessOutput(record.text);
+            break;
+        case OutputFormat::Ndjson:
+            binaryOutput.write(record.json);
+            break;
+        case OutputFormat::Columnar:
+            columnarOutput->append(record.row);
+            break;
         }
-        g_fileContent.resize(len);
-        reader.read(g_fileContent.data(), len);
-        if (reader.eof())
+    };
+
+    // records are written as soon as they are ready, or held back until all earlier ones are out (--ordered)
+    std::mutex outputMutex;
+    std::map<size_t, Record> heldRecords;
+    size_t nextRecord = 0;
+    auto emitRecord = [&](size_t index, Record record)
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if (!g_orderedOutput)
         {
-            g_fileContent.resize(0);
-            return false;
+            writeRecord(record);
+            return;
         }
+        heldRecords.emplace(index, std::move(record));
+        for (auto it = heldRecords.begin(); it != heldRecords.end() && it->first == nextRecord; it = heldRecords.erase(it), nextRecord++)
+        {
+            writeRecord(it->second);
+        }
+    };
+
+    // The cache holds records of analyzed and of skipped files, keyed by the options that shape a
+    // record and the path. Files that could not be analyzed are not cached; they may be readable next time.
+    std::unique_ptr<ResultCache> cache;
+    std::string cacheTag;
+    if (!g_cachePath.empty())
+    {
+        cache = std::make_unique<ResultCache>();
+        if (!cache->open(g_cachePath))
+            cache.reset();  // the scan goes on without it
+        cacheTag = "QuickFileInfo " + std::to_string(CACHED_RESULT_VERSION) + " format=" + std::to_string(static_cast<int>(g_outputFormat)) +
+            " hash=" + std::to_string(g_hashMask) + " tree=" + std::to_string(g_treeHash) + " histogram=" + std::to_string(g_byteHistogram) + " headers=" + std::to_string(g_headersOnly) + "\n";
     }
-    return true;
+    auto encodeRecord = [](const Record& record)
+    {
+        std::string value(1, record.skipped ? 'S' : 'R');
+        if (record.skipped)
+            return value;
+        switch (g_outputFormat)
+        {
+        case OutputFormat::Text:
+            value.append(reinterpret_cast<const char*>(record.text.data()), record.text.size() * sizeof(wchar_t));
+            break;
+        case OutputFormat::Ndjson:
+            value += record.json;
+            break;
+        case OutputFormat::Columnar:
+            record.row.encode(value);
+            break;
+        }
+        return value;
+    };
+    auto decodeRecord = [](std::string_view value, Record& record)
+    {
+        if (value.empty())
+            return false;
+        record.skipped = value[0] == 'S';
+        value.remove_prefix(1);
+        if (record.skipped)
+            return value.empty();
+        switch (g_outputFormat)
+        {
+        case OutputFormat::Text:
+            if (value.size() % sizeof(wchar_t) != 0)
+                return false;
+            record.text.resize(value.size() / sizeof(wchar_t));
+            memcpy(&record.text[0], value.data(), value.size());
+            return true;
+        case OutputFormat::Ndjson:
+            record.json = value;
+            return true;
+        case OutputFormat::Columnar:
+            return record.row.decode(value);
+        }
+        return false;
+    };
+
+    // --incremental: files unchanged since the previous scan are not even enumerated
+    IncrementalScan tracker;
+    bool incremental = !g_snapshotPath.empty();
+    if (incremental)
+        tracker.load(g_snapshotPath);
+    auto enumerate = [&](const InputFileCallback& callback)
+    {
+        if (incremental)
+            tracker.enumerateChangedFiles(inputs, callback);
+        else
+            enumerateInputFiles(inputs, callback);
+    };
+
+    WorkStealingPool pool(g_batchJobs);
+    std::atomic<size_t> numberOfFailures{ 0 };
+    size_t numberOfFiles = 0;
+    // the record of a file that could not be analyzed; such records are not cached
+    auto failedRecord = [&](const wstring& path, const wstring& error)
+    {
+        numberOfFailures++;
+        if (incremental)
+            tracker.forget(path);  // tried again next time
+        Record record;
+        if (g_outputFormat == OutputFormat::Columnar)
+        {
+            record.row = ColumnarRow(NUMBER_OF_IMAGE_COLUMNS);
+            std::string utf8;
+            appendUtf8(utf8, path);
+            record.row.setBytes(COLUMN_PATH, utf8);
+            utf8.clear();
+            appendUtf8(utf8, error);
+            record.row.setBytes(COLUMN_ERROR, utf8);
+        }
+        else if (g_outputFormat == OutputFormat::Ndjson)
+        {
+            JsonWriter json(record.json);
+            json.beginObject();
+            json.member("file", path);
+            json.member("error", error);
+            json.endObject();
+            record.json += '\n';
+        }
+        else
+        {
+            record.text = L"File: " + path + L"\r\n" + error + L"\r\n\r\n";
+        }
+        return record;
+    };
+    // a file's analysis; head: the first bytes of the file if they were read ahead, else nullptr
+    auto analyzeFile = [&](const wstring& path, bool explicitlyNamed, std::shared_ptr<vector<unsigned char>> head)
+    {
+        Record record;
+        // an unchanged file is answered from the cache without being opened
+        FileStamp stamp;
+        unsigned char digest[QUICK_DIGEST_SIZE];
+        std::string cacheKey;
+        bool cacheable = cache && readFileStamp(path, stamp) && (!g_cacheVerify || quickDigest(path, stamp.size, digest));
+        if (cacheable)
+        {
+            cacheKey = cacheTag;
+            appendUtf8(cacheKey, path);
+            std::string cached;
+            if (cache->lookup(cacheKey, stamp, g_cacheVerify ? digest : nullptr, cached) && decodeRecord(cached, record))
+                return record;
+            record = Record();
+        }
+        auto startsLikePe = [&]() { return head ? head->size() >= 2 && (*head)[0] == 'M' && (*head)[1] == 'Z' : looksLikePeFile(path); };
+        if (!explicitlyNamed && !startsLikePe())
+        {
+            record.skipped = true;
+            if (cacheable)
+                cache->store(cacheKey, stamp, g_cacheVerify ? digest : nullptr, encodeRecord(record));
+            return record;
+        }
+        PeImage image;
+        bool opened = g_headersOnly ? image.openHeaders(path, head ? std::move(*head) : vector<unsigned char>()) : image.open(path);
+        if (!opened)
+            return failedRecord(path, image.error());
+        if (g_outputFormat == OutputFormat::Columnar)
+        {
+            record.row = ColumnarRow(NUMBER_OF_IMAGE_COLUMNS);
+            fillImageRow(record.row, image, g_headersOnly ? FileHashes() : computeHashesOnPool(pool, image, g_hashMask, g_treeHash));
+        }
+        else if (g_outputFormat == OutputFormat::Ndjson)
+        {
+            JsonWriter json(record.json);
+            writeImageJson(json, image, g_headersOnly ? FileHashes() : computeHashesOnPool(pool, image, g_hashMask, g_treeHash), g_byteHistogram);
+            record.json += '\n';
+        }
+        else
+        {
+            record.text = describeImage(image);
+            if (!g_headersOnly)
+                record.text += formatHashes(computeHashesOnPool(pool, image, g_hashMask, g_treeHash), g_byteHistogram);
+            record.text += L"\r\n";
+        }
+        if (cacheable)
+            cache->store(cacheKey, stamp, g_cacheVerify ? digest : nullptr, encodeRecord(record));
+        return record;
+    };
+    auto submitFile = [&](const wstring& path, bool explicitlyNamed, size_t index, std::shared_ptr<vector<unsigned char>> head)
+    {
+        pool.submit([&, path, explicitlyNamed, index, head]()
+            {
+                Record record;
+                try
+                {
+                    record = analyzeFile(path, explicitlyNamed, head);
+                }
+                catch (const std::exception& e)
+                {
+                    // a file that breaks the analysis (out of memory, a malformed field) fails alone, not the scan
+                    std::string what = e.what();
+                    record = failedRecord(path, L"Analysis failed: " + wstring(what.begin(), what.end()));
+                }
+                emitRecord(index, std::move(record));
+            });
+    };
+    // --headers-only: the walk thread reads the first block of every file ahead, with many reads in
+    // flight, and the worker only reads what lies past it. Not with a cache, whose hits don't need the file.
+    std::unique_ptr<AsyncFileReader> reader;
+    if (g_headersOnly && !cache)
+        reader = std::make_unique<AsyncFileReader>(g_ioDepth ? g_ioDepth : AsyncFileReader::DEFAULT_QUEUE_DEPTH);
+    enumerate([&](const wstring& path, bool explicitlyNamed)
+        {
+            size_t index = numberOfFiles++;
+            unsigned long long size = 0;
+            int file = reader ? reader->openFile(path, size) : -1;
+            if (file < 0)
+            {
+                submitFile(path, explicitlyNamed, index, nullptr);
+            }
+            else
+            {
+                auto head = std::make_shared<vector<unsigned char>>(static_cast<size_t>(std::min<unsigned long long>(size, PeImage::HEADER_READ_SIZE)));
+                reader->read(file, 0, head->data(), head->size(), [&, path, explicitlyNamed, index, file, head](bool ok, size_t bytesRead)
+                    {
+                        reader->closeFile(file);
+                        head->resize(bytesRead);
+                        submitFile(path, explicitlyNamed, index, ok ? head : nullptr);
+                    });
+                reader->poll(false);
+            }
+            // don't let the directory walk run arbitrarily far ahead of the workers
+            pool.throttle(4 * pool.size());
+        });
+    if (reader)
+        reader->drain();
+    pool.waitIdle();
+    if (cache)
+        cache->flush();
+    if (incremental)
+        tracker.save(g_snapshotPath);
+    if (columnarOutput)
+        columnarOutput->finish();
+    binaryOutput.flush();
+    return numberOfFailures == 0 ? 0 : 1;
 }
-bool extractBasicInfo()
+int populateSymbolStore(const vector<wstring>& inputs)
 {
-    void* fileCurrentParsePosition = g_fileContent.data();
-    IMAGE_DOS_HEADER* dosHeader = static_cast<IMAGE_DOS_HEADER*>(fileCurrentParsePosition);
-    if (dosHeader->e_magic != 'ZM')
+    // the workers read the CodeView record of every image; the store downloads and copies behind them
+    std::mutex outputMutex;
+    std::atomic<size_t> numberOfFailures{ 0 };
+    SymbolStore::Options options;
+    options.root = g_symbolStorePath;
+    options.servers = g_symbolServers;
+    options.numberOfConnections = g_downloadConnections;
+    options.proxyType = proxyType;
+    options.proxyServer = g_proxyServer;
+    options.proxyBypass = g_proxyBypass;
+    options.isHttp2Enabled = g_isHttp2Enabled;
+    options.negativeTtlSeconds = g_negativeTtlSeconds;
+    SymbolStore store(options, [&](const wstring& entry, SymbolStore::Outcome outcome, const wstring& detail)
+        {
+            static const wchar_t* const outcomeNames[] = { L"Stored", L"Already present", L"Not on any server", L"Failed" };
+            std::lock_guard<std::mutex> lock(outputMutex);
+            writeHeadlessOutput(wstring(outcomeNames[static_cast<size_t>(outcome)]) + L": " + entry + (detail.empty() ? L"" : L" (" + detail + L")") + L"\r\n");
+        });
+    WorkStealingPool pool(g_batchJobs);
+    enumerateInputFiles(inputs, [&](const wstring& path, bool explicitlyNamed)
+        {
+            pool.submit([&, path, explicitlyNamed]()
+                {
+                    wstring error;
+                    try
+                    {
+                        if (!explicitlyNamed && !looksLikePeFile(path))
+                            return;
+                        PeImage image;
+                        if (image.openHeaders(path))
+                            store.addImage(path, image.debugInfo());
+                        else
+                            error = image.error();
+                    }
+                    catch (const std::exception& e)
+                    {
+                        std::string what = e.what();
+                        error = L"Analysis failed: " + wstring(what.begin(), what.end());
+                    }
+                    if (!error.empty())
+                    {
+                        numberOfFailures++;
+                        std::lock_guard<std::mutex> lock(outputMutex);
+                        writeHeadlessOutput(L"File: " + path + L"\r\n" + error + L"\r\n");
+                    }
+                });
+            pool.throttle(4 * pool.size());
+        });
+    pool.waitIdle();
+    store.finish();
+    writeHeadlessOutput(std::to_wstring(store.count(SymbolStore::Outcome::Stored)) + L" stored, " +
+        std::to_wstring(store.count(SymbolStore::Outcome::AlreadyPresent)) + L" already present, " +
+        std::to_wstring(store.count(SymbolStore::Outcome::NotFound)) + L" not on any server, " +
+        std::to_wstring(store.count(SymbolStore::Outcome::Failed)) + L" failed; " +
+        std::to_wstring(store.requestCount()) + L" requests, " + std::to_wstring(store.reusedRequestCount()) + L" of them on kept-alive connections\r\n");
+    return numberOfFailures == 0 && store.count(SymbolStore::Outcome::Failed) == 0 ? 0 : 1;
+}
+void writeHeadlessOutput(const std::wstring& str)
+{
+    if (!g_hHeadlessOutput || str.empty())
+        return;
+    if (GetFileType(g_hHeadlessOutput) == FILE_TYPE_CHAR)
     {
-        showInfo(L"Error: File " + filePath + L" is not a valid PE file: does not start with \"PE\"");
-        return false;
+        writeConsole(g_hHeadlessOutput, str);
+        return;
     }
-    LONG offsetToNtHeader = dosHeader->e_lfanew;
-    if (offsetToNtHeader + sizeof(IMAGE_NT_HEADERS32) > g_fileContent.size() ||
-        offsetToNtHeader + sizeof(IMAGE_NT_HEADERS64) > g_fileContent.size())
-    {
-        showInfo(L"Error: File " + filePath + L" is not a valid PE file: DOS header's e_lfanew value is too large");
-        return false;
+    // redirected to a file or a pipe: write UTF-8
+    int len = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), static_cast<int>(str.length()), nullptr, 0, nullptr, nullptr);
+    std::string utf8(len, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, str.c_str(), static_cast<int>(str.length()), &utf8[0], len, nullptr, nullptr);
+    DWORD written = 0;
+    WriteFile(g_hHeadlessOutput, utf8.data(), static_cast<DWORD>(utf8.size()), &written, nullptr);
+}
+vector<wstring> readStdinLines()
+{
+    // stdin is read as UTF-8 text, one path per line
+    vector<wstring> lines;
+    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+    if (!hStdin || hStdin == INVALID_HANDLE_VALUE)
+        return lines;
+    std::string content;
+    char buf[64 * 1024];
+    DWORD bytesRead = 0;
+    while (ReadFile(hStdin, buf, sizeof(buf), &bytesRead, nullptr) && bytesRead > 0)
+    {
+        content.append(buf, bytesRead);
+    }
+    if (content.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        content.erase(0, 3);  // BOM
+    int len = MultiByteToWideChar(CP_UTF8, 0, content.data(), static_cast<int>(content.size()), nullptr, 0);
+    wstring text(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, content.data(), static_cast<int>(content.size()), &text[0], len);
+    size_t start = 0;
+    while (start < text.length())
+    {
+        size_t end = text.find(L'\n', start);
+        if (end == wstring::npos)
+            end = text.length();
+        wstring line = text.substr(start, end - start);
+        line.erase(std::remove(line.begin(), line.end(), L'\r'), line.end());
+        if (!line.empty())
+            lines.push_back(line);
+        start = end + 1;
     }
-    fileCurrentParsePosition = g_fileContent.data() + offsetToNtHeader;
-    auto nt32Header = static_cast<IMAGE_NT_HEADERS32*>(fileCurrentParsePosition);
-    if (nt32Header->Signature != 'EP')
+    return lines;
+}
+void showUsage()
+{
+    showInfo(g_usage);
+}
+void showInfo(const std::wstring& msg)
+{
+    if (g_headless)
     {
-        // wrong signature
-        showInfo(L"Error: File " + filePath + L" is not a valid PE file: Wrong PE Signature");
-        return false;
+        // batch mode never shows a message box
+        writeHeadlessOutput(msg + L"\r\n");
+        return;
     }
-    const auto& fileHeader = nt32Header->FileHeader;
-    switch (fileHeader.Machine)
+    MessageBoxW(g_hMain ? g_hMain : nullptr, msg.c_str(), L"Quick File Information", MB_OK);
+}
+wstring describeImage(const PeImage& image)
+{
+    wstring msg = L"File: " + image.path() + L"\r\n";
+    switch (image.machine())
     {
     case IMAGE_FILE_MACHINE_I386:
-        fileInfoMsg += L"Architecture: 32-bit x86\r\n";
+        msg += L"Architecture: 32-bit x86\r\n";
         break;
     case IMAGE_FILE_MACHINE_IA64:
-        fileInfoMsg += L"Architecture: IA64\r\n";
+        msg += L"Architecture: IA64\r\n";
         break;
     case IMAGE_FILE_MACHINE_AMD64:
-        fileInfoMsg += L"Architecture: 64-bit x64\r\n";
+        msg += L"Architecture: 64-bit x64\r\n";
         break;
     case IMAGE_FILE_MACHINE_ARM:
-        fileInfoMsg += L"Architecture: ARM\r\n";
+        msg += L"Architecture: ARM\r\n";
         break;
     case IMAGE_FILE_MACHINE_ARM64:
-        fileInfoMsg += L"Architecture: ARM64\r\n";
+        msg += L"Architecture: ARM64\r\n";
         break;
     default:
-        fileInfoMsg += L"Architecture: Unknown\r\n";
+        msg += L"Architecture: Unknown\r\n";
         break;
     }
-    fileInfoMsg += L"Number of sections: " + std::to_wstring(fileHeader.NumberOfSections) + L"\r\n";
-    numOfSection = fileHeader.NumberOfSections;
+    msg += L"Number of sections: " + std::to_wstring(image.fileHeader().NumberOfSections) + L"\r\n";
 
-    WORD characteristics = fileHeader.Characteristics;
+    WORD characteristics = image.characteristics();
 
 #define CHECK_AND_OUTPUT_CHARACTERISTIC(name) do { \
-fileInfoMsg = fileInfoMsg + L#name + L": " + ((characteristics & name) ? L"Yes" : L"No") + L"\r\n";\
+msg = msg + L#name + L": " + ((characteristics & name) ? L"Yes" : L"No") + L"\r\n";\
 } while(0)
 
     CHECK_AND_OUTPUT_CHARACTERISTIC(IMAGE_FILE_RELOCS_STRIPPED);
@@ -603,250 +1160,743 @@ fileInfoMsg = fileInfoMsg + L#name + L": " + ((characteristics & name) ? L"Yes"
     CHECK_AND_OUTPUT_CHARACTERISTIC(IMAGE_FILE_DLL);
 #undef CHECK_AND_OUTPUT_CHARACTERISTIC
 
-    if (fileHeader.SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER32))
+    if (image.isDotNet())
     {
-        const auto& optionalHeader = nt32Header->OptionalHeader;
-        if (optionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR32_MAGIC)
-        {
-            showInfo(L"Error: File " + filePath + L" is not a valid PE file: OptionalHeader32.Magic is incorrect.");
-            return false;
-        }
-        g_SizeOfImage = optionalHeader.SizeOfImage;
-        is32bit = true;
-        pOptionalHeaders32 = &nt32Header->OptionalHeader;
-        sectionHeader = (IMAGE_SECTION_HEADER*)(nt32Header + 1);
-        debugDirectoryRva = optionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].VirtualAddress;
-        debugDirectoryLen = optionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].Size;  // debug directory
-        if (optionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR].Size != 0)
-        {
-            fileInfoMsg += L".NET executable: Yes\r\n";
-        }
-        else
-        {
-            fileInfoMsg += L".NET executable: No\r\n";
-        }
-        
-        parseSubsystem(pOptionalHeaders32->Subsystem);
-        parseDllCharacteristics(pOptionalHeaders32->DllCharacteristics);
+        msg += L".NET executable: Yes\r\n";
     }
-    else if (fileHeader.SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER64))
+    else
     {
-        auto nt64Header = static_cast<IMAGE_NT_HEADERS64*>(fileCurrentParsePosition);
-        const auto& optionalHeader = nt64Header->OptionalHeader;
-        if (optionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR64_MAGIC)
-        {
-            showInfo(L"Error: File " + filePath + L" is not a valid PE file: OptionalHeader64.Magic is incorrect.");
-            return false;
-        }
-        g_SizeOfImage = optionalHeader.SizeOfImage;
-        is32bit = false;
-        pOptionalHeaders64 = &nt64Header->OptionalHeader;
-        sectionHeader = (IMAGE_SECTION_HEADER*)(nt64Header + 1);
-        debugDirectoryRva = optionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].VirtualAddress;
-        debugDirectoryLen = optionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].Size;  // debug directory
-        if (optionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR].Size != 0)
+        msg += L".NET executable: No\r\n";
+    }
+    msg += describeSubsystem(image.subsystem());
+    msg += describeDllCharacteristics(image.dllCharacteristics());
+    if (!image.sections().empty())
+    {
+        msg += L"\r\n";
+    }
+    if (image.hasDebugInfo())
+    {
+        msg += L"PDB GUID: " + image.debugInfo().pdbGuid + L"\r\n";
+        msg += L"PDB File: " + image.debugInfo().pdbFile + L"\r\n";
+    }
+    msg += L"\r\n";
+    if (image.headersOnly())
+        return msg;
+    msg += describeImports(image);
+    msg += describeExports(image);
+    msg += describeResources(image);
+    msg += describeRichHeader(image);
+    return msg;
+}
+wstring describeRichHeader(const PeImage& image)
+{
+    RichHeader rich = parseRichHeader(image);
+    if (!rich.present)
+    {
+        return L"";
+    }
+    wstring msg = L"Rich header: " + std::to_wstring(rich.entries.size()) + L" tool(s), checksum " +
+        (rich.checksumValid ? L"valid" : L"invalid") + L", MD5 " + rich.hash + L"\r\n";
+    for (const auto& entry : rich.entries)
+    {
+        msg += L"  product " + std::to_wstring(entry.productId) + L", build " + std::to_wstring(entry.build) +
+            L": " + std::to_wstring(entry.count) + L" object(s)\r\n";
+    }
+    msg += L"\r\n";
+    return msg;
+}
+wstring describeExports(const PeImage& image)
+{
+    ExportTable exports(image);
+    if (exports.functions().empty())
+    {
+        return L"";
+    }
+    size_t numberOfForwarders = std::count_if(exports.functions().begin(), exports.functions().end(),
+        [](const ExportedFunction& function) { return !function.forwarder.empty(); });
+    wstring msg = L"Exports: " + wstring(exports.dllName().begin(), exports.dllName().end()) + L", " +
+        std::to_wstring(exports.functions().size()) + L" function(s), " + std::to_wstring(exports.numberOfNames()) + L" name(s), " +
+        std::to_wstring(numberOfForwarders) + L" forwarded" + (exports.truncated() ? L", truncated" : L"") + L"\r\n\r\n";
+    return msg;
+}
+wstring describeResources(const PeImage& image)
+{
+    ResourceDirectory resources(image);
+    if (resources.leaves().empty())
+    {
+        return L"";
+    }
+    wstring msg = L"Resources: " + std::to_wstring(resources.leaves().size()) + L" in " + std::to_wstring(resources.numberOfTypes()) +
+        L" type(s)" + (resources.truncated() ? L", truncated" : L"") + L"\r\n";
+    VersionInfo version;
+    if (resources.versionInfo(version))
+    {
+        if (!version.fileVersion.empty())
+            msg += L"  File version: " + version.fileVersion + L"\r\n";
+        if (!version.productVersion.empty())
+            msg += L"  Product version: " + version.productVersion + L"\r\n";
+        for (const wchar_t* key : { L"CompanyName", L"ProductName", L"FileDescription", L"OriginalFilename" })
         {
-            fileInfoMsg += L".NET executable: Yes\r\n";
+            wstring value = version.value(key);
+            if (!value.empty())
+                msg += wstring(L"  ") + key + L": " + value + L"\r\n";
         }
-        else
+    }
+    std::string_view manifest = resources.manifest();
+    if (!manifest.empty())
+        msg += L"  Manifest: " + std::to_wstring(manifest.size()) + L" bytes\r\n";
+    auto iconGroups = resources.iconGroups();
+    if (!iconGroups.empty())
+    {
+        // the first group is the one Explorer shows
+        msg += L"  Icons: " + std::to_wstring(iconGroups.size()) + L" group(s)";
+        if (!iconGroups[0].empty())
         {
-            fileInfoMsg += L".NET executable: No\r\n";
+            msg += L", first has";
+            for (const auto& icon : iconGroups[0])
+                msg += L" " + std::to_wstring(icon.width) + L"x" + std::to_wstring(icon.height);
         }
-
-        parseSubsystem(pOptionalHeaders64->Subsystem);
-        parseDllCharacteristics(pOptionalHeaders64->DllCharacteristics);
+        msg += L"\r\n";
     }
-    else
+    msg += L"\r\n";
+    return msg;
+}
+wstring describeImports(const PeImage& image)
+{
+    ImportTable imports(image);
+    if (imports.modules().empty())
     {
-        showInfo(L"Error: File " + filePath + L" is not a valid PE file: size of optional header is incorrect");
-        return false;
+        return L"";
     }
-    return true;
+    wstring msg = L"Imports: " + std::to_wstring(imports.functions().size()) + L" function(s) from " +
+        std::to_wstring(imports.modules().size()) + L" DLL(s)" + (imports.truncated() ? L", truncated" : L"") + L"\r\n";
+    for (const auto& module : imports.modules())
+    {
+        // DLL names are ASCII in practice
+        msg += L"  " + wstring(module.name.begin(), module.name.end()) + L" (" + std::to_wstring(module.numberOfFunctions) +
+            (module.delayLoaded ? L", delay-loaded" : L"") + L")\r\n";
+    }
+    wstring importHash = imphash(imports);
+    if (!importHash.empty())
+        msg += L"Imphash: " + importHash + L"\r\n";
+    msg += L"\r\n";
+    return msg;
 }
-void parseSubsystem(WORD Subsystem)
+wstring describeSubsystem(WORD Subsystem)
 {
     switch (Subsystem) {        
-    case IMAGE_SUBSYSTEM_NATIVE: fileInfoMsg += L"Subsystem: driver or native exe\r\n"; break; 
-    case IMAGE_SUBSYSTEM_WINDOWS_GUI: fileInfoMsg += L"Subsystem: GUI\r\n"; break; 
-    case IMAGE_SUBSYSTEM_WINDOWS_CUI: fileInfoMsg += L"Subsystem: Console\r\n"; break; 
-    case IMAGE_SUBSYSTEM_WINDOWS_BOOT_APPLICATION: fileInfoMsg += L"Subsystem: Boot application\r\n"; break; 
-    default: fileInfoMsg += L"Subsystem: Unknown (" + std::to_wstring(Subsystem) + L")\r\n"; break;
+    case IMAGE_SUBSYSTEM_NATIVE: return L"Subsystem: driver or native exe\r\n"; 
+    case IMAGE_SUBSYSTEM_WINDOWS_GUI: return L"Subsystem: GUI\r\n"; 
+    case IMAGE_SUBSYSTEM_WINDOWS_CUI: return L"Subsystem: Console\r\n"; 
+    case IMAGE_SUBSYSTEM_WINDOWS_BOOT_APPLICATION: return L"Subsystem: Boot application\r\n"; 
+    default: return L"Subsystem: Unknown (" + std::to_wstring(Subsystem) + L")\r\n";
     }
 }
-void parseDllCharacteristics(WORD dll)
+wstring describeDllCharacteristics(WORD dll)
 {
-    fileInfoMsg += L"DLL Characteristics:\r\n";
+    wstring msg = L"DLL Characteristics:\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_HIGH_ENTROPY_VA)
-        fileInfoMsg += L"  High entropy 64-bit address space\r\n";
+        msg += L"  High entropy 64-bit address space\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE)
-        fileInfoMsg += L"  The DLL can be relocated at load time.\r\n";
+        msg += L"  The DLL can be relocated at load time.\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_FORCE_INTEGRITY)
-        fileInfoMsg += L"  Code integrity checks are forced (linker: /integritycheck).\r\n";
+        msg += L"  Code integrity checks are forced (linker: /integritycheck).\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_NX_COMPAT)
-        fileInfoMsg += L"  DEP enabled\r\n";
+        msg += L"  DEP enabled\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_NO_ISOLATION)
-        fileInfoMsg += L"  The image is isolation aware, but should not be isolated.\r\n";
+        msg += L"  The image is isolation aware, but should not be isolated.\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_NO_SEH)
-        fileInfoMsg += L"  No SEH\r\n";
+        msg += L"  No SEH\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_NO_BIND)
-        fileInfoMsg += L"  Do not bind this image.\r\n";
+        msg += L"  Do not bind this image.\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_WDM_DRIVER)
-        fileInfoMsg += L"  WDM driver\r\n";
+        msg += L"  WDM driver\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_TERMINAL_SERVER_AWARE)
-        fileInfoMsg += L"  Terminal server aware\r\n";
+        msg += L"  Terminal server aware\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_GUARD_CF)
-        fileInfoMsg += L"  CFG enabled\r\n";
+        msg += L"  CFG enabled\r\n";
     if (dll & IMAGE_DLLCHARACTERISTICS_APPCONTAINER)
-        fileInfoMsg += L"  Should run in AppContainer\r\n";
+        msg += L"  Should run in AppContainer\r\n";
+    return msg;
 }
-void extractSectionInfo()
+// Digests of the signature's algorithm are always computed, so the signed digest can be checked
+unsigned authenticodeMask(const AuthenticodeSignature& signature, unsigned hashMask)
 {
-    if (!sectionHeader || !numOfSection)
-        return;
-    
-    for (DWORD index = 0; index < numOfSection; index++)
+    return signature.hasHashType ? hashMask | hashFlag(signature.hashType) : hashMask;
+}
+// digests that depend on the image layout, fed from the same read as the whole-file digests
+struct ImageSinks
+{
+    ImageSinks(const PeImage& image, const AuthenticodeSignature& signature, unsigned hashMask)
+        : authenticode(image, authenticodeMask(signature, hashMask)), sections(image.sections(), hashMask), byteStatistics(image.sections())
     {
-        IMAGE_SECTION_HEADER* currentSectionHeader = sectionHeader + index;
-        DWORD va = currentSectionHeader->VirtualAddress;
-        DWORD virtualsize = currentSectionHeader->Misc.VirtualSize;
-        DWORD ptrToRawData = currentSectionHeader->PointerToRawData;
+    }
+    vector<ChunkSink*> all() { return { &authenticode, &sections, &byteStatistics }; }
+    void readInto(FileHashes& hashes)
+    {
+        for (int i = 0; i < NUMBER_OF_HASH_TYPES; i++)
+            hashes.authenticode[i] = authenticode.hexDigest(static_cast<HashType>(i));
+        hashes.sections = sections.digests();
+        hashes.fileStatistics = byteStatistics.file();
+        hashes.sectionStatistics = byteStatistics.sections();
+    }
 
-        // <VA, PointerToRawData, Size>
-        vecSectionInfo.push_back(std::make_tuple(va, ptrToRawData, virtualsize));        
+    AuthenticodeHash authenticode;
+    SectionHashes sections;
+    ByteStatisticsSink byteStatistics;
+};
+// the whole-file digests and the image sinks in one walk over the mapping, chunk by chunk
+void hashInOnePass(const unsigned char* fileContent, size_t fileLen, unsigned hashMask, ImageSinks& imageSinks, FileHashes& hashes)
+{
+    MultiHash hash(hashMask);
+    vector<ChunkSink*> sinks = imageSinks.all();
+    for (size_t offset = 0; offset < fileLen; offset += MultiHash::CHUNK_SIZE)
+    {
+        size_t len = fileLen - offset < MultiHash::CHUNK_SIZE ? fileLen - offset : MultiHash::CHUNK_SIZE;
+        hash.update(fileContent + offset, len);
+        for (auto sink : sinks)
+            sink->consume(offset, fileContent + offset, len);
     }
-    fileInfoMsg += L"\r\n";
+    for (int i = 0; i < NUMBER_OF_HASH_TYPES; i++)
+        hashes.digests[i] = hash.hexDigest(static_cast<HashType>(i));
+    imageSinks.readInto(hashes);
+    hashes.mode = L"single pass";
 }
-void extractDebugGUID(IMAGE_DEBUG_DIRECTORY* pFirstDebugDirectory)
+FileHashes computeHashes(const PeImage& image, unsigned hashMask, bool treeHash)
 {
-    // https://github.com/dotnet/symstore/blob/master/docs/specs/SSQP_Key_Conventions.md
-    if (debugDirectoryLen % sizeof(IMAGE_DEBUG_DIRECTORY) != 0)
-        return;
-    size_t numOfDebugDirectory = debugDirectoryLen / sizeof(IMAGE_DEBUG_DIRECTORY);
-    for (size_t i = 0; i < numOfDebugDirectory; i++)
-    {
-        auto curDebugDir = pFirstDebugDirectory + i;
-        if (curDebugDir->Type == IMAGE_DEBUG_TYPE_CODEVIEW)
+    const unsigned char* fileContent = image.data();
+    size_t fileLen = image.size();
+    FileHashes hashes;
+    hashes.signature = parseAuthenticodeSignature(image);
+    ImageSinks imageSinks(image, hashes.signature, hashMask);
+    bool hashed = false;
+    if (fileLen >= PIPELINE_THRESHOLD)
+    {
+        // large file: an I/O thread reads ahead while each digest runs on its own worker
+        vector<DigestSink> sinks;
+        sinks.reserve(NUMBER_OF_HASH_TYPES);
+        HashPipeline pipeline;
+        for (int i = 0; i < NUMBER_OF_HASH_TYPES; i++)
         {
-            DWORD dataLen = curDebugDir->SizeOfData;
-            DWORD dataRva = curDebugDir->AddressOfRawData;
-            DWORD dataRaw = curDebugDir->PointerToRawData;
-            DWORD dataCalculatedRaw = rvaToRaw(dataRva);
-            if (dataCalculatedRaw == dataRaw)
+            if (hashMask & hashFlag(static_cast<HashType>(i)))
             {
-                // info is consistent
-                auto rsdsStruct = static_cast<undocCodeViewFormat*>(static_cast<void*>(g_fileContent.data() + dataRaw));
-                wstring wGUID = guidToWstring(rsdsStruct->guid);
-                std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-                std::wstring wPDbFileName = converter.from_bytes(rsdsStruct->pdbName);
-                fileInfoMsg += L"PDB GUID: " + wGUID + L"\r\n";
-                fileInfoMsg += L"PDB File: " + wPDbFileName + L"\r\n";
-
-                g_debugAge = std::to_wstring(rsdsStruct->age);
-                g_debugGUID = wGUID;
-                g_pdbFile = wPDbFileName;
-                DWORD timestamp = curDebugDir->TimeDateStamp;
-                wchar_t exekey[17]{};
-                swprintf_s(exekey, L"%08X%X", timestamp, g_SizeOfImage);  // timestamp (but not size of image) must pad to 8 chars with zeros prefixed
-                g_exeKey = exekey;
+                sinks.emplace_back(static_cast<HashType>(i));
+                pipeline.addSink(&sinks.back());
             }
         }
+        for (auto sink : imageSinks.all())
+            pipeline.addSink(sink);
+        if (pipeline.run(image.path()))
+        {
+            for (auto& sink : sinks)
+                hashes.digests[static_cast<int>(sink.type())] = sink.hexDigest();
+            imageSinks.readInto(hashes);
+            hashes.mode = L"pipelined, " + std::to_wstring(sinks.size() + imageSinks.all().size()) + L" worker(s)";
+            hashed = true;
+        }
+    }
+    if (!hashed)
+    {
+        // a failed pipeline may have fed part of the file to the sinks already
+        ImageSinks fresh(image, hashes.signature, hashMask);
+        hashInOnePass(fileContent, fileLen, hashMask, fresh, hashes);
     }
+    if (treeHash)
+    {
+        unsigned numberOfThreads = std::thread::hardware_concurrency();
+        hashes.treeHash = treeHashSha256(fileContent, fileLen, numberOfThreads);
+        hashes.treeMode = L"tree, 1 MB leaves, " + std::to_wstring(numberOfThreads) + L" thread(s)";
+    }
+    return hashes;
 }
-DWORD rvaToRaw(DWORD rva)
+FileHashes computeHashesOnPool(WorkStealingPool& pool, const PeImage& image, unsigned hashMask, bool treeHash)
 {
-    for (const auto& sec : vecSectionInfo)
-    {
-        DWORD va = 0;
-        DWORD vSize = 0;
-        DWORD ptrToRawData = 0;
-        std::tie(va, ptrToRawData, vSize) = sec;
-        if (rva >= va && rva < va + vSize)
+    // subtasks are waited for with pool.waitFor, so the calling worker helps instead of blocking
+    const unsigned char* fileContent = image.data();
+    size_t fileLen = image.size();
+    FileHashes hashes;
+    hashes.signature = parseAuthenticodeSignature(image);
+    ImageSinks imageSinks(image, hashes.signature, hashMask);
+    if (fileLen < PIPELINE_THRESHOLD)
+    {
+        // small file: analyzed whole on this worker, other files keep the other workers busy
+        hashInOnePass(fileContent, fileLen, hashMask, imageSinks, hashes);
+        if (treeHash)
         {
-            return rva - va + ptrToRawData;
+            vector<unsigned char> leafDigests(treeHashLeafCount(fileLen) * Sha256::DIGEST_SIZE);
+            treeHashLeaves(fileContent, fileLen, 0, treeHashLeafCount(fileLen), leafDigests.data());
+            hashes.treeHash = treeHashRoot(leafDigests.data(), fileLen);
+            hashes.treeMode = L"tree, 1 MB leaves, 1 thread(s)";
         }
+        return hashes;
     }
-    return 0;
+
+    // large file: walked once, one window at a time. Each digest, each image sink and the tree hash
+    // leaves of the window are subtasks that idle workers can steal; they all read the window while
+    // it is in memory, and the next window is started when they are done with it.
+    constexpr size_t LEAVES_PER_WINDOW = 8;  // a full set of sha256MultiBuffer lanes
+    constexpr size_t WINDOW_SIZE = LEAVES_PER_WINDOW * TREE_HASH_LEAF_SIZE;
+    vector<DigestSink> digestSinks;
+    digestSinks.reserve(NUMBER_OF_HASH_TYPES);
+    vector<ChunkSink*> sinks;
+    for (int i = 0; i < NUMBER_OF_HASH_TYPES; i++)
+    {
+        if (hashMask & hashFlag(static_cast<HashType>(i)))
+        {
+            digestSinks.emplace_back(static_cast<HashType>(i));
+            sinks.push_back(&digestSinks.back());
+        }
+    }
+    for (auto sink : imageSinks.all())
+        sinks.push_back(sink);
+    size_t numberOfLeaves = treeHashLeafCount(fileLen);
+    vector<unsigned char> leafDigests(treeHash ? numberOfLeaves * Sha256::DIGEST_SIZE : 0);
+
+    std::atomic<size_t> pending{ 0 };
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    // a subtask that throws still counts down, or waitFor would never return; the error is rethrown here
+    auto submitSubtask = [&](std::function<void()> work)
+    {
+        pending++;
+        pool.submit([&, work]()
+            {
+                try
+                {
+                    work();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                pending--;
+            });
+    };
+    for (size_t offset = 0; offset < fileLen && !error; offset += WINDOW_SIZE)
+    {
+        size_t len = fileLen - offset < WINDOW_SIZE ? fileLen - offset : WINDOW_SIZE;
+        for (auto sink : sinks)
+            submitSubtask([=]() { sink->consume(offset, fileContent + offset, len); });
+        if (treeHash)
+        {
+            size_t first = offset / TREE_HASH_LEAF_SIZE;
+            size_t last = first + LEAVES_PER_WINDOW < numberOfLeaves ? first + LEAVES_PER_WINDOW : numberOfLeaves;
+            submitSubtask([&, first, last]() { treeHashLeaves(fileContent, fileLen, first, last, leafDigests.data()); });
+        }
+        pool.waitFor(pending);
+    }
+    if (error)
+        std::rethrow_exception(error);
+    for (auto& sink : digestSinks)
+        hashes.digests[static_cast<int>(sink.type())] = sink.hexDigest();
+    imageSinks.readInto(hashes);
+    hashes.mode = L"windowed, " + std::to_wstring(sinks.size() + (treeHash ? 1 : 0)) + L" subtask(s) per " + std::to_wstring(WINDOW_SIZE >> 20) + L" MB";
+    if (treeHash)
+    {
+        hashes.treeHash = treeHashRoot(leafDigests.data(), fileLen);
+        hashes.treeMode = L"tree, 1 MB leaves, " + std::to_wstring(pool.size()) + L" thread(s)";
+    }
+    return hashes;
 }
-wstring guidToWstring(const GUID& guid)
+// bits per byte with two decimals; packed or encrypted data is close to 8
+wstring formatEntropy(const ByteStatistics& statistics)
 {
-    wchar_t wsGUID[100]{};
-    if (StringFromGUID2(guid, wsGUID, sizeof(wsGUID) / sizeof(wsGUID[0])) > 0)
-    {
-        return wstring(wsGUID);
-    }
-    return L"";
+    wchar_t text[16];
+    swprintf_s(text, L"%.2f", statistics.entropy());
+    return text;
 }
-void getHashMessage(const char* const fileContent, const unsigned long fileLen)
+wstring formatHashes(const FileHashes& hashes, bool byteHistogram)
 {
-    std::wstring wsMD5 = GetHashText(fileContent, fileLen, HashType::HashMd5);
-    std::wstring wsSHA1 = GetHashText(fileContent, fileLen, HashType::HashSha1);
-    std::wstring wsSHA256 = GetHashText(fileContent, fileLen, HashType::HashSha256);
+    wstring msg;
+    const wstring& wsMD5 = hashes.digests[static_cast<int>(HashType::HashMd5)];
+    const wstring& wsSHA1 = hashes.digests[static_cast<int>(HashType::HashSha1)];
+    const wstring& wsSHA256 = hashes.digests[static_cast<int>(HashType::HashSha256)];
     if (wsMD5.length() > 0)
-        fileInfoMsg += L"MD5: " + wsMD5 + L"\r\n";
+        msg += L"MD5: " + wsMD5 + L"  [" + hashes.mode + L"]\r\n";
     if (wsSHA1.length() > 0)
-        fileInfoMsg += L"SHA1: " + wsSHA1 + L"\r\n";
+        msg += L"SHA1: " + wsSHA1 + L"  [" + hashes.mode + L"]\r\n";
     if (wsSHA256.length() > 0)
-        fileInfoMsg += L"SHA256: " + wsSHA256 + L"\r\n";
+        msg += L"SHA256: " + wsSHA256 + L"  [" + hashes.mode + L"]\r\n";
+    if (hashes.treeHash.length() > 0)
+        msg += L"Tree SHA256: " + hashes.treeHash + L"  [" + hashes.treeMode + L"]\r\n";
+    const wstring& authenticodeSHA1 = hashes.authenticode[static_cast<int>(HashType::HashSha1)];
+    const wstring& authenticodeSHA256 = hashes.authenticode[static_cast<int>(HashType::HashSha256)];
+    if (authenticodeSHA1.length() > 0)
+        msg += L"Authenticode SHA1: " + authenticodeSHA1 + L"\r\n";
+    if (authenticodeSHA256.length() > 0)
+        msg += L"Authenticode SHA256: " + authenticodeSHA256 + L"\r\n";
+    msg += L"Entropy: " + formatEntropy(hashes.fileStatistics) + L"\r\n";
+    if (!hashes.sections.empty())
+        msg += L"Sections:\r\n";
+    for (size_t i = 0; i < hashes.sections.size(); i++)
+    {
+        const SectionDigest& section = hashes.sections[i];
+        msg += L"  " + wstring(section.name.begin(), section.name.end()) + L": entropy " + formatEntropy(hashes.sectionStatistics[i]);
+        if (!section.md5.empty())
+            msg += L", MD5 " + section.md5;
+        if (!section.sha256.empty())
+            msg += L", SHA256 " + section.sha256;
+        msg += L"\r\n";
+    }
+    if (byteHistogram)
+    {
+        // 16 rows of 16 counts, the row starts with the first byte value it counts
+        msg += L"Byte histogram:\r\n";
+        for (int row = 0; row < 256; row += 16)
+        {
+            wchar_t rowStart[8];
+            swprintf_s(rowStart, L"  %02X:", row);
+            msg += rowStart;
+            for (int i = row; i < row + 16; i++)
+                msg += L" " + std::to_wstring(hashes.fileStatistics.histogram[i]);
+            msg += L"\r\n";
+        }
+    }
+    const AuthenticodeSignature& signature = hashes.signature;
+    if (!signature.present)
+    {
+        msg += L"Signature: none\r\n";
+    }
+    else if (!signature.parsed)
+    {
+        msg += L"Signature: unreadable certificate table\r\n";
+    }
+    else
+    {
+        // the signature itself is not verified, only the digest it covers is compared
+        msg += L"Signature: " + signature.digestAlgorithm;
+        if (!signature.signer.empty())
+            msg += L", signed by " + signature.signer;
+        if (!signature.issuer.empty())
+            msg += L", issued by " + signature.issuer;
+        if (signature.hasHashType)
+            msg += signature.signedDigest == hashes.authenticode[static_cast<int>(signature.hashType)] ? L", digest matches" : L", digest does not match";
+        msg += L"\r\n";
+    }
+    return msg;
+}
+// The same information as describeImage and formatHashes, as one JSON object.
+// Numbers are the raw header values; text is left to the consumer.
+void writeImageJson(JsonWriter& json, const PeImage& image, const FileHashes& hashes, bool byteHistogram)
+{
+    json.beginObject();
+    json.member("file", image.path());
+    json.member("machine", image.machine());
+    json.member("is64bit", !image.is32bit());
+    json.member("numberOfSections", image.fileHeader().NumberOfSections);
+    json.member("timeDateStamp", image.fileHeader().TimeDateStamp);
+    json.member("characteristics", image.characteristics());
+    json.member("dotNet", image.isDotNet());
+    json.member("subsystem", image.subsystem());
+    json.member("dllCharacteristics", image.dllCharacteristics());
+    json.member("sizeOfImage", image.sizeOfImage());
+    json.key("pdb");
+    if (image.hasDebugInfo())
+    {
+        json.beginObject();
+        json.member("guid", image.debugInfo().pdbGuid);
+        json.member("age", image.debugInfo().pdbAge);
+        json.member("file", image.debugInfo().pdbFile);
+        json.endObject();
+    }
+    else
+    {
+        json.null();
+    }
+    if (image.headersOnly())
+    {
+        json.member("fileSize", image.fileSize());
+        json.endObject();
+        return;
+    }
+
+    ImportTable imports(image);
+    json.key("imports");
+    json.beginObject();
+    json.member("imphash", imphash(imports));
+    json.member("truncated", imports.truncated());
+    json.key("modules");
+    json.beginArray();
+    for (const auto& module : imports.modules())
+    {
+        json.beginObject();
+        json.member("name", module.name);
+        json.member("functions", module.numberOfFunctions);
+        json.member("delayLoaded", module.delayLoaded);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+
+    ExportTable exports(image);
+    json.key("exports");
+    if (exports.functions().empty())
+    {
+        json.null();
+    }
+    else
+    {
+        size_t numberOfForwarders = std::count_if(exports.functions().begin(), exports.functions().end(),
+            [](const ExportedFunction& function) { return !function.forwarder.empty(); });
+        json.beginObject();
+        json.member("dll", exports.dllName());
+        json.member("functions", static_cast<unsigned long long>(exports.functions().size()));
+        json.member("names", static_cast<unsigned long long>(exports.numberOfNames()));
+        json.member("forwarded", static_cast<unsigned long long>(numberOfForwarders));
+        json.member("truncated", exports.truncated());
+        json.endObject();
+    }
+
+    ResourceDirectory resources(image);
+    json.key("resources");
+    json.beginObject();
+    json.member("count", static_cast<unsigned long long>(resources.leaves().size()));
+    json.member("types", static_cast<unsigned long long>(resources.numberOfTypes()));
+    json.member("truncated", resources.truncated());
+    VersionInfo version;
+    json.key("version");
+    if (resources.versionInfo(version))
+    {
+        json.beginObject();
+        json.member("fileVersion", version.fileVersion);
+        json.member("productVersion", version.productVersion);
+        json.key("strings");
+        json.beginObject();
+        for (const auto& entry : version.strings)
+        {
+            // keys such as CompanyName come from the file, so they may hold anything
+            json.key(entry.first);
+            json.value(entry.second);
+        }
+        json.endObject();
+        json.endObject();
+    }
+    else
+    {
+        json.null();
+    }
+    json.member("manifestSize", static_cast<unsigned long long>(resources.manifest().size()));
+    json.member("iconGroups", static_cast<unsigned long long>(resources.iconGroups().size()));
+    json.endObject();
+
+    RichHeader rich = parseRichHeader(image);
+    json.key("rich");
+    if (rich.present)
+    {
+        json.beginObject();
+        json.member("checksumValid", rich.checksumValid);
+        json.member("hash", rich.hash);
+        json.key("entries");
+        json.beginArray();
+        for (const auto& entry : rich.entries)
+        {
+            json.beginObject();
+            json.member("product", entry.productId);
+            json.member("build", entry.build);
+            json.member("count", entry.count);
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+    }
+    else
+    {
+        json.null();
+    }
+
+    json.key("hashes");
+    json.beginObject();
+    json.member("md5", hashes.digests[static_cast<int>(HashType::HashMd5)]);
+    json.member("sha1", hashes.digests[static_cast<int>(HashType::HashSha1)]);
+    json.member("sha256", hashes.digests[static_cast<int>(HashType::HashSha256)]);
+    json.member("mode", hashes.mode);
+    if (!hashes.treeHash.empty())
+        json.member("treeSha256", hashes.treeHash);
+    json.member("authenticodeSha1", hashes.authenticode[static_cast<int>(HashType::HashSha1)]);
+    json.member("authenticodeSha256", hashes.authenticode[static_cast<int>(HashType::HashSha256)]);
+    json.endObject();
+
+    const AuthenticodeSignature& signature = hashes.signature;
+    json.key("signature");
+    if (signature.present)
+    {
+        json.beginObject();
+        json.member("parsed", signature.parsed);
+        json.member("digestAlgorithm", signature.digestAlgorithm);
+        json.member("signer", signature.signer);
+        json.member("issuer", signature.issuer);
+        json.key("digestMatches");
+        if (signature.hasHashType)
+            json.value(signature.signedDigest == hashes.authenticode[static_cast<int>(signature.hashType)]);
+        else
+            json.null();
+        json.endObject();
+    }
+    else
+    {
+        json.null();
+    }
+
+    json.member("entropy", hashes.fileStatistics.entropy());
+    if (byteHistogram)
+    {
+        json.key("histogram");
+        json.beginArray();
+        for (auto count : hashes.fileStatistics.histogram)
+            json.value(count);
+        json.endArray();
+    }
+    json.key("sections");
+    json.beginArray();
+    for (size_t i = 0; i < hashes.sections.size(); i++)
+    {
+        const SectionDigest& section = hashes.sections[i];
+        json.beginObject();
+        json.member("name", std::string_view(section.name));
+        json.member("rawOffset", section.rawOffset);
+        json.member("rawSize", section.rawSize);
+        json.member("entropy", hashes.sectionStatistics[i].entropy());
+        json.member("md5", section.md5);
+        json.member("sha256", section.sha256);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+}
+void fillImageRow(ColumnarRow& row, const PeImage& image, const FileHashes& hashes)
+{
+    std::string utf8;
+    auto setText = [&](size_t column, const wstring& text)
+    {
+        utf8.clear();
+        appendUtf8(utf8, text);
+        row.setBytes(column, utf8);
+    };
+    // digests are stored as bytes; one that wasn't computed stays null
+    auto setDigest = [&](size_t column, const wstring& hex, size_t len)
+    {
+        unsigned char bytes[32];
+        if (len <= sizeof(bytes) && hexToBytes(hex, bytes, len))
+            row.setBytes(column, std::string_view(reinterpret_cast<const char*>(bytes), len));
+    };
+
+    setText(COLUMN_PATH, image.path());
+    row.setNumber(COLUMN_FILE_SIZE, image.fileSize());
+    row.setNumber(COLUMN_MACHINE, image.machine());
+    row.setNumber(COLUMN_CHARACTERISTICS, image.characteristics());
+    row.setNumber(COLUMN_SUBSYSTEM, image.subsystem());
+    row.setNumber(COLUMN_DLL_CHARACTERISTICS, image.dllCharacteristics());
+    row.setNumber(COLUMN_SIZE_OF_IMAGE, image.sizeOfImage());
+    row.setNumber(COLUMN_TIME_DATE_STAMP, image.fileHeader().TimeDateStamp);
+    row.setNumber(COLUMN_NUMBER_OF_SECTIONS, image.fileHeader().NumberOfSections);
+    row.setNumber(COLUMN_IS_64BIT, !image.is32bit());
+    row.setNumber(COLUMN_DOT_NET, image.isDotNet());
+    if (image.hasDebugInfo())
+    {
+        row.setBytes(COLUMN_PDB_GUID, std::string_view(reinterpret_cast<const char*>(&image.debugInfo().guid), sizeof(GUID)));
+        row.setNumber(COLUMN_PDB_AGE, image.debugInfo().age);
+        setText(COLUMN_PDB_FILE, image.debugInfo().pdbFile);
+    }
+    if (image.headersOnly())
+        return;
+
+    ImportTable imports(image);
+    row.beginList(COLUMN_IMPORT_MODULES);
+    row.beginList(COLUMN_IMPORTS);
+    for (const auto& module : imports.modules())
+    {
+        row.addElement(COLUMN_IMPORT_MODULES, module.name);
+        for (unsigned i = module.firstFunction; i < module.firstFunction + module.numberOfFunctions; i++)
+        {
+            const ImportedFunction& function = imports.functions()[i];
+            utf8.assign(module.name);
+            utf8 += '!';
+            if (function.byOrdinal)
+                utf8 += '#' + std::to_string(function.hintOrOrdinal);
+            else
+                utf8 += function.name;
+            row.addElement(COLUMN_IMPORTS, utf8);
+        }
+    }
+    setDigest(COLUMN_IMPHASH, imphash(imports), Md5::DIGEST_SIZE);
+
+    ExportTable exports(image);
+    if (!exports.functions().empty())
+    {
+        row.setBytes(COLUMN_EXPORT_DLL, exports.dllName());
+        row.setNumber(COLUMN_NUMBER_OF_EXPORTS, exports.functions().size());
+    }
+
+    ResourceDirectory resources(image);
+    VersionInfo version;
+    if (resources.versionInfo(version))
+    {
+        setText(COLUMN_FILE_VERSION, version.fileVersion);
+        setText(COLUMN_COMPANY_NAME, version.value(L"CompanyName"));
+    }
+    RichHeader rich = parseRichHeader(image);
+    if (rich.present)
+        setDigest(COLUMN_RICH_HASH, rich.hash, Md5::DIGEST_SIZE);
+
+    setDigest(COLUMN_MD5, hashes.digests[static_cast<int>(HashType::HashMd5)], Md5::DIGEST_SIZE);
+    setDigest(COLUMN_SHA1, hashes.digests[static_cast<int>(HashType::HashSha1)], Sha1::DIGEST_SIZE);
+    setDigest(COLUMN_SHA256, hashes.digests[static_cast<int>(HashType::HashSha256)], Sha256::DIGEST_SIZE);
+    setDigest(COLUMN_AUTHENTICODE_SHA1, hashes.authenticode[static_cast<int>(HashType::HashSha1)], Sha1::DIGEST_SIZE);
+    setDigest(COLUMN_AUTHENTICODE_SHA256, hashes.authenticode[static_cast<int>(HashType::HashSha256)], Sha256::DIGEST_SIZE);
+    const AuthenticodeSignature& signature = hashes.signature;
+    if (signature.parsed)
+        setText(COLUMN_SIGNER, signature.signer);
+    if (signature.hasHashType && !hashes.authenticode[static_cast<int>(signature.hashType)].empty())
+        row.setNumber(COLUMN_SIGNATURE_MATCHES, signature.signedDigest == hashes.authenticode[static_cast<int>(signature.hashType)]);
+    row.setReal(COLUMN_ENTROPY, hashes.fileStatistics.entropy());
+    row.beginList(COLUMN_SECTION_NAMES);
+    for (const auto& section : hashes.sections)
+        row.addElement(COLUMN_SECTION_NAMES, section.name);
+}
+unsigned parseHashList(const wstring& hashList)
+{
+    // e.g. "sha1,sha256". Unknown names are ignored.
+    unsigned mask = 0;
+    size_t start = 0;
+    while (start <= hashList.length())
+    {
+        size_t end = hashList.find(L',', start);
+        if (end == wstring::npos)
+            end = hashList.length();
+        wstring name = hashList.substr(start, end - start);
+        std::transform(name.begin(), name.end(), name.begin(), ::towlower);
+        if (name == L"md5")
+            mask |= hashFlag(HashType::HashMd5);
+        else if (name == L"sha1")
+            mask |= hashFlag(HashType::HashSha1);
+        else if (name == L"sha256")
+            mask |= hashFlag(HashType::HashSha256);
+        start = end + 1;
+    }
+    return mask;
 }
 void pdbDownloadCompleted(bool successful, DWORD dwStatusCode, DWORD numberOfBytesRead, DWORD contentLength, wstring localSavedPath)
 {
+    bool isResumed = fileDownloader != nullptr;
     delete fileDownloader;
     fileDownloader = nullptr;
     if (successful)
     {
         appendTextOnEdit(g_hEditMsg, L"Downloaded PDB is saved to " + localSavedPath + L"\r\n");
-        if (g_compressedTried)
+        if (isResumed && localSavedPath.back() == L'_')
         {
-            // Downloaded file is a CAB compressed file. Use built-in expand.exe to decompress it.
-            wstring argsToExpand = L"-R \"" + localSavedPath + L"\"";
-            SHELLEXECUTEINFOW execInfo{};
-            execInfo.cbSize = sizeof(execInfo);
-            execInfo.fMask = SEE_MASK_NOCLOSEPROCESS;
-            execInfo.hwnd = g_hMain;
-            execInfo.lpVerb = L"open";
-            execInfo.lpFile = L"C:\\Windows\\System32\\expand.exe";
-            execInfo.lpParameters = argsToExpand.c_str();
-            execInfo.lpDirectory = L"C:\\Windows\\System32";
-            execInfo.nShow = HIDE_WINDOW;
-
+            // a lookup expands a .pd_ while it downloads; a resumed download is expanded from its file
+            wstring expandedPath = localSavedPath;
+            expandedPath.back() = localSavedPath[localSavedPath.length() - 2] == L'D' ? L'B' : L'b';
+            wstring error;
             appendTextOnEdit(g_hEditMsg, L"Decompressing downloaded file ...\r\n");
-            if (ShellExecuteExW(&execInfo))
-            {
-                if (execInfo.hProcess)
-                {
-                    WaitForSingleObject(execInfo.hProcess, 5000);
-                    DWORD exitCode = 0;
-                    if (GetExitCodeProcess(execInfo.hProcess, &exitCode))
-                    {
-                        if (exitCode == ERROR_SUCCESS)
-                        {
-                            appendTextOnEdit(g_hEditMsg, L"Decompression is successful.\r\n");
-                            // Don't delete the original download, in case user wants to keep the compressed PDB.
-                        }
-                        else if (exitCode == STILL_ACTIVE)
-                        {
-                            appendTextOnEdit(g_hEditMsg, L"Can't determine if the decompression is successful or not.\r\n");
-                        }
-                        else
-                        {
-                            appendTextOnEdit(g_hEditMsg, L"Decompression has failed: expand.exe returns " + std::to_wstring(exitCode) + L"\r\n");
-                        }
-                    }
-                    else
-                    {
-                        appendTextOnEdit(g_hEditMsg, L"Can't determine if the decompression is successful or not.\r\n");
-                    }
-                    CloseHandle(execInfo.hProcess);
-                }
-                else
-                {
-                    appendTextOnEdit(g_hEditMsg, L"Can't determine if the decompression is successful or not.\r\n");
-                }
-            }
+            if (CabExtractor::extract(localSavedPath, expandedPath, error))
+                appendTextOnEdit(g_hEditMsg, L"Decompressed PDB is saved to " + expandedPath + L"\r\n");
             else
-            {
-                appendTextOnEdit(g_hEditMsg, L"Can't decompress the downloaded PDB file: Can't execute expand.exe\r\n");
-            }
+                appendTextOnEdit(g_hEditMsg, L"Decompression has failed: " + error + L"\r\n");
+            // Don't delete the original download, in case user wants to keep the compressed PDB.
         }
         SendMessageW(g_hProgressBar, PBM_SETPOS, 1000, 0);
         SendMessageW(g_hProgressBar, PBM_SETBARCOLOR, 0, COLOR_TOTAL_BLACK);
@@ -872,24 +1922,8 @@ void pdbDownloadCompleted(bool successful, DWORD dwStatusCode, DWORD numberOfByt
             appendTextOnEdit(g_hEditMsg, L"Error: " + std::to_wstring(dwStatusCode) + L"\r\n");
             break;
         }
-        if (!g_compressedTried)
-        {
-            g_compressedTried = true;
-            if (downloadSymbolToDisk(g_symbolServerUsed, g_debugGUID, g_debugAge, g_pdbFile, g_localSymbolCacheDirectory, true))
-            {
-                //appendTextOnEdit(g_hEditMsg, L"PDB File is successfully cached.\r\n");  // pending
-            }
-            else
-            {
-                appendTextOnEdit(g_hEditMsg, L"Error: PDB File is not cached.\r\n");
-            }
-        }
-        else
-        {
-            g_compressedTried = false;
-            EnableWindow(g_hBtnDownloadSymbol, TRUE);
-            EnableWindow(g_hBtnConfig, TRUE);
-        }
+        EnableWindow(g_hBtnDownloadSymbol, TRUE);
+        EnableWindow(g_hBtnConfig, TRUE);
     }
 }
 void pdbDownloadProgressNotified(DWORD numberOfBytesRead, DWORD contentLength)
@@ -957,50 +1991,14 @@ void copyModuleBinaryToDisk(const wstring& binaryFilePath, const wstring& exekey
         }
     }
 }
-bool downloadSymbolToDisk(const wstring& symbolServer, const wstring& symbolGUID, const wstring& symbolAge, const wstring& symbolFilename, const wstring& localSymbolPath, bool isCabCompressed)
+bool downloadSymbolToDisk(const wstring& symbolGUID, const wstring& symbolAge, const wstring& symbolFilename, const wstring& localSymbolPath)
 {
     if (symbolGUID.length() == 0 || symbolFilename.length() == 0)
         return false;
-    // e.g. https://msdl.microsoft.com/download/symbols/rpcrt4.pdb/A3028D6B45DA006244A6C9E4DDDA11021/rpcrt4.pdb
-    wstring urlToDownload;
-    wstring normalizedSymbolGUID;
-    wstring normalizedSymbolFilename;  // extract filename in case symbolFilename is full path
-    size_t lastBackslashInFilename = symbolFilename.find_last_of(L"/\\");    
-    if (lastBackslashInFilename != -1)
-    {
-        normalizedSymbolFilename = symbolFilename.substr(lastBackslashInFilename + 1);
-    }
-    else
-    {
-        normalizedSymbolFilename = symbolFilename;
-    }
-    if (normalizedSymbolFilename.length() == 0)
+    wstring normalizedSymbolFilename = SymbolLookup::fileNameOf(symbolFilename);  // symbolFilename may be a full path
+    if (!SymbolLookup::isValidFileName(normalizedSymbolFilename))
         return false;
-    for (const auto k : symbolGUID)
-    {
-        if ((k >= L'A' && k <= L'Z') || (k >= L'0' && k <= L'9'))
-        {
-            normalizedSymbolGUID += k;
-        }
-        else if (k >= L'a' && k <= L'z')
-        {
-            normalizedSymbolGUID += ( k - (L'a' - L'A'));
-        }
-    }
-    normalizedSymbolGUID += symbolAge;
-    if (symbolServer.find_last_of(L'/') == symbolServer.length() - 1)
-    {
-        urlToDownload = symbolServer + normalizedSymbolFilename + L"/" + normalizedSymbolGUID + L"/" + normalizedSymbolFilename;
-    }
-    else
-    {
-        urlToDownload = symbolServer + L"/" + normalizedSymbolFilename + L"/" + normalizedSymbolGUID + L"/" + normalizedSymbolFilename;
-    }   
-    if (isCabCompressed)
-    {
-        // change the filename extension from .pdb to .pd_
-        urlToDownload[urlToDownload.length() - 1] = L'_';
-    }
+    wstring normalizedSymbolGUID = SymbolLookup::pdbKey(symbolGUID, symbolAge);
     wstring dirToCreate;
     if (localSymbolPath.find_last_of(L'\\') == localSymbolPath.length() - 1)
     {
@@ -1014,56 +2012,84 @@ bool downloadSymbolToDisk(const wstring& symbolServer, const wstring& symbolGUID
     dirToCreate += L'\\' + normalizedSymbolGUID;
     CreateDirectoryW(dirToCreate.c_str(), nullptr);
     wstring pdbPath = dirToCreate + L"\\" + normalizedSymbolFilename;
-    if (isCabCompressed)
-    {
-        pdbPath[pdbPath.length() - 1] = L'_';
-    }
+    wstring compressedPdbPath = pdbPath;
+    compressedPdbPath[compressedPdbPath.length() - 1] = L'_';
 
-    if (PathFileExistsW(pdbPath.c_str()))
+    for (const auto& path : { pdbPath, compressedPdbPath })
     {
-        appendTextOnEdit(g_hEditMsg, L"PDB file is already cached at " + pdbPath + L"\r\n");
-        return true;
+        if (PathFileExistsW(path.c_str()))
+        {
+            appendTextOnEdit(g_hEditMsg, L"PDB file is already cached at " + path + L"\r\n");
+            return true;
+        }
     }
-    if (fileDownloader)
+    if (fileDownloader || g_isSymbolLookupRunning)
     {
         // another download is in progress. We should not start a new download.
         return false;
     }
 
-    wstring pdbTempPath = pdbPath + NetAsync::TEMP_FILE_SUFFIX;
-    bool isResume = false;
-    DWORD bytesAlreadyDownloaded = 0;
-    if (PathFileExistsW(pdbTempPath.c_str()))
+    NetCallbacks callbacks{ };
+    callbacks.pCompletion = pdbDownloadCompleted;
+    callbacks.pContentLength = pdbDownloadContentLengthObtained;
+    callbacks.pProgress = pdbDownloadProgressNotified;
+
+    // a single-stream download left by an earlier version is resumed from the first server
+    for (const auto& path : { pdbPath, compressedPdbPath })
     {
-        isResume = true;
+        wstring pdbTempPath = path + NetAsync::TEMP_FILE_SUFFIX;
+        DWORD bytesAlreadyDownloaded = 0;
+        if (!PathFileExistsW(pdbTempPath.c_str()))
+            continue;
         if (!getFileSizeFromPath(pdbTempPath, bytesAlreadyDownloaded))
         {
             // This shouldn't happen
             return false;
         }
+        wstring urlToDownload = SymbolLookup::serverUrl(g_symbolServers.front(), normalizedSymbolFilename, normalizedSymbolGUID, path != pdbPath);
         appendTextOnEdit(g_hEditMsg, L"Resuming PDB download from " + urlToDownload + L"\r\n");
-    }
-    else
-    {
-        appendTextOnEdit(g_hEditMsg, L"Downloading PDB from " + urlToDownload + L"\r\n");
+        fileDownloader = new NetAsync(L"PDB Symbol Downloader", proxyType, g_proxyServer.c_str(), g_proxyBypass.c_str());
+        return fileDownloader->resumeDownload(urlToDownload, path, bytesAlreadyDownloaded, callbacks);
     }
 
-    fileDownloader = new NetAsync(L"PDB Symbol Downloader", proxyType, g_proxyServer.c_str(), g_proxyBypass.c_str());
-    NetCallbacks callbacks{ };
-    callbacks.pCompletion = pdbDownloadCompleted;
-    callbacks.pContentLength = pdbDownloadContentLengthObtained;
-    callbacks.pProgress = pdbDownloadProgressNotified;
+    SymbolLookup::Options options;
+    options.servers = g_symbolServers;
+    options.numberOfConnections = g_downloadConnections;
+    options.proxyType = proxyType;
+    options.proxyServer = g_proxyServer;
+    options.proxyBypass = g_proxyBypass;
+    options.isHttp2Enabled = g_isHttp2Enabled;
+    if (g_negativeTtlSeconds != 0)
+        options.negativeCachePath = localSymbolPath + L"\\" + SymbolLookup::NEGATIVE_CACHE_FILE_NAME;
+    options.negativeTtlSeconds = g_negativeTtlSeconds;
+    options.expandCompressed = true;
+    for (const auto& server : g_symbolServers)
+        appendTextOnEdit(g_hEditMsg, L"Looking up PDB on " + server + L"\r\n");
 
-    bool isSuccess = false;
-    if (isResume)
-    {
-        isSuccess = fileDownloader->resumeDownload(urlToDownload, pdbPath, bytesAlreadyDownloaded, callbacks);
-    }
-    else
-    {
-        isSuccess = fileDownloader->startDownload(urlToDownload.c_str(), pdbPath.c_str(), callbacks);
-    }
-    return isSuccess;
+    // the servers are raced on their own threads; the callbacks come from them, as from NetAsync
+    g_isSymbolLookupRunning = true;
+    std::thread([options, normalizedSymbolFilename, normalizedSymbolGUID, dirToCreate, callbacks]()
+        {
+            NetCallbacks progressCallbacks = callbacks;
+            progressCallbacks.pCompletion = nullptr;
+            SymbolLookup::Result result;
+            {
+                SymbolLookup lookup(options);
+                result = lookup.fetch(normalizedSymbolFilename, normalizedSymbolGUID, dirToCreate, progressCallbacks);
+            }
+            if (result.found)
+                appendTextOnEdit(g_hEditMsg, L"Downloaded PDB from " + result.url + L" (" + NetRequestTiming::describe(result.timings) + L")\r\n");
+            else if (result.isKnownMissing)
+                appendTextOnEdit(g_hEditMsg, L"No symbol server had this PDB when last asked.\r\n");
+            if (!result.expandedPath.empty())
+                appendTextOnEdit(g_hEditMsg, L"Decompressed PDB is saved to " + result.expandedPath + L"\r\n");
+            else if (!result.expandError.empty())
+                appendTextOnEdit(g_hEditMsg, L"Decompression has failed: " + result.expandError + L"\r\n");
+            DWORD size = static_cast<DWORD>(std::min<unsigned long long>(result.size, MAXDWORD));
+            g_isSymbolLookupRunning = false;
+            callbacks.pCompletion(result.found, result.statusCode, size, result.found ? size : NetAsync::NO_CONTENT_LENGTH, result.savedPath);
+        }).detach();
+    return true;
 }
 bool appendTextOnEdit(HWND hEdit, const std::wstring& str)
 {
@@ -1083,8 +2109,8 @@ void HandleControlCommands(UINT code, HWND hwnd)
             EnableWindow(g_hBtnDownloadSymbol, FALSE);
             EnableWindow(g_hBtnConfig, FALSE);
             appendTextOnEdit(g_hEditMsg, L"\r\n");
-            copyModuleBinaryToDisk(filePath, g_exeKey, g_localSymbolCacheDirectory);
-            if (downloadSymbolToDisk(g_symbolServerUsed, g_debugGUID, g_debugAge, g_pdbFile, g_localSymbolCacheDirectory, false))
+            copyModuleBinaryToDisk(filePath, g_image.debugInfo().exeKey, g_localSymbolCacheDirectory);
+            if (downloadSymbolToDisk(g_image.debugInfo().pdbGuid, g_image.debugInfo().pdbAge, g_image.debugInfo().pdbFile, g_localSymbolCacheDirectory))
             {
                 //appendTextOnEdit(g_hEditMsg, L"PDB File is successfully cached.\r\n");  // pending
             }
@@ -1098,12 +2124,12 @@ void HandleControlCommands(UINT code, HWND hwnd)
         {
             wstring pathRegsrv32;
 #ifdef _WIN64
-            if (is32bit)
+            if (g_image.is32bit())
                 pathRegsrv32 = L"C:\\Windows\\SysWOW64\\regsvr32.exe";
             else
                 pathRegsrv32 = L"C:\\Windows\\System32\\regsvr32.exe";
 #else
-            if (is32bit)
+            if (g_image.is32bit())
                 pathRegsrv32 = L"C:\\Windows\\System32\\regsvr32.exe";  // File system will redirect it to SysWOW64
             else
                 pathRegsrv32 = L"C:\\Windows\\Sysnative\\regsvr32.exe";  // disable redirection on 64-bit OS. Will fail on 32-bit OS, which can't register 64-bit DLL anyway.
@@ -1147,8 +2173,9 @@ void HandleControlCommands(UINT code, HWND hwnd)
                 writeConsole(hStdout, L"\"Unknown\"\n");
                 break;
             }
-            writeConsole(hStdout, L"Current symbol server is: ");
-            writeConsole(hStdout, g_symbolServerUsed);
+            writeConsole(hStdout, L"Current symbol servers are: ");
+            for (size_t k = 0; k < g_symbolServers.size(); k++)
+                writeConsole(hStdout, (k == 0 ? L"" : L", ") + g_symbolServers[k]);
             writeConsole(hStdout, L"\n");
             writeConsole(hStdout, L"\n");
             writeConsole(hStdout, L"What do you want to do:\n");
@@ -1203,19 +2230,19 @@ void HandleControlCommands(UINT code, HWND hwnd)
                 option = getStdin(hStdin);
                 if (option == L"1")
                 {
-                    g_symbolServerUsed = g_MicrosoftSymbolServerURL;
+                    g_symbolServers = { g_MicrosoftSymbolServerURL };
                 }
                 else if (option == L"2")
                 {
-                    g_symbolServerUsed = g_MozillaSymbolServerURL;
+                    g_symbolServers = { g_MozillaSymbolServerURL };
                 }
                 else if (option == L"3")
                 {
-                    g_symbolServerUsed = g_ChromiumSymbolServerURL;
+                    g_symbolServers = { g_ChromiumSymbolServerURL };
                 }
                 else if (option == L"4")
                 {
-                    g_symbolServerUsed = g_Unity3dSymbolServerURL;
+                    g_symbolServers = { g_Unity3dSymbolServerURL };
                 }
                 else if (option == L"5")
                 {
@@ -1223,7 +2250,7 @@ void HandleControlCommands(UINT code, HWND hwnd)
                     wstring userSymbolServer = getStdin(hStdin);
                     if (userSymbolServer.find(L"http://") == 0 || userSymbolServer.find(L"https://") == 0)
                     {
-                        g_symbolServerUsed = userSymbolServer;
+                        g_symbolServers = { userSymbolServer };
                     }
                 }
             }
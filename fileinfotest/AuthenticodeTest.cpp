@@ -0,0 +1,191 @@
+#include "Test.h"
+#include "Authenticode.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// fixtures\signed.exe is written by fixtures\makesigned.py, which also prints these values. Its PE
+// hash is computed there section by section, as the specification defines it.
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const wchar_t* const SIGNED_SHA1 = L"971095f0a302d068bb4ba8f0232c178010be2492";
+    const wchar_t* const SIGNED_SHA256 = L"f38c977f7ec0e5be4b8ee61a666da9ba0b22e3a023f0df6dad85194773766be0";
+
+    std::vector<unsigned char> readFixture(const char* name)
+    {
+        std::ifstream reader(fs::path(__FILE__).parent_path() / "fixtures" / name, std::ios::binary);
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+    }
+
+    // file offsets of what the PE hash leaves out
+    struct Layout
+    {
+        size_t checkSum;
+        size_t securityEntry;
+        DWORD table;
+        DWORD tableSize;
+    };
+
+    Layout layoutOf(const std::vector<unsigned char>& file)
+    {
+        PeImage image;
+        image.load(file, L"signed.exe");
+        auto optionalHeader = reinterpret_cast<const unsigned char*>(image.optionalHeader64());
+        auto security = image.dataDirectory(IMAGE_DIRECTORY_ENTRY_SECURITY);
+        return { static_cast<size_t>(optionalHeader - image.data()) + offsetof(IMAGE_OPTIONAL_HEADER64, CheckSum),
+            static_cast<size_t>(reinterpret_cast<const unsigned char*>(security) - image.data()), security->VirtualAddress, security->Size };
+    }
+
+    // the PE hash of file fed in chunks of chunkSize bytes, "" if it doesn't parse
+    std::wstring peHash(const std::vector<unsigned char>& file, HashType hashType, size_t chunkSize = 4096)
+    {
+        PeImage image;
+        if (!image.load(file, L"test.exe"))
+            return L"";
+        AuthenticodeHash hash(image, hashFlag(HashType::HashSha1) | hashFlag(HashType::HashSha256));
+        for (size_t offset = 0; offset < file.size(); offset += chunkSize)
+            hash.consume(offset, file.data() + offset, std::min(chunkSize, file.size() - offset));
+        return hash.hexDigest(hashType);
+    }
+
+    AuthenticodeSignature signatureOf(const std::vector<unsigned char>& file)
+    {
+        PeImage image;
+        if (!image.load(file, L"test.exe"))
+            return AuthenticodeSignature();
+        return parseAuthenticodeSignature(image);
+    }
+
+    void put32(std::vector<unsigned char>& file, size_t offset, DWORD value)
+    {
+        memcpy(file.data() + offset, &value, sizeof(value));
+    }
+}
+
+TEST(authenticodeHashOfSignedFixture)
+{
+    std::vector<unsigned char> file = readFixture("signed.exe");
+    CHECK(!file.empty());
+    Layout layout = layoutOf(file);
+    DWORD checkSum;
+    memcpy(&checkSum, file.data() + layout.checkSum, sizeof(checkSum));
+    CHECK(checkSum != 0);
+    CHECK_EQUAL(file.size(), size_t(layout.table) + layout.tableSize);
+
+    // chunk boundaries inside and across the excluded ranges don't matter
+    for (size_t chunkSize : { size_t(1), size_t(7), size_t(512), size_t(4096), file.size() })
+    {
+        CHECK(peHash(file, HashType::HashSha1, chunkSize) == SIGNED_SHA1);
+        CHECK(peHash(file, HashType::HashSha256, chunkSize) == SIGNED_SHA256);
+    }
+    CHECK(peHash(file, HashType::HashMd5).empty());
+
+    AuthenticodeSignature signature = signatureOf(file);
+    CHECK(signature.present);
+    CHECK(signature.parsed);
+    CHECK(signature.digestAlgorithm == L"SHA256");
+    CHECK(signature.hasHashType);
+    CHECK(signature.hashType == HashType::HashSha256);
+    CHECK(signature.signedDigest == SIGNED_SHA256);
+    CHECK(signature.signer == L"fileinfotest signer");
+    CHECK(signature.issuer == L"fileinfotest CA");
+}
+
+TEST(authenticodeHashSkipsExcludedRanges)
+{
+    const std::vector<unsigned char> file = readFixture("signed.exe");
+    Layout layout = layoutOf(file);
+
+    // the image as it was before signing has the same hash
+    std::vector<unsigned char> beforeSigning(file.begin(), file.begin() + layout.table);
+    put32(beforeSigning, layout.checkSum, 0);
+    put32(beforeSigning, layout.securityEntry, 0);
+    put32(beforeSigning, layout.securityEntry + 4, 0);
+    CHECK(peHash(beforeSigning, HashType::HashSha256) == SIGNED_SHA256);
+    CHECK(!signatureOf(beforeSigning).present);
+
+    // every byte of the CheckSum and of the certificate table is left out, but none around them
+    for (size_t offset : { layout.checkSum, layout.checkSum + 3, size_t(layout.table), file.size() - 1 })
+    {
+        std::vector<unsigned char> changed = file;
+        changed[offset] ^= 0xff;
+        CHECK(peHash(changed, HashType::HashSha256) == SIGNED_SHA256);
+    }
+    for (size_t offset : { layout.checkSum - 1, layout.checkSum + 4, layout.securityEntry - 1, layout.securityEntry + 8, size_t(layout.table) - 1 })
+    {
+        std::vector<unsigned char> changed = file;
+        changed[offset] ^= 0xff;
+        CHECK(peHash(changed, HashType::HashSha256) != SIGNED_SHA256);
+    }
+    // data past the certificate table is hashed
+    std::vector<unsigned char> appended = file;
+    appended.push_back(0);
+    CHECK(peHash(appended, HashType::HashSha256) != SIGNED_SHA256);
+}
+
+TEST(authenticodeRejectsBrokenCertificateTables)
+{
+    const std::vector<unsigned char> file = readFixture("signed.exe");
+    Layout layout = layoutOf(file);
+    const size_t WIN_CERTIFICATE_HEADER = offsetof(WIN_CERTIFICATE, bCertificate);
+
+    // a table too small for a WIN_CERTIFICATE header
+    std::vector<unsigned char> changed = file;
+    put32(changed, layout.securityEntry + 4, WIN_CERTIFICATE_HEADER - 2);
+    AuthenticodeSignature signature = signatureOf(changed);
+    CHECK(signature.present);
+    CHECK(!signature.parsed);
+
+    // dwLength past the table, past the file, and shorter than the header
+    for (DWORD length : { layout.tableSize + 8, 0xfffffff8u, DWORD(WIN_CERTIFICATE_HEADER - 1) })
+    {
+        changed = file;
+        put32(changed, layout.table, length);
+        CHECK(!signatureOf(changed).parsed);
+        CHECK(peHash(changed, HashType::HashSha256) == SIGNED_SHA256);
+    }
+
+    // a table size past the end of the file is cut at the end of the file
+    changed = file;
+    put32(changed, layout.securityEntry + 4, 0xffffffff);
+    CHECK(signatureOf(changed).parsed);
+    CHECK(peHash(changed, HashType::HashSha256) == SIGNED_SHA256);
+
+    // a table that starts past the end of the file or inside the headers
+    for (DWORD offset : { DWORD(file.size() + 8), DWORD(0x10) })
+    {
+        changed = file;
+        put32(changed, layout.securityEntry, offset);
+        CHECK(!signatureOf(changed).parsed);
+        CHECK(!peHash(changed, HashType::HashSha256).empty());
+    }
+
+    // a file cut in the middle of the signature
+    changed.assign(file.begin(), file.end() - layout.tableSize / 2);
+    signature = signatureOf(changed);
+    CHECK(signature.present);
+    CHECK(!signature.parsed);
+
+    // an entry of another type is skipped, up to the next 8-byte boundary
+    changed = file;
+    put32(changed, layout.securityEntry + 4, layout.tableSize + 16);
+    const unsigned char x509[16] = { 13, 0, 0, 0, 0x00, 0x02, 0x01, 0x00, 0xde, 0xad, 0xbe, 0xef, 0xff };
+    changed.insert(changed.begin() + layout.table, std::begin(x509), std::end(x509));
+    CHECK(signatureOf(changed).parsed);
+    CHECK(peHash(changed, HashType::HashSha256) == SIGNED_SHA256);
+    changed.erase(changed.begin() + layout.table, changed.begin() + layout.table + 16);
+    changed[layout.table + 6] = 0x01;  // WIN_CERT_TYPE_X509
+    CHECK(!signatureOf(changed).parsed);
+
+    // any single damaged byte of the SignedData is read safely
+    for (size_t offset = layout.table + WIN_CERTIFICATE_HEADER; offset < file.size(); offset++)
+    {
+        changed = file;
+        changed[offset] ^= 0xff;
+        CHECK(signatureOf(changed).present);
+    }
+}
@@ -0,0 +1,134 @@
+#include "Test.h"
+#include "ByteStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace
+{
+    IMAGE_SECTION_HEADER section(DWORD virtualAddress, DWORD virtualSize, DWORD pointerToRawData, DWORD sizeOfRawData)
+    {
+        IMAGE_SECTION_HEADER header{};
+        header.VirtualAddress = virtualAddress;
+        header.Misc.VirtualSize = virtualSize;
+        header.PointerToRawData = pointerToRawData;
+        header.SizeOfRawData = sizeOfRawData;
+        return header;
+    }
+
+    ByteStatistics naiveStatistics(const std::vector<unsigned char>& data, size_t begin, size_t end)
+    {
+        ByteStatistics statistics;
+        for (size_t i = begin; i < end; i++)
+            statistics.histogram[data[i]]++;
+        statistics.total = end - begin;
+        return statistics;
+    }
+
+    bool sameStatistics(const ByteStatistics& a, const ByteStatistics& b)
+    {
+        return a.total == b.total && a.histogram == b.histogram && a.entropy() == b.entropy();
+    }
+}
+
+TEST(countBytesMatchesNaiveCount)
+{
+    std::mt19937 random(7);
+    std::vector<unsigned char> data(100);
+    for (auto& byte : data)
+        byte = static_cast<unsigned char>(random());
+    // every length around the 16-byte unrolled loop, at every alignment
+    for (size_t begin = 0; begin < 8; begin++)
+    {
+        for (size_t len = 0; begin + len <= 48; len++)
+        {
+            unsigned long long histogram[256] = {};
+            countBytes(data.data() + begin, len, histogram);
+            ByteStatistics expected = naiveStatistics(data, begin, begin + len);
+            if (!std::equal(expected.histogram.begin(), expected.histogram.end(), histogram))
+                reportFailure(__FILE__, __LINE__, "histogram of " + std::to_string(len) + " bytes at " + std::to_string(begin));
+        }
+    }
+}
+
+TEST(byteStatisticsEntropy)
+{
+    ByteStatistics statistics;
+    CHECK_EQUAL(0.0, statistics.entropy());
+    statistics.histogram[0] = 1000;
+    statistics.total = 1000;
+    CHECK_EQUAL(0.0, statistics.entropy());
+    statistics.histogram['A'] = 1000;
+    statistics.total = 2000;
+    CHECK(std::abs(statistics.entropy() - 1.0) < 1e-12);
+    for (auto& count : statistics.histogram)
+        count = 16;
+    statistics.total = 16 * 256;
+    CHECK(std::abs(statistics.entropy() - 8.0) < 1e-12);
+}
+
+TEST(byteStatisticsSinkAcrossChunkCuts)
+{
+    // a gap before the first section, two sections whose raw data overlap, a gap between sections,
+    // and overlay after the last one
+    IMAGE_SECTION_HEADER headers[] = {
+        section(0x1000, 0x1000, 0x400, 0x600),
+        section(0x2000, 0x2000, 0x800, 0x800),
+        section(0x4000, 0x1000, 0x1400, 0x200),
+    };
+    const size_t FILE_SIZE = 0x1800;
+    SectionTable table;
+    table.build(headers, 3, 0x200, 0x1000, 0x400, FILE_SIZE);
+    CHECK(table.rawOffset(1) < table.rawOffset(0) + table.rawSize(0));
+
+    // every region has its own byte distribution, so a piece counted in the wrong place shows
+    std::mt19937 random(1);
+    std::vector<unsigned char> file(FILE_SIZE);
+    for (size_t i = 0; i < file.size(); i++)
+        file[i] = static_cast<unsigned char>(random() % (1 + (i >> 5)));
+
+    std::vector<size_t> chunkSizes = { 1, 3, 16, 511, 512, 513, 0x600, 4096, FILE_SIZE };
+    for (size_t chunkSize : chunkSizes)
+    {
+        ByteStatisticsSink sink(table);
+        for (size_t offset = 0; offset < file.size(); offset += chunkSize)
+            sink.consume(offset, file.data() + offset, std::min(chunkSize, file.size() - offset));
+        CHECK(sameStatistics(naiveStatistics(file, 0, file.size()), sink.file()));
+        CHECK_EQUAL(size_t(3), sink.sections().size());
+        for (size_t i = 0; i < sink.sections().size(); i++)
+        {
+            ByteStatistics expected = naiveStatistics(file, table.rawOffset(i), table.rawOffset(i) + table.rawSize(i));
+            if (!sameStatistics(expected, sink.sections()[i]))
+                reportFailure(__FILE__, __LINE__, "section " + std::to_string(i) + " with chunks of " + std::to_string(chunkSize) + " bytes");
+        }
+    }
+
+    // chunks cut one byte before, on and after every section boundary, then at random places
+    std::vector<size_t> cuts;
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        for (size_t boundary : { size_t(table.rawOffset(i)), size_t(table.rawOffset(i) + table.rawSize(i)) })
+            cuts.insert(cuts.end(), { boundary - 1, boundary, boundary + 1 });
+    }
+    for (int round = 0; round < 21; round++)
+    {
+        if (round > 0)
+        {
+            cuts.clear();
+            for (size_t offset = 0; offset < file.size(); offset += 1 + random() % 0x300)
+                cuts.push_back(offset);
+        }
+        cuts.push_back(file.size());
+        std::sort(cuts.begin(), cuts.end());
+        ByteStatisticsSink sink(table);
+        size_t offset = 0;
+        for (size_t cut : cuts)
+        {
+            sink.consume(offset, file.data() + offset, cut - offset);
+            offset = cut;
+        }
+        CHECK(sameStatistics(naiveStatistics(file, 0, file.size()), sink.file()));
+        for (size_t i = 0; i < sink.sections().size(); i++)
+            CHECK(sameStatistics(naiveStatistics(file, table.rawOffset(i), table.rawOffset(i) + table.rawSize(i)), sink.sections()[i]));
+    }
+}
@@ -0,0 +1,252 @@
+#include "Test.h"
+#include "CabExtractor.h"
+#include "HashAlgorithms.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+// The cabinets in fixtures\ are written by fixtures\makecabinets.py, which also prints this table.
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Fixture
+    {
+        const char* name;
+        size_t size;
+        const char* sha256;
+    };
+
+    const Fixture FIXTURES[] = {
+        { "empty", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "stored", 33000, "3a8f96c4b20d8e5867a4da095c22b2ceae975d8168f009fa554020087f61e32a" },
+        { "mszip", 100000, "0fb9f4993f8277ebcd0b8064b67f8ec76256f186bfa2265699cfa93e5d07f396" },
+        { "mszip-reserve", 40000, "9bd5ba76e9bff8a437d6cb6bfd8dbff40e35b04ce8ae85e070993d426dc5c6fb" },
+        { "lzx-verbatim", 70000, "09ee64a08f384f8a41a8981d0640a247633ccb245747a99ccd19ddb3ea0dd72b" },
+        { "lzx-aligned", 70000, "da2cdb4d8d1cdc1863a48c7f8eee0a75aeb2aa4f6a59d7c71a8d9ba7e6ca609f" },
+        { "lzx-uncompressed", 33001, "1b651bdb7f5e62e819adfd31f65c6a91d2aa4e90e869d1209e3fb0e5d93ed417" },
+        { "lzx-mixed-e8", 100000, "9a8086fdce41922614ef007832c2d94ccad56c849ca96bffb485d840dc7decce" },
+        { "lzx-e8-file-size", 40000, "9bd5ba76e9bff8a437d6cb6bfd8dbff40e35b04ce8ae85e070993d426dc5c6fb" },
+        { "lzx-small", 3000, "9d3d423cfd56bdadc7f47d476fe681115d21deddc5cccce4c4d389712c7db8a6" },
+    };
+
+    fs::path fixturePath(const Fixture& fixture)
+    {
+        return fs::path(__FILE__).parent_path() / "fixtures" / (std::string(fixture.name) + ".pd_");
+    }
+
+    std::string readFile(const fs::path& path)
+    {
+        std::ifstream reader(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+    }
+
+    std::string sha256Of(const std::string& data)
+    {
+        Sha256 hash;
+        hash.update(data.data(), data.size());
+        uint8_t digest[Sha256::DIGEST_SIZE];
+        hash.final(digest);
+        std::string hex;
+        char digits[3];
+        for (auto byte : digest)
+        {
+            snprintf(digits, sizeof(digits), "%02x", byte);
+            hex += digits;
+        }
+        return hex;
+    }
+
+    // the file extracted from cabinet fed to CabExtractor in pieces of step bytes, or "failed"
+    std::string extractInPieces(const std::string& cabinet, size_t step, const std::wstring& outputPath)
+    {
+        CabExtractor extractor(outputPath);
+        for (size_t i = 0; i < cabinet.size(); i += step)
+        {
+            if (!extractor.write(cabinet.data() + i, std::min(step, cabinet.size() - i)))
+                return "failed";
+        }
+        return extractor.finish() ? readFile(outputPath) : "failed";
+    }
+
+    void append16(std::string& data, unsigned value)
+    {
+        data += static_cast<char>(value & 0xff);
+        data += static_cast<char>(value >> 8 & 0xff);
+    }
+
+    void append32(std::string& data, unsigned value)
+    {
+        append16(data, value & 0xffff);
+        append16(data, value >> 16);
+    }
+
+    // a one-file cabinet of the given CFDATA blocks: data and uncompressed size
+    std::string makeCabinet(unsigned typeCompress, const std::vector<std::pair<std::string, unsigned>>& blocks, unsigned fileSize)
+    {
+        const char name[] = "test.pdb";
+        unsigned filesOffset = 36 + 8;
+        unsigned dataOffset = filesOffset + 16 + sizeof(name);
+        std::string cabinet = "MSCF";
+        append32(cabinet, 0);
+        append32(cabinet, 0);  // cabinet size, which isn't checked
+        append32(cabinet, 0);
+        append32(cabinet, filesOffset);
+        append32(cabinet, 0);
+        append16(cabinet, 0x0103);
+        append16(cabinet, 1);  // folders
+        append16(cabinet, 1);  // files
+        append16(cabinet, 0);  // flags
+        append32(cabinet, 0);  // set ID and index
+        append32(cabinet, dataOffset);
+        append16(cabinet, static_cast<unsigned>(blocks.size()));
+        append16(cabinet, typeCompress);
+        append32(cabinet, fileSize);
+        append32(cabinet, 0);  // offset in the folder
+        append32(cabinet, 0);  // folder, date
+        append32(cabinet, 0);  // time, attributes
+        cabinet.append(name, sizeof(name));
+        for (const auto& block : blocks)
+        {
+            append32(cabinet, 0);  // checksum
+            append16(cabinet, static_cast<unsigned>(block.first.size()));
+            append16(cabinet, block.second);
+            cabinet += block.first;
+        }
+        return cabinet;
+    }
+
+    // nothing but the extracted files: no temporary file was left behind
+    bool hasOnlyFile(const TempDirectory& directory, const char* name)
+    {
+        for (const auto& entry : fs::directory_iterator(directory.path))
+        {
+            if (entry.path().filename() != name)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(cabExtractorFixtures)
+{
+    TempDirectory directory("fileinfotest-cab");
+    for (const auto& fixture : FIXTURES)
+    {
+        std::wstring outputPath = directory.file("out.pdb");
+        std::wstring error;
+        bool isExtracted = CabExtractor::extract(fixturePath(fixture).wstring(), outputPath, error);
+        if (!isExtracted)
+            reportFailure(__FILE__, __LINE__, std::string(fixture.name) + ": " + std::string(error.begin(), error.end()));
+        std::string output = readFile(outputPath);
+        CHECK_EQUAL(fixture.size, output.size());
+        CHECK_EQUAL(std::string(fixture.sha256), sha256Of(output));
+    }
+    CHECK(hasOnlyFile(directory, "out.pdb"));
+}
+
+TEST(cabExtractorStreamedInPieces)
+{
+    // as a download delivers it: a block, its header or the cabinet header may be cut anywhere
+    TempDirectory directory("fileinfotest-cab-pieces");
+    std::wstring outputPath = directory.file("out.pdb");
+    for (const auto& fixture : FIXTURES)
+    {
+        std::string cabinet = readFile(fixturePath(fixture));
+        for (size_t step : { size_t(1), size_t(3), size_t(8), size_t(511), size_t(4096), size_t(32769) })
+            CHECK_EQUAL(std::string(fixture.sha256), sha256Of(extractInPieces(cabinet, step, outputPath)));
+    }
+}
+
+TEST(cabExtractorEverySplitPoint)
+{
+    TempDirectory directory("fileinfotest-cab-split");
+    std::wstring outputPath = directory.file("out.pdb");
+    for (const char* name : { "lzx-small", "empty" })
+    {
+        const Fixture& fixture = *std::find_if(std::begin(FIXTURES), std::end(FIXTURES), [&](const Fixture& f) { return std::string(f.name) == name; });
+        std::string cabinet = readFile(fixturePath(fixture));
+        for (size_t split = 0; split <= cabinet.size(); split++)
+        {
+            CabExtractor extractor(outputPath);
+            CHECK(extractor.write(cabinet.data(), split));
+            CHECK(extractor.write(cabinet.data() + split, cabinet.size() - split));
+            CHECK(extractor.finish());
+            CHECK_EQUAL(std::string(fixture.sha256), sha256Of(readFile(outputPath)));
+        }
+    }
+}
+
+TEST(cabExtractorRejectsTruncated)
+{
+    TempDirectory directory("fileinfotest-cab-truncated");
+    std::mt19937 random(5);
+    for (const auto& fixture : FIXTURES)
+    {
+        std::string cabinet = readFile(fixturePath(fixture));
+        std::vector<size_t> lengths = { 0, cabinet.size() - 1 };
+        for (int i = 0; i < 20; i++)
+            lengths.push_back(random() % cabinet.size());
+        for (size_t length : lengths)
+        {
+            CabExtractor extractor(directory.file("out.pdb"));
+            extractor.write(cabinet.data(), length);
+            CHECK(!extractor.finish());
+            CHECK(!extractor.error().empty());
+        }
+    }
+    CHECK(fs::is_empty(directory.path));
+}
+
+TEST(cabExtractorSurvivesBitFlips)
+{
+    // damaged cabinets must fail cleanly or decode to something; never crash, hang or leave files behind
+    TempDirectory directory("fileinfotest-cab-flips");
+    std::mt19937 random(7);
+    for (const auto& fixture : FIXTURES)
+    {
+        std::string cabinet = readFile(fixturePath(fixture));
+        for (int i = 0; i < 60; i++)
+        {
+            std::string damaged = cabinet;
+            int numberOfFlips = 1 + i % 8;
+            for (int flip = 0; flip < numberOfFlips; flip++)
+                damaged[random() % damaged.size()] ^= static_cast<char>(1 << (random() % 8));
+            std::wstring outputPath = directory.file("out.pdb");
+            bool isExtracted = extractInPieces(damaged, 1 + random() % 9000, outputPath) != "failed";
+            CHECK(isExtracted == fs::exists(fs::path(outputPath)));
+            fs::remove(fs::path(outputPath));
+        }
+    }
+    CHECK(fs::is_empty(directory.path));
+}
+
+TEST(cabExtractorRejectsShortFrameBeforeLast)
+{
+    // One uncompressed LZX block of 32769 bytes in a 32 KB window, sent as a 1-byte frame and then a
+    // full one, which would end past the window. Block header: no E8 translation, type 3, the length
+    // and the padding to the word, then the repeated offsets.
+    std::string header("\x08\x30\x10\x00", 4);
+    for (int i = 0; i < 3; i++)
+        header += std::string("\x01\x00\x00\x00", 4);
+    std::string first = header + "a";
+    std::string second(LzxDecoder::FRAME_SIZE, 'b');
+
+    std::vector<uint8_t> out(LzxDecoder::FRAME_SIZE);
+    LzxDecoder decoder(LzxDecoder::MIN_WINDOW_BITS);
+    CHECK(decoder.decodeFrame(reinterpret_cast<const uint8_t*>(first.data()), first.size(), out.data(), 1));
+    CHECK_EQUAL(uint8_t('a'), out[0]);
+    CHECK(!decoder.decodeFrame(reinterpret_cast<const uint8_t*>(second.data()), second.size(), out.data(), out.size()));
+
+    TempDirectory directory("fileinfotest-cab-short");
+    std::string cabinet = makeCabinet(3 | LzxDecoder::MIN_WINDOW_BITS << 8, { { first, 1 }, { second + "\0", 32768 } }, 32769);
+    std::wstring outputPath = directory.file("out.pdb");
+    CHECK_EQUAL(std::string("failed"), extractInPieces(cabinet, cabinet.size(), outputPath));
+    CHECK(fs::is_empty(directory.path));
+    // the same stream as one frame of 32768 and one of 1 is fine
+    std::string whole = header + "a" + second;
+    cabinet = makeCabinet(3 | LzxDecoder::MIN_WINDOW_BITS << 8, { { whole.substr(0, header.size() + 32768), 32768 }, { whole.substr(header.size() + 32768) + "\0", 1 } }, 32769);
+    CHECK_EQUAL("a" + second, extractInPieces(cabinet, cabinet.size(), outputPath));
+}
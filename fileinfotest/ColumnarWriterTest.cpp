@@ -0,0 +1,441 @@
+#include "Test.h"
+#include "ColumnarWriter.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// ColumnarWriter output read back by a reader written from the format described in ColumnarWriter.h.
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::string NULL_VALUE = "(null)";
+
+    struct ByteReader
+    {
+        std::string_view data;
+        size_t position = 0;
+        bool isBad = false;
+
+        uint64_t number(size_t width)
+        {
+            if (data.size() - position < width)
+            {
+                isBad = true;
+                position = data.size();
+                return 0;
+            }
+            uint64_t value = 0;
+            for (size_t i = 0; i < width; i++)
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(data[position + i])) << (8 * i);
+            position += width;
+            return value;
+        }
+        std::string bytes(uint64_t count)
+        {
+            if (data.size() - position < count)
+            {
+                isBad = true;
+                position = data.size();
+                return "";
+            }
+            std::string value(data.substr(position, static_cast<size_t>(count)));
+            position += static_cast<size_t>(count);
+            return value;
+        }
+    };
+
+    // how the strings of a column chunk were stored
+    struct StringsInfo
+    {
+        int encoding = -1;
+        size_t dictionarySize = 0;
+        size_t indexWidth = 0;
+    };
+
+    std::vector<std::string> readStringTable(ByteReader& reader, size_t count)
+    {
+        std::vector<uint64_t> offsets;
+        for (size_t i = 0; i <= count; i++)
+            offsets.push_back(reader.number(4));
+        std::string bytes = reader.bytes(offsets.back());
+        std::vector<std::string> strings;
+        for (size_t i = 0; i < count && !reader.isBad; i++)
+        {
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > bytes.size())
+                reader.isBad = true;
+            else
+                strings.push_back(bytes.substr(static_cast<size_t>(offsets[i]), static_cast<size_t>(offsets[i + 1] - offsets[i])));
+        }
+        return strings;
+    }
+
+    std::vector<std::string> readStrings(ByteReader& reader, size_t count, StringsInfo& info)
+    {
+        info.encoding = static_cast<int>(reader.number(1));
+        if (info.encoding == 0)
+            return readStringTable(reader, count);
+        if (info.encoding != 1)
+        {
+            reader.isBad = true;
+            return {};
+        }
+        info.dictionarySize = static_cast<size_t>(reader.number(4));
+        if (info.dictionarySize > reader.data.size())
+        {
+            reader.isBad = true;
+            return {};
+        }
+        std::vector<std::string> dictionary = readStringTable(reader, info.dictionarySize);
+        info.indexWidth = info.dictionarySize <= 0x100 ? 1 : info.dictionarySize <= 0x10000 ? 2 : 4;
+        std::vector<std::string> strings;
+        for (size_t i = 0; i < count && !reader.isBad; i++)
+        {
+            uint64_t index = reader.number(info.indexWidth);
+            if (index >= dictionary.size())
+                reader.isBad = true;
+            else
+                strings.push_back(dictionary[static_cast<size_t>(index)]);
+        }
+        return strings;
+    }
+
+    // A whole file. Values are kept as text: numbers in decimal, the elements of a list joined
+    // with '|', NULL_VALUE for null.
+    struct ColumnarFile
+    {
+        bool isValid = false;
+        std::vector<std::string> names;
+        std::vector<ColumnType> types;
+        std::vector<unsigned> widths;
+        std::vector<uint32_t> groupRows;
+        std::vector<std::vector<StringsInfo>> strings;  // by row group, by column
+        std::vector<std::vector<std::string>> values;  // by column, by row
+
+        explicit ColumnarFile(const std::string& data)
+        {
+            const size_t magicSize = sizeof(ColumnarWriter::MAGIC);
+            std::string magic(ColumnarWriter::MAGIC, magicSize);
+            if (data.size() < 2 * magicSize + 4 || data.compare(0, magicSize, magic) != 0 || data.compare(data.size() - magicSize, magicSize, magic) != 0)
+                return;
+            ByteReader lengthReader{ data, data.size() - magicSize - 4 };
+            uint64_t footerLength = lengthReader.number(4);
+            size_t footerEnd = data.size() - magicSize - 4;
+            if (footerLength > footerEnd - magicSize)
+                return;
+            size_t footerStart = footerEnd - static_cast<size_t>(footerLength);
+
+            ByteReader footer{ std::string_view(data).substr(0, footerEnd), footerStart };
+            size_t numberOfColumns = static_cast<size_t>(footer.number(4));
+            for (size_t i = 0; i < numberOfColumns && !footer.isBad; i++)
+            {
+                types.push_back(static_cast<ColumnType>(footer.number(1)));
+                widths.push_back(static_cast<unsigned>(footer.number(1)));
+                names.push_back(footer.bytes(footer.number(2)));
+            }
+            values.resize(names.size());
+            size_t numberOfRowGroups = static_cast<size_t>(footer.number(4));
+            uint64_t expectedOffset = magicSize;
+            for (size_t group = 0; group < numberOfRowGroups && !footer.isBad; group++)
+            {
+                uint32_t rows = static_cast<uint32_t>(footer.number(4));
+                groupRows.push_back(rows);
+                strings.emplace_back(names.size());
+                for (size_t column = 0; column < names.size() && !footer.isBad; column++)
+                {
+                    uint64_t offset = footer.number(8);
+                    uint64_t length = footer.number(8);
+                    // chunks follow each other, from the magic up to the footer
+                    if (offset != expectedOffset || length > footerStart - offset)
+                        return;
+                    expectedOffset = offset + length;
+                    ByteReader chunk{ std::string_view(data).substr(static_cast<size_t>(offset), static_cast<size_t>(length)) };
+                    if (!readChunk(chunk, column, rows, strings.back()[column]))
+                        return;
+                }
+            }
+            isValid = !footer.isBad && footer.position == footerEnd && expectedOffset == footerStart;
+        }
+
+    private:
+        bool readChunk(ByteReader& chunk, size_t column, uint32_t rows, StringsInfo& info)
+        {
+            uint32_t nullCount = static_cast<uint32_t>(chunk.number(4));
+            std::vector<bool> isValidRow(rows, true);
+            if (nullCount != 0)
+            {
+                std::string validity = chunk.bytes((rows + 7) / 8);
+                for (uint32_t row = 0; row < rows && !chunk.isBad; row++)
+                    isValidRow[row] = (static_cast<uint8_t>(validity[row / 8]) >> (row % 8) & 1) != 0;
+            }
+            size_t count = 0;
+            for (bool isValidValue : isValidRow)
+                count += isValidValue;
+            if (rows - count != nullCount)
+                return false;
+
+            std::vector<std::string> columnValues;
+            switch (types[column])
+            {
+            case ColumnType::String:
+                columnValues = readStrings(chunk, count, info);
+                break;
+            case ColumnType::StringList:
+            {
+                std::vector<uint64_t> offsets;
+                for (size_t i = 0; i <= count; i++)
+                    offsets.push_back(chunk.number(4));
+                std::vector<std::string> elements = readStrings(chunk, static_cast<size_t>(offsets.back()), info);
+                for (size_t i = 0; i < count && !chunk.isBad; i++)
+                {
+                    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > elements.size())
+                        return false;
+                    std::string list;
+                    for (uint64_t element = offsets[i]; element < offsets[i + 1]; element++)
+                        list += (element == offsets[i] ? "" : "|") + elements[static_cast<size_t>(element)];
+                    columnValues.push_back(list);
+                }
+                break;
+            }
+            case ColumnType::Binary:
+                for (size_t i = 0; i < count; i++)
+                    columnValues.push_back(chunk.bytes(widths[column]));
+                break;
+            case ColumnType::Float64:
+                for (size_t i = 0; i < count; i++)
+                {
+                    uint64_t bits = chunk.number(8);
+                    double real = 0;
+                    memcpy(&real, &bits, sizeof(real));
+                    columnValues.push_back(std::to_string(real));
+                }
+                break;
+            default:
+                for (size_t i = 0; i < count; i++)
+                    columnValues.push_back(std::to_string(chunk.number(size_t(1) << static_cast<unsigned>(types[column]))));
+                break;
+            }
+            if (chunk.isBad || chunk.position != chunk.data.size() || columnValues.size() != count)
+                return false;
+            auto next = columnValues.begin();
+            for (bool isValidValue : isValidRow)
+                values[column].push_back(isValidValue ? *next++ : NULL_VALUE);
+            return true;
+        }
+    };
+
+    std::string readFile(const fs::path& path)
+    {
+        std::ifstream reader(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+    }
+
+    // what ColumnarWriter writes for rows
+    std::string writeColumnar(const std::vector<ColumnSpec>& schema, const std::vector<ColumnarRow>& rows, size_t rowsPerGroup = ColumnarWriter::DEFAULT_ROWS_PER_GROUP)
+    {
+        TempDirectory directory("fileinfotest-columnar");
+        std::wstring path = directory.file("out.col");
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        int file = open(fs::path(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        {
+            BufferedOutput output(file);
+            ColumnarWriter writer(output, schema, rowsPerGroup);
+            for (const auto& row : rows)
+                writer.append(row);
+            writer.finish();
+            // ignored once finished
+            writer.append(rows.empty() ? ColumnarRow(schema.size()) : rows.front());
+        }
+#ifdef _WIN32
+        CloseHandle(file);
+#else
+        close(file);
+#endif
+        return readFile(path);
+    }
+
+    const std::vector<ColumnSpec> ALL_TYPES = {
+        { "u8", ColumnType::UInt8, 0 },
+        { "u16", ColumnType::UInt16, 0 },
+        { "u32", ColumnType::UInt32, 0 },
+        { "u64", ColumnType::UInt64, 0 },
+        { "real", ColumnType::Float64, 0 },
+        { "digest", ColumnType::Binary, 4 },
+        { "name", ColumnType::String, 0 },
+        { "list", ColumnType::StringList, 0 },
+    };
+
+    // row i of the table of columnarRoundTrip; every third row has nulls
+    ColumnarRow allTypesRow(unsigned i)
+    {
+        ColumnarRow row(ALL_TYPES.size());
+        row.setNumber(0, 200 + i);
+        row.setNumber(1, 60000 + i);
+        if (i % 3 != 1)
+        {
+            row.setNumber(2, 4000000000u + i);
+            row.setBytes(5, std::string("d") + static_cast<char>('0' + i) + "xy");
+        }
+        row.setNumber(3, 0xfedcba9876543210ULL + i);
+        row.setReal(4, i + 0.5);
+        if (i % 3 != 2)
+            row.setBytes(6, "name" + std::to_string(i));
+        if (i % 3 != 1)
+        {
+            row.beginList(7);
+            for (unsigned element = 0; element < i % 4; element++)
+                row.addElement(7, "e" + std::to_string(element));
+        }
+        return row;
+    }
+}
+
+TEST(columnarRoundTrip)
+{
+    std::vector<ColumnarRow> rows;
+    for (unsigned i = 0; i < 10; i++)
+        rows.push_back(allTypesRow(i));
+    ColumnarFile file(writeColumnar(ALL_TYPES, rows, 4));
+    CHECK(file.isValid);
+    CHECK(file.groupRows == std::vector<uint32_t>({ 4, 4, 2 }));
+    CHECK_EQUAL(ALL_TYPES.size(), file.names.size());
+    for (size_t column = 0; column < file.names.size() && column < ALL_TYPES.size(); column++)
+    {
+        CHECK_EQUAL(std::string(ALL_TYPES[column].name), file.names[column]);
+        CHECK(ALL_TYPES[column].type == file.types[column]);
+        CHECK_EQUAL(column == 5 ? 4u : 0u, file.widths[column]);
+        CHECK_EQUAL(rows.size(), file.values[column].size());
+    }
+    if (!file.isValid)
+        return;
+    for (unsigned i = 0; i < 10; i++)
+    {
+        CHECK_EQUAL(std::to_string(200 + i), file.values[0][i]);
+        CHECK_EQUAL(std::to_string(60000 + i), file.values[1][i]);
+        CHECK_EQUAL(i % 3 == 1 ? NULL_VALUE : std::to_string(4000000000u + i), file.values[2][i]);
+        CHECK_EQUAL(std::to_string(0xfedcba9876543210ULL + i), file.values[3][i]);
+        CHECK_EQUAL(std::to_string(i + 0.5), file.values[4][i]);
+        CHECK_EQUAL(i % 3 == 1 ? NULL_VALUE : std::string("d") + static_cast<char>('0' + i) + "xy", file.values[5][i]);
+        CHECK_EQUAL(i % 3 == 2 ? NULL_VALUE : "name" + std::to_string(i), file.values[6][i]);
+        std::string list;
+        for (unsigned element = 0; element < i % 4; element++)
+            list += (element ? "|e" : "e") + std::to_string(element);
+        CHECK_EQUAL(i % 3 == 1 ? NULL_VALUE : list, file.values[7][i]);
+    }
+}
+
+TEST(columnarEmptyFile)
+{
+    std::string data = writeColumnar(ALL_TYPES, {});
+    ColumnarFile file(data);
+    CHECK(file.isValid);
+    CHECK(file.groupRows.empty());
+    CHECK_EQUAL(ALL_TYPES.size(), file.names.size());
+    // a file cut short has no footer to find
+    CHECK(!ColumnarFile(data.substr(0, data.size() - 1)).isValid);
+}
+
+TEST(columnarNullsAndBinaryWidth)
+{
+    std::vector<ColumnSpec> schema = { { "digest", ColumnType::Binary, 3 }, { "n", ColumnType::UInt32, 0 } };
+    std::vector<ColumnarRow> rows;
+    for (unsigned i = 0; i < 20; i++)
+    {
+        ColumnarRow row(schema.size());
+        // a value of the wrong size is cut or padded
+        if (i % 5 != 0)
+            row.setBytes(0, std::string(i % 5, 'a'));
+        if (i == 9)
+            row.setNumber(1, 9);
+        rows.push_back(row);
+    }
+    // a row with fewer cells than columns has nulls in the others
+    rows.push_back(ColumnarRow(1));
+    ColumnarFile file(writeColumnar(schema, rows));
+    CHECK(file.isValid);
+    if (!file.isValid)
+        return;
+    for (unsigned i = 0; i < 20; i++)
+    {
+        std::string expected = i % 5 == 0 ? NULL_VALUE : i % 5 == 4 ? "aaa" : std::string(i % 5, 'a') + std::string(3 - i % 5, '\0');
+        CHECK(expected == file.values[0][i]);
+        CHECK_EQUAL(i == 9 ? std::string("9") : NULL_VALUE, file.values[1][i]);
+    }
+    CHECK_EQUAL(NULL_VALUE, file.values[0][20]);
+    CHECK_EQUAL(NULL_VALUE, file.values[1][20]);
+}
+
+TEST(columnarStringEncodings)
+{
+    // unique paths stay plain; names that repeat go to a dictionary with the narrowest index
+    std::vector<ColumnSpec> schema = { { "path", ColumnType::String, 0 }, { "few", ColumnType::String, 0 }, { "some", ColumnType::String, 0 },
+        { "many", ColumnType::String, 0 }, { "imports", ColumnType::StringList, 0 } };
+    const unsigned numberOfRows = 140000;
+    std::vector<ColumnarRow> rows;
+    for (unsigned i = 0; i < numberOfRows; i++)
+    {
+        ColumnarRow row(schema.size());
+        row.setBytes(0, "C:\\Windows\\System32\\file" + std::to_string(i) + ".dll");
+        row.setBytes(1, "few" + std::to_string(i % 200));
+        row.setBytes(2, "some" + std::to_string(i % 300));
+        row.setBytes(3, "many" + std::to_string(i % 70000));
+        row.beginList(4);
+        for (unsigned element = 0; element < i % 3; element++)
+            row.addElement(4, element == 0 ? "KERNEL32.dll" : "USER32.dll");
+        rows.push_back(row);
+    }
+    ColumnarFile file(writeColumnar(schema, rows, numberOfRows));
+    CHECK(file.isValid);
+    if (!file.isValid)
+        return;
+    CHECK_EQUAL(size_t(1), file.strings.size());
+    const auto& info = file.strings[0];
+    CHECK_EQUAL(0, info[0].encoding);
+    CHECK_EQUAL(1, info[1].encoding);
+    CHECK_EQUAL(size_t(200), info[1].dictionarySize);
+    CHECK_EQUAL(size_t(1), info[1].indexWidth);
+    CHECK_EQUAL(1, info[2].encoding);
+    CHECK_EQUAL(size_t(2), info[2].indexWidth);
+    CHECK_EQUAL(1, info[3].encoding);
+    CHECK_EQUAL(size_t(4), info[3].indexWidth);
+    CHECK_EQUAL(1, info[4].encoding);
+    CHECK_EQUAL(size_t(2), info[4].dictionarySize);
+    for (unsigned i = 0; i < numberOfRows; i += 997)
+    {
+        CHECK_EQUAL("C:\\Windows\\System32\\file" + std::to_string(i) + ".dll", file.values[0][i]);
+        CHECK_EQUAL("few" + std::to_string(i % 200), file.values[1][i]);
+        CHECK_EQUAL("some" + std::to_string(i % 300), file.values[2][i]);
+        CHECK_EQUAL("many" + std::to_string(i % 70000), file.values[3][i]);
+        const char* lists[] = { "", "KERNEL32.dll", "KERNEL32.dll|USER32.dll" };
+        CHECK_EQUAL(std::string(lists[i % 3]), file.values[4][i]);
+    }
+}
+
+TEST(columnarRowEncoding)
+{
+    for (unsigned i = 0; i < 3; i++)
+    {
+        ColumnarRow row = allTypesRow(i);
+        std::string encoded;
+        row.encode(encoded);
+        ColumnarRow decoded;
+        CHECK(decoded.decode(encoded));
+        std::string again;
+        decoded.encode(again);
+        CHECK(again == encoded);
+        // the decoded row is written as the original
+        CHECK(writeColumnar(ALL_TYPES, { decoded }) == writeColumnar(ALL_TYPES, { row }));
+        // anything cut off or left over is damage
+        for (size_t length = 0; length < encoded.size(); length++)
+            CHECK(!ColumnarRow().decode(std::string_view(encoded).substr(0, length)));
+        CHECK(!ColumnarRow().decode(encoded + '\0'));
+    }
+}
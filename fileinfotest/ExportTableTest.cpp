@@ -0,0 +1,153 @@
+#include "Test.h"
+#include "ExportTable.h"
+#include "TestImage.h"
+#include <map>
+#include <string>
+
+namespace
+{
+    const DWORD BASE = TestImage::SECTION_RVA;
+    const DWORD DIRECTORY_SIZE = 0x800;  // forwarder strings must lie inside it
+    const DWORD CODE = BASE + DIRECTORY_SIZE;  // RVAs of functions with code start here
+
+    // one slot of the export address table; all empty for an unused ordinal
+    struct Export
+    {
+        const char* name;  // nullptr if exported by ordinal only
+        const char* forwarder;  // nullptr for a function with code
+        DWORD rva;
+    };
+
+    // An image exporting functions from ordinal base on, with the names in the given order.
+    // Layout inside the directory: IMAGE_EXPORT_DIRECTORY, the address table at 0x40, name RVAs at
+    // 0x200, name ordinals at 0x300 and the strings from 0x400 on.
+    TestImage exportImage(const std::string& dllName, DWORD base, const std::vector<Export>& exports)
+    {
+        TestImage image;
+        DWORD strings = BASE + 0x400;
+        auto addString = [&](const std::string& text)
+        {
+            DWORD rva = strings;
+            image.putString(rva, text);
+            strings += static_cast<DWORD>(text.size() + 1);
+            return rva;
+        };
+        IMAGE_EXPORT_DIRECTORY directory{};
+        directory.Name = addString(dllName);
+        directory.Base = base;
+        directory.NumberOfFunctions = static_cast<DWORD>(exports.size());
+        directory.AddressOfFunctions = BASE + 0x40;
+        directory.AddressOfNames = BASE + 0x200;
+        directory.AddressOfNameOrdinals = BASE + 0x300;
+        for (DWORD i = 0; i < exports.size(); i++)
+        {
+            const Export& entry = exports[i];
+            image.put32(BASE + 0x40 + 4 * i, entry.forwarder ? addString(entry.forwarder) : entry.rva);
+            if (entry.name)
+            {
+                image.put32(BASE + 0x200 + 4 * directory.NumberOfNames, addString(entry.name));
+                image.put16(BASE + 0x300 + 2 * directory.NumberOfNames, static_cast<WORD>(i));
+                directory.NumberOfNames++;
+            }
+        }
+        image.put(BASE, &directory, sizeof(directory));
+        image.setDirectory(IMAGE_DIRECTORY_ENTRY_EXPORT, BASE, DIRECTORY_SIZE);
+        return image;
+    }
+
+    ExportTable exportTable(const TestImage& image)
+    {
+        PeImage pe;
+        CHECK(image.load(pe));
+        return ExportTable(pe);
+    }
+}
+
+TEST(exportTableReadsDirectory)
+{
+    // the table outlives the image it was read from
+    ExportTable exports = exportTable(exportImage("A.dll", 5, {
+        { "Zeta", nullptr, CODE },
+        { nullptr, nullptr, 0 },
+        { "Beta", "B.Beta", 0 },
+        { nullptr, nullptr, CODE + 0x20 },
+        { "Alpha", nullptr, CODE + 0x40 },
+    }));
+    CHECK(!exports.truncated());
+    CHECK(exports.dllName() == "A.dll");
+    CHECK_EQUAL(size_t(4), exports.functions().size());
+    CHECK_EQUAL(size_t(3), exports.numberOfNames());
+
+    // names are found even though the name table is not sorted
+    const ExportedFunction* alpha = exports.find("Alpha");
+    CHECK(alpha && alpha->ordinal == 9 && alpha->rva == CODE + 0x40 && alpha->name == "Alpha");
+    CHECK(exports.find("Zeta") == exports.findOrdinal(5));
+    CHECK(!exports.find("alpha"));
+    const ExportedFunction* beta = exports.find("Beta");
+    CHECK(beta && beta->rva == 0 && beta->forwarder == "B.Beta");
+
+    // ordinals: below the base, an unused slot, by ordinal only, past the end
+    CHECK(!exports.findOrdinal(4));
+    CHECK(!exports.findOrdinal(6));
+    const ExportedFunction* unnamed = exports.findOrdinal(8);
+    CHECK(unnamed && unnamed->name.empty() && unnamed->rva == CODE + 0x20);
+    CHECK(!exports.findOrdinal(10));
+}
+
+TEST(exportTableResolvesForwarders)
+{
+    std::map<std::string, ExportTable, std::less<>> modules;
+    modules["A"] = exportTable(exportImage("A.dll", 1, {
+        { "Start", "B.Middle", 0 },
+        { "ByOrdinal", "B.#7", 0 },
+        { "Loop", "C.Loop", 0 },
+        { "Self", "A.Self", 0 },
+        { "UnknownModule", "D.Function", 0 },
+        { "NoFunction", "B.", 0 },
+        { "NoOrdinal", "B.#", 0 },
+        { "BadOrdinal", "B.#7x", 0 },
+        { "HugeOrdinal", "B.#4294967303", 0 },  // 2^32 + 7
+        { "Unused", "B.#9", 0 },
+    }));
+    modules["B"] = exportTable(exportImage("B.dll", 7, {
+        { "Target", nullptr, CODE },
+        { "Middle", "C.End", 0 },
+    }));
+    modules["C"] = exportTable(exportImage("C.dll", 1, {
+        { "End", nullptr, CODE + 0x10 },
+        { "Loop", "A.Loop", 0 },
+    }));
+    int lookups = 0;
+    ExportTable::ModuleLookup lookup = [&](std::string_view name) -> const ExportTable*
+    {
+        lookups++;
+        auto it = modules.find(name);
+        return it == modules.end() ? nullptr : &it->second;
+    };
+    const ExportTable& a = modules["A"];
+
+    const ExportedFunction* end = a.resolve("Start", lookup);
+    CHECK(end && end == modules["C"].find("End"));
+    const ExportedFunction* target = a.resolve("ByOrdinal", lookup);
+    CHECK(target && target->ordinal == 7 && target->rva == CODE);
+    CHECK(!a.resolve("Missing", lookup));
+    for (const char* name : { "UnknownModule", "NoFunction", "NoOrdinal", "BadOrdinal", "HugeOrdinal", "Unused" })
+    {
+        if (a.resolve(name, lookup))
+            reportFailure(__FILE__, __LINE__, std::string(name) + " resolved");
+    }
+
+    // loops through other modules and back to the same function end after a bounded number of steps
+    lookups = 0;
+    CHECK(!a.resolve("Loop", lookup));
+    CHECK(lookups > 0 && lookups <= 16);
+    lookups = 0;
+    CHECK(!a.resolve("Self", lookup));
+    CHECK(lookups > 0 && lookups <= 16);
+
+    std::string_view module, function;
+    CHECK(ExportTable::splitForwarder("api-ms-win-core-heap-l1-1-0.HeapAlloc", module, function));
+    CHECK(module == "api-ms-win-core-heap-l1-1-0" && function == "HeapAlloc");
+    CHECK(!ExportTable::splitForwarder(".HeapAlloc", module, function));
+    CHECK(!ExportTable::splitForwarder("NoDot", module, function));
+}
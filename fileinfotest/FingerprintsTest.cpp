@@ -0,0 +1,184 @@
+#include "Test.h"
+#include "Fingerprints.h"
+#include "TestImage.h"
+#include <cstring>
+
+// The expected imphash and Rich header hash values are those pefile's get_imphash and
+// get_rich_header_hash give for the same imports and bytes, apart from the ws2_32 ordinal noted
+// below; the Rich key is the checksum the linker computes over them.
+
+namespace
+{
+    const DWORD BASE = TestImage::SECTION_RVA;
+
+    // One module of the regular imports: its descriptor at descriptorRva, its thunks and strings
+    // from dataRva on, functions by name or by ordinal as "#N". Returns where the next one's data can go.
+    DWORD addModule(TestImage& image, DWORD descriptorRva, DWORD dataRva, const std::string& name, const std::vector<std::string>& functions, bool is64bit = true)
+    {
+        DWORD thunkSize = is64bit ? 8 : 4;
+        DWORD thunks = dataRva;
+        DWORD strings = thunks + static_cast<DWORD>(functions.size() + 1) * thunkSize;
+        IMAGE_IMPORT_DESCRIPTOR descriptor{};
+        descriptor.OriginalFirstThunk = thunks;
+        descriptor.FirstThunk = thunks;
+        descriptor.Name = strings;
+        image.put(descriptorRva, &descriptor, sizeof(descriptor));
+        image.putString(strings, name);
+        strings += static_cast<DWORD>(name.size() + 1);
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            ULONGLONG thunk;
+            if (functions[i][0] == '#')
+            {
+                thunk = std::stoul(functions[i].substr(1)) | (is64bit ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32);
+            }
+            else
+            {
+                // IMAGE_IMPORT_BY_NAME is WORD aligned
+                strings = (strings + 1) & ~1u;
+                thunk = strings;
+                image.put16(strings, 0);
+                image.putString(strings + sizeof(WORD), functions[i]);
+                strings += static_cast<DWORD>(sizeof(WORD) + functions[i].size() + 1);
+            }
+            image.put(thunks + static_cast<DWORD>(i) * thunkSize, &thunk, thunkSize);
+        }
+        return (strings + 7) & ~7u;
+    }
+
+    std::wstring imphashOf(const TestImage& image)
+    {
+        PeImage pe;
+        CHECK(image.load(pe));
+        return imphash(ImportTable(pe));
+    }
+
+    // the DOS header and stub of an MSVC linked image, followed by a Rich header at 0x80
+    const char DOS_HEADER[] =
+        "MZ\x90\0\3\0\0\0\4\0\0\0\xff\xff\0\0\xb8\0\0\0\0\0\0\0\x40\0\0\0\0\0\0\0"
+        "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\xf0\0\0\0";
+    const char DOS_STUB[] = "\x0e\x1f\xba\x0e\0\xb4\x09\xcd\x21\xb8\x01\x4c\xcd\x21This program cannot be run in DOS mode.\r\r\n$\0\0\0\0\0\0\0";
+    const DWORD RICH_KEY = 0x6e9cc6ef;
+    const RichEntry RICH_ENTRIES[] = { { 0x105, 30148, 12 }, { 0x104, 30148, 3 }, { 0x103, 30148, 2 }, { 0x102, 30151, 1 }, { 0x101, 30148, 7 } };
+    const wchar_t* const RICH_HASH = L"4285d7209cb2f847bdf77094eaf5d76e";
+
+    // A TestImage with the MSVC DOS header and stub, the Rich header and the PE header after them;
+    // the headers keep their size.
+    std::vector<unsigned char> richImage()
+    {
+        std::vector<unsigned char> rich(DOS_HEADER, DOS_HEADER + sizeof(IMAGE_DOS_HEADER));
+        rich.insert(rich.end(), DOS_STUB, DOS_STUB + sizeof(DOS_STUB) - 1);
+        std::vector<DWORD> dwords = { 0x536e6144 ^ RICH_KEY, RICH_KEY, RICH_KEY, RICH_KEY };  // "DanS"
+        for (const auto& entry : RICH_ENTRIES)
+        {
+            dwords.push_back(((static_cast<DWORD>(entry.productId) << 16) | entry.build) ^ RICH_KEY);
+            dwords.push_back(entry.count ^ RICH_KEY);
+        }
+        dwords.push_back(0x68636952);  // "Rich"
+        dwords.push_back(RICH_KEY);
+        size_t richOffset = rich.size();
+        rich.resize(richOffset + dwords.size() * sizeof(DWORD));
+        memcpy(rich.data() + richOffset, dwords.data(), dwords.size() * sizeof(DWORD));
+
+        std::vector<unsigned char> file = TestImage().file;
+        size_t added = rich.size() - sizeof(IMAGE_DOS_HEADER);
+        file.erase(file.begin(), file.begin() + sizeof(IMAGE_DOS_HEADER));
+        file.erase(file.begin() + TestImage::SECTION_OFFSET - sizeof(IMAGE_DOS_HEADER) - added, file.begin() + TestImage::SECTION_OFFSET - sizeof(IMAGE_DOS_HEADER));
+        file.insert(file.begin(), rich.begin(), rich.end());
+        LONG lfanew = static_cast<LONG>(rich.size());
+        memcpy(file.data() + offsetof(IMAGE_DOS_HEADER, e_lfanew), &lfanew, sizeof(lfanew));
+        return file;
+    }
+
+    RichHeader richHeaderOf(const std::vector<unsigned char>& file)
+    {
+        PeImage pe;
+        CHECK(pe.load(file, L"rich.exe"));
+        return parseRichHeader(pe);
+    }
+}
+
+TEST(imphashMatchesPefile)
+{
+    // md5("kernel32.createfilew,kernel32.readfile,user32.messageboxw,mydriver.ord3,custom.drv.function")
+    TestImage image;
+    DWORD data = BASE + 0x100;
+    data = addModule(image, BASE, data, "KERNEL32.dll", { "CreateFileW", "ReadFile" });
+    data = addModule(image, BASE + 0x14, data, "USER32.DLL", { "MessageBoxW" });
+    data = addModule(image, BASE + 0x28, data, "MyDriver.SYS", { "#3" });
+    data = addModule(image, BASE + 0x3c, data, "custom.drv", { "Function" });
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, BASE, 5 * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    // delay-loaded modules are left out
+    IMAGE_DELAYLOAD_DESCRIPTOR delayLoad{};
+    delayLoad.Attributes.AllAttributes = 1;
+    delayLoad.DllNameRVA = data;
+    delayLoad.ImportNameTableRVA = BASE + 0x100;
+    image.putString(data, "COMCTL32.dll");
+    image.put(BASE + 0x800, &delayLoad, sizeof(delayLoad));
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT, BASE + 0x800, 2 * sizeof(delayLoad));
+    CHECK(imphashOf(image) == L"3448dd731ba64ee7fb407caaaee2b8bc");
+
+    // the same imports of a 32-bit image
+    TestImage image32(0x1000, false);
+    data = BASE + 0x100;
+    data = addModule(image32, BASE, data, "KERNEL32.dll", { "CreateFileW", "ReadFile" }, false);
+    data = addModule(image32, BASE + 0x14, data, "USER32.DLL", { "MessageBoxW" }, false);
+    data = addModule(image32, BASE + 0x28, data, "MyDriver.SYS", { "#3" }, false);
+    addModule(image32, BASE + 0x3c, data, "custom.drv", { "Function" }, false);
+    image32.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, BASE, 5 * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    CHECK(imphashOf(image32) == L"3448dd731ba64ee7fb407caaaee2b8bc");
+
+    // md5("ws2_32.ord115"); unlike pefile, which resolves that ordinal to wsastartup
+    TestImage byOrdinal;
+    addModule(byOrdinal, BASE, BASE + 0x100, "WS2_32.dll", { "#115" });
+    byOrdinal.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, BASE, 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    CHECK(imphashOf(byOrdinal) == L"97cbb4c3289287516a51ab8bdfee13e4");
+
+    // no regular imports at all
+    TestImage none;
+    CHECK(imphashOf(none).empty());
+    none.put(BASE + 0x800, &delayLoad, sizeof(delayLoad));
+    none.putString(delayLoad.DllNameRVA, "COMCTL32.dll");
+    none.setDirectory(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT, BASE + 0x800, 2 * sizeof(delayLoad));
+    CHECK(imphashOf(none).empty());
+}
+
+TEST(richHeaderChecksum)
+{
+    std::vector<unsigned char> file = richImage();
+    RichHeader rich = richHeaderOf(file);
+    CHECK(rich.present);
+    CHECK(rich.checksumValid);
+    CHECK_EQUAL(RICH_KEY, rich.key);
+    CHECK(rich.hash == RICH_HASH);
+    CHECK_EQUAL(size_t(5), rich.entries.size());
+    for (size_t i = 0; i < rich.entries.size() && i < 5; i++)
+    {
+        CHECK_EQUAL(RICH_ENTRIES[i].productId, rich.entries[i].productId);
+        CHECK_EQUAL(RICH_ENTRIES[i].build, rich.entries[i].build);
+        CHECK_EQUAL(RICH_ENTRIES[i].count, rich.entries[i].count);
+    }
+
+    // a byte of the stub changed after linking: the entries still decode, the key doesn't match
+    std::vector<unsigned char> changed = file;
+    changed[0x50] ^= 1;
+    rich = richHeaderOf(changed);
+    CHECK(rich.present);
+    CHECK(!rich.checksumValid);
+    CHECK(rich.hash == RICH_HASH);
+
+    // so does an edited count, which changes the hash as well
+    changed = file;
+    changed[0x80 + 4 * 5] ^= 1;
+    rich = richHeaderOf(changed);
+    CHECK(rich.present);
+    CHECK(!rich.checksumValid);
+    CHECK(rich.hash != RICH_HASH);
+    CHECK(!rich.entries.empty() && rich.entries[0].count == 13);
+
+    // without "DanS" there is no header to decode
+    changed = file;
+    changed[0x80] ^= 1;
+    CHECK(!richHeaderOf(changed).present);
+    CHECK(!richHeaderOf(TestImage().file).present);
+}
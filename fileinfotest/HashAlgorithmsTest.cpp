@@ -0,0 +1,228 @@
+#include "Test.h"
+#include "HashAlgorithms.h"
+#include "crypto.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct KnownAnswer
+    {
+        std::string message;
+        const char* md5;  // nullptr where the standard gives no vector
+        const char* sha1;
+        const char* sha256;
+    };
+
+    // RFC 1321 appendix A.5 and the FIPS 180-4 examples (csrc.nist.gov)
+    const KnownAnswer KNOWN_ANSWERS[] = {
+        { "", "d41d8cd98f00b204e9800998ecf8427e", "da39a3ee5e6b4b0d3255bfef95601890afd80709", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "a", "0cc175b9c0f1b6a831c399e269772661", nullptr, nullptr },
+        { "abc", "900150983cd24fb0d6963f7d28e17f72", "a9993e364706816aba3e25717850c26c9cd0d89d", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "message digest", "f96b697d7cb7938d525a2f31aaf161d0", nullptr, nullptr },
+        { "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b", nullptr, nullptr },
+        { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f", nullptr, nullptr },
+        { "12345678901234567890123456789012345678901234567890123456789012345678901234567890", "57edf4a22be3c955ac49da2e2107b67a", nullptr, nullptr },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", nullptr,
+            "84983e441c3bd26ebaae4aa1f95129e5e54670f1", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", nullptr,
+            "a49b2446a02c645bf419f995b67091253a04a259", "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+        { std::string(1000000, 'a'), "7707d6ae4e027c70eea2a935c2296f21",
+            "34aa973cd4c4daa4f61eeb2bdbad27316534016f", "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    };
+
+    // The lengths around the padding boundaries (55/56 bytes: the bit length still fits the last block or not)
+    // and a few multi-block ones, of the bytes patternByte(0), patternByte(1), ...; digests from Python's hashlib.
+    struct BoundaryAnswer
+    {
+        size_t length;
+        const char* md5;
+        const char* sha1;
+        const char* sha256;
+    };
+    const BoundaryAnswer BOUNDARY_ANSWERS[] = {
+        { 0, "d41d8cd98f00b204e9800998ecf8427e", "da39a3ee5e6b4b0d3255bfef95601890afd80709", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { 1, "89e74e640b8c46257a29de0616794d5d", "5d1be7e9dda1ee8896be5b7e34a85ee16452a7b4", "ca358758f6d27e6cf45272937977a748fd88391db679ceda7dc7bf1f005ee879" },
+        { 55, "c9e512626618c9980ef21a96597af94c", "749bbefb28edc4638b28b2b9a9e03ab9a4032b90", "8aa994584139d128848eeebc4e815639ba5ab6e6e39574195a63ac4f14f7c43b" },
+        { 56, "ecde7caa08e9f5657c863df107cac60a", "a5b6e9c29d201c774753ff8e7fb64931656f5e63", "ad574708f75c044c9b85de64cb568ee7711ff4f36448c6242f053ba8f6cc2b63" },
+        { 57, "b17b1a018dd6a4d1edda8aca15f17846", "eb0737bed5451790722b2df351829ce117e3d9dd", "5b46e502092be01b1100193e089fdda95638c12e19a1d24f308eb2c3d3ae849d" },
+        { 63, "2f0301069e1c40af7f6c8f843b1b13f2", "d1a454409359fc372b4d22b3cea6488d6ba1be00", "280ed3e8ff1df845b2e7dfe6ac6cee817bef20e783cc65abc41b818b4d2fe076" },
+        { 64, "b6bf87c24b1bc334e2541387a92b981b", "39a0d8b645ad85f1f976731ed112ac9455e28b78", "c6ab9724ade5b6a7a1edfffb12f3aa9181351355af8fd08c919952ad211339dd" },
+        { 65, "f168246f08b6134d66bd2a10343fa9f1", "d0c96e18890114a14716e9686528d2e3fdba8d9e", "788367c73c7ddf4c53f65e68cc0d943e6227ab55b0e78ba63ace822b1c6301c0" },
+        { 119, "d5dc3d8264de3aa24dee105910ee27fe", "562ecf8a430f8e1056e3619bae33628e9a1d0a4e", "3d610547d68216dedf7435a4fb6260353911f6b3fd3f18805ddb8be285d726fe" },
+        { 120, "bcc139b3848923904860d1eefd6e5923", "353f6d2bf0e91aa91b74a2e0b3f297510f7d825f", "1f80156a804cb7862ad113e8200e9d74499723e7c7854d5f48776d3148e09656" },
+        { 127, "27670172396247fa5f68637f13f8933d", "bebc42d2d3d1e5fb8ad8895c2dcef2d68a6c279a", "192409cd280e14b743642ad1343fbd3e82d9305de72c078117745a679210cc3d" },
+        { 128, "3e85b70ffc8df5c735ecf2a8f14f1bee", "0060f2a7e34b6e4d459f560197ef93243732a400", "cc548ca2dec1f6fe4f58b2e27aa9c7521607df1130d140b55a4dad0665302356" },
+        { 1000, "2b1e78d5765de9e10495a01412a1cf22", "414475341017ec91703435a6f290324818f983e9", "5097e7d587352f5097062ae679f37bda5802d9f875aba14c8cb4d1a188ada179" },
+        { 4113, "3d4aefa1532b461bb420fe0ce2252999", "bd6cdff47f642c2ec188099ea9c825b8680b0f40", "2cae9d09464ce822402ac6dd461198fccb3f89333425e4504ef55f31409bcc93" },
+    };
+
+    uint8_t patternByte(size_t i) { return static_cast<uint8_t>(i * 31 + 7); }
+
+    std::vector<uint8_t> pattern(size_t length, size_t offset = 0)
+    {
+        std::vector<uint8_t> data(length);
+        for (size_t i = 0; i < length; i++)
+            data[i] = patternByte(i + offset);
+        return data;
+    }
+
+    std::string toHex(const uint8_t* digest, size_t length)
+    {
+        std::string hex;
+        char digits[3];
+        for (size_t i = 0; i < length; i++)
+        {
+            snprintf(digits, sizeof(digits), "%02x", digest[i]);
+            hex += digits;
+        }
+        return hex;
+    }
+
+    // fed in pieces of step bytes, so the block buffering is exercised too
+    template <class Hash>
+    std::string digestOf(const uint8_t* data, size_t length, size_t step)
+    {
+        Hash hash;
+        for (size_t i = 0; i < length; i += step)
+            hash.update(data + i, step < length - i ? step : length - i);
+        uint8_t digest[Hash::DIGEST_SIZE];
+        hash.final(digest);
+        return toHex(digest, Hash::DIGEST_SIZE);
+    }
+
+    template <class Hash>
+    void checkDigest(const uint8_t* data, size_t length, const char* expected, const char* kernelName)
+    {
+        if (!expected)
+            return;
+        for (size_t step : { size_t(1), size_t(63), size_t(64), size_t(1000), length + 1 })
+        {
+            std::string actual = digestOf<Hash>(data, length, step);
+            if (actual != expected)
+            {
+                reportFailure(__FILE__, __LINE__, std::string(kernelName) + ": " + std::to_string(length) + " bytes in steps of "
+                    + std::to_string(step) + ": " + actual + " != " + expected);
+                return;
+            }
+        }
+    }
+
+    void checkMultiBuffer(size_t length, const char* kernelName)
+    {
+        // 11 messages: a full group of 8 lanes, then 3 left over
+        const size_t numberOfMessages = 11;
+        std::vector<std::vector<uint8_t>> messages;
+        std::vector<const uint8_t*> pointers;
+        for (size_t i = 0; i < numberOfMessages; i++)
+        {
+            messages.push_back(pattern(length, i * 1000));
+            pointers.push_back(messages.back().data());
+        }
+        std::vector<uint8_t> digestBytes(numberOfMessages * Sha256::DIGEST_SIZE);
+        auto digests = reinterpret_cast<uint8_t (*)[Sha256::DIGEST_SIZE]>(digestBytes.data());
+        sha256MultiBuffer(pointers.data(), numberOfMessages, length, digests);
+        for (size_t i = 0; i < numberOfMessages; i++)
+        {
+            std::string expected = digestOf<Sha256>(messages[i].data(), length, length + 1);
+            std::string actual = toHex(digests[i], Sha256::DIGEST_SIZE);
+            if (actual != expected)
+                reportFailure(__FILE__, __LINE__, std::string(kernelName) + ": sha256MultiBuffer, " + std::to_string(length)
+                    + " bytes, message " + std::to_string(i) + ": " + actual + " != " + expected);
+        }
+    }
+
+    struct Kernels
+    {
+        const char* name;
+        bool isShaNiAllowed;
+        bool isAvx2Allowed;
+    };
+    // AVX2 only drives sha256MultiBuffer, and only where SHA-NI is missing
+    const Kernels KERNELS[] = {
+        { "scalar", false, false },
+        { "SHA-NI", true, false },
+        { "AVX2", false, true },
+    };
+
+    void checkKernels(const Kernels& kernels)
+    {
+        if (!restrictHashKernels(kernels.isShaNiAllowed, kernels.isAvx2Allowed))
+        {
+            printf("  %s: not supported by this CPU, skipped\n", kernels.name);
+            restrictHashKernels(true, true);
+            return;
+        }
+        CHECK_EQUAL(std::string(kernels.name), std::string(hashBackendName()));
+        for (const KnownAnswer& answer : KNOWN_ANSWERS)
+        {
+            auto data = reinterpret_cast<const uint8_t*>(answer.message.data());
+            checkDigest<Md5>(data, answer.message.size(), answer.md5, kernels.name);
+            checkDigest<Sha1>(data, answer.message.size(), answer.sha1, kernels.name);
+            checkDigest<Sha256>(data, answer.message.size(), answer.sha256, kernels.name);
+        }
+        for (const BoundaryAnswer& answer : BOUNDARY_ANSWERS)
+        {
+            std::vector<uint8_t> data = pattern(answer.length);
+            checkDigest<Md5>(data.data(), data.size(), answer.md5, kernels.name);
+            checkDigest<Sha1>(data.data(), data.size(), answer.sha1, kernels.name);
+            checkDigest<Sha256>(data.data(), data.size(), answer.sha256, kernels.name);
+            checkMultiBuffer(answer.length, kernels.name);
+        }
+        restrictHashKernels(true, true);
+    }
+}
+
+TEST(hashScalarKnownAnswers)
+{
+    checkKernels(KERNELS[0]);
+}
+
+TEST(hashShaNiKnownAnswers)
+{
+    checkKernels(KERNELS[1]);
+}
+
+TEST(hashAvx2MultiBufferKnownAnswers)
+{
+    checkKernels(KERNELS[2]);
+}
+
+TEST(hashEmptyPieces)
+{
+    // an empty piece may come without a buffer, at the start or with a block half full
+    Sha256 hash;
+    hash.update(nullptr, 0);
+    hash.update("abc", 3);
+    hash.update(nullptr, 0);
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    hash.final(digest);
+    CHECK_EQUAL(std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), toHex(digest, sizeof(digest)));
+
+    const uint8_t* messages[11] = {};
+    uint8_t digests[11][Sha256::DIGEST_SIZE];
+    sha256MultiBuffer(messages, 11, 0, digests);
+    for (const auto& emptyDigest : digests)
+        CHECK_EQUAL(std::string("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"), toHex(emptyDigest, sizeof(emptyDigest)));
+}
+
+TEST(multiHashMatchesSingleDigests)
+{
+    // over several CHUNK_SIZE chunks, with a partial one at the end
+    std::vector<uint8_t> data = pattern(MultiHash::CHUNK_SIZE * 2 + 4113);
+    MultiHash hash;
+    hash.update(data.data(), data.size());
+    for (int i = 0; i < NUMBER_OF_HASH_TYPES; i++)
+    {
+        HashType hashType = static_cast<HashType>(i);
+        CHECK(hash.hexDigest(hashType) == GetHashText(data.data(), static_cast<unsigned long>(data.size()), hashType));
+    }
+    std::wstring sha256 = hash.hexDigest(HashType::HashSha256);
+    CHECK_EQUAL(std::string(sha256.begin(), sha256.end()), digestOf<Sha256>(data.data(), data.size(), 4096));
+
+    MultiHash md5Only(hashFlag(HashType::HashMd5));
+    md5Only.update(data.data(), data.size());
+    CHECK(md5Only.hexDigest(HashType::HashSha1).empty());
+    CHECK(!md5Only.hexDigest(HashType::HashMd5).empty());
+}
@@ -0,0 +1,113 @@
+#include "Test.h"
+#include "HashAlgorithms.h"
+#include <chrono>
+#ifdef _WIN32
+#include <Windows.h>
+#include <wincrypt.h>
+#endif
+
+namespace
+{
+    const size_t BENCHMARK_SIZE = 256 * 1024 * 1024;
+    const size_t UPDATE_SIZE = 256 * 1024;  // MultiHash::CHUNK_SIZE, what the file digests are fed with
+
+    std::vector<uint8_t> benchmarkData()
+    {
+        std::vector<uint8_t> data(BENCHMARK_SIZE);
+        uint32_t x = 2463534242u;
+        for (auto& b : data)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            b = static_cast<uint8_t>(x);
+        }
+        return data;
+    }
+
+    template <class Function>
+    double megabytesPerSecond(size_t size, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return size / seconds / (1024 * 1024);
+    }
+
+    template <class Hash>
+    double inTree(const std::vector<uint8_t>& data)
+    {
+        return megabytesPerSecond(data.size(), [&]()
+            {
+                Hash hash;
+                for (size_t i = 0; i < data.size(); i += UPDATE_SIZE)
+                    hash.update(data.data() + i, UPDATE_SIZE);
+                uint8_t digest[Hash::DIGEST_SIZE];
+                hash.final(digest);
+            });
+    }
+
+#ifdef _WIN32
+    // the backend that HashAlgorithms replaced
+    double cryptoApi(const std::vector<uint8_t>& data, ALG_ID algorithm)
+    {
+        HCRYPTPROV hProv = NULL;
+        if (!CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT))
+            return 0;
+        double speed = megabytesPerSecond(data.size(), [&]()
+            {
+                HCRYPTHASH hHash = NULL;
+                if (!CryptCreateHash(hProv, algorithm, 0, 0, &hHash))
+                    return;
+                for (size_t i = 0; i < data.size(); i += UPDATE_SIZE)
+                    CryptHashData(hHash, data.data() + i, static_cast<DWORD>(UPDATE_SIZE), 0);
+                BYTE digest[32];
+                DWORD digestSize = sizeof(digest);
+                CryptGetHashParam(hHash, HP_HASHVAL, digest, &digestSize, 0);
+                CryptDestroyHash(hHash);
+            });
+        CryptReleaseContext(hProv, 0);
+        return speed;
+    }
+#endif
+}
+
+// MB/s of every kernel this CPU has, and of CryptoAPI on Windows, over 256 MB in memory
+BENCHMARK(hashThroughput)
+{
+    std::vector<uint8_t> data = benchmarkData();
+    for (bool isShaNiAllowed : { false, true })
+    {
+        if (!restrictHashKernels(isShaNiAllowed, false))
+            continue;
+        printf("  %-8s MD5 %6.0f  SHA1 %6.0f  SHA256 %6.0f MB/s\n", hashBackendName(), inTree<Md5>(data), inTree<Sha1>(data), inTree<Sha256>(data));
+    }
+    restrictHashKernels(true, true);
+#ifdef _WIN32
+    printf("  %-8s MD5 %6.0f  SHA1 %6.0f  SHA256 %6.0f MB/s\n", "CryptoAPI", cryptoApi(data, CALG_MD5), cryptoApi(data, CALG_SHA1), cryptoApi(data, CALG_SHA_256));
+#endif
+}
+
+// MB/s of sha256MultiBuffer on 1 MB messages, the tree hash leaves, with each kernel this CPU has
+BENCHMARK(sha256MultiBufferThroughput)
+{
+    std::vector<uint8_t> data = benchmarkData();
+    const size_t messageSize = 1024 * 1024;
+    const size_t numberOfMessages = data.size() / messageSize;
+    std::vector<const uint8_t*> messages;
+    for (size_t i = 0; i < numberOfMessages; i++)
+        messages.push_back(data.data() + i * messageSize);
+    std::vector<uint8_t> digests(numberOfMessages * Sha256::DIGEST_SIZE);
+    const bool allowed[][2] = { { false, false }, { false, true }, { true, false } };
+    for (auto& allow : allowed)
+    {
+        if (!restrictHashKernels(allow[0], allow[1]))
+            continue;
+        double speed = megabytesPerSecond(data.size(), [&]()
+            {
+                sha256MultiBuffer(messages.data(), numberOfMessages, messageSize, reinterpret_cast<uint8_t (*)[Sha256::DIGEST_SIZE]>(digests.data()));
+            });
+        printf("  %-8s SHA256 x%zu %6.0f MB/s\n", hashBackendName(), numberOfMessages, speed);
+    }
+    restrictHashKernels(true, true);
+}
@@ -0,0 +1,176 @@
+#include "Test.h"
+#include "ImportTable.h"
+#include "TestImage.h"
+
+namespace
+{
+    const DWORD BASE = TestImage::SECTION_RVA;
+
+    void putDescriptor(TestImage& image, DWORD rva, DWORD originalFirstThunk, DWORD name, DWORD firstThunk)
+    {
+        IMAGE_IMPORT_DESCRIPTOR descriptor{};
+        descriptor.OriginalFirstThunk = originalFirstThunk;
+        descriptor.Name = name;
+        descriptor.FirstThunk = firstThunk;
+        image.put(rva, &descriptor, sizeof(descriptor));
+    }
+
+    void putDelayDescriptor(TestImage& image, DWORD rva, DWORD name, DWORD importNameTable)
+    {
+        IMAGE_DELAYLOAD_DESCRIPTOR descriptor{};
+        descriptor.Attributes.AllAttributes = 1;  // RvaBased
+        descriptor.DllNameRVA = name;
+        descriptor.ImportNameTableRVA = importNameTable;
+        image.put(rva, &descriptor, sizeof(descriptor));
+    }
+
+    // IMAGE_IMPORT_BY_NAME
+    void putImportByName(TestImage& image, DWORD rva, WORD hint, const std::string& name)
+    {
+        image.put16(rva, hint);
+        image.putString(rva + sizeof(WORD), name);
+    }
+
+    void putThunk64(TestImage& image, DWORD rva, ULONGLONG thunk)
+    {
+        image.put(rva, &thunk, sizeof(thunk));
+    }
+}
+
+TEST(importTableReadsModulesAndFunctions)
+{
+    TestImage image;
+    putDescriptor(image, BASE, BASE + 0x200, BASE + 0x100, BASE + 0x280);
+    putDescriptor(image, BASE + 0x14, 0, BASE + 0x110, BASE + 0x240);  // names read from the IAT
+    image.putString(BASE + 0x100, "KERNEL32.dll");
+    image.putString(BASE + 0x110, "USER32.dll");
+    image.putString(BASE + 0x120, "COMCTL32.dll");
+    putThunk64(image, BASE + 0x200, BASE + 0x300);
+    putThunk64(image, BASE + 0x208, IMAGE_ORDINAL_FLAG64 | 7);
+    putThunk64(image, BASE + 0x240, BASE + 0x320);
+    putImportByName(image, BASE + 0x300, 0x12, "CreateFileW");
+    putImportByName(image, BASE + 0x320, 5, "MessageBoxW");
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, BASE, 3 * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    putDelayDescriptor(image, BASE + 0x400, BASE + 0x120, BASE + 0x260);
+    putThunk64(image, BASE + 0x260, IMAGE_ORDINAL_FLAG64 | 17);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT, BASE + 0x400, 2 * sizeof(IMAGE_DELAYLOAD_DESCRIPTOR));
+    PeImage pe;
+    CHECK(image.load(pe));
+
+    ImportTable imports(pe);
+    CHECK(!imports.truncated());
+    const auto& modules = imports.modules();
+    const auto& functions = imports.functions();
+    CHECK_EQUAL(size_t(3), modules.size());
+    CHECK_EQUAL(size_t(4), functions.size());
+    CHECK(modules[0].name == "KERNEL32.dll");
+    CHECK_EQUAL(2u, modules[0].numberOfFunctions);
+    CHECK(!modules[0].delayLoaded);
+    CHECK(modules[1].name == "USER32.dll");
+    CHECK_EQUAL(2u, modules[1].firstFunction);
+    CHECK(modules[2].name == "COMCTL32.dll");
+    CHECK(modules[2].delayLoaded);
+
+    CHECK(functions[0].name == "CreateFileW");
+    CHECK_EQUAL(WORD(0x12), functions[0].hintOrOrdinal);
+    CHECK(!functions[0].byOrdinal);
+    CHECK(functions[1].name.empty());
+    CHECK(functions[1].byOrdinal);
+    CHECK_EQUAL(WORD(7), functions[1].hintOrOrdinal);
+    CHECK(functions[2].name == "MessageBoxW");
+    CHECK_EQUAL(1u, functions[2].module);
+    CHECK_EQUAL(2u, functions[3].module);
+    CHECK_EQUAL(WORD(17), functions[3].hintOrOrdinal);
+}
+
+TEST(importTableStopsAtEndOfImage)
+{
+    // a 32-bit thunk array that runs into the end of the section without its terminating 0
+    TestImage image(0x1000, false);
+    putDescriptor(image, BASE, BASE + 0xff8, BASE + 0x100, BASE + 0xff8);
+    image.putString(BASE + 0x100, "KERNEL32.dll");
+    image.put32(BASE + 0xff8, IMAGE_ORDINAL_FLAG32 | 1);
+    image.put32(BASE + 0xffc, IMAGE_ORDINAL_FLAG32 | 2);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, BASE, 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    PeImage pe;
+    CHECK(image.load(pe));
+
+    ImportTable imports(pe);
+    CHECK(imports.truncated());
+    CHECK_EQUAL(size_t(1), imports.modules().size());
+    CHECK_EQUAL(size_t(2), imports.functions().size());
+    CHECK_EQUAL(WORD(2), imports.functions()[1].hintOrOrdinal);
+}
+
+TEST(importTableCapsModules)
+{
+    // descriptors of both directories, all sharing one name and one single-function thunk array
+    const DWORD IMPORTS = BASE + 0x100;
+    const DWORD DELAY_IMPORTS = IMPORTS + (ImportTable::MAX_IMPORTED_MODULES + 1) * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+    const DWORD END = DELAY_IMPORTS + (ImportTable::MAX_IMPORTED_MODULES + 1) * sizeof(IMAGE_DELAYLOAD_DESCRIPTOR);
+    TestImage image(END - BASE);
+    image.putString(BASE, "MODULE.dll");
+    putThunk64(image, BASE + 0x10, IMAGE_ORDINAL_FLAG64 | 1);
+    for (DWORD i = 0; i < ImportTable::MAX_IMPORTED_MODULES; i++)
+    {
+        putDescriptor(image, IMPORTS + i * sizeof(IMAGE_IMPORT_DESCRIPTOR), BASE + 0x10, BASE, BASE + 0x10);
+        putDelayDescriptor(image, DELAY_IMPORTS + i * sizeof(IMAGE_DELAYLOAD_DESCRIPTOR), BASE, BASE + 0x10);
+    }
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, IMPORTS, 0);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT, DELAY_IMPORTS, 0);
+    PeImage pe;
+    CHECK(image.load(pe));
+    {
+        // exactly at the limit, followed by the terminating descriptor
+        ImportTable imports(pe);
+        CHECK(!imports.truncated());
+        CHECK_EQUAL(size_t(2 * ImportTable::MAX_IMPORTED_MODULES), imports.modules().size());
+    }
+
+    // one more of each is past it
+    putDescriptor(image, IMPORTS + ImportTable::MAX_IMPORTED_MODULES * sizeof(IMAGE_IMPORT_DESCRIPTOR), BASE + 0x10, BASE, BASE + 0x10);
+    PeImage more;
+    CHECK(image.load(more));
+    ImportTable imports(more);
+    CHECK(imports.truncated());
+    CHECK_EQUAL(size_t(2 * ImportTable::MAX_IMPORTED_MODULES), imports.modules().size());
+    CHECK(!imports.modules()[ImportTable::MAX_IMPORTED_MODULES - 1].delayLoaded);
+    CHECK(imports.modules()[ImportTable::MAX_IMPORTED_MODULES].delayLoaded);
+
+    putDelayDescriptor(image, DELAY_IMPORTS + ImportTable::MAX_IMPORTED_MODULES * sizeof(IMAGE_DELAYLOAD_DESCRIPTOR), BASE, BASE + 0x10);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, 0, 0);
+    PeImage delayOnly;
+    CHECK(image.load(delayOnly));
+    ImportTable delayImports(delayOnly);
+    CHECK(delayImports.truncated());
+    CHECK_EQUAL(size_t(ImportTable::MAX_IMPORTED_MODULES), delayImports.modules().size());
+}
+
+TEST(importTableCapsFunctions)
+{
+    // one module with a 32-bit thunk array of MAX_FUNCTIONS_PER_MODULE imports by ordinal
+    const DWORD THUNKS = BASE + 0x100;
+    const DWORD END = THUNKS + (ImportTable::MAX_FUNCTIONS_PER_MODULE + 2) * sizeof(DWORD);
+    TestImage image(END - BASE, false);
+    putDescriptor(image, BASE, THUNKS, BASE + 0x40, THUNKS);
+    image.putString(BASE + 0x40, "MODULE.dll");
+    for (DWORD n = 0; n < ImportTable::MAX_FUNCTIONS_PER_MODULE; n++)
+        image.put32(THUNKS + n * sizeof(DWORD), IMAGE_ORDINAL_FLAG32 | (n & 0xffff));
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT, BASE, 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    PeImage pe;
+    CHECK(image.load(pe));
+    {
+        ImportTable imports(pe);
+        CHECK(!imports.truncated());
+        CHECK_EQUAL(size_t(ImportTable::MAX_FUNCTIONS_PER_MODULE), imports.functions().size());
+    }
+
+    image.put32(THUNKS + ImportTable::MAX_FUNCTIONS_PER_MODULE * sizeof(DWORD), IMAGE_ORDINAL_FLAG32 | 1);
+    PeImage more;
+    CHECK(image.load(more));
+    ImportTable imports(more);
+    CHECK(imports.truncated());
+    CHECK_EQUAL(size_t(ImportTable::MAX_FUNCTIONS_PER_MODULE), imports.functions().size());
+    CHECK_EQUAL(ImportTable::MAX_FUNCTIONS_PER_MODULE, imports.modules()[0].numberOfFunctions);
+    CHECK_EQUAL(WORD(0xffff), imports.functions().back().hintOrOrdinal);
+}
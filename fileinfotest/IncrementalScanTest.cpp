@@ -0,0 +1,112 @@
+#include "Test.h"
+#include "IncrementalScan.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    void writeFile(const fs::path& path, const std::string& content)
+    {
+        fs::create_directories(path.parent_path());
+        std::ofstream writer(path, std::ios::binary | std::ios::trunc);
+        writer << content;
+    }
+
+    std::string readFile(const fs::path& path)
+    {
+        std::ifstream reader(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+    }
+
+    // a scan of inputs with the snapshot at snapshotPath, which is saved again; the file names reported, sorted
+    std::vector<std::wstring> scan(const std::wstring& snapshotPath, const std::vector<std::wstring>& inputs, const std::wstring& failingName = L"")
+    {
+        IncrementalScan tracker;
+        tracker.load(snapshotPath);
+        std::vector<std::wstring> names;
+        tracker.enumerateChangedFiles(inputs, [&](const std::wstring& path, bool)
+            {
+                std::wstring name = fs::path(path).filename().wstring();
+                names.push_back(name);
+                if (name == failingName)
+                    tracker.forget(path);
+            });
+        tracker.save(snapshotPath);
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    using Names = std::vector<std::wstring>;
+}
+
+TEST(incrementalScanReportsChanges)
+{
+    TempDirectory directory("fileinfotest-incremental");
+    fs::path files = directory.path / "files";
+    writeFile(files / "a.dll", "a");
+    writeFile(files / "b.dll", "b");
+    writeFile(files / "sub" / "c.exe", "c");
+    std::wstring snapshot = directory.file("snapshot");
+    std::vector<std::wstring> inputs = { files.wstring() };
+
+    CHECK(scan(snapshot, inputs) == Names({ L"a.dll", L"b.dll", L"c.exe" }));
+    CHECK(scan(snapshot, inputs).empty());
+    writeFile(files / "b.dll", "bigger");
+    writeFile(files / "sub" / "d.dll", "d");
+    CHECK(scan(snapshot, inputs) == Names({ L"b.dll", L"d.dll" }));
+    CHECK(scan(snapshot, inputs).empty());
+    // a file that couldn't be analyzed is reported until it can
+    CHECK(scan(snapshot, inputs, L"c.exe").empty());
+    writeFile(files / "sub" / "c.exe", "changed");
+    CHECK(scan(snapshot, inputs, L"c.exe") == Names({ L"c.exe" }));
+    CHECK(scan(snapshot, inputs) == Names({ L"c.exe" }));
+    CHECK(scan(snapshot, inputs).empty());
+}
+
+TEST(incrementalScanPatternsAndNamedFiles)
+{
+    TempDirectory directory("fileinfotest-incremental-pattern");
+    fs::path files = directory.path / "files";
+    writeFile(files / "a.dll", "a");
+    writeFile(files / "b.exe", "b");
+    writeFile(files / "sub" / "c.dll", "c");
+    std::wstring snapshot = directory.file("snapshot");
+    std::vector<std::wstring> inputs = { (files / "*.dll").wstring(), (files / "b.exe").wstring(), (files / "missing.dll").wstring() };
+
+    CHECK(scan(snapshot, inputs) == Names({ L"a.dll", L"b.exe", L"missing.dll" }));
+    // a missing file named on the command line is reported every time, so the caller can tell about it
+    CHECK(scan(snapshot, inputs) == Names({ L"missing.dll" }));
+}
+
+TEST(incrementalScanSnapshotFile)
+{
+    TempDirectory directory("fileinfotest-incremental-snapshot");
+    fs::path files = directory.path / "files";
+    for (const char* name : { "a.dll", "b.dll", "c.dll" })
+        writeFile(files / name, name);
+    std::wstring snapshot = directory.file("snapshot");
+    std::vector<std::wstring> inputs = { files.wstring() };
+    scan(snapshot, inputs, L"b.dll");
+
+    // the same state gives the same file, the path to retry included
+    std::string saved = readFile(snapshot);
+    CHECK(scan(snapshot, inputs, L"b.dll") == Names({ L"b.dll" }));
+    CHECK(readFile(snapshot) == saved);
+    CHECK(!fs::exists(fs::path(snapshot + L".tmp")));
+
+    // a damaged or missing snapshot is as good as none
+    writeFile(snapshot, saved.substr(0, saved.size() - 3));
+    CHECK(scan(snapshot, inputs) == Names({ L"a.dll", L"b.dll", L"c.dll" }));
+    std::string other = readFile(snapshot);
+    other[8]++;  // version
+    writeFile(snapshot, other);
+    CHECK(scan(snapshot, inputs) == Names({ L"a.dll", L"b.dll", L"c.dll" }));
+    fs::remove(fs::path(snapshot));
+    CHECK(scan(snapshot, inputs) == Names({ L"a.dll", L"b.dll", L"c.dll" }));
+
+    // other inputs are compared with the same stamps
+    CHECK(scan(snapshot, { (files / "a.dll").wstring() }).empty());
+}
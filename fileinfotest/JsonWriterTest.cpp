@@ -0,0 +1,43 @@
+#include "Test.h"
+#include "JsonWriter.h"
+
+TEST(jsonWriterNesting)
+{
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.member("a", 1u);
+    json.key("b");
+    json.beginArray();
+    json.value(true);
+    json.null();
+    json.value(L"x");
+    json.endArray();
+    json.endObject();
+    CHECK_EQUAL(std::string("{\"a\":1,\"b\":[true,null,\"x\"]}"), out);
+}
+
+TEST(jsonWriterEscapesKeysFromTheFile)
+{
+    // a version resource key can hold quotes, backslashes, control characters and lone surrogates
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.key(std::wstring(L"Company\"Name\\\x01\n"));
+    json.value(L"v");
+    json.key(std::wstring(L"Caf\xe9 \xd800"));
+    json.value(L"w");
+    json.endObject();
+    CHECK_EQUAL(std::string("{\"Company\\\"Name\\\\\\u0001\\n\":\"v\",\"Caf\xc3\xa9 \xef\xbf\xbd\":\"w\"}"), out);
+}
+
+TEST(jsonWriterEscapesValues)
+{
+    std::string out;
+    JsonWriter json(out);
+    json.beginArray();
+    json.value(L"\"\\\t\x1f");
+    json.value(std::string_view("a\xe9"));
+    json.endArray();
+    CHECK_EQUAL(std::string("[\"\\\"\\\\\\t\\u001f\",\"a\xc3\xa9\"]"), out);
+}
@@ -0,0 +1,303 @@
+#include "Test.h"
+#include "NetMultithread.h"
+#include "RangeServer.h"
+#include "SymbolLookup.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+// NetMultithread and SymbolLookup against RangeServer stand-ins on 127.0.0.1; nothing leaves the machine.
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // more than two 5 MB chunks of NetMultithread, not a multiple of them
+    std::string testContent(size_t size = 12 * 1024 * 1024 + 123)
+    {
+        std::string content(size, '\0');
+        for (size_t i = 0; i < size; i++)
+            content[i] = static_cast<char>((i * 31 + i / 4096) & 0xff);
+        return content;
+    }
+
+    std::string readFile(const std::wstring& path)
+    {
+        std::ifstream reader(fs::path(path), std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+    }
+
+    bool exists(const std::wstring& path)
+    {
+        return fs::exists(fs::path(path));
+    }
+
+    std::unique_ptr<NetMultithread> makeDownloader()
+    {
+        return std::make_unique<NetMultithread>(L"fileinfotest", NetAsyncProxyType::Direct, nullptr, nullptr, NetMultithread::DEFAULT_PARALLEL_DOWNLOADS);
+    }
+
+    SymbolLookup::Options lookupOptions(const std::vector<const RangeServer*>& servers)
+    {
+        SymbolLookup::Options options;
+        for (auto server : servers)
+            options.servers.push_back(server->url("/sym"));
+        options.numberOfConnections = NetMultithread::DEFAULT_PARALLEL_DOWNLOADS;
+        options.proxyType = NetAsyncProxyType::Direct;
+        return options;
+    }
+
+    // what the last pContentLength callback reported
+    DWORD reportedContentLength = 0;
+    void contentLengthObtained(DWORD contentLength)
+    {
+        reportedContentLength = contentLength;
+    }
+
+    const char* const PDB_PATH = "/sym/test.pdb/ABC1/test.pdb";
+    const char* const COMPRESSED_PDB_PATH = "/sym/test.pdb/ABC1/test.pd_";
+}
+
+TEST(netDownloadInRanges)
+{
+    TempDirectory directory("fileinfotest-net-ranges");
+    RangeServer server(RangeServer::Mode::Ranges, 20);
+    CHECK(server.isRunning());
+    std::string content = testContent();
+    server.addFile("/file", content);
+    std::wstring savePath = directory.file("file");
+    DWORD statusCode = 0;
+    unsigned long long size = 0;
+    CHECK(makeDownloader()->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size));
+    CHECK_EQUAL(DWORD(206), statusCode);
+    CHECK_EQUAL(static_cast<unsigned long long>(content.size()), size);
+    CHECK(readFile(savePath) == content);
+    CHECK(!exists(savePath + NetMultithread::TEMP_FILE_SUFFIX));
+    // one request per 5 MB chunk, the later ones at the same time
+    CHECK_EQUAL(size_t(3), server.requestCount("/file"));
+    CHECK(server.peakConcurrency() >= 2);
+}
+
+TEST(netDownloadWithoutRanges)
+{
+    TempDirectory directory("fileinfotest-net-noranges");
+    RangeServer server(RangeServer::Mode::NoRanges);
+    std::string content = testContent();
+    server.addFile("/file", content);
+    std::wstring savePath = directory.file("file");
+    DWORD statusCode = 0;
+    unsigned long long size = 0;
+    NetCallbacks callbacks{};
+    callbacks.pContentLength = contentLengthObtained;
+    reportedContentLength = 0;
+    CHECK(makeDownloader()->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size, callbacks));
+    CHECK_EQUAL(DWORD(200), statusCode);
+    CHECK(readFile(savePath) == content);
+    CHECK_EQUAL(size_t(1), server.requestCount("/file"));
+    // the size comes from Content-Length, there being no Content-Range
+    CHECK_EQUAL(DWORD(content.size()), reportedContentLength);
+}
+
+TEST(netDownloadRetriesCutChunks)
+{
+    // every chunk is cut off once; the bytes handed to consume must still be the file, once and in order
+    TempDirectory directory("fileinfotest-net-flaky");
+    RangeServer server(RangeServer::Mode::Flaky);
+    std::string content = testContent();
+    server.addFile("/file", content);
+    std::wstring savePath = directory.file("file");
+    std::string consumed;
+    DWORD statusCode = 0;
+    unsigned long long size = 0;
+    CHECK(makeDownloader()->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size, {}, {}, [&](const char* data, size_t length)
+        {
+            consumed.append(data, length);
+            return true;
+        }));
+    CHECK(readFile(savePath) == content);
+    CHECK(consumed == content);
+    CHECK(server.requestCount("/file") > 3);
+}
+
+TEST(netDownloadMissingFile)
+{
+    TempDirectory directory("fileinfotest-net-missing");
+    RangeServer server;
+    std::wstring savePath = directory.file("file");
+    DWORD statusCode = 0;
+    unsigned long long size = 0;
+    CHECK(!makeDownloader()->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size));
+    CHECK_EQUAL(DWORD(404), statusCode);
+    CHECK(!exists(savePath));
+    CHECK(!exists(savePath + NetMultithread::TEMP_FILE_SUFFIX));
+}
+
+TEST(netDownloadClaimRefused)
+{
+    TempDirectory directory("fileinfotest-net-claim");
+    RangeServer server;
+    server.addFile("/file", testContent());
+    std::wstring savePath = directory.file("file");
+    size_t numberOfClaims = 0;
+    DWORD statusCode = 0;
+    unsigned long long size = 0;
+    CHECK(!makeDownloader()->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size, {}, [&]()
+        {
+            numberOfClaims++;
+            return false;
+        }));
+    CHECK_EQUAL(size_t(1), numberOfClaims);
+    CHECK(!exists(savePath));
+    CHECK(!exists(savePath + NetMultithread::TEMP_FILE_SUFFIX));
+}
+
+TEST(netDownloadCancelled)
+{
+    TempDirectory directory("fileinfotest-net-cancel");
+    RangeServer server(RangeServer::Mode::Ranges, 300);
+    server.addFile("/file", testContent());
+    std::wstring savePath = directory.file("file");
+    auto downloader = makeDownloader();
+    std::thread canceller([&]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            downloader->cancel();
+        });
+    auto start = std::chrono::steady_clock::now();
+    DWORD statusCode = 0;
+    unsigned long long size = 0;
+    CHECK(!downloader->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size));
+    canceller.join();
+    // it gives up at once, not after the chunks it would have waited for
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(600));
+    CHECK(!exists(savePath));
+    CHECK(!exists(savePath + NetMultithread::TEMP_FILE_SUFFIX));
+    // and so does a later download on it, without a request
+    size_t numberOfRequests = server.requestCount();
+    CHECK(!downloader->download(server.url("/file").c_str(), savePath.c_str(), statusCode, size));
+    CHECK_EQUAL(numberOfRequests, server.requestCount());
+}
+
+TEST(netSessionKeepsConnectionsAlive)
+{
+    // downloads one after the other through one session: only the first request connects
+    TempDirectory directory("fileinfotest-net-session");
+    RangeServer server;
+    std::string content = testContent(100000);
+    server.addFile("/file", content);
+    NetSession::Settings settings;
+    settings.userAgent = L"fileinfotest-session";
+    settings.proxyType = NetAsyncProxyType::Direct;
+    std::shared_ptr<NetSession> session = NetSession::get(settings);
+    CHECK(session != nullptr);
+    const size_t numberOfDownloads = 6;
+    for (size_t i = 0; i < numberOfDownloads && session; i++)
+    {
+        NetMultithread downloader(session, 1);
+        std::wstring savePath = directory.file(("file" + std::to_string(i)).c_str());
+        DWORD statusCode = 0;
+        unsigned long long size = 0;
+        CHECK(downloader.download(server.url("/file").c_str(), savePath.c_str(), statusCode, size));
+        CHECK(readFile(savePath) == content);
+        std::vector<NetRequestTiming> timings = downloader.timings();
+        CHECK_EQUAL(size_t(1), timings.size());
+        if (timings.empty())
+            continue;
+        CHECK_EQUAL(i != 0, timings[0].isReused);
+        CHECK_EQUAL(static_cast<unsigned long long>(content.size()), timings[0].size);
+        CHECK(timings[0].firstByte >= 0 && timings[0].transfer >= 0);
+    }
+    CHECK_EQUAL(numberOfDownloads, server.requestCount("/file"));
+    CHECK(server.connectionCount() < server.requestCount());
+}
+
+TEST(symbolLookupFastestServerWins)
+{
+    // the slow server has the .pdb, the fast one the .pd_: the .pd_ wins and the .pdb is never written
+    TempDirectory directory("fileinfotest-lookup-race");
+    RangeServer slow(RangeServer::Mode::Ranges, 300);
+    RangeServer fast(RangeServer::Mode::Ranges, 10);
+    std::string content = testContent();
+    slow.addFile(PDB_PATH, content);
+    fast.addFile(COMPRESSED_PDB_PATH, content);
+    SymbolLookup lookup(lookupOptions({ &slow, &fast }));
+    SymbolLookup::Result result = lookup.fetch(L"test.pdb", L"ABC1", directory.path.wstring());
+    CHECK(result.found);
+    CHECK(result.url == fast.url(COMPRESSED_PDB_PATH));
+    CHECK(result.savedPath == directory.file("test.pd_"));
+    CHECK(readFile(result.savedPath) == content);
+    CHECK(!exists(directory.file("test.pdb")));
+    CHECK(!exists(directory.file("test.pdb") + NetMultithread::TEMP_FILE_SUFFIX));
+}
+
+TEST(symbolLookupFallsBackToLaterServer)
+{
+    TempDirectory directory("fileinfotest-lookup-fallback");
+    RangeServer empty;
+    RangeServer full(RangeServer::Mode::Ranges, 50);
+    full.addFile(PDB_PATH, "pdb");
+    SymbolLookup lookup(lookupOptions({ &empty, &full }));
+    SymbolLookup::Result result = lookup.fetch(L"test.pdb", L"ABC1", directory.path.wstring());
+    CHECK(result.found);
+    CHECK(result.url == full.url(PDB_PATH));
+    CHECK_EQUAL(std::string("pdb"), readFile(directory.file("test.pdb")));
+    CHECK_EQUAL(size_t(1), empty.requestCount(PDB_PATH));
+    CHECK_EQUAL(size_t(1), empty.requestCount(COMPRESSED_PDB_PATH));
+}
+
+TEST(symbolLookupNegativeCache)
+{
+    TempDirectory directory("fileinfotest-lookup-misses");
+    // the 404s come first: a server still waiting for its answer when another wins is cancelled, not a miss
+    RangeServer empty;
+    RangeServer full(RangeServer::Mode::Ranges, 50);
+    full.addFile(PDB_PATH, "pdb");
+    SymbolLookup::Options options = lookupOptions({ &empty, &full });
+    options.negativeCachePath = directory.file("misses");
+    {
+        SymbolLookup lookup(options);
+        CHECK(lookup.fetch(L"test.pdb", L"ABC1", directory.path.wstring()).found);
+        CHECK_EQUAL(size_t(2), empty.requestCount());
+        // the server that answered 404 for both forms isn't asked again
+        CHECK(lookup.fetch(L"test.pdb", L"ABC1", directory.path.wstring()).found);
+        CHECK_EQUAL(size_t(2), empty.requestCount());
+    }
+    {
+        // nor by a later run
+        SymbolLookup lookup(options);
+        CHECK(lookup.fetch(L"test.pdb", L"ABC1", directory.path.wstring()).found);
+        CHECK_EQUAL(size_t(2), empty.requestCount());
+        // a PDB that no server has costs no request the second time
+        size_t numberOfRequests = empty.requestCount() + full.requestCount();
+        SymbolLookup::Result missing = lookup.fetch(L"other.pdb", L"ABC1", directory.path.wstring());
+        CHECK(!missing.found);
+        CHECK_EQUAL(DWORD(404), missing.statusCode);
+        CHECK(!missing.isKnownMissing);
+        CHECK_EQUAL(numberOfRequests + 4, empty.requestCount() + full.requestCount());
+        missing = lookup.fetch(L"other.pdb", L"ABC1", directory.path.wstring());
+        CHECK(missing.isKnownMissing);
+        CHECK_EQUAL(numberOfRequests + 4, empty.requestCount() + full.requestCount());
+    }
+    {
+        options.negativeTtlSeconds = 0;
+        SymbolLookup lookup(options);
+        CHECK(lookup.fetch(L"test.pdb", L"ABC1", directory.path.wstring()).found);
+        CHECK_EQUAL(size_t(2), empty.requestCount(PDB_PATH));
+    }
+}
+
+TEST(symbolLookupEncodesNames)
+{
+    TempDirectory directory("fileinfotest-lookup-names");
+    RangeServer server;
+    server.addFile("/sym/a%20b%25.pdb/ABC1/a%20b%25.pdb", "pdb");
+    SymbolLookup lookup(lookupOptions({ &server }));
+    CHECK(lookup.fetch(L"a b%.pdb", L"ABC1", directory.path.wstring()).found);
+    CHECK_EQUAL(std::string("pdb"), readFile(directory.file("a b%.pdb")));
+    // a name that would lead out of the directory isn't asked for
+    CHECK(!lookup.fetch(L"..", L"ABC1", directory.path.wstring()).found);
+    CHECK(!lookup.fetch(L"c:test.pdb", L"ABC1", directory.path.wstring()).found);
+    CHECK_EQUAL(size_t(2), server.requestCount());
+}
@@ -0,0 +1,295 @@
+#include "RangeServer.h"
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+#ifdef _WIN32
+    using NativeSocket = SOCKET;
+    constexpr int SEND_FLAGS = 0;
+    constexpr int SHUTDOWN_BOTH = SD_BOTH;
+
+    void closeSocket(RangeServer::SocketHandle s)
+    {
+        closesocket(static_cast<SOCKET>(s));
+    }
+#else
+    using NativeSocket = int;
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;  // a client that went away is not a SIGPIPE
+    constexpr int SHUTDOWN_BOTH = SHUT_RDWR;
+
+    void closeSocket(RangeServer::SocketHandle s)
+    {
+        ::close(static_cast<int>(s));
+    }
+#endif
+
+    NativeSocket native(RangeServer::SocketHandle s)
+    {
+        return static_cast<NativeSocket>(s);
+    }
+
+    void shutdownSocket(RangeServer::SocketHandle s)
+    {
+        shutdown(native(s), SHUTDOWN_BOTH);
+    }
+
+    bool sendAll(RangeServer::SocketHandle s, const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+            int sent = static_cast<int>(send(native(s), data, chunk, SEND_FLAGS));
+            if (sent <= 0)
+                return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool sendAll(RangeServer::SocketHandle s, const std::string& text)
+    {
+        return sendAll(s, text.data(), text.size());
+    }
+
+    // "Range: bytes=first-last" or "bytes=first-"; false if there is none
+    bool findRange(const std::string& request, unsigned long long& first, unsigned long long& last, bool& hasLast)
+    {
+        std::string lower = request;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        size_t position = lower.find("\r\nrange: bytes=");
+        if (position == std::string::npos)
+            return false;
+        const char* p = request.c_str() + position + strlen("\r\nrange: bytes=");
+        char* end = nullptr;
+        first = strtoull(p, &end, 10);
+        if (end == p || *end != '-')
+            return false;
+        p = end + 1;
+        last = strtoull(p, &end, 10);
+        hasLast = end != p;
+        return true;
+    }
+}
+
+RangeServer::RangeServer(Mode mode, unsigned latencyMs) : mode(mode), latencyMs(latencyMs)
+{
+#ifdef _WIN32
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return;
+#endif
+    NativeSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    listener = static_cast<SocketHandle>(s);
+    if (listener == NO_SOCKET)
+        return;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(s, 64) != 0 ||
+        getsockname(s, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        closeSocket(listener);
+        listener = NO_SOCKET;
+        return;
+    }
+    port = ntohs(address.sin_port);
+    acceptThread = std::thread(&RangeServer::acceptConnections, this);
+}
+
+RangeServer::~RangeServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto client : clients)
+            shutdownSocket(client);
+    }
+    if (listener != NO_SOCKET)
+    {
+        // shutdown is what wakes a blocked accept on Linux, closing it is on Windows
+        shutdownSocket(listener);
+        closeSocket(listener);
+    }
+    if (acceptThread.joinable())
+        acceptThread.join();
+    // no thread is added once acceptThread is gone
+    for (auto& thread : threads)
+        thread.join();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void RangeServer::addFile(const std::string& path, std::string content)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    files[path] = std::make_shared<const std::string>(std::move(content));
+}
+
+std::wstring RangeServer::url(const std::string& path) const
+{
+    return L"http://127.0.0.1:" + std::to_wstring(port) + std::wstring(path.begin(), path.end());
+}
+
+size_t RangeServer::requestCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (const auto& entry : requests)
+        count += entry.second;
+    return count;
+}
+
+size_t RangeServer::requestCount(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = requests.find(path);
+    return it == requests.end() ? 0 : it->second;
+}
+
+size_t RangeServer::connectionCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return numberOfConnections;
+}
+
+size_t RangeServer::peakConcurrency() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakRequests;
+}
+
+void RangeServer::acceptConnections()
+{
+    for (;;)
+    {
+        SocketHandle client = static_cast<SocketHandle>(accept(native(listener), nullptr, nullptr));
+        if (client == NO_SOCKET)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+        {
+            closeSocket(client);
+            return;
+        }
+        numberOfConnections++;
+        clients.insert(client);
+        threads.emplace_back(&RangeServer::serve, this, client);
+    }
+}
+
+void RangeServer::serve(SocketHandle client)
+{
+    std::string buffer;
+    char received[4096];
+    for (;;)
+    {
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            int size = static_cast<int>(recv(native(client), received, sizeof(received), 0));
+            if (size <= 0)
+                break;
+            buffer.append(received, size);
+        }
+        if (headerEnd == std::string::npos)
+            break;
+        std::string request = buffer.substr(0, headerEnd);
+        buffer.erase(0, headerEnd + 4);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeRequests++;
+            peakRequests = std::max(peakRequests, activeRequests);
+        }
+        bool keepOpen = respond(client, request);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeRequests--;
+        }
+        if (!keepOpen)
+            break;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    clients.erase(client);
+    closeSocket(client);
+}
+
+bool RangeServer::respond(SocketHandle client, const std::string& request)
+{
+    size_t pathStart = request.find(' ');
+    size_t pathEnd = pathStart == std::string::npos ? std::string::npos : request.find(' ', pathStart + 1);
+    if (pathEnd == std::string::npos)
+        return false;
+    std::string path = request.substr(pathStart + 1, pathEnd - pathStart - 1);
+    std::shared_ptr<const std::string> content;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests[path]++;
+        auto it = files.find(path);
+        if (it != files.end())
+            content = it->second;
+    }
+    if (latencyMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return false;
+    }
+    if (!content)
+        return sendAll(client, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+
+    unsigned long long size = content->size();
+    unsigned long long first = 0;
+    unsigned long long last = size - 1;
+    bool hasLast = false;
+    bool isRange = mode != Mode::NoRanges && findRange(request, first, last, hasLast);
+    std::string header;
+    if (isRange)
+    {
+        if (first >= size)
+            return sendAll(client, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(size) + "\r\nContent-Length: 0\r\n\r\n");
+        if (!hasLast || last >= size)
+            last = size - 1;
+        header = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size) + "\r\n";
+    }
+    else
+    {
+        first = 0;
+        last = size - 1;
+        header = "HTTP/1.1 200 OK\r\n";
+    }
+    unsigned long long length = size == 0 ? 0 : last - first + 1;
+    header += "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+    bool isCut = false;
+    if (mode == Mode::Flaky && length > 1)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isCut = cutRanges.insert(path + " " + std::to_string(first) + "-" + std::to_string(last)).second;
+    }
+    if (!sendAll(client, header))
+        return false;
+    if (isCut)
+    {
+        // the client is told the whole length but gets half of it, then the connection is gone
+        sendAll(client, content->data() + first, static_cast<size_t>(length / 2));
+        return false;
+    }
+    return sendAll(client, content->data() + first, static_cast<size_t>(length));
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An HTTP/1.1 stand-in for a symbol server, on 127.0.0.1 at a port of its own, for the download tests.
+// Files are served from memory, with keep-alive and Range requests. Every request waits latencyMs
+// before it is answered, and a path that wasn't added is a 404, so several servers with different
+// latencies and files make the races of SymbolLookup play out the same way every time.
+// Each connection has its own thread; the destructor closes them all.
+class RangeServer
+{
+public:
+    enum class Mode
+    {
+        Ranges,
+        NoRanges,  // a Range header is ignored: 200 with the whole file
+        Flaky,  // the first response to every range is cut off after half its body
+    };
+
+    explicit RangeServer(Mode mode = Mode::Ranges, unsigned latencyMs = 0);
+    ~RangeServer();
+    RangeServer(const RangeServer&) = delete;
+    RangeServer& operator=(const RangeServer&) = delete;
+
+    // false if no port could be opened
+    bool isRunning() const { return listener != NO_SOCKET; }
+    void addFile(const std::string& path, std::string content);
+    // e.g. http://127.0.0.1:50123/sym
+    std::wstring url(const std::string& path = "") const;
+
+    size_t requestCount() const;
+    size_t requestCount(const std::string& path) const;
+    size_t connectionCount() const;
+    // the most requests that were being answered at the same time
+    size_t peakConcurrency() const;
+
+    using SocketHandle = uintptr_t;  // SOCKET or file descriptor
+    static constexpr SocketHandle NO_SOCKET = ~SocketHandle(0);
+private:
+    void acceptConnections();
+    void serve(SocketHandle client);
+    // false if the connection is to be closed
+    bool respond(SocketHandle client, const std::string& request);
+
+    const Mode mode;
+    const unsigned latencyMs;
+    SocketHandle listener = NO_SOCKET;
+    unsigned short port = 0;
+    std::thread acceptThread;
+
+    mutable std::mutex mutex;
+    bool stopping = false;
+    std::map<std::string, std::shared_ptr<const std::string>> files;
+    std::map<std::string, size_t> requests;  // path -> number of requests
+    std::set<std::string> cutRanges;  // Flaky: "path first-last" already answered with a cut body
+    std::set<SocketHandle> clients;  // open connections
+    std::vector<std::thread> threads;
+    size_t numberOfConnections = 0;
+    size_t activeRequests = 0;
+    size_t peakRequests = 0;
+};
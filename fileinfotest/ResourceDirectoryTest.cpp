@@ -0,0 +1,228 @@
+#include "Test.h"
+#include "ResourceDirectory.h"
+#include "TestImage.h"
+#include <cstring>
+
+namespace
+{
+    // the resource directory starts the section; directory and data entry offsets are relative to it
+    const DWORD ROOT = TestImage::SECTION_RVA;
+
+    DWORD subdirectory(DWORD offset)
+    {
+        return offset | IMAGE_RESOURCE_DATA_IS_DIRECTORY;
+    }
+
+    DWORD named(DWORD nameOffset)
+    {
+        return nameOffset | IMAGE_RESOURCE_NAME_IS_STRING;
+    }
+
+    // named entries must come first
+    void putDirectory(TestImage& image, DWORD offset, const std::vector<IMAGE_RESOURCE_DIRECTORY_ENTRY>& entries)
+    {
+        IMAGE_RESOURCE_DIRECTORY directory{};
+        for (const auto& entry : entries)
+        {
+            if (entry.Name & IMAGE_RESOURCE_NAME_IS_STRING)
+                directory.NumberOfNamedEntries++;
+            else
+                directory.NumberOfIdEntries++;
+        }
+        image.put(ROOT + offset, &directory, sizeof(directory));
+        for (size_t i = 0; i < entries.size(); i++)
+            image.put(ROOT + offset + static_cast<DWORD>(sizeof(directory) + i * sizeof(entries[i])), &entries[i], sizeof(entries[i]));
+    }
+
+    void putDataEntry(TestImage& image, DWORD offset, DWORD dataRva, DWORD size)
+    {
+        IMAGE_RESOURCE_DATA_ENTRY entry{ dataRva, size, 0, 0 };
+        image.put(ROOT + offset, &entry, sizeof(entry));
+    }
+
+    std::string utf16(const std::wstring& text)
+    {
+        std::string bytes;
+        for (wchar_t c : text)
+        {
+            bytes += static_cast<char>(c & 0xff);
+            bytes += static_cast<char>(c >> 8);
+        }
+        return bytes;
+    }
+
+    // IMAGE_RESOURCE_DIR_STRING_U
+    void putName(TestImage& image, DWORD offset, const std::wstring& name)
+    {
+        image.put16(ROOT + offset, static_cast<WORD>(name.size()));
+        std::string chars = utf16(name);
+        image.put(ROOT + offset + sizeof(WORD), chars.data(), chars.size());
+    }
+
+    void padTo4(std::string& bytes)
+    {
+        bytes.resize((bytes.size() + 3) & ~size_t(3));
+    }
+
+    // one block of a VS_VERSIONINFO; valueLength counts characters for text (type 1) values
+    std::string versionBlock(const std::wstring& key, WORD type, const std::string& value, WORD valueLength, const std::vector<std::string>& children = {})
+    {
+        std::string block(6, '\0');
+        block += utf16(key) + std::string(2, '\0');
+        padTo4(block);
+        block += value;
+        for (const auto& child : children)
+        {
+            padTo4(block);
+            block += child;
+        }
+        WORD header[3] = { static_cast<WORD>(block.size()), valueLength, type };
+        memcpy(&block[0], header, sizeof(header));
+        return block;
+    }
+
+    std::string versionResource()
+    {
+        VS_FIXEDFILEINFO fixed{};
+        fixed.dwSignature = 0xFEEF04BD;
+        fixed.dwFileVersionMS = 0x00010002;
+        fixed.dwFileVersionLS = 0x00030004;
+        fixed.dwProductVersionMS = 0x00050006;
+        fixed.dwProductVersionLS = 0x00070008;
+        std::string company = versionBlock(L"CompanyName", 1, utf16(L"Contoso") + std::string(2, '\0'), 8);
+        std::string product = versionBlock(L"ProductName", 1, utf16(L"Widget") + std::string(2, '\0'), 7);
+        std::string table = versionBlock(L"040904b0", 1, "", 0, { company, product });
+        std::string stringFileInfo = versionBlock(L"StringFileInfo", 1, "", 0, { table });
+        return versionBlock(L"VS_VERSION_INFO", 0, std::string(reinterpret_cast<const char*>(&fixed), sizeof(fixed)), sizeof(fixed), { stringFileInfo });
+    }
+
+    std::string iconGroupResource()
+    {
+        // GRPICONDIR with two GRPICONDIRENTRYs: 16x16 and 256x256 (stored as 0), 32 bits per pixel
+        std::string group("\0\0\1\0\2\0", 6);
+        group += std::string("\x10\x10\0\0\1\0\x20\0\x68\x04\0\0\1\0", 14);
+        group += std::string("\0\0\0\0\1\0\x20\0\x00\x00\x01\0\2\0", 14);
+        return group;
+    }
+}
+
+TEST(resourceDirectoryReadsTree)
+{
+    // a named type, then RT_GROUP_ICON, RT_VERSION and RT_MANIFEST, each with name #1 and language 0x409
+    const std::string manifest = "<assembly/>";
+    const std::string payloads[] = { "custom", iconGroupResource(), versionResource(), manifest };
+    const DWORD types[] = { named(0x380), ResourceDirectory::TYPE_GROUP_ICON, ResourceDirectory::TYPE_VERSION, ResourceDirectory::TYPE_MANIFEST };
+
+    TestImage image;
+    std::vector<IMAGE_RESOURCE_DIRECTORY_ENTRY> root;
+    for (DWORD k = 0; k < 4; k++)
+    {
+        root.push_back({ types[k], subdirectory(0x100 + 0x40 * k) });
+        putDirectory(image, 0x100 + 0x40 * k, { { 1, subdirectory(0x200 + 0x40 * k) } });
+        putDirectory(image, 0x200 + 0x40 * k, { { 0x409, 0x300 + 0x10 * k } });
+        putDataEntry(image, 0x300 + 0x10 * k, ROOT + 0x400 + 0x200 * k, static_cast<DWORD>(payloads[k].size()));
+        image.put(ROOT + 0x400 + 0x200 * k, payloads[k].data(), payloads[k].size());
+    }
+    putDirectory(image, 0, root);
+    putName(image, 0x380, L"CUSTOM");
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE, ROOT, 0xc00);
+    PeImage pe;
+    CHECK(image.load(pe));
+
+    ResourceDirectory resources(pe);
+    CHECK(!resources.truncated());
+    CHECK_EQUAL(size_t(4), resources.leaves().size());
+    CHECK_EQUAL(size_t(4), resources.numberOfTypes());
+    const auto& leaves = resources.leaves();
+    CHECK(leaves[0].type.isName());
+    CHECK(resources.toString(leaves[0].type) == L"CUSTOM");
+    CHECK(resources.toString(leaves[1].type) == L"#14");
+    CHECK(resources.toString(leaves[1].name) == L"#1");
+    CHECK_EQUAL(WORD(0x409), leaves[1].language);
+    CHECK(resources.data(leaves[0]) == "custom");
+    CHECK(resources.manifest() == manifest);
+
+    VersionInfo info;
+    CHECK(resources.versionInfo(info));
+    CHECK(info.fileVersion == L"1.2.3.4");
+    CHECK(info.productVersion == L"5.6.7.8");
+    CHECK_EQUAL(size_t(2), info.strings.size());
+    CHECK(info.value(L"CompanyName") == L"Contoso");
+    CHECK(info.value(L"ProductName") == L"Widget");
+    CHECK(info.value(L"FileDescription").empty());
+
+    auto groups = resources.iconGroups();
+    CHECK_EQUAL(size_t(1), groups.size());
+    CHECK_EQUAL(size_t(2), groups[0].size());
+    CHECK_EQUAL(16u, groups[0][0].width);
+    CHECK_EQUAL(256u, groups[0][1].height);
+    CHECK_EQUAL(WORD(32), groups[0][1].bitCount);
+    CHECK_EQUAL(DWORD(0x10000), groups[0][1].bytesInResource);
+    CHECK_EQUAL(WORD(2), groups[0][1].iconId);
+}
+
+TEST(resourceDirectoryStopsAtCycles)
+{
+    TestImage image;
+    // RT_VERSION: a name directory holding itself and one good leaf; RT_MANIFEST: the root again
+    putDirectory(image, 0, { { ResourceDirectory::TYPE_VERSION, subdirectory(0x100) }, { ResourceDirectory::TYPE_MANIFEST, subdirectory(0) } });
+    putDirectory(image, 0x100, { { 1, subdirectory(0x100) }, { 2, subdirectory(0x200) } });
+    // a language directory holding a directory instead of a data entry
+    putDirectory(image, 0x200, { { 0x409, 0x300 }, { 0x407, subdirectory(0x200) } });
+    putDataEntry(image, 0x300, ROOT + 0x400, 4);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE, ROOT, 0x400);
+    PeImage pe;
+    CHECK(image.load(pe));
+
+    ResourceDirectory resources(pe);
+    CHECK(resources.truncated());
+    CHECK_EQUAL(size_t(1), resources.leaves().size());
+    CHECK_EQUAL(WORD(2), resources.leaves()[0].name.id);
+    CHECK_EQUAL(WORD(0x409), resources.leaves()[0].language);
+}
+
+TEST(resourceDirectoryFlagsUnresolvedNames)
+{
+    TestImage image;
+    // the name of the first type points past the end of the image
+    putDirectory(image, 0, { { named(0x100000), subdirectory(0x100) }, { ResourceDirectory::TYPE_MANIFEST, subdirectory(0x100) } });
+    putDirectory(image, 0x100, { { 1, subdirectory(0x200) } });
+    putDirectory(image, 0x200, { { 0x409, 0x300 } });
+    putDataEntry(image, 0x300, ROOT + 0x400, 4);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE, ROOT, 0x400);
+    PeImage pe;
+    CHECK(image.load(pe));
+
+    ResourceDirectory resources(pe);
+    CHECK(resources.truncated());
+    CHECK_EQUAL(size_t(1), resources.leaves().size());
+    CHECK(resources.toString(resources.leaves()[0].type) == L"#24");
+}
+
+TEST(resourceDirectoryCapsLeaves)
+{
+    // five names of 65535 languages each, all sharing one data entry: more than MAX_LEAVES leaves
+    const DWORD LANGUAGES = 0xffff;
+    const DWORD LANGUAGE_DIRECTORY_SIZE = sizeof(IMAGE_RESOURCE_DIRECTORY) + LANGUAGES * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+    const DWORD NAMES = 5;
+    TestImage image(0x1000 + NAMES * LANGUAGE_DIRECTORY_SIZE);
+    putDirectory(image, 0, { { 10, subdirectory(0x100) } });
+    std::vector<IMAGE_RESOURCE_DIRECTORY_ENTRY> names;
+    std::vector<IMAGE_RESOURCE_DIRECTORY_ENTRY> languages(LANGUAGES, { 0x409, 0x200 });
+    for (DWORD k = 0; k < NAMES; k++)
+    {
+        DWORD offset = 0x1000 + k * LANGUAGE_DIRECTORY_SIZE;
+        names.push_back({ k + 1, subdirectory(offset) });
+        putDirectory(image, offset, languages);
+    }
+    putDirectory(image, 0x100, names);
+    putDataEntry(image, 0x200, ROOT + 0x400, 4);
+    image.setDirectory(IMAGE_DIRECTORY_ENTRY_RESOURCE, ROOT, 0x1000 + NAMES * LANGUAGE_DIRECTORY_SIZE);
+    PeImage pe;
+    CHECK(image.load(pe));
+
+    ResourceDirectory resources(pe);
+    CHECK(resources.truncated());
+    CHECK_EQUAL(ResourceDirectory::MAX_LEAVES, resources.leaves().size());
+    CHECK_EQUAL(WORD(5), resources.leaves().back().name.id);
+}
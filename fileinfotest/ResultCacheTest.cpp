@@ -0,0 +1,136 @@
+#include "Test.h"
+#include "ResultCache.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    // a cache file of its own in the temp directory, deleted again at the end of the test
+    struct TempCacheFile
+    {
+        std::filesystem::path path;
+
+        explicit TempCacheFile(const char* name) : path(std::filesystem::temp_directory_path() / name)
+        {
+            std::filesystem::remove(path);
+        }
+        ~TempCacheFile()
+        {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+        void appendBytes(const std::string& bytes) const
+        {
+            std::ofstream writer(path, std::ios::binary | std::ios::app);
+            writer.write(bytes.data(), bytes.size());
+        }
+    };
+
+    FileStamp stampOf(unsigned long long n)
+    {
+        FileStamp stamp;
+        stamp.size = n;
+        stamp.modified = n * 1000;
+        stamp.fileId = n + 1;
+        stamp.volume = 7;
+        return stamp;
+    }
+
+    template <typename T>
+    void append(std::string& out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+}
+
+TEST(resultCacheRoundTrip)
+{
+    TempCacheFile file("fileinfotest-roundtrip.fileinfo");
+    unsigned char digest[QUICK_DIGEST_SIZE] = { 1, 2, 3 };
+    {
+        ResultCache cache;
+        CHECK(cache.open(file.path.wstring()));
+        cache.store("a", stampOf(1), nullptr, "first");
+        cache.store("b", stampOf(2), digest, "second");
+        cache.store("a", stampOf(3), nullptr, "newer");
+        CHECK(cache.flush());
+    }
+    ResultCache cache;
+    CHECK(cache.open(file.path.wstring()));
+    CHECK_EQUAL(size_t(2), cache.size());
+    std::string value;
+    CHECK(cache.lookup("a", stampOf(3), nullptr, value));
+    CHECK_EQUAL(std::string("newer"), value);
+    CHECK(!cache.lookup("a", stampOf(1), nullptr, value));
+    CHECK(cache.lookup("b", stampOf(2), digest, value));
+    CHECK_EQUAL(std::string("second"), value);
+    digest[0] = 9;
+    CHECK(!cache.lookup("b", stampOf(2), digest, value));
+    CHECK(!cache.lookup("c", stampOf(2), nullptr, value));
+}
+
+TEST(resultCacheTornRecordKeepsLaterRecords)
+{
+    // A scanner crashed after writing the header of a record and part of its payload. The length
+    // in that header covers the start of the records the next scanner appends; they must survive.
+    TempCacheFile file("fileinfotest-torn.fileinfo");
+    {
+        ResultCache cache;
+        CHECK(cache.open(file.path.wstring()));
+        cache.store("before", stampOf(1), nullptr, "kept");
+        CHECK(cache.flush());
+    }
+    std::string torn;
+    append(torn, uint32_t(0x31444352));  // "RCD1"
+    append(torn, uint32_t(200));
+    append(torn, uint64_t(0x1234));
+    append(torn, uint64_t(0x5678));
+    torn.append(50, 'x');
+    file.appendBytes(torn);
+    {
+        ResultCache cache;
+        CHECK(cache.open(file.path.wstring()));
+        cache.store("after", stampOf(2), nullptr, std::string(500, 'y'));
+        cache.store("last", stampOf(3), nullptr, "also kept");
+        CHECK(cache.flush());
+    }
+    ResultCache cache;
+    CHECK(cache.open(file.path.wstring()));
+    std::string value;
+    CHECK(cache.lookup("before", stampOf(1), nullptr, value));
+    CHECK_EQUAL(std::string("kept"), value);
+    CHECK(cache.lookup("after", stampOf(2), nullptr, value));
+    CHECK_EQUAL(std::string(500, 'y'), value);
+    CHECK(cache.lookup("last", stampOf(3), nullptr, value));
+    CHECK_EQUAL(std::string("also kept"), value);
+}
+
+TEST(resultCacheDamagedRecordIsSkipped)
+{
+    TempCacheFile file("fileinfotest-damaged.fileinfo");
+    {
+        ResultCache cache;
+        CHECK(cache.open(file.path.wstring()));
+        cache.store("damaged", stampOf(1), nullptr, std::string(100, 'a'));
+        CHECK(cache.flush());
+    }
+    {
+        // flip a byte of the value in place
+        std::fstream stream(file.path, std::ios::binary | std::ios::in | std::ios::out);
+        stream.seekp(-20, std::ios::end);
+        stream.put('b');
+    }
+    {
+        ResultCache cache;
+        CHECK(cache.open(file.path.wstring()));
+        cache.store("intact", stampOf(2), nullptr, "value");
+        CHECK(cache.flush());
+    }
+    ResultCache cache;
+    CHECK(cache.open(file.path.wstring()));
+    std::string value;
+    CHECK(!cache.lookup("damaged", stampOf(1), nullptr, value));
+    CHECK(cache.lookup("intact", stampOf(2), nullptr, value));
+    CHECK_EQUAL(std::string("value"), value);
+}
@@ -0,0 +1,186 @@
+#include "Test.h"
+#include "SectionTable.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+namespace
+{
+    IMAGE_SECTION_HEADER section(DWORD virtualAddress, DWORD virtualSize, DWORD pointerToRawData, DWORD sizeOfRawData)
+    {
+        IMAGE_SECTION_HEADER header{};
+        header.VirtualAddress = virtualAddress;
+        header.Misc.VirtualSize = virtualSize;
+        header.PointerToRawData = pointerToRawData;
+        header.SizeOfRawData = sizeOfRawData;
+        return header;
+    }
+
+    const DWORD FILE_ALIGNMENT = 0x200;
+    const DWORD SECTION_ALIGNMENT = 0x1000;
+    const DWORD SIZE_OF_HEADERS = 0x400;
+    const size_t FILE_SIZE = 0x100000;
+}
+
+TEST(sectionTableRoundsPointerToRawDataDownTo512)
+{
+    IMAGE_SECTION_HEADER headers[] = { section(0x1000, 0x1000, 0x4c3, 0x1000) };
+    SectionTable table;
+    table.build(headers, 1, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, FILE_SIZE);
+    CHECK_EQUAL(DWORD(0x400), table.rawOffset(0));
+    CHECK_EQUAL(DWORD(0x410), table.rvaToOffset(0x1010));
+
+    // low alignment images (FileAlignment below 512) are not rounded
+    table.build(headers, 1, 0x20, 0x20, SIZE_OF_HEADERS, FILE_SIZE);
+    CHECK_EQUAL(DWORD(0x4c3), table.rawOffset(0));
+    CHECK_EQUAL(DWORD(0x4d3), table.rvaToOffset(0x1010));
+}
+
+TEST(sectionTableCapsRawSizeByVirtualSize)
+{
+    // SizeOfRawData rounded up to FileAlignment, but no more than VirtualSize rounded up to SectionAlignment
+    IMAGE_SECTION_HEADER headers[] = {
+        section(0x1000, 0x800, 0x400, 0x3000),  // raw data larger than the section in memory
+        section(0x2000, 0x2000, 0x3400, 0x110),  // raw data shorter than a file alignment unit
+    };
+    SectionTable table;
+    table.build(headers, 2, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, FILE_SIZE);
+    CHECK_EQUAL(DWORD(0x1000), table.rawSize(0));
+    CHECK_EQUAL(DWORD(0x1000), table.virtualSize(0));
+    CHECK_EQUAL(DWORD(0x13ff), table.rvaToOffset(0x1fff));
+
+    CHECK_EQUAL(DWORD(0x200), table.rawSize(1));
+    CHECK_EQUAL(DWORD(0x35ff), table.rvaToOffset(0x21ff));
+    // the zero filled rest of the section has no file offset, even though the next section's data is there
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x2200));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x3fff));
+    CHECK_EQUAL(1, table.find(0x3fff));
+    CHECK_EQUAL(-1, table.find(0x4000));
+}
+
+TEST(sectionTableVirtualSizeZeroMeansSizeOfRawData)
+{
+    IMAGE_SECTION_HEADER headers[] = { section(0x1000, 0, 0x400, 0x1800) };
+    SectionTable table;
+    table.build(headers, 1, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, FILE_SIZE);
+    CHECK_EQUAL(DWORD(0x2000), table.virtualSize(0));
+    CHECK_EQUAL(DWORD(0x1800), table.rawSize(0));
+    CHECK_EQUAL(DWORD(0x1bff), table.rvaToOffset(0x27ff));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x2800));
+}
+
+TEST(sectionTableMapsHeadersOneToOne)
+{
+    IMAGE_SECTION_HEADER headers[] = { section(0x1000, 0x1000, 0x400, 0x200) };
+    SectionTable table;
+    table.build(headers, 1, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, FILE_SIZE);
+    CHECK_EQUAL(DWORD(0x3c), table.rvaToOffset(0x3c));
+    CHECK_EQUAL(DWORD(0x3fc), table.rvaToOffset(0x3fc, 4));
+    // past SizeOfHeaders, or a structure that runs over it, is not in the headers
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x3fc, 8));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x400));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0xfff));
+
+    // SizeOfHeaders can't reach past the end of the file
+    table.build(headers, 1, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, 0x300);
+    CHECK_EQUAL(DWORD(0x2ff), table.rvaToOffset(0x2ff));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x300));
+}
+
+TEST(sectionTableClipsRawDataAtEndOfFile)
+{
+    IMAGE_SECTION_HEADER headers[] = {
+        section(0x1000, 0x1000, 0x400, 0x1000),  // half of it in the file
+        section(0x2000, 0x1000, 0x2000, 0x1000),  // none of it
+    };
+    SectionTable table;
+    table.build(headers, 2, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, 0xc00);
+    CHECK_EQUAL(DWORD(0x800), table.rawSize(0));
+    CHECK_EQUAL(DWORD(0xbff), table.rvaToOffset(0x17ff));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x1800));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x17f0, 0x20));
+    CHECK_EQUAL(DWORD(0), table.rawSize(1));
+    CHECK_EQUAL(DWORD(0), table.rawOffset(1));
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x2000));
+}
+
+TEST(sectionTableSortsByVirtualAddress)
+{
+    IMAGE_SECTION_HEADER headers[] = {
+        section(0x3000, 0x1000, 0x2400, 0x1000),
+        section(0x1000, 0x1000, 0x400, 0x1000),
+        section(0x2000, 0x1000, 0x1400, 0x1000),
+    };
+    memcpy(headers[0].Name, ".data", 5);
+    memcpy(headers[1].Name, ".text", 5);
+    memcpy(headers[2].Name, ".rdata", 6);
+    SectionTable table;
+    table.build(headers, 3, FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, FILE_SIZE);
+    CHECK_EQUAL(std::string(".text"), table.name(0));
+    CHECK_EQUAL(std::string(".rdata"), table.name(1));
+    CHECK_EQUAL(std::string(".data"), table.name(2));
+    // alternating between sections, so the hint of the previous lookup misses as often as it hits
+    for (int k = 0; k < 2; k++)
+    {
+        CHECK_EQUAL(2, table.find(0x3abc));
+        CHECK_EQUAL(0, table.find(0x1000));
+        CHECK_EQUAL(1, table.find(0x2fff));
+        CHECK_EQUAL(DWORD(0x2ebc), table.rvaToOffset(0x3abc));
+    }
+    CHECK_EQUAL(-1, table.find(0xfff));
+    CHECK_EQUAL(-1, table.find(0x4000));
+
+    SectionTable copy(table);
+    CHECK_EQUAL(DWORD(0x1400), copy.rvaToOffset(0x2000));
+    table.clear();
+    CHECK(table.empty());
+    CHECK_EQUAL(DWORD(0), table.rvaToOffset(0x2000));
+}
+
+// ns per rvaToOffset against the linear scan over the headers that SectionTable replaced, for
+// random RVAs and for RVAs sorted the way a parser walks one directory at a time
+BENCHMARK(sectionTableLookup)
+{
+    for (int numberOfSections : { 6, 40, 96 })
+    {
+        std::vector<IMAGE_SECTION_HEADER> headers;
+        for (int i = 0; i < numberOfSections; i++)
+            headers.push_back(section(0x4000 * (i + 1), 0x3000, 0x400 + i * 0x3000, 0x3000));
+        SectionTable table;
+        table.build(headers.data(), static_cast<WORD>(numberOfSections), FILE_ALIGNMENT, SECTION_ALIGNMENT, SIZE_OF_HEADERS, 1u << 30);
+        std::mt19937 rng(1);
+        std::vector<DWORD> rvas(1 << 20);
+        for (auto& rva : rvas)
+        {
+            const IMAGE_SECTION_HEADER& header = headers[rng() % numberOfSections];
+            rva = header.VirtualAddress + rng() % header.Misc.VirtualSize;
+        }
+        auto linear = [&](DWORD rva) -> DWORD
+        {
+            for (const auto& header : headers)
+            {
+                if (rva >= header.VirtualAddress && rva < header.VirtualAddress + header.Misc.VirtualSize)
+                    return rva - header.VirtualAddress + header.PointerToRawData;
+            }
+            return 0;
+        };
+        const int rounds = 20;
+        auto nanosecondsPerLookup = [&](auto lookup)
+        {
+            volatile DWORD sink = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int k = 0; k < rounds; k++)
+            {
+                for (DWORD rva : rvas)
+                    sink = sink + lookup(rva);
+            }
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double(rounds) * rvas.size());
+        };
+        double linearRandom = nanosecondsPerLookup(linear);
+        double indexedRandom = nanosecondsPerLookup([&](DWORD rva) { return table.rvaToOffset(rva); });
+        std::sort(rvas.begin(), rvas.end());
+        double indexedSequential = nanosecondsPerLookup([&](DWORD rva) { return table.rvaToOffset(rva); });
+        printf("  %2d sections: linear %.1f ns, indexed %.1f ns, indexed sequential %.1f ns\n", numberOfSections, linearRandom, indexedRandom, indexedSequential);
+    }
+}
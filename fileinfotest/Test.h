@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A minimal test runner, so the tests build with nothing but the sources of fileinfo.
+// TEST(name) defines a test and BENCHMARK(name) a benchmark; both register themselves at startup.
+// CHECK records a failure and carries on with the test.
+
+struct TestCase
+{
+    const char* name;
+    std::function<void()> run;
+    bool isBenchmark;
+};
+
+std::vector<TestCase>& testCases();
+void reportFailure(const char* file, int line, const std::string& message);
+
+struct TestRegistration
+{
+    TestRegistration(const char* name, std::function<void()> run, bool isBenchmark)
+    {
+        testCases().push_back({ name, std::move(run), isBenchmark });
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name, false); \
+    static void name()
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name, true); \
+    static void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) reportFailure(__FILE__, __LINE__, #condition); } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { if (!((expected) == (actual))) reportFailure(__FILE__, __LINE__, std::string(#actual) + " != " + #expected); } while (0)
+
+// a directory of its own in the temp directory, deleted again at the end of the test
+struct TempDirectory
+{
+    std::filesystem::path path;
+
+    explicit TempDirectory(const char* name) : path(std::filesystem::temp_directory_path() / name)
+    {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TempDirectory()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(path, error);
+    }
+    std::wstring file(const char* name) const
+    {
+        return (path / name).wstring();
+    }
+};
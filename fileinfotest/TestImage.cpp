@@ -0,0 +1,95 @@
+#include "TestImage.h"
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+    const LONG NT_HEADERS_OFFSET = sizeof(IMAGE_DOS_HEADER);
+    const DWORD FILE_ALIGNMENT = 0x200;
+    const DWORD SECTION_ALIGNMENT = 0x1000;
+
+    DWORD alignUp(DWORD value, DWORD alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // the fields both optional header layouts have in the same form
+    template <typename OptionalHeader>
+    void fillOptionalHeader(OptionalHeader& header, WORD magic, DWORD sectionSize)
+    {
+        header.Magic = magic;
+        header.SectionAlignment = SECTION_ALIGNMENT;
+        header.FileAlignment = FILE_ALIGNMENT;
+        header.MajorSubsystemVersion = 6;
+        header.SizeOfImage = TestImage::SECTION_RVA + alignUp(sectionSize, SECTION_ALIGNMENT);
+        header.SizeOfHeaders = TestImage::SECTION_OFFSET;
+        header.Subsystem = IMAGE_SUBSYSTEM_WINDOWS_CUI;
+        header.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    }
+}
+
+TestImage::TestImage(DWORD sectionSize, bool is64bit) : is64bit(is64bit)
+{
+    DWORD rawSize = alignUp(sectionSize, FILE_ALIGNMENT);
+    file.assign(SECTION_OFFSET + rawSize, 0);
+
+    IMAGE_DOS_HEADER dosHeader{};
+    dosHeader.e_magic = 'ZM';
+    dosHeader.e_lfanew = NT_HEADERS_OFFSET;
+    memcpy(file.data(), &dosHeader, sizeof(dosHeader));
+
+    IMAGE_FILE_HEADER fileHeader{};
+    fileHeader.NumberOfSections = 1;
+    fileHeader.Characteristics = IMAGE_FILE_EXECUTABLE_IMAGE;
+    size_t sectionHeaderOffset;
+    if (is64bit)
+    {
+        IMAGE_NT_HEADERS64 ntHeaders{};
+        ntHeaders.Signature = 'EP';
+        ntHeaders.FileHeader = fileHeader;
+        ntHeaders.FileHeader.Machine = IMAGE_FILE_MACHINE_AMD64;
+        ntHeaders.FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER64);
+        fillOptionalHeader(ntHeaders.OptionalHeader, IMAGE_NT_OPTIONAL_HDR64_MAGIC, sectionSize);
+        ntHeaders.OptionalHeader.ImageBase = 0x140000000;
+        memcpy(file.data() + NT_HEADERS_OFFSET, &ntHeaders, sizeof(ntHeaders));
+        sectionHeaderOffset = NT_HEADERS_OFFSET + sizeof(ntHeaders);
+    }
+    else
+    {
+        IMAGE_NT_HEADERS32 ntHeaders{};
+        ntHeaders.Signature = 'EP';
+        ntHeaders.FileHeader = fileHeader;
+        ntHeaders.FileHeader.Machine = IMAGE_FILE_MACHINE_I386;
+        ntHeaders.FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER32);
+        fillOptionalHeader(ntHeaders.OptionalHeader, IMAGE_NT_OPTIONAL_HDR32_MAGIC, sectionSize);
+        ntHeaders.OptionalHeader.ImageBase = 0x400000;
+        memcpy(file.data() + NT_HEADERS_OFFSET, &ntHeaders, sizeof(ntHeaders));
+        sectionHeaderOffset = NT_HEADERS_OFFSET + sizeof(ntHeaders);
+    }
+
+    IMAGE_SECTION_HEADER section{};
+    memcpy(section.Name, ".data", 5);
+    section.Misc.VirtualSize = sectionSize;
+    section.VirtualAddress = SECTION_RVA;
+    section.SizeOfRawData = rawSize;
+    section.PointerToRawData = SECTION_OFFSET;
+    section.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+    memcpy(file.data() + sectionHeaderOffset, &section, sizeof(section));
+}
+
+void TestImage::put(DWORD rva, const void* data, size_t size)
+{
+    memcpy(file.data() + SECTION_OFFSET + (rva - SECTION_RVA), data, size);
+}
+
+size_t TestImage::optionalHeaderOffset() const
+{
+    return NT_HEADERS_OFFSET + offsetof(IMAGE_NT_HEADERS32, OptionalHeader);
+}
+
+void TestImage::setDirectory(DWORD index, DWORD rva, DWORD size)
+{
+    size_t offset = optionalHeaderOffset() + (is64bit ? offsetof(IMAGE_OPTIONAL_HEADER64, DataDirectory) : offsetof(IMAGE_OPTIONAL_HEADER32, DataDirectory));
+    IMAGE_DATA_DIRECTORY entry{ rva, size };
+    memcpy(file.data() + offset + index * sizeof(entry), &entry, sizeof(entry));
+}
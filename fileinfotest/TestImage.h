@@ -0,0 +1,35 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include "PeImage.h"
+
+// A PE image made up by a test: the headers and one section of sectionSize bytes at SECTION_RVA,
+// which the test fills in at the RVAs it gives its structures. Nothing else is set, so every
+// test adds only the data directories it is about.
+class TestImage
+{
+public:
+    static constexpr DWORD SECTION_RVA = 0x1000;
+    static constexpr DWORD SECTION_OFFSET = 0x400;  // file offset of the section's raw data
+
+    explicit TestImage(DWORD sectionSize = 0x1000, bool is64bit = true);
+
+    void put(DWORD rva, const void* data, size_t size);
+    void put16(DWORD rva, WORD value) { put(rva, &value, sizeof(value)); }
+    void put32(DWORD rva, DWORD value) { put(rva, &value, sizeof(value)); }
+    // with the terminating 0
+    void putString(DWORD rva, const std::string& text) { put(rva, text.c_str(), text.size() + 1); }
+    void setDirectory(DWORD index, DWORD rva, DWORD size);
+    // file offset of the optional header, e.g. to find CheckSum or a data directory entry
+    size_t optionalHeaderOffset() const;
+
+    // the whole file; bytes appended past the section are overlay, e.g. a certificate table
+    std::vector<unsigned char> file;
+
+    // false if the image doesn't parse
+    bool load(PeImage& image) const { return image.load(file, L"test.exe"); }
+
+private:
+    bool is64bit;
+};
@@ -0,0 +1,83 @@
+#include "Test.h"
+#include <chrono>
+#include <cstring>
+#include <exception>
+
+namespace
+{
+    int g_numberOfFailures = 0;
+    const char* g_usage = R"(usage: fileinfotest [--bench] [name ...]
+Runs the tests, or with --bench the benchmarks, whose name contains one of the names given (all of them by default).
+The exit code is 1 if a check failed.
+)";
+}
+
+std::vector<TestCase>& testCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+void reportFailure(const char* file, int line, const std::string& message)
+{
+    g_numberOfFailures++;
+    printf("  %s(%d): failed: %s\n", file, line, message.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    bool isBenchmark = false;
+    std::vector<const char*> filters;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            isBenchmark = true;
+        }
+        else if (argv[i][0] == '-')
+        {
+            fputs(g_usage, stderr);
+            return 2;
+        }
+        else
+        {
+            filters.push_back(argv[i]);
+        }
+    }
+
+    int numberOfRun = 0;
+    int numberOfFailedTests = 0;
+    for (const TestCase& testCase : testCases())
+    {
+        if (testCase.isBenchmark != isBenchmark)
+            continue;
+        bool isSelected = filters.empty();
+        for (const char* filter : filters)
+        {
+            if (strstr(testCase.name, filter))
+                isSelected = true;
+        }
+        if (!isSelected)
+            continue;
+
+        printf("%s\n", testCase.name);
+        fflush(stdout);
+        int failuresBefore = g_numberOfFailures;
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            testCase.run();
+        }
+        catch (const std::exception& e)
+        {
+            reportFailure(__FILE__, __LINE__, std::string("exception: ") + e.what());
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        numberOfRun++;
+        if (g_numberOfFailures != failuresBefore)
+            numberOfFailedTests++;
+        printf("  %s (%.2f s)\n", g_numberOfFailures != failuresBefore ? "FAILED" : "ok", seconds);
+    }
+    printf("%d run, %d failed\n", numberOfRun, numberOfFailedTests);
+    return numberOfFailedTests == 0 ? 0 : 1;
+}
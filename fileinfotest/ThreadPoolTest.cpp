@@ -0,0 +1,63 @@
+#include "Test.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <stdexcept>
+
+TEST(threadPoolRunsEveryTask)
+{
+    std::atomic<size_t> sum{ 0 };
+    WorkStealingPool pool(4);
+    for (size_t i = 1; i <= 10000; i++)
+        pool.submit([&, i]() { sum += i; });
+    pool.waitIdle();
+    CHECK_EQUAL(size_t(10000 * 10001 / 2), sum.load());
+}
+
+TEST(threadPoolSurvivesThrowingTasks)
+{
+    // an escaping exception must neither end the process nor leave waitIdle waiting for the task
+    std::atomic<size_t> numberOfRun{ 0 };
+    WorkStealingPool pool(2);
+    for (int i = 0; i < 100; i++)
+    {
+        pool.submit([&, i]()
+            {
+                numberOfRun++;
+                if (i % 3 == 0)
+                    throw std::runtime_error("task failed");
+            });
+    }
+    pool.waitIdle();
+    CHECK_EQUAL(size_t(100), numberOfRun.load());
+}
+
+TEST(threadPoolWaitForSubtasks)
+{
+    // every task waits for subtasks that outlast it on other workers, with no worker left free to run them
+    const size_t numberOfTasks = 16;
+    const size_t numberOfSubtasks = 8;
+    std::atomic<size_t> numberOfDone{ 0 };
+    WorkStealingPool pool(4);
+    for (size_t i = 0; i < numberOfTasks; i++)
+    {
+        pool.submit([&]()
+            {
+                std::atomic<size_t> pending{ numberOfSubtasks };
+                std::atomic<size_t> subtasksDone{ 0 };
+                for (size_t j = 0; j < numberOfSubtasks; j++)
+                {
+                    pool.submit([&]()
+                        {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                            subtasksDone++;
+                            pending--;
+                        });
+                }
+                pool.waitFor(pending);
+                if (subtasksDone == numberOfSubtasks)
+                    numberOfDone++;
+            });
+    }
+    pool.waitIdle();
+    CHECK_EQUAL(numberOfTasks, numberOfDone.load());
+}
@@ -0,0 +1,331 @@
+# Writes the cabinets CabExtractorTest reads: stored, MSZIP (through zlib) and LZX (an encoder of its
+# own, so every block type, E8 translation and window size can be asked for). The output is
+# deterministic; run it in this directory to write them again:  python makecabinets.py .
+import struct, sys, zlib, random, heapq
+
+FRAME = 32768
+
+# ---------------- LZX encoder ----------------
+def extra_bits(slot): return 0 if slot < 4 else min((slot - 2) // 2, 17)
+BASE = [0]
+for i in range(60): BASE.append(BASE[-1] + (1 << extra_bits(i)))
+SLOTS = {15: 30, 16: 32, 17: 34, 18: 36, 19: 38, 20: 42, 21: 50}
+
+class BitWriter:
+    def __init__(self): self.out = bytearray(); self.acc = 0; self.n = 0
+    def bits(self, value, count):
+        for i in range(count - 1, -1, -1):
+            self.acc = (self.acc << 1) | ((value >> i) & 1); self.n += 1
+            if self.n == 16:
+                self.out += struct.pack('<H', self.acc); self.acc = 0; self.n = 0
+    def align16(self):  # pad to 16-bit boundary (0 bits if aligned)
+        if self.n: self.bits(0, 16 - self.n)
+    def pad_uncompressed(self):  # 1..16 bits
+        self.bits(0, 16 - self.n if self.n else 16)
+    def raw(self, data):
+        assert self.n == 0
+        self.out += data
+    def pos(self): return len(self.out) * 8 + self.n
+
+def huffman_lengths(freqs, maxlen):
+    syms = [(f, i) for i, f in enumerate(freqs) if f > 0]
+    n = len(freqs)
+    if len(syms) == 0: return [0] * n
+    if len(syms) == 1:
+        # a single code would be incomplete; add a partner
+        other = 0 if syms[0][1] != 0 else 1
+        syms.append((1, other))
+    scale = 1
+    while True:
+        heap = [(max(1, f // scale), idx, (i,)) for idx, (f, i) in enumerate(syms)]
+        heapq.heapify(heap); cnt = len(heap)
+        lengths = [0] * n
+        while len(heap) > 1:
+            a = heapq.heappop(heap); b = heapq.heappop(heap)
+            for s in a[2] + b[2]: lengths[s] += 1
+            cnt += 1
+            heapq.heappush(heap, (a[0] + b[0], cnt, a[2] + b[2]))
+        if max(lengths) <= maxlen: return lengths
+        scale *= 2
+
+def canonical_codes(lengths):
+    codes = [0] * len(lengths); code = 0
+    for L in range(1, 17):
+        for s in range(len(lengths)):
+            if lengths[s] == L: codes[s] = code; code += 1
+        code <<= 1
+    return codes
+
+def write_pretree_lengths(w, new, old, first, last, rng):
+    # encode lengths[first:last] as deltas through a pretree
+    items = []; i = first
+    while i < last:
+        if new[i] == 0:
+            run = 1
+            while i + run < last and new[i + run] == 0: run += 1
+            if run >= 20 and rng.random() < 0.9:
+                r = min(run, 51); items.append((18, r - 20, 5)); i += r; continue
+            if run >= 4 and rng.random() < 0.9:
+                r = min(run, 19); items.append((17, r - 4, 4)); i += r; continue
+        run = 1
+        while i + run < last and new[i + run] == new[i]: run += 1
+        if run >= 4 and rng.random() < 0.7:
+            r = min(run, 5)
+            # all use old[i]'s delta in the decoder
+            z = (old[i] - new[i]) % 17
+            items.append((19, r - 4, 1, z)); i += r; continue
+        items.append(((old[i] - new[i]) % 17,)); i += 1
+    freqs = [0] * 20
+    for it in items:
+        freqs[it[0]] += 1
+        if it[0] == 19: freqs[it[3]] += 1
+    plen = huffman_lengths(freqs, 15); pcode = canonical_codes(plen)
+    for L in plen: w.bits(L, 4)
+    for it in items:
+        w.bits(pcode[it[0]], plen[it[0]])
+        if it[0] in (17, 18): w.bits(it[1], it[2])
+        elif it[0] == 19:
+            w.bits(it[1], 1); w.bits(pcode[it[3]], plen[it[3]])
+
+def e8_forward(data, filesize):
+    data = bytearray(data); n = len(data)
+    for fs in range(0, n, FRAME):
+        size = min(FRAME, n - fs)
+        if size <= 10: continue
+        i = 0
+        while i < size - 10:
+            if data[fs + i] != 0xE8: i += 1; continue
+            cur = fs + i
+            r = struct.unpack_from('<i', data, fs + i + 1)[0]
+            if -cur <= r < filesize:
+                v = r + cur if r < filesize - cur else r - filesize
+                struct.pack_into('<i', data, fs + i + 1, v)
+            i += 5
+    return bytes(data)
+
+def lz_tokens(data, start, end, maxoff, rng, R):
+    # greedy matches inside [start, end), referring back to anything before
+    toks = []; i = start; table = {}
+    # prime table with some history
+    for j in range(max(0, start - 4096), start - 2): table.setdefault(data[j:j+3], []).append(j)
+    while i < end:
+        best = (0, 0)
+        if i + 2 < end:
+            # repeated offsets first
+            for k in range(3):
+                off = R[k]
+                if off <= i:
+                    L = 0
+                    while L < 257 and i + L < end and data[i + L] == data[i + L - off]: L += 1
+                    if L >= 2 and L > best[0]: best = (L, off)
+            for j in reversed(table.get(data[i:i+3], [])[-16:]):
+                off = i - j
+                if off > maxoff: continue
+                L = 0
+                while L < 257 and i + L < end and data[i + L] == data[j + L]: L += 1
+                if L > best[0]: best = (L, off)
+        if best[0] >= 3 or (best[0] == 2 and best[1] in R):
+            L, off = best
+            toks.append(('m', L, off))
+            for j in range(i, min(i + L, end - 2)): table.setdefault(data[j:j+3], []).append(j)
+            i += L
+        else:
+            toks.append(('l', data[i]))
+            if i + 2 < len(data): table.setdefault(data[i:i+3], []).append(i)
+            i += 1
+    return toks
+
+def lzx_compress(data, wbits, rng, intel=0, btypes=None):
+    n = len(data); wsize = 1 << wbits; maxoff = wsize - 3
+    nslots = SLOTS[wbits]; nmain = 256 + nslots * 8
+    src = e8_forward(data, intel) if intel else data
+    w = BitWriter()
+    if intel: w.bits(1, 1); w.bits(intel >> 16, 16); w.bits(intel & 0xFFFF, 16)
+    else: w.bits(0, 1)
+    R = [1, 1, 1]
+    main_old = [0] * (nmain + 64); len_old = [0] * (249 + 64)
+    frame_ends = []  # compressed byte offset at each frame end
+    pos = 0
+    pending_pad = False
+    nblocks = 0; used = set()
+    while pos < n:
+        # block: random size, may span frames
+        if btypes:  # small enough for every type to get a block, and not aligned to the frames
+            bsize = min(n - pos, rng.randint(1, max(1, n // len(btypes))))
+        else:
+            bsize = min(n - pos, rng.choice([rng.randint(1, 3000), rng.randint(1, 70000), FRAME, 100000]))
+        # 1 verbatim, 2 aligned offset, 3 uncompressed; btypes, if given, are used in turn
+        btype = btypes[nblocks % len(btypes)] if btypes else (rng.choice([1, 1, 2, 2, 3]) if rng.random() < 0.9 else 1)
+        nblocks += 1; used.add(btype)
+        bend = pos + bsize
+        if btype == 3:
+            w.bits(3, 3); w.bits(bsize >> 8, 16); w.bits(bsize & 0xFF, 8)
+            w.pad_uncompressed()
+            w.raw(struct.pack('<III', *R))
+            # raw bytes, splitting frames
+            p = pos
+            while p < bend:
+                fe = (p // FRAME + 1) * FRAME
+                q = min(bend, fe)
+                w.raw(src[p:q]); p = q
+                if p == fe or p == n:
+                    if p == bend and bsize % 2 == 1 and rng.random() < 0.5:
+                        w.raw(b'\0'); pending_pad = False
+                        frame_ends.append(len(w.out))
+                        continue
+                    if p == bend and bsize % 2 == 1:
+                        frame_ends.append(len(w.out)); pending_pad = True
+                        continue
+                    frame_ends.append(len(w.out))
+            if bsize % 2 == 1:
+                if pending_pad: w.raw(b'\0'); pending_pad = False
+                elif not (bend % FRAME == 0 or bend == n): w.raw(b'\0')
+            pos = bend
+            continue
+        # tokens, frame by frame so matches don't cross frame ends
+        toks = []; p = pos
+        while p < bend:
+            fe = min((p // FRAME + 1) * FRAME, bend)
+            t = lz_tokens(src, p, fe, maxoff, rng, list(R))
+            # recompute R along the way so repeated offsets are right
+            toks.append((p, fe, t)); p = fe
+        # assign symbols with real R tracking
+        syms = []; Rt = list(R)
+        for (a, b, t) in toks:
+            for tk in t:
+                if tk[0] == 'l': syms.append(('l', tk[1])); continue
+                L, off = tk[1], tk[2]
+                if off == Rt[0]: slot = 0
+                elif off == Rt[1]: slot = 1; Rt[1] = Rt[0]; Rt[0] = off
+                elif off == Rt[2]: slot = 2; Rt[2] = Rt[0]; Rt[0] = off
+                else:
+                    f = off + 2; slot = max(s for s in range(nslots) if BASE[s] <= f)
+                    if slot < 3: slot = 3 if f == 3 else slot
+                    Rt[2] = Rt[1]; Rt[1] = Rt[0]; Rt[0] = off
+                    if L == 2 and slot >= 3: pass
+                syms.append(('m', L, off, slot))
+            syms.append(('frame_end', b))
+        # frequencies
+        mf = [0] * nmain; lf = [0] * 249; af = [0] * 8
+        for s in syms:
+            if s[0] == 'l': mf[s[1]] += 1
+            elif s[0] == 'm':
+                L, off, slot = s[1], s[2], s[3]; ml = L - 2
+                hdr = min(ml, 7); mf[256 + slot * 8 + hdr] += 1
+                if ml >= 7: lf[ml - 7] += 1
+                if btype == 2 and slot >= 3 and extra_bits(slot) >= 3: af[(off + 2 - BASE[slot]) & 7] += 1
+        mlen = huffman_lengths(mf, 16); llen = huffman_lengths(lf, 16); alen = huffman_lengths(af, 7) if btype == 2 else None
+        if btype == 2 and sum(1 for x in alen if x) == 0: alen = [3] * 8
+        mcode = canonical_codes(mlen); lcode = canonical_codes(llen)
+        w.bits(btype, 3); w.bits(bsize >> 8, 16); w.bits(bsize & 0xFF, 8)
+        if btype == 2:
+            acode = canonical_codes(alen)
+            for L in alen: w.bits(L, 3)
+        newmain = list(mlen) + [0] * 64
+        write_pretree_lengths(w, newmain, main_old, 0, 256, rng)
+        write_pretree_lengths(w, newmain, main_old, 256, nmain, rng)
+        main_old = newmain
+        newlen = list(llen) + [0] * 64
+        write_pretree_lengths(w, newlen, len_old, 0, 249, rng)
+        len_old = newlen
+        for s in syms:
+            if s[0] == 'frame_end':
+                b = s[1]
+                if b % FRAME == 0 or b == n:
+                    w.align16(); frame_ends.append(len(w.out))
+                continue
+            if s[0] == 'l': w.bits(mcode[s[1]], mlen[s[1]]); continue
+            L, off, slot = s[1], s[2], s[3]; ml = L - 2; hdr = min(ml, 7)
+            sym = 256 + slot * 8 + hdr
+            w.bits(mcode[sym], mlen[sym])
+            if ml >= 7: w.bits(lcode[ml - 7], llen[ml - 7])
+            if slot >= 3:
+                eb = extra_bits(slot); footer = off + 2 - BASE[slot]
+                if btype == 2 and eb >= 3:
+                    w.bits(footer >> 3, eb - 3); w.bits(acode[footer & 7], alen[footer & 7])
+                else:
+                    w.bits(footer, eb)
+        R = Rt
+        pos = bend
+    # split into frames
+    frames = []; prev = 0
+    for e in frame_ends: frames.append(bytes(w.out[prev:e])); prev = e
+    if pending_pad: pass
+    assert len(frames) == (n + FRAME - 1) // FRAME, (len(frames), n)
+    if btypes: assert used == set(btypes), (used, btypes)
+    return frames
+
+# ---------------- cabinet ----------------
+def mszip_blocks(data, rng):
+    blocks = []; hist = b''
+    for i in range(0, len(data), FRAME):
+        chunk = data[i:i+FRAME]
+        level = rng.choice([0, 1, 6, 9]); strat = rng.choice([zlib.Z_DEFAULT_STRATEGY, zlib.Z_FIXED, zlib.Z_HUFFMAN_ONLY])
+        c = zlib.compressobj(level, zlib.DEFLATED, -15, 9, strat, zdict=hist) if hist else zlib.compressobj(level, zlib.DEFLATED, -15, 9, strat)
+        blocks.append(b'CK' + c.compress(chunk) + c.flush())
+        hist = (hist + chunk)[-32768:]
+    return blocks
+
+def cabinet(name, data, method, wbits=21, rng=None, intel=0, reserve=None, btypes=None):
+    rng = rng or random.Random(1)
+    if method == 'none': blocks = [data[i:i+FRAME] for i in range(0, len(data), FRAME)]; tc = 0
+    elif method == 'mszip': blocks = mszip_blocks(data, rng); tc = 1
+    else: blocks = lzx_compress(data, wbits, rng, intel, btypes); tc = 3 | (wbits << 8)
+    flags = 4 if reserve else 0
+    hdr_res = reserve[0] if reserve else 0; fold_res = reserve[1] if reserve else 0; data_res = reserve[2] if reserve else 0
+    hdr_len = 36 + (4 + hdr_res if reserve else 0)
+    folder_off = hdr_len; files_off = folder_off + 8 + fold_res
+    fname = name.encode() + b'\0'
+    data_off = files_off + 16 + len(fname)
+    cfdata = bytearray()
+    for i, b in enumerate(blocks):
+        unc = min(FRAME, len(data) - i * FRAME)
+        cfdata += struct.pack('<IHH', 0, len(b), unc) + b'\x5a' * data_res + b
+    total = data_off + len(cfdata)
+    out = bytearray(b'MSCF' + struct.pack('<IIIIIBBHHHHH', 0, total, 0, files_off, 0, 3, 1, 1, 1, flags, 0x1234, 0))
+    if reserve: out += struct.pack('<HBB', hdr_res, fold_res, data_res) + b'\x11' * hdr_res
+    out += struct.pack('<IHH', data_off, len(blocks), tc) + b'\x22' * fold_res
+    out += struct.pack('<IIHHHH', len(data), 0, 0, 0x5a21, 0x6000, 0x20) + fname
+    assert len(out) == data_off
+    return bytes(out + cfdata)
+
+def sample(n, kind):
+    r = random.Random(n * 31 + len(kind))
+    if kind == 'random': return bytes(r.getrandbits(8) for _ in range(n))
+    if kind == 'text':
+        words = [bytes(r.choice(b'abcdefghij ') for _ in range(r.randint(2, 9))) for _ in range(300)]
+        out = bytearray()
+        while len(out) < n: out += r.choice(words) + b' '
+        return bytes(out[:n])
+    if kind == 'code':  # x86-ish, with E8 calls for the translation
+        out = bytearray()
+        while len(out) < n:
+            c = r.random()
+            if c < 0.15: out += b'\xe8' + struct.pack('<i', r.randint(-200000, 200000))
+            elif c < 0.3: out += bytes([0x48, 0x89, r.choice([0x45, 0x4c, 0x5c]), r.randint(0, 255)])
+            else: out += bytes([r.choice([0x90, 0xc3, 0x55, 0x8b, 0xe8, 0x00, 0xff])])
+        return bytes(out[:n])
+
+# name, size, content, method, window bits, E8 translation size, reserve (header, folder, data), LZX block types
+FIXTURES = [
+    ('empty', 0, 'text', 'none', 21, 0, None, None),
+    ('stored', 33000, 'text', 'none', 21, 0, None, None),
+    ('mszip', 100000, 'text', 'mszip', 21, 0, None, None),
+    ('mszip-reserve', 40000, 'code', 'mszip', 21, 0, (4, 3, 8), None),
+    ('lzx-verbatim', 70000, 'text', 'lzx', 16, 0, None, [1]),
+    ('lzx-aligned', 70000, 'code', 'lzx', 17, 0, None, [2]),
+    ('lzx-uncompressed', 33001, 'random', 'lzx', 15, 0, None, [3]),
+    ('lzx-mixed-e8', 100000, 'code', 'lzx', 21, 12000000, (4, 3, 2), [1, 2, 3]),
+    ('lzx-e8-file-size', 40000, 'code', 'lzx', 16, 40000, None, [2, 1]),
+    ('lzx-small', 3000, 'text', 'lzx', 15, 0, None, [1, 3, 2]),
+]
+
+if __name__ == '__main__':
+    import hashlib, os
+    outdir = sys.argv[1] if len(sys.argv) > 1 else '.'
+    for name, n, kind, method, wbits, intel, reserve, btypes in FIXTURES:
+        data = sample(n, kind)
+        cab = cabinet(name + '.pdb', data, method, wbits, random.Random(n + wbits), intel, reserve, btypes)
+        open(os.path.join(outdir, name + '.pd_'), 'wb').write(cab)
+        # the table in CabExtractorTest.cpp
+        print('{ "%s", %d, "%s" },' % (name, n, hashlib.sha256(data).hexdigest()))
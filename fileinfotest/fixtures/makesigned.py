@@ -0,0 +1,133 @@
+# Writes signed.exe, the Authenticode-signed image AuthenticodeTest reads: a small PE32+ image with
+# two sections, signed through openssl cms by a leaf certificate of a test CA, with the CheckSum
+# updated after signing as signtool does. The PE hash is computed here by the section-by-section
+# definition of the specification, independently of the code under test, and printed for the test.
+# The keys are made anew on every run, so the certificate table changes but the PE hash does not.
+# Needs openssl on the path; run it in this directory:  python makesigned.py .
+import hashlib, os, struct, subprocess, sys, tempfile
+
+FILE_ALIGNMENT = 0x200
+SECTION_ALIGNMENT = 0x1000
+SIZE_OF_HEADERS = 0x400
+NT_HEADERS = 0x80
+SECURITY = 4
+
+def der(tag, content):
+    n = len(content)
+    if n < 0x80:
+        length = bytes([n])
+    else:
+        body = n.to_bytes((n.bit_length() + 7) // 8, 'big')
+        length = bytes([0x80 | len(body)]) + body
+    return bytes([tag]) + length + content
+
+def oid(text):
+    parts = [int(p) for p in text.split('.')]
+    out = bytes([40 * parts[0] + parts[1]])
+    for p in parts[2:]:
+        chunk = [p & 0x7f]
+        p >>= 7
+        while p:
+            chunk.append(0x80 | (p & 0x7f))
+            p >>= 7
+        out += bytes(reversed(chunk))
+    return der(0x06, out)
+
+def image():
+    sections = [
+        (b'.text', 0x1000, b'\x48\x31\xc0\xc3' + bytes(range(256)) * 2),
+        (b'.rdata', 0x2000, b'fileinfotest signed fixture\0' * 9),
+    ]
+    raw = SIZE_OF_HEADERS
+    table = b''
+    bodies = b''
+    for name, rva, body in sections:
+        size = (len(body) + FILE_ALIGNMENT - 1) // FILE_ALIGNMENT * FILE_ALIGNMENT
+        table += struct.pack('<8sIIIIIIHHI', name, len(body), rva, size, raw, 0, 0, 0, 0, 0x40000040)
+        bodies += body.ljust(size, b'\0')
+        raw += size
+    optional = struct.pack('<HBBIIIIIQIIHHHHHHIIIIHHQQQQII', 0x20b, 14, 0, 0x200, 0x200, 0, 0x1000, 0x1000,
+                           0x140000000, SECTION_ALIGNMENT, FILE_ALIGNMENT, 6, 0, 0, 0, 6, 0, 0,
+                           0x3000, SIZE_OF_HEADERS, 0, 3, 0x8160, 0x100000, 0x1000, 0x100000, 0x1000, 0, 16)
+    optional += bytes(16 * 8)
+    file_header = struct.pack('<HHIIIHH', 0x8664, len(sections), 0x5f5e1000, 0, 0, len(optional), 0x22)
+    dos = b'MZ' + bytes(0x3a) + struct.pack('<I', NT_HEADERS)
+    dos += b'This program cannot be run in DOS mode.'.ljust(NT_HEADERS - len(dos), b'\0')
+    headers = dos + b'PE\0\0' + file_header + optional + table
+    return bytearray(headers.ljust(SIZE_OF_HEADERS, b'\0') + bodies)
+
+def optional_header():
+    return NT_HEADERS + 4 + 20
+
+def pe_hashes(data, algorithms):
+    # section by section, as in the Authenticode specification
+    checksum = optional_header() + 64
+    entry = optional_header() + 112 + SECURITY * 8
+    cert_offset, cert_size = struct.unpack_from('<II', data, entry)
+    number_of_sections = struct.unpack_from('<H', data, NT_HEADERS + 6)[0]
+    table = optional_header() + struct.unpack_from('<H', data, NT_HEADERS + 20)[0]
+    hashes = [hashlib.new(a) for a in algorithms]
+    def update(piece):
+        for h in hashes:
+            h.update(piece)
+    update(data[:checksum])
+    update(data[checksum + 4:entry])
+    update(data[entry + 8:SIZE_OF_HEADERS])
+    hashed = SIZE_OF_HEADERS
+    # (PointerToRawData, SizeOfRawData) in file order
+    sections = sorted(struct.unpack_from('<II', data, table + 40 * i + 16)[::-1] for i in range(number_of_sections))
+    for raw, size in sections:
+        update(data[raw:raw + size])
+        hashed += size
+    update(data[hashed:len(data) - cert_size])
+    return [h.hexdigest() for h in hashes]
+
+def pe_checksum(data):
+    checksum = optional_header() + 64
+    total = 0
+    padded = bytes(data) + bytes(len(data) % 2)
+    for i in range(0, len(padded), 2):
+        if i == checksum or i == checksum + 2:
+            continue
+        total += struct.unpack_from('<H', padded, i)[0]
+        total = (total & 0xffff) + (total >> 16)
+    return ((total & 0xffff) + (total >> 16)) + len(data)
+
+def openssl(*args, cwd):
+    subprocess.run(['openssl'] + list(args), cwd=cwd, check=True, capture_output=True)
+
+def sign(content, directory):
+    open(os.path.join(directory, 'content.der'), 'wb').write(content)
+    openssl('req', '-x509', '-newkey', 'rsa:2048', '-nodes', '-keyout', 'ca.key', '-out', 'ca.pem', '-days', '3650',
+            '-subj', '/O=fileinfotest/CN=fileinfotest CA', cwd=directory)
+    openssl('req', '-newkey', 'rsa:2048', '-nodes', '-keyout', 'signer.key', '-out', 'signer.csr',
+            '-subj', '/O=fileinfotest/CN=fileinfotest signer', cwd=directory)
+    openssl('x509', '-req', '-in', 'signer.csr', '-CA', 'ca.pem', '-CAkey', 'ca.key', '-set_serial', '4660',
+            '-days', '3650', '-out', 'signer.pem', cwd=directory)
+    openssl('cms', '-sign', '-binary', '-nodetach', '-md', 'sha256', '-in', 'content.der', '-signer', 'signer.pem',
+            '-inkey', 'signer.key', '-certfile', 'ca.pem', '-econtent_type', '1.3.6.1.4.1.311.2.1.4',
+            '-outform', 'DER', '-out', 'signature.der', cwd=directory)
+    return open(os.path.join(directory, 'signature.der'), 'rb').read()
+
+if __name__ == '__main__':
+    outdir = sys.argv[1] if len(sys.argv) > 1 else '.'
+    data = image()
+    sha1, sha256 = pe_hashes(data, ['sha1', 'sha256'])
+    # SpcIndirectDataContent { SpcAttributeTypeAndOptionalValue { SPC_PE_IMAGE_DATA, SpcPeImageData }, DigestInfo }
+    pe_image_data = der(0x30, der(0x03, b'\0') + der(0xa0, der(0xa2, der(0x80, '<<<Obsolete>>>'.encode('utf-16-be')))))
+    attribute = der(0x30, oid('1.3.6.1.4.1.311.2.1.15') + pe_image_data)
+    digest_info = der(0x30, der(0x30, oid('2.16.840.1.101.3.4.2.1') + der(0x05, b'')) + der(0x04, bytes.fromhex(sha256)))
+    with tempfile.TemporaryDirectory() as directory:
+        signature = sign(der(0x30, attribute + digest_info), directory)
+    # WIN_CERTIFICATE, revision 2.0, PKCS#7 SignedData, padded to 8 bytes
+    certificate = struct.pack('<IHH', 8 + len(signature), 0x200, 2) + signature
+    certificate = certificate.ljust((len(certificate) + 7) // 8 * 8, b'\0')
+    struct.pack_into('<II', data, optional_header() + 112 + SECURITY * 8, len(data), len(certificate))
+    data += certificate
+    struct.pack_into('<I', data, optional_header() + 64, pe_checksum(data))
+    assert pe_hashes(data, ['sha1', 'sha256']) == [sha1, sha256]
+    open(os.path.join(outdir, 'signed.exe'), 'wb').write(data)
+    # the constants in AuthenticodeTest.cpp
+    print('certificate table at 0x%x, %d bytes' % (len(data) - len(certificate), len(certificate)))
+    print('SHA1   %s' % sha1)
+    print('SHA256 %s' % sha256)